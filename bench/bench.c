@@ -0,0 +1,635 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+/*
+ * vpcs_bench, the micro benchmarks of the protocol code.
+ *
+ * The protocol functions are linked as they are and fed with synthetic
+ * frames built from a fixed seed, the replies are taken from the queues
+ * of the VPC as an in-memory device would do. Each benchmark prints the
+ * packets per second and the nanoseconds per packet.
+ *
+ * usage: vpcs_bench [-n packets] [-s seed] [name ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "vpcs.h"
+#include "queue.h"
+#include "packets.h"
+#include "packets6.h"
+#include "frag.h"
+#include "frag6.h"
+#include "tcp.h"
+#include "dns.h"
+#include "utils.h"
+
+#define BATCH	64		/* less than PKTQ_SIZE */
+#define DUT	(&vpc[0])
+
+extern u_int time_tick;
+extern int num_pths;
+
+struct bench {
+	const char *name;
+	/* build the input of n packets, not timed */
+	void (*setup)(int n);
+	/* process the input, timed, return the packets processed */
+	int (*run)(int n);
+};
+
+static u_int seed = 1;
+static struct packet *input[BATCH];
+static u_char peermac[ETH_ALEN] = {0x00, 0x50, 0x79, 0x66, 0x68, 0x80};
+static u_int peerip;
+static ip6 peerip6;
+
+static u_int rnd(void);
+static void drain(struct pq *pq);
+static struct packet *mkip4(int proto, int dlen);
+static struct packet *mkip6(int proto, int dlen);
+static void fix_ip4(struct packet *m);
+static void init_dut(void);
+
+/*
+ * xorshift32, the traffic is the same for the same seed
+ */
+static u_int rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	
+	return seed;
+}
+
+/* the in-memory device, the frames are freed as soon as written */
+static void drain(struct pq *pq)
+{
+	struct packet *m;
+	
+	while ((m = deq(pq)) != NULL)
+		del_pkt(m);
+}
+
+static struct packet *mkip4(int proto, int dlen)
+{
+	struct packet *m;
+	ethdr *eh;
+	iphdr *ip;
+	int i;
+	
+	m = new_pkt(sizeof(ethdr) + sizeof(iphdr) + dlen);
+	if (m == NULL) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+	eh = (ethdr *)(m->data);
+	ip = (iphdr *)(eh + 1);
+	
+	ip->ver = 4;
+	ip->ihl = sizeof(iphdr) >> 2;
+	ip->len = htons(sizeof(iphdr) + dlen);
+	ip->id = htons(rnd() & 0xffff);
+	ip->ttl = TTL;
+	ip->proto = proto;
+	ip->sip = peerip;
+	ip->dip = DUT->ip4.ip;
+	for (i = 0; i < dlen; i++)
+		((u_char *)(ip + 1))[i] = rnd() & 0xff;
+	
+	encap_ehead(m->data, peermac, DUT->ip4.mac, ETHERTYPE_IP);
+	
+	return m;
+}
+
+static void fix_ip4(struct packet *m)
+{
+	iphdr *ip = (iphdr *)(m->data + sizeof(ethdr));
+	
+	ip->cksum = 0;
+	ip->cksum = cksum((u_short *)ip, sizeof(iphdr));
+}
+
+static struct packet *mkip6(int proto, int dlen)
+{
+	struct packet *m;
+	ip6hdr *ip;
+	int i;
+	
+	m = new_pkt(sizeof(ethdr) + sizeof(ip6hdr) + dlen);
+	if (m == NULL) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+	ip = (ip6hdr *)(m->data + sizeof(ethdr));
+	
+	ip->ip6_flow = 0;
+	ip->ip6_vfc = IPV6_VERSION;
+	ip->ip6_plen = htons(dlen);
+	ip->ip6_nxt = proto;
+	ip->ip6_hlim = TTL;
+	memcpy(&ip->src, &peerip6, sizeof(ip6));
+	memcpy(&ip->dst, &DUT->link6.ip, sizeof(ip6));
+	for (i = 0; i < dlen; i++)
+		((u_char *)(ip + 1))[i] = rnd() & 0xff;
+	
+	encap_ehead(m->data, peermac, DUT->ip4.mac, ETHERTYPE_IPV6);
+	
+	return m;
+}
+
+/* cksum over a full sized frame */
+static void setup_cksum(int n)
+{
+	int i;
+	
+	for (i = 0; i < n; i++)
+		input[i] = mkip4(IPPROTO_UDP, 1480);
+}
+
+static int run_cksum(int n)
+{
+	volatile u_short sum = 0;
+	int i;
+	
+	for (i = 0; i < n; i++) {
+		sum += cksum((u_short *)(input[i]->data + sizeof(ethdr)), 1500);
+		del_pkt(input[i]);
+	}
+	return n;
+}
+
+static void setup_small(int n)
+{
+	int i;
+	
+	for (i = 0; i < n; i++)
+		input[i] = mkip4(IPPROTO_UDP, 64);
+}
+
+static int run_queue(int n)
+{
+	struct packet *m;
+	int i;
+	
+	for (i = 0; i < n; i++) {
+		enq(&DUT->oq, input[i]);
+		m = deq(&DUT->oq);
+		del_pkt(m);
+	}
+	return n;
+}
+
+/* ping me, the reply is built in place */
+static void setup_icmp(int n)
+{
+	icmphdr *icmp;
+	int i;
+	
+	for (i = 0; i < n; i++) {
+		input[i] = mkip4(IPPROTO_ICMP, sizeof(icmphdr) + 56);
+		icmp = (icmphdr *)(input[i]->data + sizeof(ethdr) + 
+		    sizeof(iphdr));
+		icmp->type = ICMP_ECHO;
+		icmp->code = 0;
+		icmp->cksum = 0;
+		icmp->cksum = cksum((u_short *)icmp, sizeof(icmphdr) + 56);
+		fix_ip4(input[i]);
+	}
+}
+
+/* as pth_reader, upv4 takes over the packet unless it's dropped */
+static int run_upv4(int n)
+{
+	struct packet *m;
+	int i;
+	
+	for (i = 0; i < n; i++) {
+		m = input[i];
+		if (upv4(DUT, &m) != PKT_ENQ)
+			del_pkt(m);
+	}
+	drain(&DUT->bgoq);
+	drain(&DUT->oq);
+	return n;
+}
+
+/* udp to a closed port, answered by udpReply */
+static void setup_udp(int n)
+{
+	udpiphdr *ui;
+	int i;
+	
+	for (i = 0; i < n; i++) {
+		input[i] = mkip4(IPPROTO_UDP, sizeof(udphdr) + 64);
+		ui = (udpiphdr *)(input[i]->data + sizeof(ethdr));
+		ui->ui_sport = htons(1024 + (rnd() & 0x7fff));
+		ui->ui_dport = htons(7);
+		ui->ui_ulen = htons(sizeof(udphdr) + 64);
+		ui->ui_sum = 0;
+		fix_ip4(input[i]);
+	}
+}
+
+/* syn from 256 ports, answered by tcp with syn+ack */
+static void setup_tcp(int n)
+{
+	tcpiphdr *ti;
+	int i;
+	
+	for (i = 0; i < n; i++) {
+		input[i] = mkip4(IPPROTO_TCP, sizeof(tcphdr));
+		ti = (tcpiphdr *)(input[i]->data + sizeof(ethdr));
+		memset(&ti->ti_t, 0, sizeof(tcphdr));
+		ti->ti_sport = htons(40000 + (rnd() & 0xff));
+		ti->ti_dport = htons(80);
+		ti->ti_seq = htonl(rnd());
+		ti->ti_off = sizeof(tcphdr) >> 2;
+		ti->ti_flags = TH_SYN;
+		ti->ti_win = htons(65535);
+		fix_ip4(input[i]);
+	}
+}
+
+static int run_tcp(int n)
+{
+	int i;
+	
+	for (i = 0; i < n; i++) {
+		tcp(DUT, input[i]);
+		del_pkt(input[i]);
+	}
+	drain(&DUT->bgoq);
+	return n;
+}
+
+/* 4000 bytes datagrams, cut to 1500 */
+static void setup_big(int n)
+{
+	int i;
+	
+	for (i = 0; i < n; i++) {
+		input[i] = mkip4(IPPROTO_UDP, 4000);
+		fix_ip4(input[i]);
+	}
+}
+
+static int run_ipfrag(int n)
+{
+	struct packet *m;
+	int i;
+	
+	for (i = 0; i < n; i++) {
+		m = ipfrag(input[i], 1500);
+		free_pkts(m);
+	}
+	return n;
+}
+
+/* the fragments of a datagram arrive one by one */
+static void setup_frags(int n)
+{
+	int i;
+	
+	for (i = 0; i < n; i++) {
+		input[i] = mkip4(IPPROTO_UDP, 4000);
+		fix_ip4(input[i]);
+		input[i] = ipfrag(input[i], 1500);
+	}
+}
+
+static int run_ipreass(int n)
+{
+	struct packet *m, *next;
+	int i, c = 0, done = 0;
+	
+	for (i = 0; i < n; i++) {
+		for (m = input[i]; m != NULL; m = next) {
+			next = m->next;
+			m->next = NULL;
+			c++;
+			m = ipreass(m);
+			if (m != NULL) {
+				free_pkts(m);
+				done++;
+			}
+		}
+	}
+	if (done != n)
+		printf("ipreass: %d of %d datagrams not reassembled\n", 
+		    n - done, n);
+	return c;
+}
+
+static void setup_icmp6(int n)
+{
+	icmp6hdr *icmp;
+	int i;
+	
+	for (i = 0; i < n; i++) {
+		input[i] = mkip6(IPPROTO_ICMPV6, sizeof(icmp6hdr) + 56);
+		icmp = (icmp6hdr *)(input[i]->data + sizeof(ethdr) + 
+		    sizeof(ip6hdr));
+		icmp->type = ICMP6_ECHO_REQUEST;
+		icmp->code = 0;
+		icmp->cksum = 0;
+	}
+}
+
+static int run_upv6(int n)
+{
+	struct packet *m;
+	int i;
+	
+	for (i = 0; i < n; i++) {
+		m = input[i];
+		if (upv6(DUT, &m) != PKT_ENQ)
+			del_pkt(m);
+	}
+	drain(&DUT->bgoq);
+	drain(&DUT->oq);
+	return n;
+}
+
+static void setup_big6(int n)
+{
+	int i;
+	
+	for (i = 0; i < n; i++)
+		input[i] = mkip6(IPPROTO_UDP, 4000);
+}
+
+static int run_ipfrag6(int n)
+{
+	struct packet *m;
+	int i;
+	
+	for (i = 0; i < n; i++) {
+		m = ipfrag6(input[i], 1500);
+		free_pkts(m);
+	}
+	return n;
+}
+
+static void setup_frags6(int n)
+{
+	int i;
+	
+	for (i = 0; i < n; i++) {
+		input[i] = mkip6(IPPROTO_UDP, 4000);
+		input[i] = ipfrag6(input[i], 1500);
+	}
+}
+
+static int run_ipreass6(int n)
+{
+	struct packet *m, *next;
+	int i, c = 0, done = 0;
+	
+	for (i = 0; i < n; i++) {
+		for (m = input[i]; m != NULL; m = next) {
+			next = m->next;
+			m->next = NULL;
+			c++;
+			m = ipreass6(m);
+			if (m != NULL) {
+				free_pkts(m);
+				done++;
+			}
+		}
+	}
+	if (done != n)
+		printf("ipreass6: %d of %d datagrams not reassembled\n", 
+		    n - done, n);
+	return c;
+}
+
+/* 
+ * the answer of www.example.com A, 
+ * 0xc00c A IN ttl 10.0.0.x
+ */
+static void setup_dns(int n)
+{
+	const u_char qname[] = "\3www\7example\3com";
+	udpiphdr *ui;
+	dnshdr *dh;
+	u_char *p;
+	int i, dlen;
+	
+	dlen = sizeof(dnshdr) + sizeof(qname) + 4 + 16;
+	for (i = 0; i < n; i++) {
+		input[i] = mkip4(IPPROTO_UDP, sizeof(udphdr) + dlen);
+		ui = (udpiphdr *)(input[i]->data + sizeof(ethdr));
+		ui->ui_sport = htons(53);
+		ui->ui_dport = htons(1024 + (rnd() & 0x7fff));
+		ui->ui_ulen = htons(sizeof(udphdr) + dlen);
+		ui->ui_sum = 0;
+		
+		dh = (dnshdr *)(ui + 1);
+		dh->id = htons(i);
+		dh->flags = htons(0x8180);
+		dh->query = htons(1);
+		dh->answer = htons(1);
+		dh->author = 0;
+		dh->addition = 0;
+		
+		p = (u_char *)(dh + 1);
+		memcpy(p, qname, sizeof(qname));
+		p += sizeof(qname);
+		*p++ = 0; *p++ = 1;		/* A */
+		*p++ = 0; *p++ = 1;		/* IN */
+		*p++ = 0xc0; *p++ = 0x0c;
+		*p++ = 0; *p++ = 1;
+		*p++ = 0; *p++ = 1;
+		*p++ = 0; *p++ = 0; *p++ = 0x0e; *p++ = 0x10;
+		*p++ = 0; *p++ = 4;
+		*p++ = 10; *p++ = 0; *p++ = 0; *p++ = rnd() & 0xff;
+		fix_ip4(input[i]);
+	}
+}
+
+static int run_dns(int n)
+{
+	char name[MAX_DNS_NAME * 4];
+	u_char ip[17];
+	int i, c = 0;
+	
+	for (i = 0; i < n; i++) {
+		if (dnsparse(input[i], htons(i), name, sizeof(name), ip) == 1)
+			c++;
+		del_pkt(input[i]);
+	}
+	if (c != n)
+		printf("dnsparse: %d of %d answers not parsed\n", n - c, n);
+	return n;
+}
+
+static struct bench benches[] = {
+	{"cksum",	setup_cksum,	run_cksum},
+	{"enq/deq",	setup_small,	run_queue},
+	{"upv4/icmp",	setup_icmp,	run_upv4},
+	{"upv4/udp",	setup_udp,	run_upv4},
+	{"tcp/syn",	setup_tcp,	run_tcp},
+	{"ipfrag",	setup_big,	run_ipfrag},
+	{"ipreass",	setup_frags,	run_ipreass},
+	{"upv6/icmp6",	setup_icmp6,	run_upv6},
+	{"ipfrag6",	setup_big6,	run_ipfrag6},
+	{"ipreass6",	setup_frags6,	run_ipreass6},
+	{"dnsparse",	setup_dns,	run_dns},
+	{NULL,		NULL,		NULL}
+};
+
+static void init_dut(void)
+{
+	pcs *pc = DUT;
+	
+	memset(vpc, 0, sizeof(pcs) * MAX_NUM_PTHS);
+	num_pths = 1;
+	time_tick = time(0);
+	
+	pc->id = 0;
+	strcpy(pc->xname, "VPCS");
+	pc->mtu = 1500;
+	pc->ip4.mac[0] = 0x00;
+	pc->ip4.mac[1] = 0x50;
+	pc->ip4.mac[2] = 0x79;
+	pc->ip4.mac[3] = 0x66;
+	pc->ip4.mac[4] = 0x68;
+	pc->ip4.mac[5] = 0x00;
+	pc->ip4.ip = inet_addr("10.0.0.1");
+	pc->ip4.cidr = 24;
+	pc->ip4.flags |= IPF_FRAG;
+	
+	pthread_mutex_init(&pc->locker, NULL);
+	init_queue(&pc->iq);
+	init_queue(&pc->oq);
+	init_queue(&pc->bgiq);
+	init_queue(&pc->bgoq);
+	
+	/* fe80::250:79ff:fe66:6800 */
+	pc->link6.ip.addr16[0] = IPV6_ADDR_INT16_ULL;
+	pc->link6.ip.addr8[8] = pc->ip4.mac[0] ^ 0x2;
+	pc->link6.ip.addr8[9] = pc->ip4.mac[1];
+	pc->link6.ip.addr8[10] = pc->ip4.mac[2];
+	pc->link6.ip.addr8[11] = 0xff;
+	pc->link6.ip.addr8[12] = 0xfe;
+	pc->link6.ip.addr8[13] = pc->ip4.mac[3];
+	pc->link6.ip.addr8[14] = pc->ip4.mac[4];
+	pc->link6.ip.addr8[15] = pc->ip4.mac[5];
+	pc->link6.cidr = 64;
+	pc->link6.type = IP6TYPE_LOCALLINK;
+	
+	peerip = inet_addr("10.0.0.2");
+	memcpy(&peerip6, &pc->link6.ip, sizeof(ip6));
+	peerip6.addr8[15] = 0x80;
+	
+	init_ipfrag();
+	init_ip6frag();
+}
+
+static void bench_usage(void)
+{
+	struct bench *b;
+	
+	printf("usage: vpcs_bench [-n packets] [-s seed] [name ...]\n"
+	    "benchmarks:");
+	for (b = benches; b->name; b++)
+		printf(" %s", b->name);
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct bench *b;
+	struct timespec t0, t1;
+	double ns, total;
+	u_int seed0 = 1;
+	int n = 100000;
+	int c, i, k, done, run;
+	
+	while ((c = getopt(argc, argv, "hn:s:")) != -1) {
+		switch (c) {
+			case 'n':
+				n = atoi(optarg);
+				break;
+			case 's':
+				seed0 = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				bench_usage();
+				return 1;
+		}
+	}
+	if (n < BATCH || seed0 == 0) {
+		bench_usage();
+		return 1;
+	}
+	
+	init_dut();
+	
+	printf("%-12s %10s %12s %10s\n", "benchmark", "packets", "pps", 
+	    "ns/packet");
+	for (b = benches; b->name; b++) {
+		if (optind < argc) {
+			for (i = optind; i < argc; i++)
+				if (!strcmp(argv[i], b->name))
+					break;
+			if (i == argc)
+				continue;
+		}
+		
+		/* the same traffic for each run */
+		seed = seed0;
+		srandom(seed0);
+		
+		total = 0;
+		done = 0;
+		for (k = 0; k < n; k += BATCH) {
+			b->setup(BATCH);
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			run = b->run(BATCH);
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			total += (t1.tv_sec - t0.tv_sec) * 1e9 + 
+			    (t1.tv_nsec - t0.tv_nsec);
+			done += run;
+		}
+		ns = total / done;
+		printf("%-12s %10d %12.0f %10.1f\n", b->name, done, 1e9 / ns, 
+		    ns);
+	}
+	
+	return 0;
+}
+
+/* end of file */
@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "globle.h"
+#include "vpcs.h"
+#include "afpacket.h"
+
+#ifdef Linux
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+
+struct pktring {
+	u_char *map;
+	size_t maplen;
+	u_char *rx;			/* PKT_RXBLOCKS blocks */
+	u_char *tx;			/* PKT_TXFRAMES frames */
+	u_int rxcur;			/* block being read */
+	struct tpacket3_hdr *pkt;	/* next frame in the block */
+	u_int left;			/* frames left in the block */
+	u_int txcur;			/* next frame to fill */
+	u_int pending;			/* frames not kicked yet */
+};
+
+#define PKT_TXFRAMES	(PKT_TXBLOCKSIZE / PKT_FRAMESIZE * PKT_TXBLOCKS)
+#define PKT_TXDATA	(TPACKET3_HDRLEN - sizeof(struct sockaddr_ll))
+
+static struct pktring *pktring[MAX_NUM_PTHS];
+
+static int packet_filter(int fd, u_char *mac);
+static int packet_ring(int fd, int type, int bsize, int bnum, int tov);
+
+/* 
+ * the interface is put into the promiscuous mode, the frames of the 
+ * VPC do not carry the address of the interface
+ */
+int open_packet(int id, const char *ifname)
+{
+	struct pktring *r;
+	struct sockaddr_ll sll;
+	struct packet_mreq mr;
+	int fd, ifindex, v = TPACKET_V3;
+	size_t rxlen, txlen;
+
+	ifindex = if_nametoindex(ifname);
+	if (ifindex == 0)
+		return 0;
+
+	r = (struct pktring *)malloc(sizeof(struct pktring));
+	if (r == NULL)
+		return 0;
+	memset(r, 0, sizeof(struct pktring));
+
+	/* no frame is queued before the filter is in place */
+	fd = socket(AF_PACKET, SOCK_RAW, 0);
+	if (fd < 0) {
+		free(r);
+		return 0;
+	}
+
+	rxlen = PKT_RXBLOCKSIZE * PKT_RXBLOCKS;
+	txlen = PKT_TXBLOCKSIZE * PKT_TXBLOCKS;
+	if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &v, sizeof(v)) < 0 ||
+	    packet_filter(fd, vpc[id].ip4.mac) < 0 ||
+	    packet_ring(fd, PACKET_RX_RING, PKT_RXBLOCKSIZE, PKT_RXBLOCKS, 
+	    PKT_RXTIMEOUT) < 0 ||
+	    packet_ring(fd, PACKET_TX_RING, PKT_TXBLOCKSIZE, PKT_TXBLOCKS, 
+	    0) < 0)
+		goto err;
+
+	r->maplen = rxlen + txlen;
+	r->map = mmap(NULL, r->maplen, PROT_READ | PROT_WRITE, 
+	    MAP_SHARED | MAP_LOCKED, fd, 0);
+	if (r->map == MAP_FAILED)
+		r->map = mmap(NULL, r->maplen, PROT_READ | PROT_WRITE, 
+		    MAP_SHARED, fd, 0);
+	if (r->map == MAP_FAILED)
+		goto err;
+	r->rx = r->map;
+	r->tx = r->map + rxlen;
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_ALL);
+	sll.sll_ifindex = ifindex;
+	if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) < 0)
+		goto err_unmap;
+
+	memset(&mr, 0, sizeof(mr));
+	mr.mr_ifindex = ifindex;
+	mr.mr_type = PACKET_MR_PROMISC;
+	if (setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, 
+	    &mr, sizeof(mr)) < 0)
+		goto err_unmap;
+
+	pktring[id] = r;
+	return fd;
+
+err_unmap:
+	munmap(r->map, r->maplen);
+err:
+	v = errno;
+	close(fd);
+	free(r);
+	errno = v;
+	return 0;
+}
+
+/*
+ * walk the frames of the block handed over by the kernel, give the 
+ * block back after the last one, sleep in poll only if the kernel has
+ * not filled the next block yet.
+ */
+int packet_read(int id, void *buf, int len)
+{
+	struct pktring *r = pktring[id];
+	struct tpacket_block_desc *bd;
+	struct pollfd pfd;
+	int n;
+
+	bd = (struct tpacket_block_desc *)
+	    (r->rx + r->rxcur * PKT_RXBLOCKSIZE);
+
+	if (r->pkt == NULL) {
+		if (!(bd->hdr.bh1.block_status & TP_STATUS_USER)) {
+			pfd.fd = vpc[id].fd;
+			pfd.events = POLLIN | POLLERR;
+			pfd.revents = 0;
+			if (poll(&pfd, 1, 1000) <= 0 ||
+			    !(bd->hdr.bh1.block_status & TP_STATUS_USER))
+				return 0;
+		}
+		__sync_synchronize();
+		r->pkt = (struct tpacket3_hdr *)
+		    ((u_char *)bd + bd->hdr.bh1.offset_to_first_pkt);
+		r->left = bd->hdr.bh1.num_pkts;
+	}
+
+	n = 0;
+	if (r->left > 0) {
+		n = r->pkt->tp_snaplen;
+		if (n > len)
+			n = len;
+		memcpy(buf, (u_char *)r->pkt + r->pkt->tp_mac, n);
+		r->pkt = (struct tpacket3_hdr *)
+		    ((u_char *)r->pkt + r->pkt->tp_next_offset);
+		r->left--;
+	}
+
+	if (r->left == 0) {
+		__sync_synchronize();
+		bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+		r->rxcur = (r->rxcur + 1) % PKT_RXBLOCKS;
+		r->pkt = NULL;
+	}
+
+	return n;
+}
+
+/* a full ring is kicked and waited for, at most one second */
+int packet_write(int id, void *buf, int len)
+{
+	struct pktring *r = pktring[id];
+	struct tpacket3_hdr *hdr;
+	struct pollfd pfd;
+
+	if (len > PKT_FRAMESIZE - PKT_TXDATA)
+		return 0;
+
+	hdr = (struct tpacket3_hdr *)(r->tx + r->txcur * PKT_FRAMESIZE);
+	if (hdr->tp_status & TP_STATUS_WRONG_FORMAT)
+		hdr->tp_status = TP_STATUS_AVAILABLE;
+	if (hdr->tp_status != TP_STATUS_AVAILABLE) {
+		packet_flush(id);
+		pfd.fd = vpc[id].fd;
+		pfd.events = POLLOUT;
+		pfd.revents = 0;
+		poll(&pfd, 1, 1000);
+		__sync_synchronize();
+		if (hdr->tp_status != TP_STATUS_AVAILABLE)
+			return 0;
+	}
+
+	memcpy((u_char *)hdr + PKT_TXDATA, buf, len);
+	hdr->tp_len = len;
+	hdr->tp_snaplen = len;
+	hdr->tp_next_offset = 0;
+	__sync_synchronize();
+	hdr->tp_status = TP_STATUS_SEND_REQUEST;
+	r->txcur = (r->txcur + 1) % PKT_TXFRAMES;
+
+	if (++r->pending >= PKT_TXBATCH)
+		packet_flush(id);
+
+	return len;
+}
+
+/* called by pth_writer when its queue is empty */
+void packet_flush(int id)
+{
+	struct pktring *r = pktring[id];
+
+	if (r == NULL || r->pending == 0)
+		return;
+	r->pending = 0;
+	send(vpc[id].fd, NULL, 0, MSG_DONTWAIT);
+}
+
+/* 
+ * accept the frames to the VPC, broadcast and multicast, except the 
+ * ones sent by itself which the kernel loops back to the socket 
+ */
+static int 
+packet_filter(int fd, u_char *mac)
+{
+	u_int hi = (mac[0] << 24) | (mac[1] << 16) | (mac[2] << 8) | mac[3];
+	u_int lo = (mac[4] << 8) | mac[5];
+	struct sock_fprog prog;
+	struct sock_filter code[] = {
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 6),		/* src */
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, hi, 0, 2),
+		BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 10),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, lo, 7, 0),
+		BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 0),		/* dst */
+		BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 1, 4, 0),
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 0),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, hi, 0, 3),
+		BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 4),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, lo, 0, 1),
+		BPF_STMT(BPF_RET | BPF_K, 0x40000),
+		BPF_STMT(BPF_RET | BPF_K, 0),
+	};
+
+	prog.len = sizeof(code) / sizeof(code[0]);
+	prog.filter = code;
+
+	return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, 
+	    &prog, sizeof(prog));
+}
+
+static int 
+packet_ring(int fd, int type, int bsize, int bnum, int tov)
+{
+	struct tpacket_req3 req;
+
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = bsize;
+	req.tp_block_nr = bnum;
+	req.tp_frame_size = PKT_FRAMESIZE;
+	req.tp_frame_nr = bsize / PKT_FRAMESIZE * bnum;
+	req.tp_retire_blk_tov = tov;
+
+	return setsockopt(fd, SOL_PACKET, type, &req, sizeof(req));
+}
+
+#else
+
+int open_packet(int id, const char *ifname)
+{
+	errno = ENOSYS;
+	return 0;
+}
+
+int packet_read(int id, void *buf, int len)
+{
+	return 0;
+}
+
+int packet_write(int id, void *buf, int len)
+{
+	return 0;
+}
+
+void packet_flush(int id)
+{
+}
+
+#endif
+
+/* end of file */
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef _AFPACKET_H_
+#define _AFPACKET_H_
+
+/*
+ * DEV_PACKET: a VPC attached to an existing host interface through an
+ * AF_PACKET socket with TPACKET_V3 rings mapped into the process. The
+ * receive ring is consumed a block at a time, frames are queued into
+ * the transmit ring and handed to the kernel in batches.
+ */
+#define PKT_RXBLOCKSIZE	(1 << 17)
+#define PKT_RXBLOCKS	8
+#define PKT_RXTIMEOUT	1		/* ms to retire a partial block */
+#define PKT_FRAMESIZE	2048
+#define PKT_TXBLOCKSIZE	(1 << 16)
+#define PKT_TXBLOCKS	8
+#define PKT_TXBATCH	32		/* frames queued before a kick */
+
+int open_packet(int id, const char *ifname);
+int packet_read(int id, void *buf, int len);
+int packet_write(int id, void *buf, int len);
+void packet_flush(int id);
+
+#endif
+
+/* end of file */
@@ -40,22 +40,26 @@
 #include "utils.h"
 #include "vpcs.h"
 #include "dev.h"
+#include "shm.h"
 #include "packets.h"
 #include "packets6.h"
 #include "queue.h"
 #include "dhcp.h"
 #include "tcp.h"
+#include "tcpstream.h"
 #include "dns.h"
 #include "remote.h"
 #include "readline.h"
 #include "help.h"
 #include "dump.h"
+#include "filter.h"
 #include "relay.h"
-#include "http.h"
-#include "website.h"
+#include "inet6.h"
 
 extern int pcid;
 extern int devtype;
+extern int memtopo;
+extern char *pktif;
 extern int ctrl_c;
 extern int ctrl_z;
 extern u_int time_tick;
@@ -74,10 +78,22 @@ static const char *color_name[8] = {
 	"black", "red", "green", "yellow", "blue", "magenta", "cyan", "white"};
 
 static int set_dump(int argc, char **argv);
+static int set_dump_rotate(int argc, char **argv);
+static int set_dump_filter(int argc, char **argv);
+static int set_dump_rate(int argc, char **argv);
+static int set_shm(pcs *pc, const char *name);
+static void show_dump_rotate(void);
+static void show_dump_filter(pcs *pc);
+static void show_dump_console(pcs *pc);
 static int show_dump(int argc, char **argv);
 static int show_ip(int argc, char **argv);
 static int show_echo(int argc, char **argv);
 static int show_arp(int argc, char **argv);
+static int show_stats(int argc, char **argv);
+static int show_latency(int argc, char **argv);
+static void show_latency1(int id);
+static void show_stats1(pcs *pc);
+static void reset_stats(pcs *pc);
 
 static int run_dhcp_new(int renew, int dump);
 static int run_dhcp_release(int dump);
@@ -120,6 +136,12 @@ int run_show(int argc, char **argv)
 		if (!strncmp("echo", argv[1], strlen(argv[1])))
 			return show_echo(argc, argv);
 
+		if (!strncmp("stats", argv[1], strlen(argv[1])))
+			return show_stats(argc, argv);
+
+		if (!strncmp("latency", argv[1], strlen(argv[1])))
+			return show_latency(argc, argv);
+
 		if (!strncmp("version", argv[1], strlen(argv[1])))
 			return run_ver(0, NULL);
 
@@ -204,7 +226,98 @@ int run_show(int argc, char **argv)
 				j = sprintf(buf + 65, "%d", vpc[i].lport);
 				buf[j + 65] = ' ';
 				in.s_addr = vpc[i].rhost;
-				j = sprintf(buf + 72, "%s:%d", inet_ntoa(in), vpc[i].rport);
+				if (vpc[i].shm != NULL)
+					j = sprintf(buf + 72, "shm:%.40s", vpc[i].shm->name);
+				else
+					j = sprintf(buf + 72, "%s:%d", inet_ntoa(in), vpc[i].rport);
+				printf("%s\n", buf);
+				run_show6(&vpc[i]);
+			}
+			break;
+		case DEV_UNIX:
+			j = sprintf(buf, "NAME");
+			buf[j] = ' ';
+			j = sprintf(buf + 7, "IP/MASK");
+			buf[j + 7] = ' ';
+			j = sprintf(buf + 28, "GATEWAY");
+			buf[j + 28] = ' ';
+			j = sprintf(buf + 46, "MAC");
+			buf[j + 46] = ' ';
+			j = sprintf(buf + 65, "RSOCK");
+			printf("%s\n", buf);
+
+			for (i = 0; i < num_pths; i++) {
+				memset(buf, 0, sizeof(buf));
+				memset(buf, ' ', sizeof(buf) - 1);
+				if (strcmp(vpc[i].xname, "VPCS")== 0)
+					j = sprintf(buf, "%s%d", vpc[i].xname, i + 1);
+				else
+					j = sprintf(buf, "%s", vpc[i].xname);
+				buf[j] = ' ';
+
+				in.s_addr = vpc[i].ip4.ip;
+				j = sprintf(buf + 7, "%s/%d", inet_ntoa(in), vpc[i].ip4.cidr);
+
+				buf[j + 7] = ' ';
+				in.s_addr = vpc[i].ip4.gw;
+				j = sprintf(buf + 28, "%s", inet_ntoa(in));
+				buf[j + 28] = ' ';
+
+				for (k = 0; k < 6; k++)
+					sprintf(buf + 46 + k * 3, "%2.2x:", vpc[i].ip4.mac[k]);
+				buf[63] = ' ';
+				buf[64] = ' ';
+				if (vpc[i].shm != NULL)
+					sprintf(buf + 65, "shm:%.40s", vpc[i].shm->name);
+				else
+					sprintf(buf + 65, "%.60s", vpc[i].rsock);
+				printf("%s\n", buf);
+				run_show6(&vpc[i]);
+			}
+			break;
+		case DEV_MEM:
+		case DEV_PACKET:
+			j = sprintf(buf, "NAME");
+			buf[j] = ' ';
+			j = sprintf(buf + 7, "IP/MASK");
+			buf[j + 7] = ' ';
+			j = sprintf(buf + 28, "GATEWAY");
+			buf[j + 28] = ' ';
+			j = sprintf(buf + 46, "MAC");
+			buf[j + 46] = ' ';
+			j = sprintf(buf + 65, "LINK");
+			printf("%s\n", buf);
+
+			for (i = 0; i < num_pths; i++) {
+				memset(buf, 0, sizeof(buf));
+				memset(buf, ' ', sizeof(buf) - 1);
+				if (strcmp(vpc[i].xname, "VPCS")== 0)
+					j = sprintf(buf, "%s%d", vpc[i].xname, i + 1);
+				else
+					j = sprintf(buf, "%s", vpc[i].xname);
+				buf[j] = ' ';
+
+				in.s_addr = vpc[i].ip4.ip;
+				j = sprintf(buf + 7, "%s/%d", inet_ntoa(in), vpc[i].ip4.cidr);
+
+				buf[j + 7] = ' ';
+				in.s_addr = vpc[i].ip4.gw;
+				j = sprintf(buf + 28, "%s", inet_ntoa(in));
+				buf[j + 28] = ' ';
+
+				for (k = 0; k < 6; k++)
+					sprintf(buf + 46 + k * 3, "%2.2x:", vpc[i].ip4.mac[k]);
+				buf[63] = ' ';
+				buf[64] = ' ';
+				if (devtype == DEV_PACKET)
+					sprintf(buf + 65, "%.60s", pktif);
+				else if (memtopo == MEM_SWITCH)
+					sprintf(buf + 65, "switch");
+				else if (mem_peer(i) == -1)
+					sprintf(buf + 65, "none");
+				else
+					sprintf(buf + 65, "%s%d", vpc[mem_peer(i)].xname,
+					    mem_peer(i) + 1);
 				printf("%s\n", buf);
 				run_show6(&vpc[i]);
 			}
@@ -229,6 +342,8 @@ int run_ping(int argc, char **argv)
 	char proto_seq[16];
 	int count = 5;
 	int interval = 1000;
+	u_int64_t bulk = 0;
+	struct tcpstream stream;
 
 	if (argc < 2 || (argc == 2 && strlen(argv[1]) == 1 && argv[1][0] == '?')) {
 		return help_ping(argc, argv);
@@ -278,6 +393,12 @@ int run_ping(int argc, char **argv)
 				pc->mscb.proto = IPPROTO_TCP;
 				strcpy(proto_seq, "tcp_seq");
 				break;
+			case 'B':
+				if (i < argc)
+					bulk = arg2size(argv[i++]);
+				pc->mscb.proto = IPPROTO_TCP;
+				strcpy(proto_seq, "tcp_seq");
+				break;
 			case 'P':
 				if (i < argc) {
 					int pro = atoi(argv[i++]);
@@ -517,22 +638,39 @@ redirect:
 			    usec / 1000.0);
 
 			traveltime = 0.6 * usec / 1000;
-			/* send data after 1.5 * time2travel */
-			delay_ms(traveltime);
-			gettimeofday(&(ts), (void*)0);
-			k = tcp_send(pc, 4);
-			if (k == 0) {
-				printf("SendData  %d@%s timeout\n",
-				    pc->mscb.dport, argv[1]);
-				continue;
-			}
+			if (bulk > 0) {
+				memset(&stream, 0, sizeof(stream));
+				stream.bytes = bulk;
+				pc->mscb.cc = TCPCC_DEFAULT;
+				k = tcp_stream(pc, 4, &stream);
+				tcp_stream_report(&stream, pc->mscb.dport, 
+				    argv[1]);
+				if (k == 3)
+					printf("Stream    %d@%s RST returned\n",
+					    pc->mscb.dport, argv[1]);
+				else if (k == 0)
+					printf("Stream    %d@%s timeout\n",
+					    pc->mscb.dport, argv[1]);
+				if (k != 1)
+					continue;
+			} else {
+				/* send data after 1.5 * time2travel */
+				delay_ms(traveltime);
+				gettimeofday(&(ts), (void*)0);
+				k = tcp_send(pc, 4);
+				if (k == 0) {
+					printf("SendData  %d@%s timeout\n",
+					    pc->mscb.dport, argv[1]);
+					continue;
+				}
 
-			gettimeofday(&(ts0), (void*)0);
-			usec = (ts0.tv_sec - ts.tv_sec) * 1000000 +
-			    ts0.tv_usec - ts.tv_usec;
-			printf("SendData  %d@%s seq=%d ttl=%d time=%.3f ms\n",
-			    pc->mscb.dport, argv[1], i, pc->mscb.rttl,
-			    usec / 1000.0);
+				gettimeofday(&(ts0), (void*)0);
+				usec = (ts0.tv_sec - ts.tv_sec) * 1000000 +
+				    ts0.tv_usec - ts.tv_usec;
+				printf("SendData  %d@%s seq=%d ttl=%d "
+				    "time=%.3f ms\n", pc->mscb.dport, argv[1], 
+				    i, pc->mscb.rttl, usec / 1000.0);
+			}
 
 			/* close after 1.5 * time2travel */
 			if (k != 2)
@@ -1400,6 +1538,10 @@ int run_set(int argc, char **argv)
 			printf("Incomplete command.\n");
 			return 1;
 		}
+		if (devtype != DEV_UDP) {
+			printf("Only in the udp mode.\n");
+			return 1;
+		}
 		value = atoi(argv[2]);
 		if (value < 1024 || value > 65000) {
 			printf("Invalid port. 1024 > port < 65000.\n");
@@ -1424,6 +1566,45 @@ int run_set(int argc, char **argv)
 			printf("Invalid port. 1024 > port < 65000.\n");
 		} else
 			pc->rport = value;
+	} else if (!strncmp("lsock", argv[1], strlen(argv[1])) ||
+	    !strncmp("rsock", argv[1], strlen(argv[1]))) {
+		if (argc < 3) {
+			printf("Incomplete command.\n");
+			return 1;
+		}
+		/* the console splits the words at '/' */
+		if (argc > 3) {
+			printf("Invalid path, quote it, e.g. \"/tmp/vpcs.sock\"\n");
+			return 1;
+		}
+		if (devtype != DEV_UNIX) {
+			printf("Only in the unix mode.\n");
+			return 1;
+		}
+		if (strlen(argv[2]) >= UNIX_PATH_LEN) {
+			printf("Invalid path, at most %d characters.\n", 
+			    UNIX_PATH_LEN - 1);
+			return 1;
+		}
+		if (argv[1][0] == 'r') {
+			strcpy(pc->rsock, argv[2]);
+			/* 
+			 * the writer thread may be sending on wfd, let it
+			 * connect to the new peer on the next frame
+			 */
+			pc->wreset = 1;
+			return 1;
+		}
+		fd = open_unix(argv[2]);
+		if (fd <= 0) {
+			printf("Device(%d) open error [%s]\n", pcid, strerror(errno));
+			return 0;
+		}
+		close(pc->fd);
+		if (strcmp(pc->lsock, argv[2]))
+			unlink(pc->lsock);
+		pc->fd = fd;
+		strcpy(pc->lsock, argv[2]);
 	} else if (!strncmp("rhost", argv[1], strlen(argv[1]))) {
 		if (argc != 3) {
 			printf("Incomplete command.\n");
@@ -1483,6 +1664,35 @@ int run_set(int argc, char **argv)
 			}
 		}
 
+	} else if (!strncmp("latency", argv[1], strlen(argv[1]))) {
+		if (argc != 3 || (strcasecmp(argv[2], "on") && 
+		    strcasecmp(argv[2], "off"))) {
+			argc = 3;
+			argv[2] = "?";
+			return help_set(argc, argv);
+		}
+		trace_enabled = !strcasecmp(argv[2], "on");
+		return 1;
+	} else if (!strncmp("shm", argv[1], strlen(argv[1]))) {
+		if (argc != 3 || !strcmp(argv[2], "?")) {
+			argc = 3;
+			argv[2] = "?";
+			return help_set(argc, argv);
+		}
+		return set_shm(pc, argv[2]);
+	} else if (!strncmp("tcpcc", argv[1], strlen(argv[1]))) {
+		if (argc != 3 || !strcmp(argv[2], "?")) {
+			argc = 3;
+			argv[2] = "?";
+			return help_set(argc, argv);
+		}
+		value = tcpcc_lookup(argv[2]);
+		if (value == TCPCC_DEFAULT) {
+			printf("Invalid congestion control: %s\n", argv[2]);
+			return 0;
+		}
+		tcpcc_default = value;
+		return 1;
 	} else
 		printf("Invalid command.\n");
 	return 1;
@@ -1595,6 +1805,50 @@ int run_remote(int argc, char **argv)
 	return help_rlogin(argc, argv);
 }
 
+/* 
+ * move the VPC onto the shared memory link or back to its device, 
+ * the reader may sleep in shm_read, keep waking it up until both the
+ * reader and the writer are out of the link before unmapping it
+ */
+static int set_shm(pcs *pc, const char *name)
+{
+	struct shmdev *sd = pc->shm;
+
+	if (sd != NULL) {
+		pc->shm = NULL;
+		__sync_synchronize();
+		while (pc->shmusers > 0) {
+			pthread_cond_broadcast(&sd->hdr->ring[!sd->side].cond);
+			delay_ms(1);
+		}
+		shm_detach(sd);
+	}
+	if (!strcmp(name, "off"))
+		return 1;
+
+	sd = shm_attach(name);
+	if (sd == NULL) {
+		printf("Open shared memory /vpcs-%s error [%s]\n", name, 
+		    strerror(errno));
+		return 0;
+	}
+	pc->shm = sd;
+	printf("%s the shared memory /vpcs-%s\n", 
+	    sd->side ? "Attached to" : "Created", name);
+
+	return 1;
+}
+
+void shm_clean(void)
+{
+	int i;
+
+	for (i = 0; i < num_pths; i++) {
+		if (vpc[i].shm != NULL)
+			set_shm(&vpc[i], "off");
+	}
+}
+
 static int set_dump(int argc, char **argv)
 {
 	int ok = 1;
@@ -1602,10 +1856,22 @@ static int set_dump(int argc, char **argv)
 	pcs *pc = &vpc[pcid];
 
 	int dmpflag = 0;
+	int off = 0;
+	int oldflag, newflag;
 
 	if (argc == 2)
 		ok = 0;
 
+	if (argc > 2 && strlen(argv[2]) > 1 && 
+	    !strncmp(argv[2], "rotate", strlen(argv[2])))
+		return set_dump_rotate(argc, argv);
+
+	if (argc > 2 && !strcmp(argv[2], "filter"))
+		return set_dump_filter(argc, argv);
+
+	if (argc > 2 && !strcmp(argv[2], "rate"))
+		return set_dump_rate(argc, argv);
+
 	while (i < argc) {
 		if (!strncmp(argv[i], "mac", strlen(argv[i])))
 			dmpflag |= DMP_MAC;
@@ -1615,21 +1881,13 @@ static int set_dump(int argc, char **argv)
 			dmpflag |= DMP_DETAIL;
 		else if (!strncmp(argv[i], "all", strlen(argv[i])))
 			dmpflag |= DMP_ALL;
-		else if (!strncmp(argv[i], "file", strlen(argv[i]))) {
-			if (pc->dmpfile == NULL) {
-				char tfname[1024];
-				sprintf(tfname, "vpcs%d", pc->id + 1);
-				pc->dmpfile = open_dmpfile(tfname);
-			}
+		else if (!strncmp(argv[i], "file", strlen(argv[i])))
 			dmpflag |= DMP_FILE;
-		} else if (!strncmp(argv[i], "off", strlen(argv[i]))) {
+		else if (!strncmp(argv[i], "pcapng", strlen(argv[i])))
+			dmpflag |= DMP_PCAPNG;
+		else if (!strncmp(argv[i], "off", strlen(argv[i]))) {
 			dmpflag = 0;
-			/* give pthread reader/writer a little time */
-			usleep(1000);
-			if (pc->dmpfile) {
-				close_dmpfile(pc->dmpfile);
-				pc->dmpfile = NULL;
-			}
+			off = 1;
 		} else {
 			printf("Invalid options\n");
 			ok = 0;
@@ -1638,10 +1896,30 @@ static int set_dump(int argc, char **argv)
 		i++;
 	}
 	if (ok) {
-		if (dmpflag == 0)
-			pc->dmpflag = 0;
-		else
-			pc->dmpflag |= dmpflag;
+		/* 
+		 * open or close the files by the flags before and after 
+		 * the command, 'pcapng off' takes no reference
+		 */
+		newflag = (off ? 0 : pc->dmpflag) | dmpflag;
+
+		if ((newflag & DMP_PCAPNG) && !(pc->dmpflag & DMP_PCAPNG) && 
+		    open_pcapng() != 0) {
+			printf("Open pcapng file error [%s]\n", strerror(errno));
+			return 1;
+		}
+		if ((newflag & DMP_FILE) && pc->dmpfile == NULL) {
+			char tfname[1024];
+			sprintf(tfname, "vpcs%d", pc->id + 1);
+			pc->dmpfile = open_dmpfile(tfname);
+		}
+
+		oldflag = pc->dmpflag;
+		pc->dmpflag = newflag;
+
+		if (!(newflag & DMP_FILE) && pc->dmpfile)
+			close_dmpfile(&pc->dmpfile);
+		if (!(newflag & DMP_PCAPNG) && (oldflag & DMP_PCAPNG))
+			close_pcapng();
 
 		printf("\ndump flags:");
 		if (pc->dmpflag & DMP_MAC)
@@ -1654,6 +1932,8 @@ static int set_dump(int argc, char **argv)
 			printf(" all");
 		if (pc->dmpflag & DMP_FILE)
 			printf(" file");
+		if (pc->dmpflag & DMP_PCAPNG)
+			printf(" pcapng");
 		if (pc->dmpflag == 0)
 			printf(" (none)");
 		printf("\n");
@@ -1663,6 +1943,126 @@ static int set_dump(int argc, char **argv)
 	return 1;
 }
 
+/* set dump rotate [size MB] [time seconds] [files n] | off */
+static int set_dump_rotate(int argc, char **argv)
+{
+	struct dmprotate rot;
+	int i;
+
+	dmp_getrotate(&rot);
+	if (argc == 4 && !strncmp(argv[3], "off", strlen(argv[3]))) {
+		memset(&rot, 0, sizeof(rot));
+		argc = 3;
+	}
+
+	for (i = 3; i < argc; i += 2) {
+		if (i + 1 >= argc || !digitstring(argv[i + 1])) {
+			printf("Invalid options\n");
+			return 1;
+		}
+		if (!strncmp(argv[i], "size", strlen(argv[i])))
+			rot.size = (u_int64_t)atoi(argv[i + 1]) << 20;
+		else if (!strncmp(argv[i], "time", strlen(argv[i])))
+			rot.duration = atoi(argv[i + 1]);
+		else if (!strncmp(argv[i], "files", strlen(argv[i])))
+			rot.files = atoi(argv[i + 1]);
+		else {
+			printf("Invalid options\n");
+			return 1;
+		}
+	}
+	dmp_setrotate(&rot);
+
+	printf("\n");
+	show_dump_rotate();
+
+	return 1;
+}
+
+/* set dump filter EXPRESSION | off */
+static int set_dump_filter(int argc, char **argv)
+{
+	pcs *pc = &vpc[pcid];
+	struct dmpfilter *flt = NULL;
+
+	if (argc > 3 && !(argc == 4 && !strcmp(argv[3], "off"))) {
+		flt = filter_compile(argc - 3, argv + 3);
+		if (flt == NULL)
+			return 1;
+	}
+
+	/* the reader or the writer may still be matching the old one */
+	filter_set(&pc->dmpfilter, flt);
+
+	printf("\n");
+	show_dump_filter(pc);
+
+	return 1;
+}
+
+/* set dump rate n|off */
+static int set_dump_rate(int argc, char **argv)
+{
+	if (argc != 4 || (strcmp(argv[3], "off") && !digitstring(argv[3]))) {
+		printf("Invalid options\n");
+		return 1;
+	}
+	if (!strcmp(argv[3], "off"))
+		dmp_setrate(0);
+	else
+		dmp_setrate(atoi(argv[3]));
+
+	printf("\n");
+	show_dump_console(&vpc[pcid]);
+
+	return 1;
+}
+
+static void show_dump_console(pcs *pc)
+{
+	u_long dropped, limited;
+
+	dmp_getdrops(pc->id, &dropped, &limited);
+	if (dmp_getrate())
+		printf("dump rate: %d packets/s", dmp_getrate());
+	else
+		printf("dump rate: no limit");
+	printf(", %lu dropped, %lu over the rate\n", dropped, limited);
+}
+
+static void show_dump_filter(pcs *pc)
+{
+	struct dmpfilter *flt = pc->dmpfilter;
+
+	if (flt == NULL)
+		return;
+
+	printf("dump filter: %s\n", flt->expr);
+	printf("    in:  %lu matched, %lu skipped\n", 
+	    flt->matched[0], flt->skipped[0]);
+	printf("    out: %lu matched, %lu skipped\n", 
+	    flt->matched[1], flt->skipped[1]);
+}
+
+static void show_dump_rotate(void)
+{
+	struct dmprotate rot;
+
+	dmp_getrotate(&rot);
+	if (rot.size == 0 && rot.duration == 0) {
+		printf("dump rotate: off\n");
+		return;
+	}
+	printf("dump rotate:");
+	if (rot.size)
+		printf(" size %lluMB", (unsigned long long)(rot.size >> 20));
+	if (rot.duration)
+		printf(" time %ds", rot.duration);
+	if (rot.files)
+		printf(" files %d", rot.files);
+	printf("\n");
+}
+
 int show_arp(int argc, char **argv)
 {
 	pcs *pc;
@@ -1759,10 +2159,16 @@ static int show_dump(int argc, char **argv)
 					printf(" all");
 				if (vpc[i].dmpflag & DMP_FILE)
 					printf(" file");
+				if (vpc[i].dmpflag & DMP_PCAPNG)
+					printf(" pcapng");
 				if (vpc[i].dmpflag == 0)
 					printf(" (none)");
 				printf("\n");
+				if (vpc[i].dmpfilter)
+					printf("    filter: %s\n", 
+					    vpc[i].dmpfilter->expr);
 			}
+			show_dump_rotate();
 			return 1;
 		}
 		if (strlen(argv[2]) == 1 && digitstring(argv[2])) {
@@ -1786,12 +2192,197 @@ static int show_dump(int argc, char **argv)
 		printf(" all");
 	if (pc->dmpflag & DMP_FILE)
 		printf(" file");
+	if (pc->dmpflag & DMP_PCAPNG)
+		printf(" pcapng");
 	if (pc->dmpflag == 0)
 		printf(" (none)");
 	printf("\n");
+	show_dump_filter(pc);
+	show_dump_console(pc);
+	show_dump_rotate();
+	return 1;
+}
+
+static int show_stats(int argc, char **argv)
+{
+	int i, reset = 0;
+	int si = pcid;
+
+	for (i = 2; i < argc; i++) {
+		if (!strncmp(argv[i], "reset", strlen(argv[i])))
+			reset = 1;
+		else if (!strncmp(argv[i], "all", strlen(argv[i])))
+			si = -1;
+		else if (strlen(argv[i]) == 1 && digitstring(argv[i]) &&
+		    atoi(argv[i]) >= 1 && atoi(argv[i]) <= num_pths)
+			si = atoi(argv[i]) - 1;
+		else {
+			printf("Invalid arguments\n");
+			return 1;
+		}
+	}
+
+	for (i = 0; i < num_pths; i++) {
+		if (si != -1 && i != si)
+			continue;
+		if (reset) {
+			reset_stats(&vpc[i]);
+			continue;
+		}
+		printf("\n");
+		if (num_pths > 1)
+			printf("%s[%d]:\n", vpc[i].xname, i + 1);
+		show_stats1(&vpc[i]);
+	}
+	if (!reset)
+		printf("\n");
+
 	return 1;
 }
 
+static void show_stats1(pcs *pc)
+{
+	struct pcstats *st = &pc->stats;
+	struct pq *qs[4];
+	const char *qn[4] = {"iq", "oq", "bgiq", "bgoq"};
+	int i, n;
+
+	printf("rx   %lu frames, %lu bytes, %lu up\n", 
+	    st->rx.frames, st->rx.bytes, st->rx.up);
+	printf("tx   %lu frames, %lu bytes, %lu errors\n",
+	    st->tx.frames, st->tx.bytes, st->tx.errors);
+	printf("drop %lu type, %lu mcast, %lu addr, %lu mtu, %lu noapp\n",
+	    st->rx.drop_type, st->rx.drop_mcast, st->rx.drop_addr,
+	    st->rx.drop_mtu, st->rx.drop_noapp);
+	printf("frag %lu received, %lu reassembled, %lu sent\n",
+	    st->rx.frags, st->rx.reass, st->ev.frags);
+	printf("arp  %lu requests, %lu cache hits\n", 
+	    st->ev.arp_req, st->ev.arp_hit);
+	printf("nd   %lu solicitations, %lu cache hits\n", 
+	    st->ev.nd_req, st->ev.nd_hit);
+
+	for (i = 0, n = 0; i < MAX_SESSIONS; i++) {
+		if (pc->sesscb[i].timeout != 0 &&
+		    time_tick - pc->sesscb[i].timeout <= TCP_TIMEOUT)
+			n++;
+	}
+	printf("tcp  %d active, %lu opened, %lu closed, %lu reset, "
+	    "%lu refused\n", n, st->ev.tcp_open, st->ev.tcp_close, 
+	    st->ev.tcp_reset, st->ev.tcp_full);
+
+	qs[0] = &pc->iq;
+	qs[1] = &pc->oq;
+	qs[2] = &pc->bgiq;
+	qs[3] = &pc->bgoq;
+	printf("queue  size  hwm  drops\n");
+	for (i = 0; i < 4; i++)
+		printf("%-5s  %4d  %3d  %lu\n", qn[i], qs[i]->size, 
+		    qs[i]->hwm, qs[i]->drops);
+}
+
+static int show_latency(int argc, char **argv)
+{
+	int i, reset = 0;
+	int si = pcid;
+
+	for (i = 2; i < argc; i++) {
+		if (!strncmp(argv[i], "reset", strlen(argv[i])))
+			reset = 1;
+		else if (!strncmp(argv[i], "all", strlen(argv[i])))
+			si = -1;
+		else if (strlen(argv[i]) == 1 && digitstring(argv[i]) &&
+		    atoi(argv[i]) >= 1 && atoi(argv[i]) <= num_pths)
+			si = atoi(argv[i]) - 1;
+		else {
+			printf("Invalid arguments\n");
+			return 1;
+		}
+	}
+
+	if (!reset)
+		printf("\nlatency tracing is %s\n", trace_enabled ? "on" : "off");
+	for (i = 0; i < num_pths; i++) {
+		if (si != -1 && i != si)
+			continue;
+		if (reset) {
+			trace_reset(i);
+			continue;
+		}
+		printf("\n");
+		if (num_pths > 1)
+			printf("%s[%d]:\n", vpc[i].xname, i + 1);
+		show_latency1(i);
+	}
+
+	return 1;
+}
+
+/*
+ * stage   count  avg(us)  p50(us)  p99(us)  max(us)
+ * then the histogram, one row per bucket, one column per stage
+ */
+static void show_latency1(int id)
+{
+	struct trchist *h = trace_hist(id);
+	char p50[16], p99[16];
+	u_long n;
+	int i, b;
+
+	if (h[TRC_TOTAL].count == 0) {
+		printf("no packets traced\n");
+		return;
+	}
+
+	printf("stage        count   avg(us)   p50(us)   p99(us)   max(us)\n");
+	for (i = 0; i <= TRC_TOTAL; i++) {
+		if (h[i].count == 0)
+			continue;
+		snprintf(p50, sizeof(p50), "<%lu", trace_histpct(&h[i], 50));
+		snprintf(p99, sizeof(p99), "<%lu", trace_histpct(&h[i], 99));
+		printf("%-7s %10lu %9.1f %9s %9s %9.1f\n", trace_stage(i), 
+		    h[i].count, h[i].sum / 1000.0 / h[i].count, p50, p99, 
+		    h[i].max / 1000.0);
+	}
+
+	printf("\n    us ");
+	for (i = 0; i <= TRC_TOTAL; i++)
+		printf(" %7s", trace_stage(i));
+	printf("\n");
+	for (b = 0; b < TRC_BUCKETS; b++) {
+		for (i = 0, n = 0; i <= TRC_TOTAL; i++)
+			n += h[i].bucket[b];
+		if (n == 0)
+			continue;
+		if (b == TRC_BUCKETS - 1)
+			printf(">%-6lu", 1UL << (b - 1));
+		else
+			printf("<%-6lu", 1UL << b);
+		for (i = 0; i <= TRC_TOTAL; i++)
+			printf(" %7lu", h[i].bucket[b]);
+		printf("\n");
+	}
+}
+
+static void reset_stats(pcs *pc)
+{
+	struct pq *qs[4];
+	int i;
+
+	/* the data path keeps counting, some of the new values may be lost */
+	memset(&pc->stats, 0, sizeof(pc->stats));
+
+	qs[0] = &pc->iq;
+	qs[1] = &pc->oq;
+	qs[2] = &pc->bgiq;
+	qs[3] = &pc->bgoq;
+	for (i = 0; i < 4; i++) {
+		lock_q(qs[i]);
+		qs[i]->hwm = qs[i]->size;
+		qs[i]->drops = 0;
+		ulock_q(qs[i]);
+	}
+}
+
 static int show_ip(int argc, char **argv)
 {
 	int i, j, k;
@@ -1893,9 +2484,14 @@ static int show_ip(int argc, char **argv)
 		printf("MAC         : ");
 		PRINT_MAC(vpc[id].ip4.mac);
 		printf("\n");
-		printf("LPORT       : %d\n", vpc[id].lport);
-		in.s_addr = vpc[id].rhost;
-		printf("RHOST:PORT  : %s:%d\n", inet_ntoa(in), vpc[id].rport);
+		if (devtype == DEV_UNIX) {
+			printf("LSOCK       : %s\n", vpc[id].lsock);
+			printf("RSOCK       : %s\n", vpc[id].rsock);
+		} else {
+			printf("LPORT       : %d\n", vpc[id].lport);
+			in.s_addr = vpc[id].rhost;
+			printf("RHOST:PORT  : %s:%d\n", inet_ntoa(in), vpc[id].rport);
+		}
 		printf("MTU         : %d\n", vpc[id].mtu);
 		return 1;
 	}
@@ -2060,6 +2656,10 @@ int run_save(int argc, char **argv)
 				in.s_addr = vpc[i].rhost;
 				fprintf(fp, "set rhost %s\n", inet_ntoa(in));
 			}
+			if (devtype == DEV_UNIX) {
+				fprintf(fp, "set lsock \"%s\"\n", vpc[i].lsock);
+				fprintf(fp, "set rsock \"%s\"\n", vpc[i].rsock);
+			}
 		}
 
 		if (vpc[i].ip4.dynip == 1)
@@ -2145,42 +2745,4 @@ const char* ip_to_string(u_int addr){
 	return inet_ntoa(in);
 }
 
-int run_webserver(int argc, char **argv){
-	printf("Hello, I am a webserver!\n");
-
-	struct packet *p;
-	pcs *pc = &vpc[pcid];
-	while(true){
-		sesscb *cb = tcp_accept(pc, 80);
-
-		printf("Accepting connection from %s\n", ip_to_string(cb->dip));
-
-		while (true) {
-			if((p = deq(&pc->iq)) != NULL){
-				struct packet *reply = tcpReply(p, cb);
-				if(reply){
-					enq(&pc->oq, reply);
-				}
-
-				http_request_type req_type;
-				if(parse_http_request(tcp_get_data(p), &req_type, 0) == 0){
-					printf("Anwsering GET request\n");
-					int len;
-					char* http_response = prepare_http_response(200, website_html, website_html_len, &len);
-					struct packet *m = tcp_prepare_packet(&pc->mscb, http_response, len);
-					free(http_response);
-					enq(&pc->oq, m);
-
-					printf("Closing \n");
-					tcp_close(pc, 4);
-					break;
-				}
-			}
-		}
-	}
-
-	return 0;
-}
-
-
 /* end of file */
@@ -33,13 +33,13 @@ int run_ping(int argc, char **argv);
 int run_ipconfig(int argc, char **argv);
 int run_tracert(int argc, char **argv);
 int run_set(int argc, char **argv);
+void shm_clean(void);
 int run_sleep(int argc, char **argv);
 int run_clear(int argc, char **argv);
 int run_echo(int argc, char **argv);
 int run_ver(int argc, char **argv);
 int run_hist(int argc, char **argv);
 int run_remote(int argc, char **argv);
-int run_webserver(int argc, char **argv);
 
 
 int run_load(int argc, char **argv);
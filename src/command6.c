@@ -41,6 +41,7 @@
 #include "packets6.h"
 #include "queue.h"
 #include "tcp.h"
+#include "tcpstream.h"
 #include "help.h"
 
 extern int pcid;
@@ -65,6 +66,8 @@ int run_ping6(int argc, char **argv)
 	char *p;
 	char proto_seq[16];
 	int count = 5;
+	u_int64_t bulk = 0;
+	struct tcpstream stream;
 
 	printf("\n");
 	
@@ -76,6 +79,10 @@ int run_ping6(int argc, char **argv)
 			break;
 		}
 	}
+	for (i = 2; i < argc - 1; i++) {
+		if (!strcmp(argv[i], "-B"))
+			bulk = arg2size(argv[i + 1]);
+	}
 	
 	if (vinet_pton6(AF_INET6, argv[1], &ipaddr) != 1) {
 		printf("Invalid address: %s\n", argv[1]);
@@ -168,22 +175,38 @@ int run_ping6(int argc, char **argv)
 			    pc->mscb.dport, argv[1], i, pc->mscb.rttl, usec / 1000.0);
 			
 			traveltime = 0.6 * usec / 1000;
-			/* send data */
-			delay_ms(traveltime);		
-			gettimeofday(&(ts), (void*)0);
-			k = tcp_send(pc, IPV6_VERSION);
-			if (k == 0) {
-				printf("SendData  %d@%s timeout\n", pc->mscb.dport, argv[1]);
-				continue;
+			if (bulk > 0) {
+				memset(&stream, 0, sizeof(stream));
+				stream.bytes = bulk;
+				pc->mscb.cc = TCPCC_DEFAULT;
+				k = tcp_stream(pc, IPV6_VERSION, &stream);
+				tcp_stream_report(&stream, pc->mscb.dport, argv[1]);
+				if (k == 3)
+					printf("Stream    %d@%s RST returned\n", 
+					    pc->mscb.dport, argv[1]);
+				else if (k == 0)
+					printf("Stream    %d@%s timeout\n", 
+					    pc->mscb.dport, argv[1]);
+				if (k != 1)
+					continue;
+			} else {
+				/* send data */
+				delay_ms(traveltime);		
+				gettimeofday(&(ts), (void*)0);
+				k = tcp_send(pc, IPV6_VERSION);
+				if (k == 0) {
+					printf("SendData  %d@%s timeout\n", pc->mscb.dport, argv[1]);
+					continue;
+				}
+				
+				gettimeofday(&(ts0), (void*)0);
+				usec = (ts0.tv_sec - ts.tv_sec) * 1000000 + ts0.tv_usec - ts.tv_usec;
+				if (usec < 0)
+					usec = 0;
+				printf("SendData  %d@%s seq=%d ttl=%d time=%.3f ms\n", 
+				    pc->mscb.dport, argv[1], i, pc->mscb.rttl, usec / 1000.0);
 			}
 			
-			gettimeofday(&(ts0), (void*)0);
-			usec = (ts0.tv_sec - ts.tv_sec) * 1000000 + ts0.tv_usec - ts.tv_usec;
-			if (usec < 0)
-				usec = 0;
-			printf("SendData  %d@%s seq=%d ttl=%d time=%.3f ms\n", 
-			    pc->mscb.dport, argv[1], i, pc->mscb.rttl, usec / 1000.0);
-			
 			/* close */
 			if (k != 2)
 				delay_ms(traveltime);
@@ -742,9 +765,14 @@ int show_ipv6(int argc, char **argv)
 		printf("MAC               : ");
 		PRINT_MAC(vpc[id].ip4.mac);
 		printf("\n");
-		printf("LPORT             : %d\n", vpc[id].lport);
-		in.s_addr = vpc[id].rhost;
-		printf("RHOST:PORT        : %s:%d\n", inet_ntoa(in), vpc[id].rport);
+		if (devtype == DEV_UNIX) {
+			printf("LSOCK             : %s\n", vpc[id].lsock);
+			printf("RSOCK             : %s\n", vpc[id].rsock);
+		} else {
+			printf("LPORT             : %d\n", vpc[id].lport);
+			in.s_addr = vpc[id].rhost;
+			printf("RHOST:PORT        : %s:%d\n", inet_ntoa(in), vpc[id].rport);
+		}
 		printf("MTU:              : ");
 		if (vpc[id].mtu)
 			printf("%d", vpc[id].mtu);
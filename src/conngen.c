@@ -0,0 +1,481 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "vpcs.h"
+#include "conngen.h"
+#include "tcpsock.h"
+#include "perf.h"
+#include "trace.h"
+#include "help.h"
+
+extern int pcid;
+extern int num_pths;
+
+extern const char *vinet_ntop6(int af, const void *src, char *dst, 
+    socklen_t cnt);
+
+/* the generators of every vpc, only the command line changes them */
+static struct conngen *gens[MAX_NUM_PTHS];
+
+static int cg_args(int argc, char **argv, struct conngen *cg, 
+    int *lo, int *hi);
+static int cg_vpcs(const char *arg, struct conngen *cg);
+static int cg_start(struct conngen *cg, char *host, int lo, int hi);
+static int cg_stop(void);
+static int cg_show(int reset);
+static void *cg_main(void *arg);
+static int cg_open(struct conngen *cg);
+static void cg_reap(struct conngen *cg, struct cgconn *e);
+static void cg_close(struct conngen *cg);
+static void cg_free(struct conngen *cg);
+
+/*
+ * conngen HOST [-p port] [-r rate] [-c count] [-t seconds] [-w ms] 
+ *     [-s port-port] [-v vpcs] [-h]
+ * conngen stop
+ * conngen show [reset]
+ */
+int run_conngen(int argc, char **argv)
+{
+	struct conngen *cg;
+	char *host = NULL;
+	int i, lo = 0, hi = 0;
+
+	if (argc < 2 || (argc == 2 && (!strcmp(argv[1], "?") || 
+	    !strcmp(argv[1], "help"))))
+		return help_conngen(argc, argv);
+
+	if (!strncmp(argv[1], "show", strlen(argv[1])))
+		return cg_show(argc > 2 && 
+		    !strncmp(argv[2], "reset", strlen(argv[2])));
+	if (!strncmp(argv[1], "stop", strlen(argv[1])))
+		return cg_stop();
+
+	if (gens[pcid] != NULL && !gens[pcid]->done) {
+		printf("The generator is running, stop it first\n");
+		return 0;
+	}
+
+	cg = calloc(1, sizeof(struct conngen));
+	if (cg == NULL) {
+		printf("out of memory\n");
+		return 0;
+	}
+	cg->port = CONNGEN_PORT;
+	cg->rate = CONNGEN_RATE;
+	cg->hold = CONNGEN_HOLD;
+
+	for (i = 1; i < argc; i++) {
+		if (argv[i][0] == '-')
+			break;
+		if (host != NULL) {
+			free(cg);
+			return help_conngen(argc, argv);
+		}
+		host = argv[i];
+	}
+	if (host == NULL || !cg_args(argc - i, argv + i, cg, &lo, &hi)) {
+		free(cg);
+		return (host == NULL) ? help_conngen(argc, argv) : 0;
+	}
+	if (cg->nsrc == 0) {
+		cg->src[0].id = pcid;
+		cg->nsrc = 1;
+	}
+
+	return cg_start(cg, host, lo, hi);
+}
+
+static int cg_args(int argc, char **argv, struct conngen *cg, 
+    int *lo, int *hi)
+{
+	int i;
+
+	for (i = 0; i < argc; i++) {
+		if (argv[i][0] != '-' || argv[i][1] == '\0' || 
+		    (argv[i][1] != 'h' && i + 1 >= argc)) {
+			printf("Invalid options\n");
+			return 0;
+		}
+		switch (argv[i][1]) {
+			case 'p':
+				cg->port = atoi(argv[++i]);
+				if (cg->port < 1 || cg->port > 65535) {
+					printf("Invalid port\n");
+					return 0;
+				}
+				break;
+			case 'r':
+				cg->rate = atoi(argv[++i]);
+				if (cg->rate < 1 || cg->rate > CONNGEN_MAXRATE) {
+					printf("Rate range 1 to %d\n", 
+					    CONNGEN_MAXRATE);
+					return 0;
+				}
+				break;
+			case 'c':
+				cg->count = strtoul(argv[++i], NULL, 10);
+				break;
+			case 't':
+				cg->sec = atoi(argv[++i]);
+				if (cg->sec < 0) {
+					printf("Invalid time\n");
+					return 0;
+				}
+				break;
+			case 'w':
+				cg->hold = atoi(argv[++i]);
+				if (cg->hold < 1) {
+					printf("Invalid hold time\n");
+					return 0;
+				}
+				break;
+			case 's':
+				if (sscanf(argv[++i], "%d-%d", lo, hi) != 2 || 
+				    *lo < 1 || *hi > 65535 || *hi < *lo) {
+					printf("Invalid port range\n");
+					return 0;
+				}
+				break;
+			case 'v':
+				if (!cg_vpcs(argv[++i], cg))
+					return 0;
+				break;
+			case 'h':
+				cg->halfopen = 1;
+				break;
+			default:
+				printf("Invalid options\n");
+				return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* the vpcs of the SYNs, as 1,3,5-8 */
+static int cg_vpcs(const char *arg, struct conngen *cg)
+{
+	int a, b, n;
+
+	cg->nsrc = 0;
+	while (*arg != '\0') {
+		if (sscanf(arg, "%d-%d%n", &a, &b, &n) == 2)
+			;
+		else if (sscanf(arg, "%d%n", &a, &n) == 1)
+			b = a;
+		else
+			n = 0;
+		if (n == 0 || a < 1 || b > num_pths || b < a ||
+		    (arg[n] != ',' && arg[n] != '\0')) {
+			printf("Invalid VPC list, VPC range 1 to %d\n", 
+			    num_pths);
+			return 0;
+		}
+		for (; a <= b && cg->nsrc < MAX_NUM_PTHS; a++)
+			cg->src[cg->nsrc++].id = a - 1;
+		arg += n + (arg[n] == ',');
+	}
+
+	return 1;
+}
+
+/* 
+ * find the way to host from every source and take their ports, the 
+ * name is resolved once
+ */
+static int cg_start(struct conngen *cg, char *host, int lo, int hi)
+{
+	struct cgsrc *s;
+	char addr[INET6_ADDRSTRLEN + 1];
+	struct in_addr in;
+	int i, ipv;
+
+	if (lo == 0) {
+		lo = 32768 + random() % (32768 - CONNGEN_NPORTS);
+		hi = lo + CONNGEN_NPORTS - 1;
+	}
+	for (i = 0; i < cg->nsrc; i++) {
+		s = &cg->src[i];
+		s->pc = &vpc[s->id];
+		s->pc->mscb.mtu = s->pc->mtu;
+		s->pc->mscb.ttl = TTL;
+		s->pc->mscb.proto = IPPROTO_TCP;
+		if (!perf_route(s->pc, host, &ipv)) {
+			printf("VPC%d cannot reach %s\n", s->id + 1, host);
+			break;
+		}
+		if (i > 0 && ipv != cg->ipv) {
+			printf("VPC%d reaches %s otherwise\n", s->id + 1, host);
+			break;
+		}
+		s->to = s->pc->mscb;
+		s->to.dport = cg->port;
+		if (i == 0) {
+			cg->ipv = ipv;
+			if (ipv == IPV6_VERSION)
+				vinet_ntop6(AF_INET6, &s->to.dip6, addr, 
+				    sizeof(addr));
+			else {
+				in.s_addr = s->to.dip;
+				strcpy(addr, inet_ntoa(in));
+			}
+			snprintf(cg->host, sizeof(cg->host), "%s", addr);
+			host = cg->host;
+		}
+		s->lsn = tcp_bind(s->pc, lo, hi - lo + 1);
+		if (s->lsn == NULL) {
+			printf("VPC%d cannot take ports %d-%d\n", s->id + 1, 
+			    lo, hi);
+			break;
+		}
+		s->lsn->halfopen = cg->halfopen;
+	}
+
+	/* the SYNs of a hold time */
+	if (i == cg->nsrc) {
+		cg->size = (u_int64_t)cg->rate * cg->hold / 1000 + 
+		    cg->rate + 1;
+		if (cg->size > CONNGEN_MAXOPEN)
+			cg->size = CONNGEN_MAXOPEN;
+		cg->ring = calloc(cg->size, sizeof(struct cgconn));
+		if (cg->ring == NULL)
+			printf("out of memory\n");
+	}
+	if (cg->ring == NULL || 
+	    pthread_create(&cg->tid, NULL, cg_main, cg) != 0) {
+		while (--i >= 0)
+			tcp_unlisten(cg->src[i].lsn);
+		free(cg->ring);
+		free(cg);
+		return 0;
+	}
+
+	/* the last one is done */
+	if (gens[pcid] != NULL) {
+		pthread_join(gens[pcid]->tid, NULL);
+		cg_free(gens[pcid]);
+	}
+	gens[pcid] = cg;
+	printf("Opening %d connections/s to %s port %d from ports %d-%d\n", 
+	    cg->rate, cg->host, cg->port, lo, hi);
+
+	return 1;
+}
+
+static int cg_stop(void)
+{
+	struct conngen *cg = gens[pcid];
+
+	if (cg == NULL) {
+		printf("No generator\n");
+		return 1;
+	}
+	cg->stop = 1;
+	pthread_join(cg->tid, NULL);
+	cg_show(0);
+	cg_free(cg);
+	gens[pcid] = NULL;
+
+	return 1;
+}
+
+/* the counters go on while read, a connection may be missed */
+static int cg_show(int reset)
+{
+	struct conngen *cg = gens[pcid];
+	struct cgstats *st;
+	struct trchist *h;
+	u_int64_t end;
+	int i;
+
+	if (cg == NULL) {
+		printf("No generator\n");
+		return 1;
+	}
+	st = &cg->st;
+	h = &st->lat;
+	end = cg->done ? cg->end : trace_now();
+
+	printf("%s port %d from VPC", cg->host, cg->port);
+	for (i = 0; i < cg->nsrc; i++)
+		printf("%s%d", i ? "," : "", cg->src[i].id + 1);
+	printf(", %d/s%s, %s %.1fs\n", cg->rate, 
+	    cg->halfopen ? " half-open" : "", 
+	    cg->done ? "done in" : "running", 
+	    (end - cg->start) / 1000000000.0);
+	printf("  sent  established  refused  timeouts  resets  no-port  "
+	    "held\n");
+	printf("%6lu %12lu %8lu %9lu %7lu %8lu %5d\n", st->sent, st->estab,
+	    st->refused, st->timeouts, st->resets, st->noport, cg->nopen);
+	if (h->count > 0) {
+		printf("  SYN to SYN|ACK avg %.1fus, p50 <%luus, p90 <%luus, "
+		    "p99 <%luus, max %.1fus\n", h->sum / 1000.0 / h->count,
+		    trace_histpct(h, 50), trace_histpct(h, 90), 
+		    trace_histpct(h, 99), h->max / 1000.0);
+	}
+	if (reset)
+		memset(st, 0, sizeof(struct cgstats));
+
+	return 1;
+}
+
+/*
+ * Send the SYNs as they are due every tick, from the sources in turn,
+ * and reap the connections of the hold time gone, the oldest first.
+ */
+static void *cg_main(void *arg)
+{
+	struct conngen *cg = arg;
+	u_int64_t now, due;
+	u_int64_t hold = cg->hold * 1000000ULL;
+	int i, tick, sending = 1;
+
+	cg->start = trace_now();
+	for (tick = 0; !cg->stop; tick++) {
+		now = trace_now();
+		if (sending) {
+			due = (now - cg->start) / 1000 * cg->rate / 1000000 + 1;
+			if (cg->count > 0 && due > cg->count)
+				due = cg->count;
+			while (cg->st.sent + cg->st.noport < due && 
+			    cg->nopen < cg->size && cg_open(cg))
+				;
+			if ((cg->sec > 0 && 
+			    now - cg->start >= cg->sec * 1000000000ULL) || 
+			    (cg->count > 0 && 
+			    cg->st.sent + cg->st.noport >= cg->count))
+				sending = 0;
+		}
+
+		while (cg->nopen > 0 && cg->ring[cg->head].t0 + hold <= now) {
+			cg_reap(cg, &cg->ring[cg->head]);
+			cg->head = (cg->head + 1) % cg->size;
+			cg->nopen--;
+		}
+		if (!sending && cg->nopen == 0)
+			break;
+
+		if (tick % CONNGEN_POLL == 0) {
+			for (i = 0; i < cg->nsrc; i++)
+				tcp_poll(cg->src[i].lsn, 0);
+		}
+		delay_ms(CONNGEN_TICK);
+	}
+	cg->end = trace_now();
+
+	cg_close(cg);
+	cg->done = 1;
+
+	return NULL;
+}
+
+/* return 0 if the queues of the source are full, try again later */
+static int cg_open(struct conngen *cg)
+{
+	struct cgsrc *s = &cg->src[cg->cur];
+	struct cgconn *e;
+	u_int64_t t0;
+
+	if (s->pc->bgoq.size + s->pc->oq.size >= TCPSO_OQMAX)
+		return 0;
+	cg->cur = (cg->cur + 1) % cg->nsrc;
+
+	e = &cg->ring[(cg->head + cg->nopen) % cg->size];
+	t0 = trace_now();
+	e->c = tcp_connect(s->lsn, cg->ipv, &s->to);
+	if (e->c == NULL) {
+		cg->st.noport++;
+		return 1;
+	}
+	e->t0 = t0;
+	cg->nopen++;
+	cg->st.sent++;
+
+	return 1;
+}
+
+/* the hold time is gone, count what it came to and close it */
+static void cg_reap(struct conngen *cg, struct cgconn *e)
+{
+	int k;
+
+	/* synack is set before tcp_sent takes the lock */
+	k = tcp_sent(e->c);
+	if (e->c->synack != 0) {
+		trace_histadd(&cg->st.lat, e->c->synack - e->t0);
+		cg->st.estab++;
+		if (k < 0)
+			cg->st.resets++;
+	} else if (k < 0)
+		cg->st.refused++;
+	else
+		cg->st.timeouts++;
+
+	tcp_release(e->c);
+}
+
+/* 
+ * the ones held when stopped are not counted, FIN to the established
+ * ones and a while for their peers, the rest is reset
+ */
+static void cg_close(struct conngen *cg)
+{
+	u_int64_t end;
+	int i, n;
+
+	for (; cg->nopen > 0; cg->nopen--) {
+		tcp_release(cg->ring[cg->head].c);
+		cg->head = (cg->head + 1) % cg->size;
+	}
+
+	end = trace_now() + CONNGEN_LINGER * 1000000ULL;
+	do {
+		for (i = n = 0; i < cg->nsrc; i++) {
+			tcp_poll(cg->src[i].lsn, 0);
+			n += tcp_conns(cg->src[i].lsn);
+		}
+		delay_ms(CONNGEN_TICK * CONNGEN_POLL);
+	} while (n > 0 && trace_now() < end);
+
+	for (i = 0; i < cg->nsrc; i++)
+		tcp_unlisten(cg->src[i].lsn);
+}
+
+/* call once the thread is joined */
+static void cg_free(struct conngen *cg)
+{
+	free(cg->ring);
+	free(cg);
+}
+
+/* end of file */
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef _CONNGEN_H_
+#define _CONNGEN_H_
+
+#include "vpcs.h"
+#include "trace.h"
+#include "tcpsock.h"
+
+#define CONNGEN_PORT	80
+#define CONNGEN_RATE	100		/* connections per second */
+#define CONNGEN_MAXRATE	100000
+#define CONNGEN_HOLD	1000		/* ms, a connection is held */
+#define CONNGEN_NPORTS	8192		/* of a source, by default */
+#define CONNGEN_MAXOPEN	(1 << 20)	/* held at once */
+#define CONNGEN_TICK	1		/* ms, SYNs are sent every tick */
+#define CONNGEN_POLL	10		/* ticks, the timers of the connections */
+#define CONNGEN_LINGER	2000		/* ms, for the connections to close */
+
+/* a vpc the connections are opened from */
+struct cgsrc {
+	pcs *pc;
+	int id;				/* of the vpc */
+	sesscb to;			/* the addresses, see tcp_connect */
+	struct tcplistener *lsn;
+};
+
+/* a connection held, they are reaped in the order opened */
+struct cgconn {
+	struct tcpconn *c;
+	u_int64_t t0;			/* ns, the first SYN */
+};
+
+struct cgstats {
+	u_long sent;			/* SYNs, the retransmitted not counted */
+	u_long estab;			/* SYN|ACK taken */
+	u_long refused;			/* RST to SYN */
+	u_long timeouts;		/* nothing to SYN in the hold time */
+	u_long resets;			/* RST once established */
+	u_long noport;			/* not sent, all the ports held */
+	struct trchist lat;		/* SYN to SYN|ACK */
+};
+
+/* the generator of a vpc, run by its own thread */
+struct conngen {
+	char host[64];
+	int port;
+	int ipv;
+	int rate;
+	u_long count;			/* 0 no limit */
+	int sec;			/* 0 till stopped */
+	int hold;			/* ms */
+	int halfopen;
+	struct cgsrc src[MAX_NUM_PTHS];
+	int nsrc;
+	int cur;			/* the source of the next SYN */
+	struct cgconn *ring;		/* held, the oldest at head */
+	int size;
+	int head;
+	int nopen;
+	u_int64_t start;		/* ns */
+	u_int64_t end;			/* ns, done at */
+	volatile int stop;
+	volatile int done;
+	pthread_t tid;
+	struct cgstats st;
+};
+
+int run_conngen(int argc, char **argv);
+
+#endif
+
+/* end of file */
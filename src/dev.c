@@ -30,9 +30,13 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <pthread.h>
+#include <time.h>
 
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
@@ -40,17 +44,84 @@
 
 #ifdef Linux
 #ifdef TAP
+#include <sys/uio.h>
 #include <linux/if_tun.h>
+#include <linux/virtio_net.h>
 #endif
 #endif
 
 #include "globle.h"
 #include "dev.h"
+#include "shm.h"
+#include "afpacket.h"
+#include "ip.h"
+
+#if defined(Linux) && defined(TAP) && defined(IFF_VNET_HDR)
+#define VNET
+#endif
 
 extern int devtype;
+extern int num_pths;
+
+int memtopo = MEM_PAIR;
+int unixtype = UNIX_DGRAM;
+char *pktif = NULL;
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* 
+ * DEV_MEM: each vpc owns a ring, VWrite copies the frame into the 
+ * ring of the receiver, VRead takes it out. No socket, no port, the
+ * traffic never leaves the process.
+ */
+struct memring {
+	pthread_mutex_t locker;
+	pthread_cond_t cond;
+	u_int head;
+	u_int tail;
+	int len[MEMRING_SIZE];
+	u_char data[MEMRING_SIZE][PKT_MAXSIZE];
+};
+
+static struct memring *memring[MAX_NUM_PTHS];
+
+static int mem_read(int id, void *buf, int len);
+static void mem_put(int id, void *buf, int len);
+static int mem_write(int id, void *buf, int len);
+static void unix_addr(struct sockaddr_un *addr, const char *path);
+static int unix_inuse(const struct sockaddr_un *addr);
+static int unix_read(pcs *pc, void *buf, int len);
+static int unix_write(pcs *pc, void *buf, int len);
+
+int tapvnet = 0;
+int tapqueues = 1;
+
+#ifdef VNET
+/*
+ * tap offload: every frame carries a virtio_net_hdr. The host may 
+ * hand us a TCP super-frame up to 64KB, cut into gso_size segments 
+ * here, one per VRead, and frames whose checksum it left partial.
+ */
+struct vnet {
+	struct virtio_net_hdr hdr;
+	int len;			/* super-frame */
+	int hlen;			/* ether, ip and tcp headers */
+	int off;			/* next segment in the payload */
+	int seg;
+	u_char data[VNET_BUFSIZE];
+};
+
+static struct vnet *vnet[MAX_NUM_PTHS][TAP_MAXQ];
+
+static int vnet_read(pcs *pc, int q, void *buf, int len);
+static int vnet_write(pcs *pc, int q, void *buf, int len);
+static int vnet_segment(struct vnet *v, u_char *buf, int len);
+static void vnet_csum(struct vnet *v);
+#endif
 
 #ifdef TAP
-extern int num_pths;
 extern char *tapname;
 #endif
 
@@ -61,7 +132,27 @@ int VRead(pcs *pc, void *buf, int len)
 	int n = 0;
 	fd_set readSet;
 	struct timeval timeout = {1, 0};
+	struct shmdev *sd = pc->shm;
 	
+	if (sd != NULL) {
+		/* set_shm waits for us before unmapping it */
+		__sync_fetch_and_add(&pc->shmusers, 1);
+		sd = pc->shm;
+		if (sd != NULL)
+			n = shm_read(sd, buf, len);
+		__sync_fetch_and_sub(&pc->shmusers, 1);
+		if (sd != NULL)
+			return n;
+	}
+	if (devtype == DEV_MEM)
+		return mem_read(pc->id, buf, len);
+	if (devtype == DEV_UNIX && unixtype == UNIX_SEQPACKET)
+		return unix_read(pc, buf, len);
+	if (devtype == DEV_PACKET)
+		return packet_read(pc->id, buf, len);
+	if (devtype == DEV_TAP)
+		return tap_read(pc, 0, buf, len);
+
 	FD_ZERO(&readSet);
 	FD_SET(pc->fd, &readSet);
 	
@@ -69,13 +160,13 @@ int VRead(pcs *pc, void *buf, int len)
 		return 0;
 		
 	switch (devtype) {
-		case DEV_TAP:
-			n = read(pc->fd, buf, len);
-			break;
 		case DEV_UDP:
 			size = sizeof(addr);
 			n = recvfrom(pc->fd, buf, len, 0, (struct sockaddr *)&addr, &size);
 			break;
+		case DEV_UNIX:
+			n = recv(pc->fd, buf, len, 0);
+			break;
 	}
 	return n;
 }
@@ -86,7 +177,27 @@ int VWrite(pcs *pc, void *buf, int len)
 	int n = 0;
 	fd_set writeSet;
 	struct timeval timeout = {1, 0};
+	struct shmdev *sd = pc->shm;
 	
+	if (sd != NULL) {
+		/* set_shm waits for us before unmapping it */
+		__sync_fetch_and_add(&pc->shmusers, 1);
+		sd = pc->shm;
+		if (sd != NULL)
+			n = shm_write(sd, buf, len);
+		__sync_fetch_and_sub(&pc->shmusers, 1);
+		if (sd != NULL)
+			return n;
+	}
+	if (devtype == DEV_MEM)
+		return mem_write(pc->id, buf, len);
+	if (devtype == DEV_UNIX)
+		return unix_write(pc, buf, len);
+	if (devtype == DEV_PACKET)
+		return packet_write(pc->id, buf, len);
+	if (devtype == DEV_TAP)
+		return tap_write(pc, 0, buf, len);
+
 	FD_ZERO(&writeSet);
 	FD_SET(pc->fd, &writeSet);
 	
@@ -95,9 +206,6 @@ int VWrite(pcs *pc, void *buf, int len)
 		
 		
 	switch (devtype) {
-		case DEV_TAP:
-			n = write(pc->fd, buf, len);
-			break;
 		case DEV_UDP:
 			bzero(&addr, sizeof(addr));
 			addr.sin_family = AF_INET;
@@ -112,18 +220,114 @@ int VWrite(pcs *pc, void *buf, int len)
 }
 
 
+/* 
+ * the reader and the writer of the vpc serve the queue 0 of the tap
+ * through VRead and VWrite, the other queues have their own threads
+ */
+int tap_read(pcs *pc, int q, void *buf, int len)
+{
+	int fd = pc->tapfd[q];
+	fd_set readSet;
+	struct timeval timeout = {1, 0};
+
+#ifdef VNET
+	if (tapvnet)
+		return vnet_read(pc, q, buf, len);
+#endif
+	FD_ZERO(&readSet);
+	FD_SET(fd, &readSet);
+	
+	if (select(fd + 1, &readSet, NULL, NULL, &timeout) <= 0)
+		return 0;
+
+	return read(fd, buf, len);
+}
+
+int tap_write(pcs *pc, int q, void *buf, int len)
+{
+	int fd = pc->tapfd[q];
+	fd_set writeSet;
+	struct timeval timeout = {1, 0};
+
+	FD_ZERO(&writeSet);
+	FD_SET(fd, &writeSet);
+	
+	if (select(fd + 1, NULL, &writeSet, NULL, &timeout) <= 0)
+		return 0;
+#ifdef VNET
+	if (tapvnet)
+		return vnet_write(pc, q, buf, len);
+#endif
+	return write(fd, buf, len);
+}
+
+/* 
+ * pick the tap queue of a frame from its addresses, protocol and 
+ * ports, the hash is the same both ways. The fragments of a datagram 
+ * only carry the addresses, they all hash the same way as well.
+ */
+int tap_txq(void *buf, int len, int nq)
+{
+	ethdr *eh = (ethdr *)buf;
+	iphdr *ip;
+	ip6hdr *ip6;
+	u_short *ports = NULL;
+	u_int h;
+	int i, hl;
+
+	if (eh->type == htons(ETHERTYPE_IP) &&
+	    len >= (int)(sizeof(ethdr) + sizeof(iphdr))) {
+		ip = (iphdr *)(eh + 1);
+		hl = ip->ihl * 4;
+		h = ip->sip ^ ip->dip ^ ip->proto;
+		if ((ntohs(ip->frag) & (IP_MF | IP_OFFMASK)) == 0 &&
+		    (ip->proto == IPPROTO_TCP || ip->proto == IPPROTO_UDP) &&
+		    (int)sizeof(ethdr) + hl + 4 <= len)
+			ports = (u_short *)((u_char *)ip + hl);
+	} else if (eh->type == htons(ETHERTYPE_IPV6) &&
+	    len >= (int)(sizeof(ethdr) + sizeof(ip6hdr))) {
+		ip6 = (ip6hdr *)(eh + 1);
+		h = ip6->ip6_nxt;
+		for (i = 0; i < 4; i++)
+			h ^= ip6->src.addr32[i] ^ ip6->dst.addr32[i];
+		if ((ip6->ip6_nxt == IPPROTO_TCP || 
+		    ip6->ip6_nxt == IPPROTO_UDP) &&
+		    (int)(sizeof(ethdr) + sizeof(ip6hdr)) + 4 <= len)
+			ports = (u_short *)(ip6 + 1);
+	} else
+		return 0;
+
+	if (ports != NULL)
+		h ^= ports[0] ^ ports[1];
+	h ^= h >> 16;
+	h ^= h >> 8;
+
+	return h % nq;
+}
+
 int open_dev(int id)
 {
 	int fd = 0;
+#ifdef TAP
+	int q, err;
+#endif
 
 	switch(devtype) {
 #ifdef TAP
 		case DEV_TAP:
-			fd = open_tap(id);
-			if (fd <= 0) {
-				fd = 0;
+			for (q = 0; q < tapqueues; q++) {
+				vpc[id].tapfd[q] = open_tap(id, q);
+				if (vpc[id].tapfd[q] > 0)
+					continue;
+				err = errno;
+				while (--q >= 0) {
+					close(vpc[id].tapfd[q]);
+					vpc[id].tapfd[q] = 0;
+				}
+				errno = err;
 				return 0;
 			}
+			fd = vpc[id].tapfd[0];
 			break;
 #endif			
 		case DEV_UDP:
@@ -133,11 +337,31 @@ int open_dev(int id)
 				return 0;
 			}
 			break;
+		case DEV_MEM:
+			fd = open_mem(id);
+			break;
+		case DEV_UNIX:
+			fd = open_unix(vpc[id].lsock);
+			if (fd <= 0) {
+				fd = 0;
+				return 0;
+			}
+			break;
+		case DEV_PACKET:
+			fd = open_packet(id, pktif);
+			break;
 	}
 		
 	return fd;
 }
 
+/* push out the frames VWrite may have batched */
+void VFlush(pcs *pc)
+{
+	if (devtype == DEV_PACKET && pc->shm == NULL)
+		packet_flush(pc->id);
+}
+
 int open_udp(int port)
 {
 	int s;
@@ -160,8 +384,286 @@ int open_udp(int port)
 	return s;
 }
 
+/* 
+ * there is no descriptor behind a ring, return a positive handle 
+ * so that the callers keep treating 0 as an error.
+ */
+int open_mem(int id)
+{
+	struct memring *r;
+
+	if (memring[id] != NULL)
+		return id + 1;
+
+	r = (struct memring *)malloc(sizeof(struct memring));
+	if (r == NULL)
+		return 0;
+	memset(r, 0, sizeof(struct memring));
+	pthread_mutex_init(&r->locker, NULL);
+	pthread_cond_init(&r->cond, NULL);
+	memring[id] = r;
+
+	return id + 1;
+}
+
+/* the other end of the cable in the pair mode, -1 if nobody */
+int mem_peer(int id)
+{
+	int peer = id ^ 1;
+
+	if (memtopo != MEM_PAIR || peer >= num_pths)
+		return -1;
+	return peer;
+}
+
+/* wait up to one second like the select in VRead */
+static int 
+mem_read(int id, void *buf, int len)
+{
+	struct memring *r = memring[id];
+	struct timespec ts;
+	int n;
+
+	pthread_mutex_lock(&r->locker);
+	if (r->head == r->tail) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec++;
+		pthread_cond_timedwait(&r->cond, &r->locker, &ts);
+	}
+	if (r->head == r->tail) {
+		pthread_mutex_unlock(&r->locker);
+		return 0;
+	}
+	n = r->len[r->head % MEMRING_SIZE];
+	if (n > len)
+		n = len;
+	memcpy(buf, r->data[r->head % MEMRING_SIZE], n);
+	r->head++;
+	pthread_mutex_unlock(&r->locker);
+
+	return n;
+}
+
+/* a full ring drops the frame, as a switch port would */
+static void 
+mem_put(int id, void *buf, int len)
+{
+	struct memring *r = memring[id];
+
+	if (r == NULL)
+		return;
+
+	pthread_mutex_lock(&r->locker);
+	if (r->tail - r->head >= MEMRING_SIZE) {
+		pthread_mutex_unlock(&r->locker);
+		return;
+	}
+	memcpy(r->data[r->tail % MEMRING_SIZE], buf, len);
+	r->len[r->tail % MEMRING_SIZE] = len;
+	r->tail++;
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->locker);
+}
+
+/* 
+ * pair: vpc1-vpc2, vpc3-vpc4 ... are wired back to back.
+ * switch: unicast goes to the owner of the destination mac, broadcast
+ * and multicast are flooded, frames to unknown hosts are lost.
+ */
+static int 
+mem_write(int id, void *buf, int len)
+{
+	u_char *dmac = (u_char *)buf;
+	int i;
+
+	if (len > PKT_MAXSIZE)
+		return 0;
+
+	if (memtopo == MEM_PAIR) {
+		i = mem_peer(id);
+		if (i != -1)
+			mem_put(i, buf, len);
+		return len;
+	}
+
+	for (i = 0; i < num_pths; i++) {
+		if (i == id)
+			continue;
+		if ((dmac[0] & 0x01) || 
+		    !memcmp(dmac, vpc[i].ip4.mac, ETH_ALEN)) 
+			mem_put(i, buf, len);
+	}
+	return len;
+}
+
+/* 
+ * DEV_UNIX: the datagram socket is bound to lsock and sends to rsock.
+ * The seqpacket socket listens on lsock for the peer to connect, and 
+ * a second one is connected to the rsock of the peer on the first
+ * frame sent, so both ends may be started in any order.
+ */
+int open_unix(const char *path)
+{
+	struct sockaddr_un addr;
+	int s;
+
+	s = socket(AF_UNIX, 
+	    (unixtype == UNIX_SEQPACKET) ? SOCK_SEQPACKET : SOCK_DGRAM, 0);
+	if (s == -1)
+		return 0;
+
+	unix_addr(&addr, path);
+	if (unix_inuse(&addr)) {
+		close(s);
+		errno = EADDRINUSE;
+		return 0;
+	}
+	
+	if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+	    (unixtype == UNIX_SEQPACKET && listen(s, 1) == -1)) {
+		close(s);
+		return 0;
+	}
+	return s;
+}
+
+static void 
+unix_addr(struct sockaddr_un *addr, const char *path)
+{
+	memset(addr, 0, sizeof(struct sockaddr_un));
+	addr->sun_family = AF_UNIX;
+	strncpy(addr->sun_path, path, sizeof(addr->sun_path) - 1);
+}
+
+/* 
+ * knock on the socket before taking it over, only the one left by a 
+ * previous run (nobody bound, ECONNREFUSED) is removed. The probe is a 
+ * datagram, a listener of the seqpacket mode answers EPROTOTYPE instead
+ * of accepting it and dropping its peer.
+ */
+static int 
+unix_inuse(const struct sockaddr_un *addr)
+{
+	struct stat st;
+	int s, rc;
+
+	if (lstat(addr->sun_path, &st) == -1 || !S_ISSOCK(st.st_mode))
+		return 0;
+
+	s = socket(AF_UNIX, SOCK_DGRAM, 0);
+	if (s == -1)
+		return 0;
+	rc = connect(s, (struct sockaddr *)addr, sizeof(struct sockaddr_un));
+	if (rc == -1)
+		rc = errno;
+	close(s);
+
+	if (rc == ECONNREFUSED) {
+		unlink(addr->sun_path);
+		return 0;
+	}
+	return (rc == 0 || rc == EPROTOTYPE);
+}
+
+/* a new peer replaces the old one */
+static int 
+unix_read(pcs *pc, void *buf, int len)
+{
+	fd_set readSet;
+	struct timeval timeout = {1, 0};
+	int n, maxfd;
+
+	FD_ZERO(&readSet);
+	FD_SET(pc->fd, &readSet);
+	maxfd = pc->fd;
+	if (pc->rfd > 0) {
+		FD_SET(pc->rfd, &readSet);
+		if (pc->rfd > maxfd)
+			maxfd = pc->rfd;
+	}
+	
+	if (select(maxfd + 1, &readSet, NULL, NULL, &timeout) <= 0)
+		return 0;
+
+	if (FD_ISSET(pc->fd, &readSet)) {
+		n = accept(pc->fd, NULL, NULL);
+		if (n > 0) {
+			if (pc->rfd > 0)
+				close(pc->rfd);
+			pc->rfd = n;
+		}
+		return 0;
+	}
+
+	n = recv(pc->rfd, buf, len, 0);
+	if (n <= 0) {
+		close(pc->rfd);
+		pc->rfd = 0;
+		return 0;
+	}
+	return n;
+}
+
+/* 
+ * the frame is lost on the wire if nobody listens on rsock or the 
+ * peer can not keep up, as it would be in the udp mode
+ */
+static int 
+unix_write(pcs *pc, void *buf, int len)
+{
+	struct sockaddr_un addr;
+	int n;
+
+	unix_addr(&addr, pc->rsock);
+
+	if (unixtype == UNIX_DGRAM) {
+		n = sendto(pc->fd, buf, len, MSG_DONTWAIT, 
+		    (struct sockaddr *)&addr, sizeof(addr));
+		if (n < 0 && (errno == ENOENT || errno == ECONNREFUSED ||
+		    errno == EAGAIN || errno == ENOBUFS))
+			return len;
+		return n;
+	}
+
+	/* rsock was changed by the console */
+	if (pc->wreset) {
+		pc->wreset = 0;
+		if (pc->wfd > 0) {
+			close(pc->wfd);
+			pc->wfd = 0;
+		}
+	}
+
+	if (pc->wfd <= 0) {
+		pc->wfd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+		if (pc->wfd < 0) {
+			pc->wfd = 0;
+			return -1;
+		}
+		if (connect(pc->wfd, (struct sockaddr *)&addr, 
+		    sizeof(addr)) < 0) {
+			close(pc->wfd);
+			pc->wfd = 0;
+			return len;
+		}
+	}
+
+	/* the peer is gone, connect again on the next frame */
+	n = send(pc->wfd, buf, len, MSG_NOSIGNAL);
+	if (n < 0) {
+		close(pc->wfd);
+		pc->wfd = 0;
+		return len;
+	}
+	return n;
+}
+
 #ifdef TAP
-int open_tap(int id)
+/* 
+ * with more than one queue, each call attaches one more queue of
+ * the same device, the kernel spreads the flows of the host over them
+ */
+int open_tap(int id, int q)
 {
 	struct ifreq ifr;
 	int fd;
@@ -188,15 +690,200 @@ int open_tap(int id)
 	 *             TUNSLMODE | TUNSIFHEAD on the freebsd.
 	 */
 	ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+	if (tapqueues > 1) {
+#ifdef IFF_MULTI_QUEUE
+		ifr.ifr_flags |= IFF_MULTI_QUEUE;
+#else
+		close(fd);
+		errno = EOPNOTSUPP;
+		return(-1);
+#endif
+	}
+#ifdef VNET
+	if (tapvnet)
+		ifr.ifr_flags |= IFF_VNET_HDR;
+#endif
 	strncpy(ifr.ifr_name, dev, IFNAMESIZ);
 
 	if (ioctl(fd, TUNSETIFF, (void *) &ifr) < 0) {
 		close(fd);
 		return(-1);
 	}
+#ifdef VNET
+	/* 
+	 * TUN_F_CSUM lets the host skip the checksums of the frames to 
+	 * us, TUN_F_TSO* lets it send TCP super-frames
+	 */
+	if (tapvnet) {
+		if (ioctl(fd, TUNSETOFFLOAD, 
+		    TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6 | TUN_F_TSO_ECN) < 0 ||
+		    (vnet[id][q] == NULL && 
+		    (vnet[id][q] = malloc(sizeof(struct vnet))) == NULL)) {
+			close(fd);
+			return(-1);
+		}
+		memset(vnet[id][q], 0, sizeof(struct vnet));
+	}
+#endif
 	return(fd);
 }
 #endif
 
+#ifdef VNET
+static int 
+vnet_read(pcs *pc, int q, void *buf, int len)
+{
+	struct vnet *v = vnet[pc->id][q];
+	int fd = pc->tapfd[q];
+	struct iovec iov[2];
+	fd_set readSet;
+	struct timeval timeout = {1, 0};
+	int n;
+
+	if (v->off < v->len - v->hlen)
+		return vnet_segment(v, buf, len);
+
+	FD_ZERO(&readSet);
+	FD_SET(fd, &readSet);
+	
+	if (select(fd + 1, &readSet, NULL, NULL, &timeout) <= 0)
+		return 0;
+
+	iov[0].iov_base = &v->hdr;
+	iov[0].iov_len = sizeof(v->hdr);
+	iov[1].iov_base = v->data;
+	iov[1].iov_len = sizeof(v->data);
+	n = readv(fd, iov, 2);
+	if (n <= (int)sizeof(v->hdr))
+		return 0;
+	v->len = n - sizeof(v->hdr);
+	v->off = 0;
+	v->seg = 0;
+	v->hlen = v->len;
+
+	if ((v->hdr.gso_type & ~VIRTIO_NET_HDR_GSO_ECN) != 
+	    VIRTIO_NET_HDR_GSO_NONE && v->hdr.gso_size > 0)
+		return vnet_segment(v, buf, len);
+
+	if (v->hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM)
+		vnet_csum(v);
+	n = (v->len > len) ? len : v->len;
+	memcpy(buf, v->data, n);
+	return n;
+}
+
+/* no offload for the frames we build, the header is all zero */
+static int 
+vnet_write(pcs *pc, int q, void *buf, int len)
+{
+	struct virtio_net_hdr hdr;
+	struct iovec iov[2];
+	int n;
+
+	memset(&hdr, 0, sizeof(hdr));
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = buf;
+	iov[1].iov_len = len;
+
+	n = writev(pc->tapfd[q], iov, 2);
+	if (n > (int)sizeof(hdr))
+		n -= sizeof(hdr);
+	return n;
+}
+
+/* 
+ * the headers of the super-frame are copied in front of each segment,
+ * the length, the ip id and the sequence number are fixed up, FIN and
+ * PSH stay on the last segment, CWR on the first. The host vouched 
+ * for the payload, the TCP checksum is not computed.
+ */
+static int 
+vnet_segment(struct vnet *v, u_char *buf, int len)
+{
+	ethdr *eh = (ethdr *)v->data;
+	iphdr *ip;
+	ip6hdr *ip6;
+	tcphdr *th;
+	int l3, l4, plen, total;
+
+	l3 = sizeof(ethdr);
+	if (v->seg == 0) {
+		if (eh->type == htons(ETHERTYPE_IP)) {
+			ip = (iphdr *)(v->data + l3);
+			l4 = l3 + ip->ihl * 4;
+		} else if (eh->type == htons(ETHERTYPE_IPV6)) {
+			ip6 = (ip6hdr *)(v->data + l3);
+			if (ip6->ip6_nxt != IPPROTO_TCP)
+				goto bad;
+			l4 = l3 + sizeof(ip6hdr);
+		} else
+			goto bad;
+		th = (tcphdr *)(v->data + l4);
+		v->hlen = l4 + th->th_off * 4;
+		if (v->hlen >= v->len)
+			goto bad;
+	}
+
+	total = v->len - v->hlen;
+	plen = total - v->off;
+	if (plen > v->hdr.gso_size)
+		plen = v->hdr.gso_size;
+	if (v->hlen + plen > len)
+		goto bad;
+
+	memcpy(buf, v->data, v->hlen);
+	memcpy(buf + v->hlen, v->data + v->hlen + v->off, plen);
+
+	eh = (ethdr *)buf;
+	if (eh->type == htons(ETHERTYPE_IP)) {
+		ip = (iphdr *)(buf + l3);
+		l4 = l3 + ip->ihl * 4;
+		ip->len = htons(v->hlen - l3 + plen);
+		ip->id = htons(ntohs(ip->id) + v->seg);
+		ip->cksum = 0;
+		ip->cksum = cksum((u_short *)ip, ip->ihl * 4);
+	} else {
+		ip6 = (ip6hdr *)(buf + l3);
+		l4 = l3 + sizeof(ip6hdr);
+		ip6->ip6_plen = htons(v->hlen - l4 + plen);
+	}
+	th = (tcphdr *)(buf + l4);
+	th->th_seq = htonl(ntohl(th->th_seq) + v->off);
+	if (v->off + plen < total)
+		th->th_flags &= ~(TH_FIN | TH_PUSH);
+	if (v->seg > 0)
+		th->th_flags &= ~TH_CWR;
+
+	v->off += plen;
+	v->seg++;
+
+	return v->hlen + plen;
+
+bad:
+	/* give up the rest of the super-frame */
+	v->off = v->len - v->hlen;
+	return 0;
+}
+
+/* 
+ * the checksum field holds the sum of the pseudo header, finish it 
+ * the way the hardware would
+ */
+static void 
+vnet_csum(struct vnet *v)
+{
+	int start = v->hdr.csum_start;
+	u_short sum, *p;
+
+	if (start + v->hdr.csum_offset + 2 > v->len || (start & 1))
+		return;
+
+	p = (u_short *)(v->data + start + v->hdr.csum_offset);
+	sum = cksum((u_short *)(v->data + start), v->len - start);
+	*p = (sum == 0) ? 0xffff : sum;
+}
+#endif
+
 /* end of file */
 
@@ -29,11 +29,35 @@
 
 #include "vpcs.h"
 
+/* in-memory wiring of the vpcs in the process, see open_mem */
+#define MEM_PAIR	0
+#define MEM_SWITCH	1
+
+/* frames queued per vpc, power of 2 */
+#define MEMRING_SIZE	256
+
+/* a TCP super-frame of the tap offload */
+#define VNET_BUFSIZE	(65536 + 14)
+
+/* socket type of the unix mode */
+#define UNIX_DGRAM	0
+#define UNIX_SEQPACKET	1
+
+/* default socket paths of the unix mode, from the udp ports */
+#define UNIX_SOCKPATH	"/tmp/vpcs-%d.sock"
+
 int open_dev(int id);
 int open_udp(int port);
-int open_tap(int id);
+int open_tap(int id, int q);
+int open_mem(int id);
+int open_unix(const char *path);
+int mem_peer(int id);
 int VRead(pcs *pc, void *buf, int len);
 int VWrite(pcs *pc, void *buf, int len);
+void VFlush(pcs *pc);
+int tap_read(pcs *pc, int q, void *buf, int len);
+int tap_write(pcs *pc, int q, void *buf, int len);
+int tap_txq(void *buf, int len, int nq);
 
 #endif
 
@@ -40,7 +40,6 @@ extern int ctrl_c;
 
 static int fmtstring(const char *name, char *buf);
 static int dnsrequest(u_short id, const char *name, int type, char *data, int *namelen);
-static int dnsparse(struct packet *m, u_short id, char *data, int dlen, u_char *ip);
 static int ip2str(u_char *ip, char *str);
 static void appenddomain(pcs *pc, char *dname, int sdname, const char *name);
 static struct packet *dns4(pcs *pc, int sw, char *data, int dlen);
@@ -302,7 +301,7 @@ static int dnsrequest(u_short id, const char *name, int type, char *data, int *n
  * only search A record if exist, get IP address 
  * return 1 if host name was resolved.
  */
-static int dnsparse(struct packet *m, u_short magicid, char *data, int dlen, u_char *cip)
+int dnsparse(struct packet *m, u_short magicid, char *data, int dlen, u_char *cip)
 {
 	ethdr *eh;
 	iphdr *ip4;
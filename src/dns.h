@@ -54,6 +54,8 @@ typedef struct {
 
 int hostresolv(pcs *pc, char *name, char *ipstr);
 int dmp_dns_rname(char *s, char *se, char *name);
+int dnsparse(struct packet *m, u_short magicid, char *data, int dlen, 
+    u_char *cip);
 
 #endif
 /* end of file */
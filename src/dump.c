@@ -29,11 +29,17 @@
 #include <string.h>
 #include <ctype.h>
 #include <sys/time.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "ip.h"
+#include "vpcs.h"
 #include "dump.h"
 #include "dns.h"
 
+extern int num_pths;
+
 static void dmp_ip(void *dat);
 static void dmp_ip6(void *dat);
 static void dmp_arp(void *dat);
@@ -42,6 +48,44 @@ static char *dmp_dns_timestr(u_int s);
 
 static struct timeval gtv = {0, 0};
 
+/* the pcapng file shared by all the VPCs and the relay */
+static struct dmpfile *ngfile = NULL;
+static int ngrefs = 0;
+static pthread_mutex_t nglocker = PTHREAD_MUTEX_INITIALIZER;
+
+/* guards the pointers to the open files and their reference counts */
+static pthread_mutex_t dmpref_locker = PTHREAD_MUTEX_INITIALIZER;
+
+/* the rotation settings and the open files, see pth_dmprotate */
+static struct dmprotate dmprotate = {0, 0, 0};
+static struct dmpfile *dmpfiles = NULL;
+static pthread_t dmprotate_pid = 0;
+static pthread_mutex_t dmprotate_locker = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dmprotate_cond = PTHREAD_COND_INITIALIZER;
+
+/* the console formatter, see pth_dmpformat */
+static struct dmpring *dmprings[MAX_NUM_PTHS][2];
+static pthread_once_t dmpformat_once = PTHREAD_ONCE_INIT;
+static int dmprate = 0;
+
+static struct dmpfile *dmpfile_open(const char *prefix, const char *ext, 
+    int (*header)(FILE *));
+static FILE *dmpfile_new(struct dmpfile *df, char *name, int size, 
+    u_int64_t *bytes);
+static int dmpfile_write(struct dmpfile *df, const void *hdr, int hlen, 
+    const void *m, int len, const void *tail, int tlen);
+static void dmpfile_swap(struct dmpfile *df);
+static void dmpfile_purge(struct dmpfile *df, const char *name);
+static struct dmpfile *dmpfile_hold(struct dmpfile **dfp);
+static void dmpfile_release(struct dmpfile *df);
+static void *pth_dmprotate(void *dummy);
+static void dmpformat_start(void);
+static void *pth_dmpformat(void *dummy);
+static int pcap_header(FILE *fp);
+static int pcapng_header(FILE *fp);
+static int pcapng_opt(u_char *buf, u_short code, const void *val, u_short len);
+static int pcapng_idb(FILE *fp, const char *name, const u_char *mac);
+
 int dmp_packet(const struct packet *m, const int flag)
 {
 	struct timeval tv;
@@ -54,12 +98,12 @@ int dmp_packet(const struct packet *m, const int flag)
 	ethdr *eh = (ethdr *)m->data;
 	int cr = 0;
 
-	if (flag == 0)
+	if ((flag & (DMP_MAC | DMP_RAW | DMP_DETAIL)) == 0)
 		return flag;
 	if (gtv.tv_sec == 0)
-		gettimeofday(&gtv, 0);
+		gtv = m->ts;
 	
-	gettimeofday(&tv, 0);
+	tv = m->ts;
 	usec = (tv.tv_sec - gtv.tv_sec) * 1000000 + tv.tv_usec - gtv.tv_usec;
 	printf("\n\033[32m%04d.%d\033[0m", usec / 1000000, usec % 1000000);
 	if (flag & DMP_MAC) {
@@ -548,85 +592,684 @@ dmp_dns_timestr(u_int s)
 	return buf;
 }
 
-FILE *
+/*
+ * Copy the packet to the ring of the VPC, it will be printed by the 
+ * formatter thread. If the ring is full, the packet is dropped.
+ */
+int
+dmp_defer(int id, int dir, const struct packet *m, const int flag)
+{
+	struct dmpring *r;
+	struct packet *p;
+	u_int h;
+	int len;
+
+	if ((flag & (DMP_MAC | DMP_RAW | DMP_DETAIL)) == 0)
+		return 0;
+
+	pthread_once(&dmpformat_once, dmpformat_start);
+
+	dir = (dir == DMP_DIR_OUT) ? 1 : 0;
+	r = dmprings[id][dir];
+	if (r == NULL) {
+		/* only this thread writes the ring, allocate it by itself */
+		r = (struct dmpring *)malloc(sizeof(struct dmpring));
+		if (r == NULL)
+			return 0;
+		memset(r, 0, sizeof(struct dmpring));
+		__sync_synchronize();
+		dmprings[id][dir] = r;
+	}
+
+	h = r->head;
+	if (h - r->tail >= DMP_RINGSIZE) {
+		r->dropped++;
+		return 0;
+	}
+
+	len = (m->len > PKT_MAXSIZE) ? PKT_MAXSIZE : m->len;
+	p = (struct packet *)r->slot[h & (DMP_RINGSIZE - 1)];
+	p->next = NULL;
+	p->len = len;
+	gettimeofday(&(p->ts), (void*)0);
+	memcpy(p->data, m->data, len);
+	r->flag[h & (DMP_RINGSIZE - 1)] = flag;
+
+	/* the record must be visible before the head moves */
+	__sync_synchronize();
+	r->head = h + 1;
+
+	return 0;
+}
+
+/* the packets decoded per second, 0: no limit */
+void
+dmp_setrate(int rate)
+{
+	dmprate = rate;
+}
+
+int
+dmp_getrate(void)
+{
+	return dmprate;
+}
+
+void
+dmp_getdrops(int id, u_long *dropped, u_long *limited)
+{
+	int i;
+
+	*dropped = 0;
+	*limited = 0;
+	for (i = 0; i < 2; i++) {
+		if (dmprings[id][i]) {
+			*dropped += dmprings[id][i]->dropped;
+			*limited += dmprings[id][i]->limited;
+		}
+	}
+}
+
+static void
+dmpformat_start(void)
+{
+	pthread_t pid;
+
+	if (pthread_create(&pid, NULL, pth_dmpformat, NULL) != 0)
+		printf("Create packet formatter error\n");
+}
+
+/*
+ * Print the packets in the order of their timestamps. The console may be 
+ * slow, the rings are drained as fast as it can, the rest are dropped by 
+ * the producers.
+ */
+static void *
+pth_dmpformat(void *dummy)
+{
+	struct dmpring *r, *rmin;
+	struct packet *p, *pmin;
+	u_int t;
+	int i, j;
+	time_t sec = 0;
+	int n = 0;
+	u_long drops, lastdrops = 0;
+
+	while (1) {
+		rmin = NULL;
+		pmin = NULL;
+		for (i = 0; i < num_pths; i++) {
+			for (j = 0; j < 2; j++) {
+				r = dmprings[i][j];
+				if (r == NULL || r->tail == r->head)
+					continue;
+				p = (struct packet *)r->slot[r->tail & 
+				    (DMP_RINGSIZE - 1)];
+				if (pmin == NULL || timercmp(&p->ts, &pmin->ts, <)) {
+					pmin = p;
+					rmin = r;
+				}
+			}
+		}
+
+		if (rmin == NULL) {
+			/* tell the dropped packets once in a while */
+			drops = 0;
+			for (i = 0; i < num_pths; i++) {
+				for (j = 0; j < 2; j++) {
+					r = dmprings[i][j];
+					if (r)
+						drops += r->dropped + r->limited;
+				}
+			}
+			if (drops != lastdrops) {
+				printf("\n\033[31m%lu packets were not decoded\033[0m\n",
+				    drops - lastdrops);
+				lastdrops = drops;
+			}
+			usleep(1000);
+			continue;
+		}
+
+		__sync_synchronize();
+		t = rmin->tail;
+		if (dmprate) {
+			if (pmin->ts.tv_sec != sec) {
+				sec = pmin->ts.tv_sec;
+				n = 0;
+			}
+			if (n++ >= dmprate)
+				rmin->limited++;
+			else
+				dmp_packet(pmin, rmin->flag[t & (DMP_RINGSIZE - 1)]);
+		} else
+			dmp_packet(pmin, rmin->flag[t & (DMP_RINGSIZE - 1)]);
+		fflush(stdout);
+
+		/* the slot can be reused by the producer now */
+		__sync_synchronize();
+		rmin->tail = t + 1;
+	}
+
+	return NULL;
+}
+
+struct dmpfile *
 open_dmpfile(const char *fname)
 {
-	char tfname[1024];
-	FILE *fp;
-	pcap_hdr_t phdr;
-	time_t t0;
-	struct tm *tm;
-				
-	t0 = time(0);
-	tm = localtime(&t0);
-		
-	snprintf(tfname, sizeof(tfname), "%s_%4d%02d%02d%02d%02d%02d.pcap", 
-	    fname, tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday, 
-	    tm->tm_hour, tm->tm_min, tm->tm_sec);
-				    
-	fp = fopen(tfname, "ab");
-	if (!fp)
-		return NULL;
-        		
-	phdr.magic_number = 0xa1b2c3d4;
-	phdr.version_major = 2;
-	phdr.version_minor = 4;
-	phdr.thiszone =  0;
-	phdr.sigfigs = 0;
-	phdr.snaplen = 0xffff;
-	phdr.network = 1;
-	
-	fwrite(&phdr, sizeof(phdr), 1, fp);
-	fflush(fp);
-	return fp;
+	return dmpfile_open(fname, "pcap", pcap_header);
 }
 
+/* 
+ * drop the reference of the owner, the file is closed by whoever holds
+ * the last one, the owner or a reader/writer in the middle of a packet
+ */
 void 
-close_dmpfile(FILE *fp)
+close_dmpfile(struct dmpfile **dfp)
 {
-	fclose(fp);
+	struct dmpfile *df;
+
+	pthread_mutex_lock(&dmpref_locker);
+	df = *dfp;
+	*dfp = NULL;
+	pthread_mutex_unlock(&dmpref_locker);
+
+	if (df)
+		dmpfile_release(df);
 }
 
 int 
-dmp_packet2file(const struct packet *m, FILE *fp)
+dmp_packet2file(const struct packet *m, struct dmpfile **dfp)
 {
-	pcaprec_hdr_t phdr;
-	struct timeval ts;
-	
-	gettimeofday(&(ts), (void*)0);
-	
-	phdr.ts_sec = ts.tv_sec;
-	phdr.ts_usec = ts.tv_usec;
-	phdr.incl_len = m->len;
-	phdr.orig_len = m->len;
-	
-	fwrite(&phdr, sizeof(phdr), 1, fp);
-	fwrite(m->data, m->len, 1, fp);
-	fflush(fp);
-	
-	return 0;
+	return dmp_buffer2file(m->data, m->len, dfp);
 }
 
 int 
-dmp_buffer2file(const char *m, int len, FILE *fp)
+dmp_buffer2file(const char *m, int len, struct dmpfile **dfp)
 {
 	pcaprec_hdr_t phdr;
 	struct timeval ts;
+	struct dmpfile *df;
 	
+	df = dmpfile_hold(dfp);
+	if (!df)
+		return 0;
+
 	gettimeofday(&(ts), (void*)0);
 	
 	phdr.ts_sec = ts.tv_sec;
 	phdr.ts_usec = ts.tv_usec;
 	phdr.incl_len = len;
 	phdr.orig_len = len;
-	
-	if (!fp)
+
+	dmpfile_write(df, &phdr, sizeof(phdr), m, len, NULL, 0);
+	dmpfile_release(df);
+
+	return 0;
+}
+
+void
+dmp_setrotate(const struct dmprotate *rot)
+{
+	pthread_mutex_lock(&dmprotate_locker);
+	dmprotate = *rot;
+	pthread_cond_signal(&dmprotate_cond);
+	pthread_mutex_unlock(&dmprotate_locker);
+}
+
+void
+dmp_getrotate(struct dmprotate *rot)
+{
+	*rot = dmprotate;
+}
+
+/*
+ * The pcapng file is shared by all the VPCs and the relay. Interface n - 1
+ * is VPC n, the relay is the last one. The timestamps are in nanoseconds,
+ * they are taken by the caller when the packet is received or written.
+ */
+int
+open_pcapng(void)
+{
+	struct dmpfile *df;
+
+	pthread_mutex_lock(&nglocker);
+	if (ngfile) {
+		ngrefs++;
+		pthread_mutex_unlock(&nglocker);
 		return 0;
+	}
 
-	fwrite(&phdr, sizeof(phdr), 1, fp);
-	fwrite(m, len, 1, fp);
+	df = dmpfile_open("vpcs", "pcapng", pcapng_header);
+	if (!df) {
+		pthread_mutex_unlock(&nglocker);
+		return -1;
+	}
+	pthread_mutex_lock(&dmpref_locker);
+	ngfile = df;
+	pthread_mutex_unlock(&dmpref_locker);
+	ngrefs = 1;
+	pthread_mutex_unlock(&nglocker);
+
+	return 0;
+}
+
+void
+close_pcapng(void)
+{
+	pthread_mutex_lock(&nglocker);
+	if (ngfile && --ngrefs <= 0) {
+		ngrefs = 0;
+		close_dmpfile(&ngfile);
+	}
+	pthread_mutex_unlock(&nglocker);
+}
+
+/*
+ * ifid: the id of the VPC, or DMP_IF_RELAY
+ * dir: DMP_DIR_IN or DMP_DIR_OUT
+ */
+int
+dmp_packet2pcapng(int ifid, int dir, const char *m, int len, 
+    const struct timespec *ts)
+{
+	u_int hdr[7];
+	u_char tail[24];
+	u_int64_t t;
+	u_int flags;
+	int pad, n;
+	struct dmpfile *df;
+
+	df = dmpfile_hold(&ngfile);
+	if (!df)
+		return 0;
+
+	if (ifid == DMP_IF_RELAY)
+		ifid = num_pths;
+
+	t = (u_int64_t)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+	pad = ((len + 3) & ~3) - len;
+
+	memset(tail, 0, sizeof(tail));
+	flags = dir;
+	n = pad;
+	n += pcapng_opt(tail + n, 2, &flags, sizeof(flags)); /* epb_flags */
+	n += 4;	/* opt_endofopt */
+
+	hdr[0] = PCAPNG_EPB;
+	hdr[1] = sizeof(hdr) + len + n + 4;
+	hdr[2] = ifid;
+	hdr[3] = t >> 32;
+	hdr[4] = t & 0xffffffff;
+	hdr[5] = len;
+	hdr[6] = len;
+	memcpy(tail + n, &hdr[1], 4);
+
+	dmpfile_write(df, hdr, sizeof(hdr), m, len, tail, n + 4);
+	dmpfile_release(df);
+
+	return 0;
+}
+
+/*
+ * Open the capture file 'prefix_yyyymmddHHMMSS.ext'. If the rotation is 
+ * enabled, the files are named 'prefix_yyyymmddHHMMSS_nnnnn.ext'.
+ */
+static struct dmpfile *
+dmpfile_open(const char *prefix, const char *ext, int (*header)(FILE *))
+{
+	struct dmpfile *df;
+	time_t t0;
+	struct tm *tm;
+
+	df = (struct dmpfile *)malloc(sizeof(struct dmpfile));
+	if (!df)
+		return NULL;
+	memset(df, 0, sizeof(struct dmpfile));
+
+	t0 = time(0);
+	tm = localtime(&t0);
+
+	snprintf(df->prefix, sizeof(df->prefix), "%s_%4d%02d%02d%02d%02d%02d", 
+	    prefix, tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday, 
+	    tm->tm_hour, tm->tm_min, tm->tm_sec);
+	snprintf(df->ext, sizeof(df->ext), "%s", ext);
+	df->header = header;
+	df->refs = 1;
+	pthread_mutex_init(&df->locker, NULL);
+
+	df->fp = dmpfile_new(df, df->fname, sizeof(df->fname), &df->bytes);
+	df->opened = time(0);
+	if (!df->fp) {
+		pthread_mutex_destroy(&df->locker);
+		free(df);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&dmprotate_locker);
+	if (dmprotate_pid == 0 && 
+	    pthread_create(&dmprotate_pid, NULL, pth_dmprotate, NULL) != 0) {
+		printf("Create capture rotator error\n");
+		dmprotate_pid = 0;
+	}
+	df->next = dmpfiles;
+	dmpfiles = df;
+	pthread_cond_signal(&dmprotate_cond);
+	pthread_mutex_unlock(&dmprotate_locker);
+
+	return df;
+}
+
+static FILE *
+dmpfile_new(struct dmpfile *df, char *name, int size, u_int64_t *bytes)
+{
+	FILE *fp;
+
+	if (dmprotate.size || dmprotate.duration)
+		snprintf(name, size, "%s_%05d.%s", df->prefix, df->seq++, 
+		    df->ext);
+	else
+		snprintf(name, size, "%s.%s", df->prefix, df->ext);
+
+	fp = fopen(name, "ab");
+	if (!fp)
+		return NULL;
+
+	*bytes = df->header(fp);
 	fflush(fp);
+
+	return fp;
+}
+
+/* write one record, the record may be built by three pieces */
+static int
+dmpfile_write(struct dmpfile *df, const void *hdr, int hlen, 
+    const void *m, int len, const void *tail, int tlen)
+{
+	pthread_mutex_lock(&df->locker);
+	if (!df->fp) {
+		pthread_mutex_unlock(&df->locker);
+		return 0;
+	}
+
+	fwrite(hdr, hlen, 1, df->fp);
+	fwrite(m, len, 1, df->fp);
+	if (tlen)
+		fwrite(tail, tlen, 1, df->fp);
+	df->bytes += hlen + len + tlen;
 	
-	return 0;	
+	/* switch to the spare file, the rotator closes the old one */
+	if (dmprotate.size && df->bytes >= dmprotate.size && df->spare && 
+	    !df->retired) {
+		dmpfile_swap(df);
+		pthread_mutex_unlock(&df->locker);
+		pthread_cond_signal(&dmprotate_cond);
+		return 0;
+	}
+	pthread_mutex_unlock(&df->locker);
+
+	return 0;
+}
+
+/* take a reference on the file *dfp points to, NULL if it is closed */
+static struct dmpfile *
+dmpfile_hold(struct dmpfile **dfp)
+{
+	struct dmpfile *df;
+
+	pthread_mutex_lock(&dmpref_locker);
+	df = *dfp;
+	if (df)
+		df->refs++;
+	pthread_mutex_unlock(&dmpref_locker);
+
+	return df;
+}
+
+/* drop a reference, the last one closes the files and frees it */
+static void
+dmpfile_release(struct dmpfile *df)
+{
+	struct dmpfile **pp;
+	struct dmpname *dn;
+	int refs;
+
+	pthread_mutex_lock(&dmpref_locker);
+	refs = --df->refs;
+	pthread_mutex_unlock(&dmpref_locker);
+	if (refs > 0)
+		return;
+
+	/* take it out of the rotator first, then nobody else touches it */
+	pthread_mutex_lock(&dmprotate_locker);
+	for (pp = &dmpfiles; *pp; pp = &(*pp)->next) {
+		if (*pp == df) {
+			*pp = df->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&dmprotate_locker);
+
+	pthread_mutex_lock(&df->locker);
+	if (df->fp)
+		fclose(df->fp);
+	if (df->retired) {
+		fclose(df->retired);
+		dmpfile_purge(df, df->rtname);
+	}
+	if (df->spare) {
+		fclose(df->spare);
+		unlink(df->spname);
+	}
+	df->fp = df->retired = df->spare = NULL;
+	pthread_mutex_unlock(&df->locker);
+
+	while (df->oldfiles) {
+		dn = df->oldfiles;
+		df->oldfiles = dn->next;
+		free(dn);
+	}
+	pthread_mutex_destroy(&df->locker);
+	free(df);
+}
+
+/* must be called with df->locker held */
+static void
+dmpfile_swap(struct dmpfile *df)
+{
+	df->retired = df->fp;
+	memcpy(df->rtname, df->fname, sizeof(df->rtname));
+	df->fp = df->spare;
+	memcpy(df->fname, df->spname, sizeof(df->fname));
+	df->spare = NULL;
+	df->bytes = df->sparebytes;
+	df->opened = time(0);
+}
+
+/* keep the last 'dmprotate.files' files including the one being written */
+static void
+dmpfile_purge(struct dmpfile *df, const char *name)
+{
+	struct dmpname *dn, **pp;
+	int n;
+
+	dn = (struct dmpname *)malloc(sizeof(struct dmpname) + strlen(name) + 1);
+	if (!dn)
+		return;
+	dn->next = NULL;
+	strcpy(dn->name, name);
+
+	n = 0;
+	for (pp = &df->oldfiles; *pp; pp = &(*pp)->next)
+		n++;
+	*pp = dn;
+	n++;
+
+	while (dmprotate.files > 0 && n > dmprotate.files - 1) {
+		dn = df->oldfiles;
+		df->oldfiles = dn->next;
+		unlink(dn->name);
+		free(dn);
+		n--;
+	}
+}
+
+/*
+ * The capture files are opened, closed and flushed here. The packet path 
+ * only switches to the spare file which was opened in advance.
+ */
+static void *
+pth_dmprotate(void *dummy)
+{
+	struct dmpfile *df;
+	struct timespec ts;
+	FILE *fp;
+	char name[DMP_NAMELEN];
+	u_int64_t bytes;
+
+	pthread_mutex_lock(&dmprotate_locker);
+	while (1) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec++;
+		pthread_cond_timedwait(&dmprotate_cond, &dmprotate_locker, &ts);
+
+		for (df = dmpfiles; df; df = df->next) {
+			/* close the file which has been switched out */
+			pthread_mutex_lock(&df->locker);
+			fp = df->retired;
+			df->retired = NULL;
+			memcpy(name, df->rtname, sizeof(name));
+			pthread_mutex_unlock(&df->locker);
+			if (fp) {
+				fclose(fp);
+				dmpfile_purge(df, name);
+			}
+
+			if (dmprotate.size == 0 && dmprotate.duration == 0) {
+				/* the rotation is disabled, drop the spare */
+				pthread_mutex_lock(&df->locker);
+				fp = df->spare;
+				df->spare = NULL;
+				pthread_mutex_unlock(&df->locker);
+				if (fp) {
+					fclose(fp);
+					unlink(df->spname);
+				}
+			} else if (df->spare == NULL) {
+				fp = dmpfile_new(df, name, sizeof(name), &bytes);
+				pthread_mutex_lock(&df->locker);
+				df->spare = fp;
+				df->sparebytes = bytes;
+				memcpy(df->spname, name, sizeof(df->spname));
+				pthread_mutex_unlock(&df->locker);
+			}
+
+			pthread_mutex_lock(&df->locker);
+			if (dmprotate.duration && df->spare && !df->retired && 
+			    time(0) - df->opened >= dmprotate.duration)
+				dmpfile_swap(df);
+			fp = df->fp;
+			pthread_mutex_unlock(&df->locker);
+			
+			/* only this thread closes the file, it is safe */
+			if (fp)
+				fflush(fp);
+		}
+	}
+	pthread_mutex_unlock(&dmprotate_locker);
+
+	return NULL;
+}
+
+static int
+pcap_header(FILE *fp)
+{
+	pcap_hdr_t phdr;
+
+	phdr.magic_number = 0xa1b2c3d4;
+	phdr.version_major = 2;
+	phdr.version_minor = 4;
+	phdr.thiszone =  0;
+	phdr.sigfigs = 0;
+	phdr.snaplen = 0xffff;
+	phdr.network = 1;
 	
+	fwrite(&phdr, sizeof(phdr), 1, fp);
+
+	return sizeof(phdr);
+}
+
+static int
+pcapng_header(FILE *fp)
+{
+	u_int hdr[7];
+	u_short version[2] = {1, 0};
+	char name[MAX_LEN];
+	int i, n;
+
+	/* section header block, version 1.0, section length unknown */
+	hdr[0] = PCAPNG_SHB;
+	hdr[1] = 28;
+	hdr[2] = PCAPNG_MAGIC;
+	memcpy(&hdr[3], version, sizeof(version));
+	hdr[4] = 0xffffffff;
+	hdr[5] = 0xffffffff;
+	hdr[6] = 28;
+	fwrite(hdr, sizeof(hdr), 1, fp);
+	n = sizeof(hdr);
+
+	for (i = 0; i < num_pths; i++) {
+		if (strcmp(vpc[i].xname, "VPCS") == 0)
+			snprintf(name, sizeof(name), "%s%d", vpc[i].xname, i + 1);
+		else
+			snprintf(name, sizeof(name), "%s", vpc[i].xname);
+		n += pcapng_idb(fp, name, vpc[i].ip4.mac);
+	}
+	n += pcapng_idb(fp, "relay", NULL);
+
+	return n;
+}
+
+static int
+pcapng_opt(u_char *buf, u_short code, const void *val, u_short len)
+{
+	int n;
+
+	n = (len + 3) & ~3;
+	memcpy(buf, &code, 2);
+	memcpy(buf + 2, &len, 2);
+	memset(buf + 4, 0, n);
+	memcpy(buf + 4, val, len);
+
+	return n + 4;
 }
+
+static int
+pcapng_idb(FILE *fp, const char *name, const u_char *mac)
+{
+	u_char buf[256];
+	u_int hdr[4];
+	u_short linktype[2] = {1, 0};	/* LINKTYPE_ETHERNET, reserved */
+	u_char tsresol = 9;
+	int n = 0;
+
+	n += pcapng_opt(buf + n, 2, name, strlen(name));	/* if_name */
+	if (mac)
+		n += pcapng_opt(buf + n, 6, mac, 6);		/* if_MACaddr */
+	n += pcapng_opt(buf + n, 9, &tsresol, 1);		/* if_tsresol */
+	memset(buf + n, 0, 4);					/* opt_endofopt */
+	n += 4;
+
+	hdr[0] = PCAPNG_IDB;
+	hdr[1] = sizeof(hdr) + n + 4;
+	memcpy(&hdr[2], linktype, sizeof(linktype));
+	hdr[3] = 0;	/* no snaplen */
+	memcpy(buf + n, &hdr[1], 4);
+
+	fwrite(hdr, sizeof(hdr), 1, fp);
+	fwrite(buf, n + 4, 1, fp);
+
+	return hdr[1];
+}
+
+/* end of file */
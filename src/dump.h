@@ -28,9 +28,12 @@
 #define _DUMP_H_
 
 #include <sys/types.h>
-
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "queue.h"
+#include "ip.h"
 
 typedef struct pcap_hdr_s {
         u_int magic_number;     /* magic number */
@@ -49,11 +52,91 @@ typedef struct pcaprec_hdr_s {
         u_int orig_len;       /* actual length of packet */
 } pcaprec_hdr_t;
 
+/* pcapng block types */
+#define PCAPNG_SHB	0x0a0d0d0a	/* section header block */
+#define PCAPNG_IDB	0x00000001	/* interface description block */
+#define PCAPNG_EPB	0x00000006	/* enhanced packet block */
+
+#define PCAPNG_MAGIC	0x1a2b3c4d
+
+/* direction of the packet, the epb_flags inbound/outbound bits */
+#define DMP_DIR_IN	1
+#define DMP_DIR_OUT	2
+
+/* interface id of the relay in the shared pcapng file */
+#define DMP_IF_RELAY	(-1)
+
+#define DMP_NAMELEN	1024
+
+struct dmpname {
+	struct dmpname *next;
+	char name[0];
+};
+
+/* 
+ * The capture file. With the rotation enabled, the next file is opened 
+ * in advance, the previous one is closed by the rotator thread.
+ */
+struct dmpfile {
+	FILE *fp;			/* the file being written */
+	FILE *spare;			/* the next file */
+	FILE *retired;			/* the file to be closed */
+	u_int64_t bytes;		/* size of fp */
+	u_int64_t sparebytes;		/* size of spare, the header */
+	time_t opened;			/* time fp was switched in */
+	int seq;			/* sequence of the file name */
+	int (*header)(FILE *fp);	/* write the file header */
+	char prefix[DMP_NAMELEN - 32];
+	char ext[8];
+	char fname[DMP_NAMELEN];	/* name of fp */
+	char spname[DMP_NAMELEN];	/* name of spare */
+	char rtname[DMP_NAMELEN];	/* name of retired */
+	struct dmpname *oldfiles;	/* closed files, the oldest first */
+	pthread_mutex_t locker;
+	int refs;			/* the owner and the writers */
+	struct dmpfile *next;
+};
+
+/*
+ * The console decoding is deferred to the formatter thread. Each VPC has 
+ * two rings of packet copies, one filled by the reader, one by the writer, 
+ * so every ring has one producer and one consumer and needs no lock.
+ */
+#define DMP_RINGSIZE	128		/* power of 2 */
+#define DMP_SLOTSIZE	((sizeof(struct packet) + PKT_MAXSIZE + 7) & ~7)
+
+struct dmpring {
+	volatile u_int head;		/* written by the producer */
+	volatile u_int tail;		/* written by the formatter */
+	u_long dropped;			/* the ring is full */
+	u_long limited;			/* over the rate limit */
+	int flag[DMP_RINGSIZE];
+	char slot[DMP_RINGSIZE][DMP_SLOTSIZE];
+};
+
+struct dmprotate {
+	u_int64_t size;			/* bytes per file, 0: no limit */
+	int duration;			/* seconds per file, 0: no limit */
+	int files;			/* keep the last n files, 0: all */
+};
+
 int dmp_packet(const struct packet *m, const int flag);
 
-FILE *open_dmpfile(const char *fname);
-void close_dmpfile(FILE *fp);
-int dmp_packet2file(const struct packet *m, FILE *fp);
-int dmp_buffer2file(const char *m, int len, FILE *fp);
+struct dmpfile *open_dmpfile(const char *fname);
+void close_dmpfile(struct dmpfile **dfp);
+int dmp_packet2file(const struct packet *m, struct dmpfile **dfp);
+int dmp_buffer2file(const char *m, int len, struct dmpfile **dfp);
+void dmp_setrotate(const struct dmprotate *rot);
+void dmp_getrotate(struct dmprotate *rot);
+
+int dmp_defer(int id, int dir, const struct packet *m, const int flag);
+void dmp_setrate(int rate);
+int dmp_getrate(void);
+void dmp_getdrops(int id, u_long *dropped, u_long *limited);
+
+int open_pcapng(void);
+void close_pcapng(void);
+int dmp_packet2pcapng(int ifid, int dir, const char *m, int len, 
+    const struct timespec *ts);
 
 #endif
@@ -0,0 +1,530 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "ip.h"
+#include "dump.h"
+#include "filter.h"
+
+/*
+ * The capture filter, e.g. 'tcp and host 10.1.1.1 and not port 22'
+ *
+ *   expr    := term [[or|'||'] term]...
+ *   term    := factor [[and|'&&'] factor]...
+ *   factor  := not|'!' factor | '(' expr ')' | primitive
+ *   primitive := ip|ip6|arp|icmp|icmp6|tcp|udp | proto N | ether type N |
+ *             [src|dst] host ADDRESS | [src|dst] port N
+ *
+ * 'and' may be omitted, 'tcp port 80' is 'tcp and port 80'. The expression 
+ * is compiled once into a postfix program, the packet headers are parsed 
+ * once per packet, then the program is run on a small stack.
+ */
+
+struct fltparser {
+	int argc;
+	char **argv;
+	int i;
+	struct dmpfilter *flt;
+};
+
+struct fltpkt {
+	u_short type;			/* ethertype */
+	int proto;			/* ip protocol, -1: not ip */
+	u_int sip;
+	u_int dip;
+	const ip6 *sip6;
+	const ip6 *dip6;
+	int sport;			/* -1: no ports */
+	int dport;
+};
+
+static int flt_expr(struct fltparser *p);
+static int flt_term(struct fltparser *p);
+static int flt_factor(struct fltparser *p);
+static int flt_primitive(struct fltparser *p);
+static int flt_emit(struct fltparser *p, int op, u_int k, const ip6 *a6);
+static int flt_number(const char *s, u_int max, u_int *k);
+static const char *flt_peek(struct fltparser *p);
+static void flt_parse(struct fltpkt *fp, const char *data, int len);
+static int flt_run(struct dmpfilter *flt, int dir, const char *data, int len);
+static struct dmpfilter *flt_hold(struct dmpfilter **fltp);
+
+/* 
+ * the filter is swapped by the console while the reader and the writer
+ * are matching the packets, each of them holds a reference on it
+ */
+static pthread_mutex_t fltref_locker = PTHREAD_MUTEX_INITIALIZER;
+
+struct dmpfilter *
+filter_compile(int argc, char **argv)
+{
+	struct fltparser parser;
+	struct dmpfilter *flt;
+	int i, n;
+
+	flt = (struct dmpfilter *)malloc(sizeof(struct dmpfilter));
+	if (flt == NULL) {
+		printf("Out of memory\n");
+		return NULL;
+	}
+	memset(flt, 0, sizeof(struct dmpfilter));
+	flt->refs = 1;
+
+	for (i = 0, n = 0; i < argc && n < sizeof(flt->expr) - 1; i++)
+		n += snprintf(flt->expr + n, sizeof(flt->expr) - n, "%s%s", 
+		    i ? " " : "", argv[i]);
+
+	parser.argc = argc;
+	parser.argv = argv;
+	parser.i = 0;
+	parser.flt = flt;
+
+	if (argc == 0 || flt_expr(&parser) != 0) {
+		free(flt);
+		return NULL;
+	}
+	if (parser.i < argc) {
+		printf("Invalid filter at '%s'\n", argv[parser.i]);
+		free(flt);
+		return NULL;
+	}
+
+	return flt;
+}
+
+/* drop a reference, the last one frees the filter */
+void
+filter_free(struct dmpfilter *flt)
+{
+	int refs;
+
+	if (flt == NULL)
+		return;
+
+	pthread_mutex_lock(&fltref_locker);
+	refs = --flt->refs;
+	pthread_mutex_unlock(&fltref_locker);
+	if (refs == 0)
+		free(flt);
+}
+
+/* replace the filter *fltp points to, the old one goes with its last user */
+void
+filter_set(struct dmpfilter **fltp, struct dmpfilter *flt)
+{
+	struct dmpfilter *old;
+
+	pthread_mutex_lock(&fltref_locker);
+	old = *fltp;
+	*fltp = flt;
+	pthread_mutex_unlock(&fltref_locker);
+
+	filter_free(old);
+}
+
+/* return 1 if the packet should be dumped */
+int
+filter_match(struct dmpfilter **fltp, int dir, const char *data, int len)
+{
+	struct dmpfilter *flt;
+	int r;
+
+	flt = flt_hold(fltp);
+	if (flt == NULL)
+		return 1;
+
+	r = flt_run(flt, dir, data, len);
+	filter_free(flt);
+
+	return r;
+}
+
+static struct dmpfilter *
+flt_hold(struct dmpfilter **fltp)
+{
+	struct dmpfilter *flt;
+
+	pthread_mutex_lock(&fltref_locker);
+	flt = *fltp;
+	if (flt)
+		flt->refs++;
+	pthread_mutex_unlock(&fltref_locker);
+
+	return flt;
+}
+
+static int
+flt_run(struct dmpfilter *flt, int dir, const char *data, int len)
+{
+	struct fltpkt fp;
+	struct fltinsn *insn;
+	u_char stack[FLT_MAXINSN];
+	int sp = 0;
+	int i, r;
+
+	flt_parse(&fp, data, len);
+
+	for (i = 0; i < flt->n; i++) {
+		insn = &flt->insn[i];
+		switch (insn->op) {
+			case FLT_ETHER:
+				r = (fp.type == insn->k);
+				break;
+			case FLT_PROTO:
+				r = (fp.proto == insn->k);
+				break;
+			case FLT_HOST:
+				r = (fp.proto != -1 && fp.sip6 == NULL &&
+				    (fp.sip == insn->k || fp.dip == insn->k));
+				break;
+			case FLT_SRCHOST:
+				r = (fp.proto != -1 && fp.sip6 == NULL &&
+				    fp.sip == insn->k);
+				break;
+			case FLT_DSTHOST:
+				r = (fp.proto != -1 && fp.sip6 == NULL &&
+				    fp.dip == insn->k);
+				break;
+			case FLT_HOST6:
+				r = (fp.sip6 != NULL && 
+				    (IP6EQ(fp.sip6, &insn->a6) || 
+				    IP6EQ(fp.dip6, &insn->a6)));
+				break;
+			case FLT_SRCHOST6:
+				r = (fp.sip6 != NULL && IP6EQ(fp.sip6, &insn->a6));
+				break;
+			case FLT_DSTHOST6:
+				r = (fp.dip6 != NULL && IP6EQ(fp.dip6, &insn->a6));
+				break;
+			case FLT_PORT:
+				r = (fp.sport == insn->k || fp.dport == insn->k);
+				break;
+			case FLT_SRCPORT:
+				r = (fp.sport == insn->k);
+				break;
+			case FLT_DSTPORT:
+				r = (fp.dport == insn->k);
+				break;
+			case FLT_AND:
+				sp--;
+				r = stack[sp - 1] && stack[sp];
+				sp--;
+				break;
+			case FLT_OR:
+				sp--;
+				r = stack[sp - 1] || stack[sp];
+				sp--;
+				break;
+			case FLT_NOT:
+				sp--;
+				r = !stack[sp];
+				break;
+			default:
+				r = 0;
+				break;
+		}
+		stack[sp++] = r;
+	}
+	r = (sp > 0) ? stack[sp - 1] : 1;
+
+	i = (dir == DMP_DIR_OUT) ? 1 : 0;
+	if (r)
+		flt->matched[i]++;
+	else
+		flt->skipped[i]++;
+
+	return r;
+}
+
+static const char *
+flt_peek(struct fltparser *p)
+{
+	if (p->i < p->argc)
+		return p->argv[p->i];
+	return NULL;
+}
+
+static int
+flt_emit(struct fltparser *p, int op, u_int k, const ip6 *a6)
+{
+	struct fltinsn *insn;
+
+	if (p->flt->n >= FLT_MAXINSN) {
+		printf("Filter is too long\n");
+		return -1;
+	}
+	insn = &p->flt->insn[p->flt->n++];
+	insn->op = op;
+	insn->k = k;
+	if (a6)
+		memcpy(&insn->a6, a6, sizeof(ip6));
+
+	return 0;
+}
+
+static int
+flt_expr(struct fltparser *p)
+{
+	const char *s;
+
+	if (flt_term(p) != 0)
+		return -1;
+
+	while ((s = flt_peek(p)) != NULL && 
+	    (!strcmp(s, "or") || !strcmp(s, "||"))) {
+		p->i++;
+		if (flt_term(p) != 0 || flt_emit(p, FLT_OR, 0, NULL) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int
+flt_term(struct fltparser *p)
+{
+	const char *s;
+
+	if (flt_factor(p) != 0)
+		return -1;
+
+	while ((s = flt_peek(p)) != NULL) {
+		if (!strcmp(s, "or") || !strcmp(s, "||") || !strcmp(s, ")"))
+			break;
+		if (!strcmp(s, "and") || !strcmp(s, "&&"))
+			p->i++;
+		if (flt_factor(p) != 0 || flt_emit(p, FLT_AND, 0, NULL) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int
+flt_factor(struct fltparser *p)
+{
+	const char *s;
+
+	s = flt_peek(p);
+	if (s == NULL) {
+		printf("Incomplete filter\n");
+		return -1;
+	}
+
+	if (!strcmp(s, "not") || !strcmp(s, "!")) {
+		p->i++;
+		if (flt_factor(p) != 0)
+			return -1;
+		return flt_emit(p, FLT_NOT, 0, NULL);
+	}
+
+	if (!strcmp(s, "(")) {
+		p->i++;
+		if (flt_expr(p) != 0)
+			return -1;
+		s = flt_peek(p);
+		if (s == NULL || strcmp(s, ")")) {
+			printf("Missing ')'\n");
+			return -1;
+		}
+		p->i++;
+		return 0;
+	}
+
+	return flt_primitive(p);
+}
+
+static int
+flt_primitive(struct fltparser *p)
+{
+	const char *s, *v;
+	u_int k;
+	ip6 a6;
+	struct in_addr in;
+	int dir = 0;	/* 1: src, 2: dst */
+
+	s = p->argv[p->i++];
+
+	if (!strcmp(s, "ip"))
+		return flt_emit(p, FLT_ETHER, ETHERTYPE_IP, NULL);
+	if (!strcmp(s, "ip6"))
+		return flt_emit(p, FLT_ETHER, ETHERTYPE_IPV6, NULL);
+	if (!strcmp(s, "arp"))
+		return flt_emit(p, FLT_ETHER, ETHERTYPE_ARP, NULL);
+	if (!strcmp(s, "icmp"))
+		return flt_emit(p, FLT_PROTO, IPPROTO_ICMP, NULL);
+	if (!strcmp(s, "icmp6"))
+		return flt_emit(p, FLT_PROTO, IPPROTO_ICMPV6, NULL);
+	if (!strcmp(s, "tcp"))
+		return flt_emit(p, FLT_PROTO, IPPROTO_TCP, NULL);
+	if (!strcmp(s, "udp"))
+		return flt_emit(p, FLT_PROTO, IPPROTO_UDP, NULL);
+
+	if (!strcmp(s, "proto")) {
+		v = flt_peek(p);
+		if (v == NULL || flt_number(v, 255, &k) != 0) {
+			printf("Invalid protocol\n");
+			return -1;
+		}
+		p->i++;
+		return flt_emit(p, FLT_PROTO, k, NULL);
+	}
+
+	if (!strcmp(s, "ether")) {
+		v = flt_peek(p);
+		if (v && (!strcmp(v, "type") || !strcmp(v, "proto"))) {
+			p->i++;
+			v = flt_peek(p);
+		}
+		if (v == NULL || flt_number(v, 0xffff, &k) != 0) {
+			printf("Invalid ethertype\n");
+			return -1;
+		}
+		p->i++;
+		return flt_emit(p, FLT_ETHER, k, NULL);
+	}
+
+	if (!strcmp(s, "src") || !strcmp(s, "dst")) {
+		dir = (s[0] == 's') ? 1 : 2;
+		s = flt_peek(p);
+		if (s == NULL) {
+			printf("Incomplete filter\n");
+			return -1;
+		}
+		p->i++;
+	}
+
+	if (!strcmp(s, "host")) {
+		v = flt_peek(p);
+		if (v == NULL) {
+			printf("Incomplete filter\n");
+			return -1;
+		}
+		p->i++;
+		if (inet_pton(AF_INET, v, &in) == 1)
+			return flt_emit(p, FLT_HOST + dir, in.s_addr, NULL);
+		if (inet_pton(AF_INET6, v, &a6) == 1)
+			return flt_emit(p, FLT_HOST6 + dir, 0, &a6);
+		printf("Invalid address '%s'\n", v);
+		return -1;
+	}
+
+	if (!strcmp(s, "port")) {
+		v = flt_peek(p);
+		if (v == NULL || flt_number(v, 0xffff, &k) != 0) {
+			printf("Invalid port\n");
+			return -1;
+		}
+		p->i++;
+		return flt_emit(p, FLT_PORT + dir, k, NULL);
+	}
+
+	printf("Invalid filter at '%s'\n", s);
+	return -1;
+}
+
+static int
+flt_number(const char *s, u_int max, u_int *k)
+{
+	char *end;
+	u_long v;
+
+	v = strtoul(s, &end, 0);
+	if (*s == '\0' || *end != '\0' || v > max)
+		return -1;
+	*k = v;
+
+	return 0;
+}
+
+static void
+flt_parse(struct fltpkt *fp, const char *data, int len)
+{
+	ethdr *eh = (ethdr *)data;
+	iphdr *ip;
+	ip6hdr *ip6;
+	const u_char *p;
+	int hlen, nxt;
+
+	memset(fp, 0, sizeof(struct fltpkt));
+	fp->proto = -1;
+	fp->sport = -1;
+	fp->dport = -1;
+
+	if (len < sizeof(ethdr))
+		return;
+	fp->type = ntohs(eh->type);
+	len -= sizeof(ethdr);
+	p = (const u_char *)(eh + 1);
+
+	if (fp->type == ETHERTYPE_IP && len >= sizeof(iphdr)) {
+		ip = (iphdr *)p;
+		fp->proto = ip->proto;
+		fp->sip = ip->sip;
+		fp->dip = ip->dip;
+		/* only the first fragment has the ports */
+		if (ntohs(ip->frag) & IP_OFFMASK)
+			return;
+		hlen = ip->ihl << 2;
+		nxt = ip->proto;
+	} else if (fp->type == ETHERTYPE_IPV6 && len >= sizeof(ip6hdr)) {
+		ip6 = (ip6hdr *)p;
+		fp->sip6 = &ip6->src;
+		fp->dip6 = &ip6->dst;
+		hlen = sizeof(ip6hdr);
+		nxt = ip6->ip6_nxt;
+		/* skip hop-by-hop, routing, destination and fragment headers */
+		while ((nxt == 0 || nxt == 43 || nxt == 60 || 
+		    nxt == IPPROTO_FRAGMENT) && len >= hlen + 8) {
+			if (nxt == IPPROTO_FRAGMENT) {
+				if (ntohs(((struct ip6frag *)(p + hlen))->offlg) & 
+				    0xfff8) {
+					fp->proto = p[hlen];
+					return;
+				}
+				nxt = p[hlen];
+				hlen += 8;
+			} else {
+				nxt = p[hlen];
+				hlen += (p[hlen + 1] + 1) << 3;
+			}
+		}
+		fp->proto = nxt;
+	} else
+		return;
+
+	if ((nxt == IPPROTO_TCP || nxt == IPPROTO_UDP) && len >= hlen + 4) {
+		fp->sport = ntohs(*(u_short *)(p + hlen));
+		fp->dport = ntohs(*(u_short *)(p + hlen + 2));
+	}
+}
+
+/* end of file */
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef _FILTER_H_
+#define _FILTER_H_
+
+#include <sys/types.h>
+
+#include "ip.h"
+
+#define FLT_MAXINSN	64
+#define FLT_MAXEXPR	256
+
+/* opcodes, the filter is a postfix program */
+#define FLT_ETHER	1	/* ethertype == k */
+#define FLT_PROTO	2	/* ip protocol or ipv6 next header == k */
+#define FLT_HOST	3	/* ipv4 source or destination == k */
+#define FLT_SRCHOST	4
+#define FLT_DSTHOST	5
+#define FLT_HOST6	6	/* ipv6 source or destination == a6 */
+#define FLT_SRCHOST6	7
+#define FLT_DSTHOST6	8
+#define FLT_PORT	9	/* tcp/udp source or destination == k */
+#define FLT_SRCPORT	10
+#define FLT_DSTPORT	11
+#define FLT_AND		12
+#define FLT_OR		13
+#define FLT_NOT		14
+
+struct fltinsn {
+	int op;
+	u_int k;
+	ip6 a6;
+};
+
+struct dmpfilter {
+	int n;				/* number of the instructions */
+	struct fltinsn insn[FLT_MAXINSN];
+	char expr[FLT_MAXEXPR];		/* the source, for show dump */
+	/* [0] is updated by the reader, [1] by the writer */
+	u_long matched[2];
+	u_long skipped[2];
+	int refs;			/* the console, reader and writer */
+};
+
+struct dmpfilter *filter_compile(int argc, char **argv);
+int filter_match(struct dmpfilter **fltp, int dir, const char *data, int len);
+void filter_set(struct dmpfilter **fltp, struct dmpfilter *flt);
+void filter_free(struct dmpfilter *flt);
+
+#endif
+
+/* end of file */
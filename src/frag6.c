@@ -118,7 +118,7 @@ ipfrag6(struct packet *m0, int mtu)
 
 		/* ether, ip head, frag exthead, payload */
 		memcpy(m->data, m0->data, sizeof(ethdr) + sizeof(ip6hdr));
-		memcpy(m->data + ehlen, m0->data + off, dlen);
+		memcpy(m->data + ehlen, m0->data + off, clen);
 		ip = (ip6hdr *)(m->data + sizeof(ethdr));
 		
 		ip->ip6_nxt = IPPROTO_FRAGMENT;
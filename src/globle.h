@@ -33,6 +33,18 @@
 #ifndef DEV_UDP
 #define DEV_UDP	2
 #endif
+#ifndef DEV_MEM
+#define DEV_MEM	3
+#endif
+#ifndef DEV_UNIX
+#define DEV_UNIX	4
+#endif
+#ifndef DEV_PACKET
+#define DEV_PACKET	5
+#endif
+
+/* sun_path of the unix domain sockets */
+#define UNIX_PATH_LEN	104
 
 #define DEBUG 1
 
@@ -46,6 +58,9 @@
 
 #define MAX_NUM_PTHS 9
 
+/* queues of a multi-queue tap device */
+#define TAP_MAXQ	8
+
 #ifndef IFNAMESIZ
 #define IFNAMESIZ 12
 #endif
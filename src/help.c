@@ -73,7 +73,8 @@ int help_relay(int argc, char **argv)
 		"     {Hadd} %s   Relay the packets between %s\n"
 		"     {Hdel} %s   Delete the relay rule\n"
 		"     {Hdel} {Uid}                        Delete the relay rule\n"
-		"     {Hdump} [{Hon}|{Hoff}]                 Dump relay packets to file\n"
+		"     {Hdump} [{Hon}|{Hpcapng}|{Hoff}]          Dump relay packets to file, or to\n"
+		"                                     the shared pcapng file\n"
 		"     {Hport} {Uport}                     Set relay hub port\n"
 		"     {Hshow}                          Show the relay rules\n"
 		"  Note: %s are 127.0.0.1 by default\n",
@@ -165,6 +166,34 @@ int help_neighbor(int argc, char **argv)
 	return 1;
 }
 
+int help_perf(int argc, char **argv)
+{
+	esc_prn("\n{Hperf} {UHOST} [{UOPTION} ...]\n"
+		"{Hperf} {H-s} [{UOPTION} ...]\n"
+		"  Measure the throughput to {UHOST}, or serve the clients with {H-s}. Either\n"
+		"  end may be iperf 2, the datagrams and the report of UDP are its ones.\n"
+		"    Options:\n"
+		"     {H-s}             Server, count the data to the port till Ctrl+C\n"
+		"     {H-u}             UDP, default TCP\n"
+		"     {H-p} {Uport}        Port, default 5001\n"
+		"     {H-t} {Useconds}     Time to send, default 10. The server stops after\n"
+		"                       {Useconds} if given\n"
+		"     {H-i} {Useconds}     Report every {Useconds}, default 1, 0 none\n"
+		"     {H-l} {Usize}        UDP datagram size, default 1470 (1450 for IPv6),\n"
+		"                       or the largest TCP segment\n"
+		"     {H-P} {Un}           Run {Un} streams in parallel, at most 8\n"
+		"     {H-b} {Urate}        Bits per second, k, m and g are allowed, default\n"
+		"                       1m for UDP and no limit for TCP\n"
+		"     {H-C} {UNAME}        TCP congestion control, {Hnewreno} or {Hcubic}, default\n"
+		"                       the one of {Hset tcpcc}\n\n"
+		"  Notes: 1. The VPC answers TCP on every port, the TCP server only counts\n"
+		"            the data taken in order.\n"
+		"         2. The UDP server reports the jitter and the lost datagrams.\n"
+		"         3. Use Ctrl+C to stop the command.\n");
+
+	return 1;
+}
+
 int help_ping(int argc, char **argv)
 {
 
@@ -174,6 +203,9 @@ int help_ping(int argc, char **argv)
 		"     {H-1}             ICMP mode, default\n"
 		"     {H-2}             UDP mode\n"
 		"     {H-3}             TCP mode\n"
+		"     {H-B} {Ubytes}       TCP mode, send {Ubytes} in one stream with a sliding\n"
+		"                       window and report the goodput, k, m and g are\n"
+		"                       allowed, e.g. 10m\n"
 		"     {H-c} {Ucount}       Packet count, default 5\n"
 		"     {H-D}             Set the Don't Fragment bit\n"
 		"     {H-f} {UFLAG}        Tcp header FLAG |{HC}|{HE}|{HU}|{HA}|{HP}|{HR}|{HS}|{HF}|\n"
@@ -240,19 +272,110 @@ int help_write(int argc, char **argv)
 	return 1;
 }
 
+int help_webserver(int argc, char **argv)
+{
+	esc_prn("\n{Hwebserver} [{Uport}] [{UDIRECTORY}]\n"
+		"  Serve a web page on {Uport}, default 80, in the background. The\n"
+		"  connections are kept for more requests as HTTP/1.1 does, the pipelined\n"
+		"  ones are answered in order, an idle one is closed after 15 seconds\n"
+		"    {H/bytes/}{Un}[{HK}|{HM}|{HG}]  {Un} bytes of a synthetic payload, at most 1G\n"
+		"    {H/}{Upath}            the file under {UDIRECTORY}\n"
+		"  The payload and the files are sent from where they are, a file is\n"
+		"  mapped till its response is acked. Every path starts with '/', quote\n"
+		"  it on the command line, e.g. {Hwebload 10.0.0.2 \"/bytes/1M\"}, and\n"
+		"  {UDIRECTORY} too if it holds '/'\n"
+		"{Hwebserver stop} [{Uport}]\n"
+		"  Stop the server on {Uport}, all the servers of the VPC if not given\n"
+		"{Hwebserver show} [{Hreset}]\n"
+		"  Show the connections, the requests, the errors and the latency of the\n"
+		"  servers, from a request taken to its response acked\n");
+
+	return 1;
+}
+
+int help_conngen(int argc, char **argv)
+{
+	esc_prn("\n{Hconngen} {UHOST} [{UOPTION} ...]\n"
+		"  Open TCP connections to {UHOST} at a rate in the background, hold each\n"
+		"  for a while and close it. {UHOST} can be an ip address or name\n"
+		"    Options:\n"
+		"     {H-p} {Uport}        Port, default 80\n"
+		"     {H-r} {Urate}        Connections per second, default 100, at most 100000\n"
+		"     {H-c} {Ucount}       Stop after {Ucount} connections\n"
+		"     {H-t} {Useconds}     Stop after {Useconds}, default till {Hconngen stop}\n"
+		"     {H-w} {Ums}          Hold a connection {Ums} from its SYN, default 1000. One\n"
+		"                       not answered by then is a timeout\n"
+		"     {H-s} {Ulo}-{Uhi}      Source ports, default 8192 of them at random\n"
+		"     {H-v} {Ulist}        Send from the VPCs of {Ulist} in turn, e.g. 1,3-5,\n"
+		"                       default the current one\n"
+		"     {H-h}             Half-open, SYN|ACK is not acked and the connection\n"
+		"                       is dropped quietly\n"
+		"{Hconngen stop}\n"
+		"  Stop the generator of the VPC and show its counters\n"
+		"{Hconngen show} [{Hreset}]\n"
+		"  Show the SYNs sent, the connections established, refused, timed out\n"
+		"  and reset, the SYNs not sent as all the ports were held, the ones\n"
+		"  held now and the latency from SYN to SYN|ACK\n");
+
+	return 1;
+}
+
+int help_webload(int argc, char **argv)
+{
+	esc_prn("\n{Hwebload} {UHOST} [{UPATH}] [{UOPTION} ...]\n"
+		"  Send GET requests for {UPATH}, default /, to the web server {UHOST} over\n"
+		"  many connections and report the requests per second, the errors and\n"
+		"  the latency. {UHOST} can be an ip address or name. {UPATH} starts with\n"
+		"  '/' and must be quoted, e.g. \"/bytes/1M\"\n"
+		"    Options:\n"
+		"     {H-p} {Uport}        Port, default 80\n"
+		"     {H-c} {Un}           Connections, default 10, at most 1024. Each sends a\n"
+		"                       request once the last is answered\n"
+		"     {H-r} {Urate}        Requests per second of all the connections, the\n"
+		"                       latency counts from when a request is due\n"
+		"     {H-t} {Useconds}     Time to run, default 10\n"
+		"     {H-w} {Ums}          Wait {Ums} for a connection or a response, default\n"
+		"                       2000\n"
+		"     {H-n}             A new connection for every request\n\n"
+		"  Notes: 1. The connections are kept as HTTP/1.1 does.\n"
+		"         2. The latency percentiles are the bounds of log2 buckets.\n"
+		"         3. Use Ctrl+C to stop the command.\n");
+
+	return 1;
+}
+
 int help_set(int argc, char **argv)
 {
 	if (argc == 3 && !strncmp(argv[1], "dump", strlen(argv[1])) && 
 	    (!strcmp(argv[2], "?") || !strncmp(argv[2], "help", strlen(argv[2])))) {
-		esc_prn("\n{Hset dump} {Hall}|{Hdetail}|{Hfile}|{Hoff}|{Hmac}|{Hraw}\n"
-			"  Set the packet dump flags for this VPC\n"
+		esc_prn("\n{Hset dump} {Hall}|{Hdetail}|{Hfile}|{Hpcapng}|{Hoff}|{Hmac}|{Hraw}\n"
+			"{Hset dump rotate} [{Hsize} {UMB}] [{Htime} {Useconds}] [{Hfiles} {Un}]|{Hoff}\n"
+			"{Hset dump filter} {UEXPRESSION}|{Hoff}\n"
+			"{Hset dump rate} {Un}|{Hoff}\n"
+			"  Set the packet dump flags for this VPC, or the rotation of all the\n"
+			"  capture files. The capture file is switched to a new one after {UMB}\n"
+			"  megabytes or {Useconds} seconds, only the last {Un} files are kept\n"
+			"  Only the packets matching the filter {UEXPRESSION} are dumped:\n"
+			"    {UEXPRESSION} := [{Hnot}] {UPRIMITIVE} [{Hand}|{Hor} [{Hnot}] {UPRIMITIVE}]...\n"
+			"    {UPRIMITIVE}  := {Hip}|{Hip6}|{Harp}|{Hicmp}|{Hicmp6}|{Htcp}|{Hudp}|{Hproto} {Un}|\n"
+			"                  {Hether type} {Un}|[{Hsrc}|{Hdst}] {Hhost} {Uip}|[{Hsrc}|{Hdst}] {Hport} {Un}\n"
+			"    '(' and ')' group the primitives, e.g. 'tcp and ( port 80 or port 8080 )'\n"
+			"  The packets are printed by a background thread, at most {Un} packets\n"
+			"  per second if the rate is set. The packets are dropped and counted\n"
+			"  if the console can not keep up with them.\n"
 			"    {Hall}             All the packets including incoming\n"
 			"                    must use {Udetail}|{Umac}|{Uraw} as well as 'all'\n"
 			"    {Hdetail}          Print protocol\n"
 			"    {Hfile}            Dump packets to file 'vpcs[id]_yyyymmddHHMMSS.pcap'\n"
+			"    {Hpcapng}          Dump packets to file 'vpcs_yyyymmddHHMMSS.pcapng'\n"
+			"                    shared by all the VPCs and the relay, one\n"
+			"                    interface per VPC, nanosecond timestamps\n"
 			"    {Hmac}             Print harware MAC address\n"
 			"    {Hoff}             Clear all the flags\n"
-			"    {Hraw}             Print the first 40 bytes\n");
+			"    {Hraw}             Print the first 40 bytes\n"
+			"    {Hrotate}          Rotate the capture files\n"
+			"    {Hfilter}          Dump the matching packets only\n"
+			"    {Hrate}            Limit the packets printed per second\n");
 	
 		return 1;
 	}
@@ -268,6 +391,37 @@ int help_set(int argc, char **argv)
 		return 1;
 	}
 
+	if (argc == 3 && !strncmp(argv[1], "latency", strlen(argv[1])) && 
+	    (!strcmp(argv[2], "?") || !strncmp(argv[2], "help", strlen(argv[2])))) {
+		esc_prn("\n{Hset latency} {Hon}|{Hoff}\n"
+			"  Stamp the packets at each stage of the packet path and keep the\n"
+			"  latency histograms of the stages for all the VPCs. See {Hshow latency}.\n");
+
+		return 1;
+	}
+
+	if (argc == 3 && !strncmp(argv[1], "shm", strlen(argv[1])) && 
+	    (!strcmp(argv[2], "?") || !strncmp(argv[2], "help", strlen(argv[2])))) {
+		esc_prn("\n{Hset shm} {UNAME}|{Hoff}\n"
+			"  Connect this VPC to the shared memory link {UNAME} instead of its\n"
+			"  device. The first end creates the link /vpcs-{UNAME}, the second one,\n"
+			"  another VPC or a local emulator, attaches to it. The layout and the\n"
+			"  protocol of the link are described in shm.h. {Hoff} goes back to\n"
+			"  the device.\n");
+
+		return 1;
+	}
+
+	if (argc == 3 && !strncmp(argv[1], "tcpcc", strlen(argv[1])) && 
+	    (!strcmp(argv[2], "?") || !strncmp(argv[2], "help", strlen(argv[2])))) {
+		esc_prn("\n{Hset tcpcc} {Hnewreno}|{Hcubic}\n"
+			"  Set the congestion control of the TCP senders of all the VPCs,\n"
+			"  {Hping -B} and {Hperf}, default {Hcubic}. {Hperf -C} overrides it for\n"
+			"  one run.\n");
+
+		return 1;
+	}
+
 	if (argc == 3 && !strncmp(argv[1], "mtu", strlen(argv[1])) && 
 	    (!strcmp(argv[2], "?") || !strncmp(argv[2], "help", strlen(argv[2])))) {
 		esc_prn("\n{Hset mtu} {Uvalue}\n"
@@ -285,15 +439,24 @@ int help_set(int argc, char **argv)
 		"                               must use [detail|mac|raw] as well as 'all'\n"
 		"             {Hdetail}          Print protocol\n"
 		"             {Hfile}            Dump packets to file 'vpcs[id]_yyyymmddHHMMSS.pcap'\n"
+		"             {Hpcapng}          Dump packets to the shared pcapng file\n"
 		"             {Hoff}             Clear all the flags\n"		
 		"             {Hmac}             Print hardware MAC address\n"
 		"             {Hraw}             Print the first 40 bytes\n"
+		"             {Hrotate} ...      Rotate the capture files. See {Hset dump ?}\n"
+		"             {Hfilter} ...      Dump the matching packets only. See {Hset dump ?}\n"
+		"             {Hrate} {Un}         Print at most {Un} packets per second\n"
 		"    {Hecho} {Hon}|{Hoff}|{Ucolor} ...    Set echoing options. See {Hset echo ?}\n"
+		"    {Hlatency} {Hon}|{Hoff}          Trace the latency of the packet path\n"
 		"    {Hlport} {Uport}               Local port\n"
+		"    {Hlsock} {Upath}               Local socket in the unix mode, quote {Upath}\n"
 		"    {Hmtu} {Uvalue}                Set the maximum transmission unit of the interface\n"
 		"    {Hpcname} {UNAME}              Set the hostname of the current VPC to {UNAME}\n"
 		"    {Hrport} {Uport}               Remote peer port\n"
-		"    {Hrhost} {Uip}                 Remote peer host IPv4 address\n");
+		"    {Hrhost} {Uip}                 Remote peer host IPv4 address\n"
+		"    {Hrsock} {Upath}               Remote peer socket in the unix mode, quote {Upath}\n"
+		"    {Hshm} {UNAME}|{Hoff}             Use the shared memory link {UNAME}\n"
+		"    {Htcpcc} {Hnewreno}|{Hcubic}       Congestion control of the TCP senders\n");
 	
 	return 1;
 }
@@ -332,6 +495,27 @@ int help_show(int argc, char **argv)
 		"  Show IPv6 mtu table for VPC {Udigit} (default this VPC) or all VPCs\n",
 		"\n{Hshow mtu6}\n"
 		"  Show IPv6 mtu table\n"};
+	char *hstats[2] = {
+		"\n{Hshow stats} [{Udigit}|{Hall}] [{Hreset}]\n"
+		"  Show the packet counters and queue depths for VPC {Udigit} (default this VPC)\n"
+		"  or all VPCs. {Hreset} clears them.\n",
+		"\n{Hshow stats} [{Hreset}]\n"
+		"  Show the packet counters and queue depths. {Hreset} clears them.\n"};
+	char *hlat[2] = {
+		"\n{Hshow latency} [{Udigit}|{Hall}] [{Hreset}]\n"
+		"  Show the latency of each stage of the packet path for VPC {Udigit}\n"
+		"  (default this VPC) or all VPCs. {Hreset} clears the histograms.\n"
+		"  The stages are: {Hread} from the device, {Hup} handled by the IP stack,\n"
+		"  {Hbgoq} queued for output, {Houtput} taken by the output thread, {Harp}\n"
+		"  ether address resolved, {Hoq} queued to the writer, {Hwrite} written to\n"
+		"  the device. The time between two stamps is charged to the later stage.\n",
+		"\n{Hshow latency} [{Hreset}]\n"
+		"  Show the latency of each stage of the packet path. {Hreset} clears\n"
+		"  the histograms.\n"
+		"  The stages are: {Hread} from the device, {Hup} handled by the IP stack,\n"
+		"  {Hbgoq} queued for output, {Houtput} taken by the output thread, {Harp}\n"
+		"  ether address resolved, {Hoq} queued to the writer, {Hwrite} written to\n"
+		"  the device. The time between two stamps is charged to the later stage.\n"};
 	char *hh[3] = {
 		"\n{Hshow} [{UARG}]\n"
 		"  Show information for ARG\n"
@@ -346,7 +530,9 @@ int help_show(int argc, char **argv)
 		"       {Hipv6} [{Udigit}|{Hall}]   Show IPv6 details for VPC {Udigit} or all VPCs\n"
 		"                          shows VPC Name, IPv6 addresses/mask, gateway, MAC,\n"
 		"                          lport, rhost:rport and MTU\n"
+		"       {Hlatency} [{Udigit}|{Hall}] Show packet path latency for VPC {Udigit} or all VPCs\n"
 		"       {Hmtu6} [{Udigit}|{Hall}]   Show IPv6 mtu table for VPC {Udigit} or all VPCs\n"
+		"       {Hstats} [{Udigit}|{Hall}]  Show packet counters for VPC {Udigit} or all VPCs\n"
 		"       {Hversion}            Show the version information\n\n"
 		"  Notes: \n"
 		"  1. If no parameter is given, the key information of all VPCs will be displayed\n"
@@ -362,6 +548,8 @@ int help_show(int argc, char **argv)
 		"       {Hipv6} [{Hall}]         Show IPv6 details\n"
 		"                          Shows VPC Name, IPv6 addresses/mask, gateway, MAC,\n"
 		"                          lport, rhost:rport and MTU\n"
+		"       {Hlatency}            Show the latency of the packet path\n"
+		"       {Hstats}              Show packet counters and queue depths\n"
 		"       {Hversion}            Show the version information\n\n"
 		"  Notes: \n"
 		"  1. If no parameter is given, the key information of the current VPC will be\n"
@@ -404,6 +592,20 @@ int help_show(int argc, char **argv)
 		return 1;
 	}
 	
+	if (argc == 3 && !strncmp(argv[1], "latency", strlen(argv[1])) && 
+	    (!strcmp(argv[2], "?") || !strncmp(argv[2], "help", strlen(argv[2])))) {
+		esc_prn("%s", num_pths > 1 ? hlat[0] : hlat[1]);
+
+		return 1;
+	}
+
+	if (argc == 3 && !strncmp(argv[1], "stats", strlen(argv[1])) && 
+	    (!strcmp(argv[2], "?") || !strncmp(argv[2], "help", strlen(argv[2])))) {
+		esc_prn("%s", num_pths > 1 ? hstats[0] : hstats[1]);
+
+		return 1;
+	}
+	
 	if (argc > 1 && 
 	    (!strcmp(argv[argc - 1], "?") || !strncmp(argv[argc - 1], "help", strlen(argv[argc - 1])))) {
 		esc_prn("%s", hh[0]);
@@ -459,6 +661,7 @@ int run_help(int argc, char **argv)
 	esc_prn("{Harp} %s          Shortcut for: {Hshow arp}. "
 		"Show arp table\n", (num_pths > 1) ? "[{Udigit}|{Hall}]" : "             ");
 	esc_prn("{Hclear} {UARG}                Clear IPv4/IPv6, arp/neighbor cache, command history\n"
+		"{Hconngen} {UHOST} [{UOPTION} ...] Open TCP connections at a rate. See {Hconngen ?}\n"
 		"{Hdhcp} [{UOPTION}]            Shortcut for: {Hip dhcp}. Get IPv4 address via DHCP\n"
 		"{Hdisconnect}               Exit the telnet session (daemon mode)\r\n"
 		"{Hecho} {UTEXT}                Display {UTEXT} in output. See also  {Hset echo ?}\n"
@@ -466,6 +669,7 @@ int run_help(int argc, char **argv)
 		"{Hhistory}                  Shortcut for: {Hshow history}. List the command history\n"
 		"{Hip} {UARG} ... [{UOPTION}]      Configure the current VPC's IP settings. See {Hip ?}\n"
 		"{Hload} [{UFILENAME}]          Load the configuration/script from the file {UFILENAME}\n"
+		"{Hperf} [{UHOST}] [{UOPTION} ...] Measure the TCP/UDP throughput. See {Hperf ?}\n"
 		"{Hping} {UHOST} [{UOPTION} ...]   Ping {UHOST} with ICMP (default) or TCP/UDP. See {Hping ?}\n"
 		"{Hquit}                     Quit program\n"
 		"{Hrelay} {UARG} ...            Configure packet relay between UDP ports. See {Hrelay ?}\n"
@@ -475,7 +679,9 @@ int run_help(int argc, char **argv)
 		"{Hshow} [{UARG} ...]           Print the information of VPCs (default). See {Hshow ?}\n"
 		"{Hsleep} [{Useconds}] [TEXT]   Print TEXT and pause running script for {Useconds}\n"
 		"{Htrace} {UHOST} [{UOPTION} ...]  Print the path packets take to network {UHOST}\n"
-		"{Hversion}                  Shortcut for: {Hshow version}\n\n"
+		"{Hversion}                  Shortcut for: {Hshow version}\n"
+		"{Hwebload} {UHOST} [{UOPTION} ...] Load a web server with requests. See {Hwebload ?}\n"
+		"{Hwebserver} [{Uport}]         Serve a web page on {Uport}. See {Hwebserver ?}\n\n"
 		"To get command syntax help, please enter '{H?}' as an argument of the command.\n");
 	
 	return 1;
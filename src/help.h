@@ -36,6 +36,7 @@ int help_hist(int argc, char **argv);
 int help_ip(int argc, char **argv);
 int help_load(int argc, char **argv);
 int help_neighbor(int argc, char **argv);
+int help_perf(int argc, char **argv);
 int help_ping(int argc, char **argv);
 int help_trace(int argc, char **argv);
 int help_relay(int argc, char **argv);
@@ -46,6 +47,9 @@ int help_show(int argc, char **argv);
 int help_shut(int argc, char **argv);
 int help_sleep(int argc, char **argv);
 int help_version(int argc, char **argv);
+int help_webserver(int argc, char **argv);
+int help_webload(int argc, char **argv);
+int help_conngen(int argc, char **argv);
 int help_write(int argc, char **argv);
 
 #define EHL(x) "\033[1m"x"\033[0m"
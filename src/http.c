@@ -2,15 +2,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 
 
+static const char* http_header_value(const char *line, int len, const char *name, int *value_length);
+static int http_headers_end(const char *buf, int len);
+
 char* prepare_http_response(int code, const unsigned char* content, int content_length, int *resulting_size){
-    const int max_header_length = 100;
+    const int max_header_length = 160;
     int max_length = max_header_length + content_length;
     char *response = malloc(max_length);
 
-    int n = snprintf(response, max_header_length, "HTTP/1.1 %d OK\r\nContent-Length: %d\r\nContent-Type: text/html\r\n\r\n", code, content_length);
+    if(response == NULL){
+        return 0;
+    }
+
+    int n = prepare_http_header(response, max_header_length, code, "text/html", content_length, 0);
     if(n < 0){
         free(response);
         return 0;
@@ -22,15 +30,228 @@ char* prepare_http_response(int code, const unsigned char* content, int content_
     return response;
 }
 
-// return 0 - if valid http request
+// return the length of the status line and the headers written to buf,
+//        -1 if they do not fit
+int prepare_http_header(char *buf, int size, int code, const char *type, long long content_length, int keepalive){
+    int n = snprintf(buf, size, "HTTP/1.1 %d %s\r\nServer: vpcs\r\nContent-Length: %lld\r\nContent-Type: %s\r\nConnection: %s\r\n\r\n",
+        code, http_reason(code), content_length, type, keepalive ? "keep-alive" : "close");
+    if(n < 0 || n >= size){
+        return -1;
+    }
+
+    return n;
+}
+
+const char* http_reason(int code){
+    switch(code){
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    }
+    return "Unknown";
+}
+
+// parse the request line and the headers at the head of request, the
+// requests of a pipeline follow each other after the body of the last.
+//
+// return the length of the request line and the headers
+//        0 - if not complete yet
 //       -1 - if couldn't parse
 // 
-int parse_http_request(char* request, http_request_type *type, char **path){
-    if(strncmp("GET", request, strlen("GET")) == 0){
-        *type = HTTP_GET;
-    } else{
+int parse_http_request(const char* request, int len, struct http_request *req){
+    static const struct { const char *name; http_request_type type; } methods[] = {
+        {"GET ", HTTP_GET}, {"HEAD ", HTTP_HEAD}, {"POST ", HTTP_POST},
+        {"PUT ", HTTP_PUT}, {"DELETE ", HTTP_DELETE},
+    };
+    const char *line = request, *end = request + len, *eol, *p, *value;
+    int i, n, value_length, close = 0, keepalive = 0;
+
+    memset(req, 0, sizeof(*req));
+
+    if((n = http_headers_end(request, len)) == 0){
+        return 0;
+    }
+    end = request + n;
+
+    // METHOD SP path SP HTTP/1.x
+    eol = memchr(line, '\n', end - line);
+    req->type = HTTP_OTHER;
+    for(i = 0; i < sizeof(methods) / sizeof(methods[0]); i++){
+        n = strlen(methods[i].name);
+        if(eol - line > n && strncmp(methods[i].name, line, n) == 0){
+            req->type = methods[i].type;
+            break;
+        }
+    }
+    p = memchr(line, ' ', eol - line);
+    if(p == NULL){
+        return -1;
+    }
+    line = p + 1;
+    p = memchr(line, ' ', eol - line);
+    if(p == NULL || p == line || *line != '/' || p - line >= HTTP_MAXPATH){
+        return -1;
+    }
+    memcpy(req->path, line, p - line);
+    req->path[p - line] = '\0';
+    line = p + 1;
+    if(eol - line < 8 || strncmp("HTTP/1.", line, 7) != 0 || line[7] < '0' || line[7] > '9'){
+        return -1;
+    }
+    req->version = line[7] - '0';
+
+    // the headers of interest
+    for(line = eol + 1; line < end; line = eol + 1){
+        eol = memchr(line, '\n', end - line);
+        if((value = http_header_value(line, eol - line, "Connection", &value_length)) != NULL){
+            if(value_length == 5 && strncasecmp(value, "close", 5) == 0){
+                close = 1;
+            } else if(value_length == 10 && strncasecmp(value, "keep-alive", 10) == 0){
+                keepalive = 1;
+            }
+        } else if((value = http_header_value(line, eol - line, "Content-Length", &value_length)) != NULL){
+            req->content_length = strtol(value, NULL, 10);
+            if(req->content_length < 0){
+                return -1;
+            }
+        }
+    }
+
+    // HTTP/1.1 keeps the connection unless told, HTTP/1.0 closes it
+    req->keepalive = req->version >= 1 ? !close : keepalive;
+
+    return end - request;
+}
+
+// parse the status line and the headers at the head of response, the
+// responses of a pipeline follow each other after the body of the last.
+//
+// return the length of the status line and the headers
+//        0 - if not complete yet
+//       -1 - if couldn't parse
+//
+int parse_http_response(const char* response, int len, struct http_response *rsp){
+    const char *line = response, *end, *eol, *value;
+    int n, value_length, close = 0, keepalive = 0;
+
+    memset(rsp, 0, sizeof(*rsp));
+    rsp->content_length = -1;
+
+    if((n = http_headers_end(response, len)) == 0){
+        return 0;
+    }
+    end = response + n;
+
+    // HTTP/1.x SP code SP reason
+    eol = memchr(line, '\n', end - line);
+    if(eol - line < 12 || strncmp("HTTP/1.", line, 7) != 0 || line[7] < '0' || line[7] > '9' || line[8] != ' '){
+        return -1;
+    }
+    rsp->version = line[7] - '0';
+    rsp->code = strtol(line + 9, NULL, 10);
+    if(rsp->code < 100 || rsp->code > 999){
+        return -1;
+    }
+
+    for(line = eol + 1; line < end; line = eol + 1){
+        eol = memchr(line, '\n', end - line);
+        if((value = http_header_value(line, eol - line, "Connection", &value_length)) != NULL){
+            if(value_length == 5 && strncasecmp(value, "close", 5) == 0){
+                close = 1;
+            } else if(value_length == 10 && strncasecmp(value, "keep-alive", 10) == 0){
+                keepalive = 1;
+            }
+        } else if((value = http_header_value(line, eol - line, "Content-Length", &value_length)) != NULL){
+            rsp->content_length = strtoll(value, NULL, 10);
+            if(rsp->content_length < 0){
+                return -1;
+            }
+        } else if((value = http_header_value(line, eol - line, "Transfer-Encoding", &value_length)) != NULL){
+            rsp->chunked = value_length >= 7 && strncasecmp(value + value_length - 7, "chunked", 7) == 0;
+        }
+    }
+
+    // the length of the chunks wins, no body at all in some
+    if(rsp->chunked){
+        rsp->content_length = -1;
+    }
+    if(rsp->code < 200 || rsp->code == 204 || rsp->code == 304){
+        rsp->content_length = 0;
+        rsp->chunked = 0;
+    }
+    rsp->keepalive = rsp->version >= 1 ? !close : keepalive;
+
+    return end - response;
+}
+
+// parse the size line of a chunk, "\r\n" ending the data of the last
+// one may come first
+//
+// return the length of the line, size is the one of the data after it
+//        0 - if not complete yet
+//       -1 - if couldn't parse
+//
+int parse_http_chunk(const char* chunk, int len, long long *size){
+    const char *p = chunk, *eol;
+    char *e;
+
+    if(len >= 2 && p[0] == '\r' && p[1] == '\n'){
+        p += 2;
+        len -= 2;
+    }
+    eol = memchr(p, '\n', len);
+    if(eol == NULL){
+        return len > 32 ? -1 : 0;
+    }
+    *size = strtoll(p, &e, 16);
+    if(e == p || *size < 0){
         return -1;
     }
 
+    return eol + 1 - chunk;
+}
+
+// return the length up to the empty line ending the headers, 0 if none yet
+static int http_headers_end(const char *buf, int len){
+    const char *p, *end = buf + len;
+
+    for(p = buf; p < end; p++){
+        if(*p != '\n'){
+            continue;
+        }
+        if(p + 1 < end && p[1] == '\n'){
+            return p + 2 - buf;
+        } else if(p + 2 < end && p[1] == '\r' && p[2] == '\n'){
+            return p + 3 - buf;
+        }
+    }
+
     return 0;
 }
+
+// return the value of the header name in line, trimmed, NULL if line is another one
+static const char* http_header_value(const char *line, int len, const char *name, int *value_length){
+    int n = strlen(name);
+
+    if(len <= n || strncasecmp(line, name, n) != 0 || line[n] != ':'){
+        return NULL;
+    }
+    line += n + 1;
+    len -= n + 1;
+    while(len > 0 && (*line == ' ' || *line == '\t')){
+        line++;
+        len--;
+    }
+    while(len > 0 && (line[len - 1] == '\r' || line[len - 1] == ' ' || line[len - 1] == '\t')){
+        len--;
+    }
+    *value_length = len;
+
+    return line;
+}
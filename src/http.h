@@ -1,16 +1,38 @@
+#ifndef _HTTP_H_
+#define _HTTP_H_
 
 typedef enum {
     HTTP_GET,
     HTTP_POST,
     HTTP_DELETE,
     HTTP_PUT,
+    HTTP_HEAD,
+    HTTP_OTHER,
 } http_request_type;
 
-char* prepare_http_response(int code, const unsigned char* content, int content_length, int *resulting_size);
-int parse_http_request(char* request, http_request_type *type, char **path);
-
+#define HTTP_MAXPATH 256
 
+struct http_request {
+    http_request_type type;
+    char path[HTTP_MAXPATH];
+    int version;            /* the minor one, 1 for HTTP/1.1 */
+    int keepalive;          /* the connection is kept after the response */
+    long content_length;    /* of the body following the headers */
+};
 
+struct http_response {
+    int code;
+    int version;            /* the minor one, 1 for HTTP/1.1 */
+    int keepalive;          /* the connection is kept after the body */
+    int chunked;            /* the body comes in chunks */
+    long long content_length;   /* -1 if not told, the body ends with the connection */
+};
 
- 
+char* prepare_http_response(int code, const unsigned char* content, int content_length, int *resulting_size);
+int prepare_http_header(char *buf, int size, int code, const char *type, long long content_length, int keepalive);
+const char* http_reason(int code);
+int parse_http_request(const char* request, int len, struct http_request *req);
+int parse_http_response(const char* response, int len, struct http_response *rsp);
+int parse_http_chunk(const char* chunk, int len, long long *size);
 
+#endif
@@ -0,0 +1,488 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "vpcs.h"
+#include "httpc.h"
+#include "tcpsock.h"
+#include "perf.h"
+#include "trace.h"
+#include "help.h"
+
+extern int pcid;
+extern int ctrl_c;
+
+static int httpc_args(int argc, char **argv, struct httpc *hc, 
+    char **host, char **path, int *port);
+static int httpc_run(struct httpc *hc);
+static void httpc_open(struct httpc *hc, struct httpcconn *cc, 
+    u_int64_t now);
+static void httpc_reopen(struct httpc *hc, struct httpcconn *cc, 
+    u_int64_t now);
+static void httpc_step(struct httpc *hc, struct httpcconn *cc, 
+    u_int64_t now);
+static int httpc_read(struct httpc *hc, struct httpcconn *cc);
+static int httpc_parse(struct httpcconn *cc);
+static void httpc_take(struct httpcconn *cc, int n);
+static void httpc_report(struct httpc *hc, u_int64_t ns);
+static void httpc_lat(const char *name, struct trchist *h);
+static const char *httpc_size(double n, char *buf);
+
+/*
+ * webload HOST [PATH] [-p port] [-c conns] [-r rate] [-t seconds] 
+ *     [-w ms] [-n]
+ */
+int run_webload(int argc, char **argv)
+{
+	pcs *pc = &vpc[pcid];
+	struct httpc hc;
+	char *host = NULL, *path = "/", addr[64];
+	int port = HTTPC_PORT, n, rc;
+
+	if (argc < 2 || (argc == 2 && (!strcmp(argv[1], "?") || 
+	    !strcmp(argv[1], "help"))))
+		return help_webload(argc, argv);
+
+	memset(&hc, 0, sizeof(hc));
+	if (!httpc_args(argc, argv, &hc, &host, &path, &port))
+		return 0;
+	if (host == NULL)
+		return help_webload(argc, argv);
+
+	/* the connections take the addresses of mscb, and their ports */
+	pc->mscb.mtu = pc->mtu;
+	pc->mscb.ttl = TTL;
+	pc->mscb.dport = port;
+	pc->mscb.proto = IPPROTO_TCP;
+	if (!perf_route(pc, host, &hc.ipv))
+		return 0;
+
+	n = snprintf(hc.req, sizeof(hc.req), "GET %s HTTP/1.1\r\n"
+	    "Host: %s%s%s\r\nUser-Agent: vpcs\r\nAccept: */*\r\n%s\r\n", 
+	    path, (strchr(host, ':') != NULL) ? "[" : "", host, 
+	    (strchr(host, ':') != NULL) ? "]" : "", 
+	    hc.close ? "Connection: close\r\n" : "");
+	if (n < 0 || n >= sizeof(hc.req)) {
+		printf("Path too long\n");
+		return 0;
+	}
+	hc.iov.base = hc.req;
+	hc.iov.len = n;
+
+	hc.cc = calloc(hc.conns, sizeof(struct httpcconn));
+	if (hc.cc == NULL) {
+		printf("out of memory\n");
+		return 0;
+	}
+	hc.pc = pc;
+	hc.lsn = tcp_bind(pc, 32768 + random() % (32768 - HTTPC_NPORTS), 
+	    HTTPC_NPORTS);
+	if (hc.lsn == NULL) {
+		free(hc.cc);
+		return 0;
+	}
+
+	if (strchr(host, ':') != NULL)
+		snprintf(addr, sizeof(addr), "[%s]", host);
+	else
+		snprintf(addr, sizeof(addr), "%s", host);
+	printf("Running %ds test @ http://%s:%d%s\n", hc.sec, addr, port, 
+	    path);
+	if (hc.rate > 0)
+		printf("  %d connections, %d requests/s\n", hc.conns, hc.rate);
+	else
+		printf("  %d connections\n", hc.conns);
+
+	rc = httpc_run(&hc);
+	free(hc.cc);
+
+	return rc;
+}
+
+static int httpc_args(int argc, char **argv, struct httpc *hc, 
+    char **host, char **path, int *port)
+{
+	int i;
+
+	hc->conns = HTTPC_CONNS;
+	hc->sec = HTTPC_TIME;
+	hc->timeout = HTTPC_TIMEOUT;
+
+	for (i = 1; i < argc; i++) {
+		if (argv[i][0] == '/') {
+			*path = argv[i];
+			continue;
+		}
+		if (argv[i][0] != '-') {
+			/* the console splits an unquoted path at '/' */
+			if (*host != NULL) {
+				printf("Invalid argument %s, the path must be "
+				    "quoted, e.g. \"/bytes/1M\"\n", argv[i]);
+				return 0;
+			}
+			*host = argv[i];
+			continue;
+		}
+		switch (argv[i][1]) {
+			case 'p':
+				if (i + 1 < argc)
+					*port = atoi(argv[++i]);
+				if (*port < 1 || *port > 65535) {
+					printf("Invalid port\n");
+					return 0;
+				}
+				break;
+			case 'c':
+				if (i + 1 < argc)
+					hc->conns = atoi(argv[++i]);
+				if (hc->conns < 1 || hc->conns > HTTPC_MAXCONNS) {
+					printf("Connections range 1 to %d\n",
+					    HTTPC_MAXCONNS);
+					return 0;
+				}
+				break;
+			case 'r':
+				if (i + 1 < argc)
+					hc->rate = atoi(argv[++i]);
+				if (hc->rate < 0) {
+					printf("Invalid rate\n");
+					return 0;
+				}
+				break;
+			case 't':
+				if (i + 1 < argc)
+					hc->sec = atoi(argv[++i]);
+				if (hc->sec < 1) {
+					printf("Invalid time\n");
+					return 0;
+				}
+				break;
+			case 'w':
+				if (i + 1 < argc)
+					hc->timeout = atoi(argv[++i]);
+				if (hc->timeout < 1) {
+					printf("Invalid timeout\n");
+					return 0;
+				}
+				break;
+			case 'n':
+				hc->close = 1;
+				break;
+			default:
+				printf("Invalid options\n");
+				return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* 
+ * Keep the connections busy till the time is up or Ctrl+C, each sends 
+ * a request once the last is answered. With a rate, the requests are 
+ * due one after another and the latency counts from when they are due
+ * even if no connection was free.
+ */
+static int httpc_run(struct httpc *hc)
+{
+	u_int64_t start, end, now;
+	int i;
+
+	start = now = trace_now();
+	end = start + hc->sec * 1000000000ULL;
+	hc->next = start;
+	for (i = 0; i < hc->conns; i++)
+		httpc_open(hc, &hc->cc[i], now);
+
+	while (!ctrl_c && now < end) {
+		tcp_poll(hc->lsn, HTTPC_POLL);
+		now = trace_now();
+		for (i = 0; i < hc->conns; i++)
+			httpc_step(hc, &hc->cc[i], now);
+	}
+
+	/* FIN as the queues take them, the rest is reset */
+	end = now + HTTPC_LINGER * 1000000ULL;
+	for (i = 0; i < hc->conns; i++) {
+		if (hc->cc[i].c == NULL)
+			continue;
+		while (hc->pc->bgoq.size + hc->pc->oq.size >= TCPSO_OQMAX &&
+		    trace_now() < end)
+			tcp_poll(hc->lsn, HTTPC_POLL);
+		tcp_release(hc->cc[i].c);
+	}
+	while (tcp_conns(hc->lsn) > 0 && trace_now() < end)
+		tcp_poll(hc->lsn, HTTPC_POLL);
+	tcp_unlisten(hc->lsn);
+
+	httpc_report(hc, now - start);
+
+	return 1;
+}
+
+/* 
+ * a new connection, later if the SYNs of the others fill the queues
+ * or the ports are all taken
+ */
+static void httpc_open(struct httpc *hc, struct httpcconn *cc, 
+    u_int64_t now)
+{
+	cc->state = HTTPC_DOWN;
+	cc->c = NULL;
+	if (hc->pc->bgoq.size + hc->pc->oq.size >= TCPSO_OQMAX)
+		return;
+	cc->c = tcp_connect(hc->lsn, hc->ipv, &hc->pc->mscb);
+	if (cc->c == NULL)
+		return;
+	cc->state = HTTPC_CONNECT;
+	cc->t0 = now;
+}
+
+static void httpc_reopen(struct httpc *hc, struct httpcconn *cc, 
+    u_int64_t now)
+{
+	tcp_release(cc->c);
+	httpc_open(hc, cc, now);
+}
+
+static void httpc_step(struct httpc *hc, struct httpcconn *cc, 
+    u_int64_t now)
+{
+	u_int64_t tmo = hc->timeout * 1000000ULL;
+	int k;
+
+	for (;;) {
+		switch (cc->state) {
+		case HTTPC_DOWN:
+			httpc_open(hc, cc, now);
+			return;
+		case HTTPC_CONNECT:
+			k = tcp_sent(cc->c);
+			if (k == 0) {
+				trace_histadd(&hc->st.conn, now - cc->t0);
+				hc->st.conns++;
+				cc->state = HTTPC_IDLE;
+				break;
+			}
+			if (k < 0 || now - cc->t0 > tmo) {
+				hc->st.connerrs++;
+				httpc_reopen(hc, cc, now);
+			}
+			return;
+		case HTTPC_IDLE:
+			if (hc->rate > 0 && hc->next > now)
+				return;
+			if (tcp_push(cc->c, &hc->iov, 1) < 0) {
+				/* the last request may not be acked yet */
+				if (tcp_sent(cc->c) < 0) {
+					hc->st.readerrs++;
+					httpc_reopen(hc, cc, now);
+				}
+				return;
+			}
+			if (hc->rate > 0) {
+				cc->t0 = hc->next;
+				hc->next += 1000000000ULL / hc->rate;
+			} else
+				cc->t0 = now;
+			cc->state = HTTPC_WAIT;
+			cc->part = HTTPC_HEAD;
+			cc->blen = 0;
+			break;
+		case HTTPC_WAIT:
+			k = httpc_read(hc, cc);
+			if (k == 0) {
+				if (now - cc->t0 > tmo) {
+					hc->st.timeouts++;
+					httpc_reopen(hc, cc, now);
+				}
+				return;
+			}
+			if (k < 0) {
+				hc->st.readerrs++;
+				httpc_reopen(hc, cc, now);
+				return;
+			}
+			trace_histadd(&hc->st.lat, now - cc->t0);
+			hc->st.reqs++;
+			hc->st.codes[cc->rsp.code / 100]++;
+			if (hc->close || !cc->rsp.keepalive || 
+			    cc->part == HTTPC_TILLEOF) {
+				httpc_reopen(hc, cc, now);
+				return;
+			}
+			cc->state = HTTPC_IDLE;
+			break;
+		}
+	}
+}
+
+/* return 1 if the response is in, 0 if not yet, -1 if it is lost */
+static int httpc_read(struct httpc *hc, struct httpcconn *cc)
+{
+	int k, rc;
+
+	for (;;) {
+		k = tcp_recv(cc->c, cc->buf + cc->blen, 
+		    HTTPC_BUFSIZE - cc->blen, -1);
+		if (k < 0)
+			return 0;
+		if (k == 0)
+			return (cc->part == HTTPC_TILLEOF) ? 1 : -1;
+		cc->blen += k;
+		hc->st.bytes += k;
+		if ((rc = httpc_parse(cc)) != 0)
+			return rc;
+	}
+}
+
+/* take what came of the response, the body is not kept */
+static int httpc_parse(struct httpcconn *cc)
+{
+	long long size;
+	char *p;
+	int n;
+
+	for (;;) {
+		switch (cc->part) {
+		case HTTPC_HEAD:
+			n = parse_http_response(cc->buf, cc->blen, &cc->rsp);
+			if (n == 0 && cc->blen == HTTPC_BUFSIZE)
+				return -1;
+			if (n <= 0)
+				return n;
+			httpc_take(cc, n);
+			if (cc->rsp.chunked) {
+				cc->part = HTTPC_CHUNK;
+				cc->left = 0;
+			} else if (cc->rsp.content_length >= 0) {
+				cc->part = HTTPC_BODY;
+				cc->left = cc->rsp.content_length;
+			} else
+				cc->part = HTTPC_TILLEOF;
+			break;
+		case HTTPC_BODY:
+			n = (cc->left < cc->blen) ? cc->left : cc->blen;
+			httpc_take(cc, n);
+			cc->left -= n;
+			return (cc->left == 0) ? 1 : 0;
+		case HTTPC_CHUNK:
+			n = (cc->left < cc->blen) ? cc->left : cc->blen;
+			httpc_take(cc, n);
+			cc->left -= n;
+			if (cc->left > 0)
+				return 0;
+			n = parse_http_chunk(cc->buf, cc->blen, &size);
+			if (n <= 0)
+				return n;
+			httpc_take(cc, n);
+			if (size == 0)
+				cc->part = HTTPC_TRAILER;
+			cc->left = size;
+			break;
+		case HTTPC_TRAILER:
+			/* its lines, an empty one is the end */
+			p = memchr(cc->buf, '\n', cc->blen);
+			if (p == NULL)
+				return (cc->blen == HTTPC_BUFSIZE) ? -1 : 0;
+			n = p + 1 - cc->buf;
+			httpc_take(cc, n);
+			if (n <= 2)
+				return 1;
+			break;
+		case HTTPC_TILLEOF:
+			httpc_take(cc, cc->blen);
+			return 0;
+		}
+	}
+}
+
+static void httpc_take(struct httpcconn *cc, int n)
+{
+	cc->blen -= n;
+	if (cc->blen > 0)
+		memmove(cc->buf, cc->buf + n, cc->blen);
+}
+
+/* as wrk does */
+static void httpc_report(struct httpc *hc, u_int64_t ns)
+{
+	struct httpcstats *st = &hc->st;
+	double sec = ns / 1000000000.0;
+	char buf[32];
+	u_long bad;
+
+	printf("  %-8s %9s %8s %8s %8s %9s\n", "", "avg(us)", "p50(us)", 
+	    "p90(us)", "p99(us)", "max(us)");
+	httpc_lat("Connect", &st->conn);
+	httpc_lat("Latency", &st->lat);
+	printf("  %lu requests in %.2fs, %s read, %lu connections\n", 
+	    st->reqs, sec, httpc_size(st->bytes, buf), st->conns);
+	if (st->connerrs + st->readerrs + st->timeouts > 0)
+		printf("  Socket errors: connect %lu, read %lu, timeout %lu\n",
+		    st->connerrs, st->readerrs, st->timeouts);
+	bad = st->reqs - st->codes[2] - st->codes[3];
+	if (bad > 0)
+		printf("  Non-2xx or 3xx responses: %lu\n", bad);
+	printf("Requests/sec: %10.2f\n", st->reqs / sec);
+	printf("Transfer/sec: %10s\n", httpc_size(st->bytes / sec, buf));
+}
+
+static void httpc_lat(const char *name, struct trchist *h)
+{
+	char p50[16], p90[16], p99[16];
+
+	if (h->count == 0) {
+		printf("  %-8s %9s %8s %8s %8s %9s\n", name, "-", "-", "-", 
+		    "-", "-");
+		return;
+	}
+	snprintf(p50, sizeof(p50), "<%lu", trace_histpct(h, 50));
+	snprintf(p90, sizeof(p90), "<%lu", trace_histpct(h, 90));
+	snprintf(p99, sizeof(p99), "<%lu", trace_histpct(h, 99));
+	printf("  %-8s %9.1f %8s %8s %8s %9.1f\n", name, 
+	    h->sum / 1000.0 / h->count, p50, p90, p99, h->max / 1000.0);
+}
+
+static const char *httpc_size(double n, char *buf)
+{
+	static const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+	int i = 0;
+
+	while (n >= 1024 && i < 4) {
+		n /= 1024;
+		i++;
+	}
+	sprintf(buf, "%.2f%s", n, units[i]);
+
+	return buf;
+}
+
+/* end of file */
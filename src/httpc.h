@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef _HTTPC_H_
+#define _HTTPC_H_
+
+#include "vpcs.h"
+#include "trace.h"
+#include "http.h"
+#include "tcpsock.h"
+
+#define HTTPC_PORT	80
+#define HTTPC_CONNS	10		/* default */
+#define HTTPC_MAXCONNS	1024
+#define HTTPC_TIME	10		/* seconds */
+#define HTTPC_TIMEOUT	2000		/* ms, of a connect or a response */
+#define HTTPC_NPORTS	8192		/* bound for the connections */
+#define HTTPC_BUFSIZE	8192		/* the status line and the headers */
+#define HTTPC_REQMAX	512
+#define HTTPC_POLL	1		/* ms */
+#define HTTPC_LINGER	1000		/* ms, for the connections to close */
+
+/* the states of a connection */
+#define HTTPC_DOWN	0		/* no port free yet */
+#define HTTPC_CONNECT	1		/* SYN sent */
+#define HTTPC_IDLE	2		/* ready for a request */
+#define HTTPC_WAIT	3		/* for the response */
+
+/* the parts of a response */
+#define HTTPC_HEAD	0
+#define HTTPC_BODY	1		/* left bytes */
+#define HTTPC_CHUNK	2		/* left bytes of the chunk, then the next */
+#define HTTPC_TRAILER	3		/* after the last chunk */
+#define HTTPC_TILLEOF	4		/* the body ends with the connection */
+
+struct httpcconn {
+	struct tcpconn *c;
+	int state;
+	int part;
+	struct http_response rsp;
+	long long left;
+	u_int64_t t0;			/* ns, the SYN or the request */
+	char buf[HTTPC_BUFSIZE];	/* not parsed yet */
+	int blen;
+};
+
+struct httpcstats {
+	u_long conns;			/* established */
+	u_long reqs;			/* answered */
+	u_int64_t bytes;
+	u_long connerrs;		/* refused or not answered */
+	u_long readerrs;		/* lost or malformed responses */
+	u_long timeouts;
+	u_long codes[10];		/* by the class of the status */
+	struct trchist lat;		/* the request to its response */
+	struct trchist conn;		/* the SYN to its SYN|ACK */
+};
+
+/* a run of webload, from the command line */
+struct httpc {
+	pcs *pc;
+	int ipv;
+	int conns;
+	int rate;			/* requests per second, 0 closed loop */
+	int sec;
+	int timeout;			/* ms */
+	int close;			/* a connection a request */
+	u_int64_t next;			/* ns, the next request of rate */
+	char req[HTTPC_REQMAX];
+	struct tcpiov iov;		/* of req */
+	struct tcplistener *lsn;
+	struct httpcconn *cc;
+	struct httpcstats st;
+};
+
+int run_webload(int argc, char **argv);
+
+#endif
+
+/* end of file */
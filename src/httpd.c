@@ -0,0 +1,667 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vpcs.h"
+#include "httpd.h"
+#include "http.h"
+#include "tcp.h"
+#include "tcpsock.h"
+#include "website.h"
+#include "trace.h"
+#include "help.h"
+
+extern int pcid;
+
+/* the servers of every vpc, only the command line changes them */
+static struct httpd *httpds[MAX_NUM_PTHS];
+
+/* the synthetic payload, HTTPD_PERIOD bytes over and over */
+static char pattern[HTTPD_PERIOD + 65536];
+
+static int httpd_start(pcs *pc, int port, const char *root);
+static int httpd_stop(int port);
+static int httpd_show(int reset);
+static void *httpd_main(void *arg);
+static void httpd_open(struct httpd *hd, struct tcpconn *c);
+static void httpd_close(struct httpd *hd, struct httpconn *hc);
+static int httpd_serve(struct httpd *hd, struct httpconn *hc, u_int64_t now);
+static int httpd_request(struct httpd *hd, struct httpconn *hc, 
+    u_int64_t now);
+static int httpd_cached(struct httpd *hd, struct httpconn *hc, int code, 
+    const char *type, const char *body, int len, int head);
+static struct httpcache *httpd_format(struct httpd *hd, int code, 
+    const char *type, const char *body, int len, int keepalive, int head,
+    int mss);
+static int httpd_error(struct httpd *hd, struct httpconn *hc, int code);
+static int httpd_body(struct httpd *hd, struct httpconn *hc, 
+    const char *type, const char *base, u_int len, u_int period, int head);
+static int httpd_bytes(struct httpd *hd, struct httpconn *hc, 
+    const char *arg, int head);
+static int httpd_file(struct httpd *hd, struct httpconn *hc, 
+    const char *path, int head);
+static const char *httpd_type(const char *name);
+static void httpd_unmap(struct httpconn *hc);
+
+/*
+ * webserver [port] [directory]
+ * webserver stop [port]
+ * webserver show [reset]
+ */
+int run_webserver(int argc, char **argv)
+{
+	struct stat st;
+	char *root = NULL;
+	int port = HTTPD_PORT, stop = 0;
+
+	if (argc > 1 && !strncmp(argv[1], "show", strlen(argv[1])))
+		return httpd_show(argc > 2 && 
+		    !strncmp(argv[2], "reset", strlen(argv[2])));
+
+	if (argc > 1 && !strncmp(argv[1], "stop", strlen(argv[1]))) {
+		stop = 1;
+		port = 0;
+		argv++;
+		argc--;
+	}
+	if (argc > 1 && isdigit(argv[1][0])) {
+		port = atoi(argv[1]);
+		if (port <= 0 || port > 65535) {
+			printf("Invalid port\n");
+			return 0;
+		}
+		argv++;
+		argc--;
+	}
+	if (stop)
+		return (argc > 1) ? help_webserver(0, NULL) : httpd_stop(port);
+
+	if (argc > 2)
+		return help_webserver(0, NULL);
+	if (argc > 1) {
+		root = argv[1];
+		if (stat(root, &st) != 0 || !S_ISDIR(st.st_mode)) {
+			printf("Invalid directory %s\n", root);
+			return 0;
+		}
+	}
+
+	return httpd_start(&vpc[pcid], port, root);
+}
+
+static int httpd_start(pcs *pc, int port, const char *root)
+{
+	struct httpd *hd;
+	int i;
+
+	hd = calloc(1, sizeof(struct httpd));
+	if (hd == NULL || (root != NULL && (hd->root = strdup(root)) == NULL)) {
+		printf("out of memory\n");
+		free(hd);
+		return 0;
+	}
+	hd->pc = pc;
+	hd->port = port;
+	hd->lsn = tcp_listen(pc, port, TCPSO_MAXBACKLOG);
+	if (hd->lsn == NULL) {
+		free(hd->root);
+		free(hd);
+		return 0;
+	}
+
+	/* the same bytes every time, a server may be reading them */
+	for (i = 0; i < sizeof(pattern); i++)
+		pattern[i] = "0123456789abcdefghijklmnopqrstuvwxyz"
+		    "ABCDEFGHIJKLMNOPQRSTUVWXYZ+/"[i % 64];
+
+	if (pthread_create(&hd->tid, NULL, httpd_main, hd) != 0) {
+		printf("Failed to start the server\n");
+		tcp_unlisten(hd->lsn);
+		free(hd->root);
+		free(hd);
+		return 0;
+	}
+	hd->next = httpds[pcid];
+	httpds[pcid] = hd;
+	if (root != NULL)
+		printf("Serving %s on port %d\n", root, port);
+	else
+		printf("Serving the page on port %d\n", port);
+
+	return 1;
+}
+
+/* stop the server of port, all of them if port is 0 */
+static int httpd_stop(int port)
+{
+	struct httpd **pp, *hd;
+	int n = 0;
+
+	pp = &httpds[pcid];
+	while ((hd = *pp) != NULL) {
+		if (port != 0 && hd->port != port) {
+			pp = &hd->next;
+			continue;
+		}
+		*pp = hd->next;
+		hd->stop = 1;
+		pthread_join(hd->tid, NULL);
+		printf("Stopped the server on port %d\n", hd->port);
+		free(hd->root);
+		free(hd);
+		n++;
+	}
+	if (n == 0)
+		printf("No server%s%.0d\n", port ? " on port " : "", port);
+
+	return 1;
+}
+
+/* 
+ * port  conns  open  requests  errors  avg(us)  p50(us)  p99(us)  max(us)
+ * the errors are the 4xx and 5xx answers and the connections lost. The
+ * counters go on while read, a request may be missed.
+ */
+static int httpd_show(int reset)
+{
+	struct httpd *hd;
+	struct httpstats *st;
+	char p50[16], p99[16];
+
+	if (httpds[pcid] == NULL) {
+		printf("No server\n");
+		return 1;
+	}
+
+	printf("port   conns  open  requests  errors  avg(us)  p50(us)"
+	    "  p99(us)  max(us)\n");
+	for (hd = httpds[pcid]; hd != NULL; hd = hd->next) {
+		st = &hd->st;
+		if (st->lat.count > 0) {
+			snprintf(p50, sizeof(p50), "<%lu", 
+			    trace_histpct(&st->lat, 50));
+			snprintf(p99, sizeof(p99), "<%lu", 
+			    trace_histpct(&st->lat, 99));
+		} else
+			strcpy(p50, strcpy(p99, "-"));
+		printf("%-5d %6lu %5d %9lu %7lu %8.1f %8s %8s %8.1f\n",
+		    hd->port, st->conns, hd->nconns, st->reqs, 
+		    st->codes[4] + st->codes[5] + st->resets, 
+		    st->lat.count ? st->lat.sum / 1000.0 / st->lat.count : 0.0,
+		    p50, p99, st->lat.max / 1000.0);
+		if (reset)
+			memset(st, 0, sizeof(struct httpstats));
+	}
+
+	return 1;
+}
+
+/*
+ * Wake up on every event of the listener, take the new connections, 
+ * then answer whatever came on each. A connection waits for the ack of
+ * its last responses before the next ones are sent.
+ */
+static void *httpd_main(void *arg)
+{
+	struct httpd *hd = arg;
+	struct httpconn *hc, *next;
+	struct tcpconn *c;
+	u_int64_t now;
+	int i;
+
+	while (!hd->stop) {
+		tcp_poll(hd->lsn, HTTPD_POLL);
+
+		while ((c = tcp_accept(hd->lsn, -1)) != NULL)
+			httpd_open(hd, c);
+
+		now = trace_now() / 1000000;
+		for (hc = hd->conns; hc != NULL; hc = next) {
+			next = hc->next;
+			if (httpd_serve(hd, hc, now) != 0)
+				httpd_close(hd, hc);
+		}
+	}
+
+	/* the released ones in flight are reset by tcp_unlisten */
+	for (hc = hd->conns; hc != NULL; hc = hc->next)
+		tcp_release(hc->c);
+	tcp_unlisten(hd->lsn);
+	while ((hc = hd->conns) != NULL) {
+		hd->conns = hc->next;
+		httpd_unmap(hc);
+		free(hc);
+	}
+	for (i = 0; i < hd->ncache; i++) {
+		free(hd->cache[i].data);
+		free(hd->cache[i].sums);
+	}
+
+	return NULL;
+}
+
+static void httpd_open(struct httpd *hd, struct tcpconn *c)
+{
+	struct httpconn *hc = NULL;
+
+	if (hd->nconns < HTTPD_MAXCONNS)
+		hc = calloc(1, sizeof(struct httpconn));
+	if (hc == NULL) {
+		tcp_release(c);
+		return;
+	}
+	hc->c = c;
+	hc->idle = trace_now() / 1000000;
+	hc->next = hd->conns;
+	hd->conns = hc;
+	hd->nconns++;
+	hd->st.conns++;
+}
+
+/* call once no response is in flight, see tcp_push */
+static void httpd_close(struct httpd *hd, struct httpconn *hc)
+{
+	struct httpconn **pp;
+
+	for (pp = &hd->conns; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == hc) {
+			*pp = hc->next;
+			break;
+		}
+	}
+	hd->nconns--;
+	tcp_release(hc->c);
+	httpd_unmap(hc);
+	free(hc);
+}
+
+/* return 1 if the connection is done */
+static int httpd_serve(struct httpd *hd, struct httpconn *hc, u_int64_t now)
+{
+	u_int64_t ns;
+	int i, k;
+
+	/* the responses in flight */
+	if (hc->niov > 0) {
+		k = tcp_sent(hc->c);
+		if (k < 0) {
+			hd->st.resets++;
+			return 1;
+		}
+		if (k == 0) {
+			ns = trace_now();
+			for (i = 0; i < hc->nrsp; i++)
+				trace_histadd(&hd->st.lat, ns - hc->t0[i]);
+			hc->niov = 0;
+			hc->nrsp = 0;
+			hc->sealed = 0;
+			hc->idle = now;
+			httpd_unmap(hc);
+			if (hc->close)
+				return 1;
+		}
+	}
+
+	/* the pipeline, read on while the responses are in flight */
+	while (!hc->eof && hc->rlen < HTTPD_REQMAX) {
+		k = tcp_recv(hc->c, hc->req + hc->rlen, 
+		    HTTPD_REQMAX - hc->rlen, -1);
+		if (k < 0)
+			break;
+		if (k == 0)
+			hc->eof = 1;
+		hc->rlen += k;
+		hc->idle = now;
+	}
+	if (hc->niov > 0)
+		return 0;
+
+	/* a response takes two parts at most */
+	while (hc->rlen > 0 && !hc->close && !hc->sealed &&
+	    hc->nrsp < HTTPD_PIPEMAX && hc->niov < TCPSO_MAXIOV - 1) {
+		if (httpd_request(hd, hc, now) <= 0)
+			break;
+	}
+	if (hc->niov > 0) {
+		if (tcp_push(hc->c, hc->iov, hc->niov) == 0)
+			return 0;
+		hc->niov = 0;
+		hd->st.resets++;
+		return 1;
+	}
+
+	if (hc->eof || hc->close)
+		return 1;
+	return (now - hc->idle > HTTPD_IDLE);
+}
+
+/* 
+ * Answer the request at the head of req.
+ * return 1 if answered, 0 if not all of it came, -1 if out of memory.
+ */
+static int httpd_request(struct httpd *hd, struct httpconn *hc, 
+    u_int64_t now)
+{
+	struct http_request r;
+	char *p;
+	int n, rc, head;
+
+	n = parse_http_request(hc->req, hc->rlen, &r);
+	if (n == 0 && hc->rlen < HTTPD_REQMAX)
+		return 0;
+	if (n <= 0) {
+		hc->rlen = 0;
+		return httpd_error(hd, hc, (n == 0) ? 431 : 400);
+	}
+	if (r.content_length > HTTPD_REQMAX - n) {
+		hc->rlen = 0;
+		return httpd_error(hd, hc, 413);
+	}
+	if (hc->rlen < n + r.content_length)
+		return 0;
+
+	hc->t0[hc->nrsp] = trace_now();
+	hd->st.reqs++;
+	hc->close = !r.keepalive;
+
+	/* the query is none of ours */
+	if ((p = strchr(r.path, '?')) != NULL)
+		*p = '\0';
+
+	head = (r.type == HTTP_HEAD);
+	if (r.type != HTTP_GET && r.type != HTTP_HEAD)
+		rc = httpd_error(hd, hc, 
+		    (r.type == HTTP_OTHER) ? 501 : 405);
+	else if (!strncmp(r.path, "/bytes/", 7))
+		rc = httpd_bytes(hd, hc, r.path + 7, head);
+	else if (hd->root != NULL && 
+	    (rc = httpd_file(hd, hc, r.path, head)) != 0)
+		;
+	else if (!strcmp(r.path, "/") || !strcmp(r.path, "/index.html"))
+		rc = httpd_cached(hd, hc, 200, "text/html", 
+		    (const char *)website_html, website_html_len, head);
+	else
+		rc = httpd_error(hd, hc, 404);
+
+	n += r.content_length;
+	hc->rlen -= n;
+	memmove(hc->req, hc->req + n, hc->rlen);
+
+	return rc;
+}
+
+/*
+ * Send a response of the cache, the page or a status, formatted once 
+ * with the sums of its segments, see struct tcpiov. They are told by 
+ * code as no two of them have the same.
+ */
+static int httpd_cached(struct httpd *hd, struct httpconn *hc, int code, 
+    const char *type, const char *body, int len, int head)
+{
+	struct httpcache *e = NULL;
+	struct tcpiov *v;
+	int keepalive = !hc->close, mss = hc->c->mss, i;
+
+	for (i = 0; i < hd->ncache; i++) {
+		e = &hd->cache[i];
+		if (e->code == code && e->keepalive == keepalive && 
+		    e->head == head)
+			break;
+	}
+	if (i == hd->ncache) {
+		e = httpd_format(hd, code, type, body, len, keepalive, head, 
+		    mss);
+		if (e == NULL) {
+			hc->close = 1;
+			return -1;
+		}
+	}
+
+	v = &hc->iov[hc->niov++];
+	v->base = e->data;
+	v->len = e->len;
+	v->period = 0;
+	/* a connection of another mss sums its segments */
+	v->sums = (e->mss == mss) ? e->sums : NULL;
+	v->sumlen = e->mss;
+	hc->nrsp++;
+	hd->st.codes[code / 100]++;
+
+	return 1;
+}
+
+/* a new response of the cache, with the sums of its segments for mss */
+static struct httpcache *httpd_format(struct httpd *hd, int code, 
+    const char *type, const char *body, int len, int keepalive, int head,
+    int mss)
+{
+	struct httpcache *e;
+	int i, n, nsums;
+
+	if (hd->ncache == HTTPD_MAXCACHE)
+		return NULL;
+	e = &hd->cache[hd->ncache];
+
+	e->data = malloc(HTTPD_HDRMAX + len);
+	if (e->data == NULL)
+		return NULL;
+	n = prepare_http_header(e->data, HTTPD_HDRMAX, code, type, len, 
+	    keepalive);
+	if (n < 0) {
+		free(e->data);
+		return NULL;
+	}
+	if (!head) {
+		memcpy(e->data + n, body, len);
+		n += len;
+	}
+
+	nsums = (n + mss - 1) / mss;
+	e->sums = malloc(nsums * sizeof(u_int));
+	if (e->sums == NULL) {
+		free(e->data);
+		return NULL;
+	}
+	for (i = 0; i < nsums; i++)
+		e->sums[i] = cksum_part(e->data + i * mss, 
+		    (n - i * mss < mss) ? n - i * mss : mss);
+
+	e->code = code;
+	e->keepalive = keepalive;
+	e->head = head;
+	e->len = n;
+	e->mss = mss;
+	hd->ncache++;
+
+	return e;
+}
+
+/* a short page of the status, the connection is closed after a bad one */
+static int httpd_error(struct httpd *hd, struct httpconn *hc, int code)
+{
+	char body[64];
+	int len;
+
+	/* not taken as a request by httpd_request */
+	if (code == 400 || code == 413 || code == 431) {
+		hc->close = 1;
+		hc->t0[hc->nrsp] = trace_now();
+		hd->st.reqs++;
+	}
+	len = snprintf(body, sizeof(body), "%d %s\n", code, http_reason(code));
+
+	return httpd_cached(hd, hc, code, "text/plain", body, len, 0);
+}
+
+/* 
+ * a response whose body is sent from base as it is, see struct tcpiov,
+ * it is the last of the ones sent at once
+ */
+static int httpd_body(struct httpd *hd, struct httpconn *hc, 
+    const char *type, const char *base, u_int len, u_int period, int head)
+{
+	struct tcpiov *v;
+	int n;
+
+	n = prepare_http_header(hc->hdr, HTTPD_HDRMAX, 200, type, len, 
+	    !hc->close);
+	if (n < 0) {
+		hc->close = 1;
+		return -1;
+	}
+	v = &hc->iov[hc->niov++];
+	memset(v, 0, sizeof(struct tcpiov));
+	v->base = hc->hdr;
+	v->len = n;
+	if (!head && len > 0) {
+		v = &hc->iov[hc->niov++];
+		memset(v, 0, sizeof(struct tcpiov));
+		v->base = base;
+		v->len = len;
+		v->period = period;
+	}
+	hc->sealed = 1;
+	hc->nrsp++;
+	hd->st.codes[2]++;
+
+	return 1;
+}
+
+/* /bytes/N[K|M|G], N bytes of the pattern */
+static int httpd_bytes(struct httpd *hd, struct httpconn *hc, 
+    const char *arg, int head)
+{
+	unsigned long long n;
+	char *p;
+
+	if (!isdigit(arg[0]))
+		return httpd_error(hd, hc, 404);
+	n = strtoull(arg, &p, 10);
+	switch (toupper(*p)) {
+		case 'G':
+			n <<= 10;
+			/* FALLTHROUGH */
+		case 'M':
+			n <<= 10;
+			/* FALLTHROUGH */
+		case 'K':
+			n <<= 10;
+			p++;
+			break;
+	}
+	if (*p != '\0' || n > HTTPD_MAXBYTES)
+		return httpd_error(hd, hc, 404);
+
+	return httpd_body(hd, hc, "application/octet-stream", pattern, n, 
+	    HTTPD_PERIOD, head);
+}
+
+/*
+ * The file of path under the root, mapped till its response is acked.
+ * return 0 if there is no such file.
+ */
+static int httpd_file(struct httpd *hd, struct httpconn *hc, 
+    const char *path, int head)
+{
+	char name[PATH_MAX];
+	struct stat st;
+	void *map = NULL;
+	int fd, rc;
+
+	/* nothing above the root */
+	if (strstr(path, "..") != NULL)
+		return 0;
+	if (snprintf(name, sizeof(name), "%s%s%s", hd->root, path, 
+	    (path[strlen(path) - 1] == '/') ? "index.html" : "") >= 
+	    sizeof(name))
+		return 0;
+
+	fd = open(name, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || 
+	    st.st_size > HTTPD_MAXBYTES) {
+		close(fd);
+		return 0;
+	}
+	if (!head && st.st_size > 0) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			close(fd);
+			return httpd_error(hd, hc, 500);
+		}
+	}
+	close(fd);
+
+	rc = httpd_body(hd, hc, httpd_type(name), map, st.st_size, 0, head);
+	if (map != NULL) {
+		hc->map = map;
+		hc->maplen = st.st_size;
+		if (rc < 0)
+			httpd_unmap(hc);
+	}
+
+	return rc;
+}
+
+static const char *httpd_type(const char *name)
+{
+	static const char *types[][2] = {
+		{".html", "text/html"}, {".htm", "text/html"},
+		{".txt", "text/plain"}, {".css", "text/css"},
+		{".js", "application/javascript"}, 
+		{".json", "application/json"}, {".png", "image/png"}, 
+		{".jpg", "image/jpeg"}, {".gif", "image/gif"}};
+	const char *ext = strrchr(name, '.');
+	int i;
+
+	for (i = 0; ext != NULL && i < sizeof(types) / sizeof(types[0]); i++) {
+		if (!strcasecmp(ext, types[i][0]))
+			return types[i][1];
+	}
+
+	return "application/octet-stream";
+}
+
+/* the body is acked or will never be */
+static void httpd_unmap(struct httpconn *hc)
+{
+	if (hc->map != NULL) 
+		munmap(hc->map, hc->maplen);
+	hc->map = NULL;
+}
+
+/* end of file */
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef _HTTPD_H_
+#define _HTTPD_H_
+
+#include "vpcs.h"
+#include "trace.h"
+#include "tcpsock.h"
+
+#define HTTPD_PORT	80
+#define HTTPD_MAXCONNS	256		/* of a server */
+#define HTTPD_REQMAX	8192		/* request line, headers and body */
+#define HTTPD_HDRMAX	256		/* of a response */
+#define HTTPD_PIPEMAX	16		/* responses sent at once */
+#define HTTPD_IDLE	15000		/* ms, of a kept connection */
+#define HTTPD_POLL	100		/* ms */
+#define HTTPD_MAXBYTES	(1U << 30)	/* of a body sent from where it is */
+#define HTTPD_PERIOD	4096		/* of the synthetic payload */
+#define HTTPD_MAXCACHE	32		/* responses formatted once */
+
+/* a connection, the requests are taken and answered in order */
+struct httpconn {
+	struct httpconn *next;
+	struct tcpconn *c;
+	char req[HTTPD_REQMAX];		/* not answered yet */
+	int rlen;
+	struct tcpiov iov[TCPSO_MAXIOV];	/* the responses being sent */
+	int niov;
+	int nrsp;
+	int sealed;			/* a body not copied is the last */
+	char hdr[HTTPD_HDRMAX];		/* of that body */
+	void *map;			/* the file of that body */
+	size_t maplen;
+	u_int64_t t0[HTTPD_PIPEMAX];	/* ns, the requests taken */
+	int close;			/* after the responses */
+	int eof;
+	u_int64_t idle;			/* ms, since */
+};
+
+/* a response formatted once, sums are the ones of its segments for mss */
+struct httpcache {
+	int code;
+	int keepalive;
+	int head;
+	char *data;
+	int len;
+	int mss;
+	u_int *sums;
+};
+
+struct httpstats {
+	u_long conns;
+	u_long reqs;
+	u_long codes[6];		/* by the class of the status */
+	u_long resets;			/* connections lost */
+	struct trchist lat;		/* the request taken to its response acked */
+};
+
+/* a server of a vpc, served by its own thread */
+struct httpd {
+	struct httpd *next;
+	pcs *pc;
+	int port;
+	char *root;			/* of the files, NULL if none */
+	volatile int stop;
+	pthread_t tid;
+	struct tcplistener *lsn;
+	struct httpconn *conns;
+	int nconns;
+	struct httpcache cache[HTTPD_MAXCACHE];
+	int ncache;
+	struct httpstats st;
+};
+
+int run_webserver(int argc, char **argv);
+
+#endif
+
+/* end of file */
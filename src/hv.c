@@ -395,7 +395,7 @@ run_vpcs(int ac, char **av)
 #if ((!defined(GNUkFreeBSD) && defined(FreeBSD)) || defined(Darwin))
 	optreset = 1;
 #endif	
-	while ((c = getopt(ac, av, "p:m:s:c:")) != -1) {
+	while ((c = getopt(ac, av, "p:m:s:c:M:")) != -1) {
 		switch (c) {
 			case 'p':
 				pv->vport = atoi(optarg);
@@ -425,6 +425,13 @@ run_vpcs(int ac, char **av)
 					return 1;
 				}
 				break;				
+			case 'M':
+				pv->vmport = atoi(optarg);
+				if (pv->vmport < 1024 || pv->vmport > 65000) {
+					ERR(fptys, "Invalid metrics port\r\n");
+					return 1;
+				}
+				break;
 		}
 	}
 	
@@ -453,6 +460,23 @@ run_vpcs(int ac, char **av)
 		}
 	}
 	
+	/* the metrics port is not assigned unless asked for */
+	if (pv->vmport) {
+		for (i = 0; i < MAX_DAEMONS; i++) {
+			if (vpcs_list[i].pid == 0)
+				continue;
+			if (pv->vmport != vpcs_list[i].vmport &&
+			    pv->vmport != vpcs_list[i].vport)
+				continue;
+			ERR(fptys, "Port %d already in use\r\n", pv->vmport);
+			return 1;
+		}
+		if (pv->vmport == pv->vport || pv->vmport == hvport) {
+			ERR(fptys, "Port %d already in use\r\n", pv->vmport);
+			return 1;
+		}
+	}
+	
 	/* set the new mac */
 	if (pv->vmac == 0) {
 		j = 0;
@@ -555,10 +579,14 @@ run_vpcs(int ac, char **av)
 	if (pv->vmac) 
 		i += snprintf(buf + i, sizeof(buf) - i, "-m %d ", 
 		    pv->vmac);
+	if (pv->vmport) 
+		i += snprintf(buf + i, sizeof(buf) - i, "-M %d ", 
+		    pv->vmport);
 	j = 1;
 	while (j < ac) {
 		if (!strcmp(av[j], "-p") || !strcmp(av[j], "-s") ||
-		    !strcmp(av[j], "-c") || !strcmp(av[j], "-m")) {
+		    !strcmp(av[j], "-c") || !strcmp(av[j], "-m") ||
+		    !strcmp(av[j], "-M")) {
 			j += 2;
 			continue;
 		}
@@ -58,6 +58,7 @@ struct list {
 	int vmac;
 	int vsport;
 	int vcport;
+	int vmport;		/* metrics port, 0 if none */
 	char *cmdline;
 };
 
@@ -100,7 +100,16 @@ u_short cksum_fixup(u_short cksum, u_short old, u_short new, u_short udp)
 
 u_short cksum6(ip6hdr *ip, u_char nxt, int len)
 {
-	int sum = 0;
+	return cksum6_part(ip, nxt, len, len, 0);
+}
+
+/* 
+ * the checksum of the pseudo header and the first hlen bytes of the 
+ * payload of len bytes, dsum is the cksum_part of the rest
+ */
+u_short cksum6_part(ip6hdr *ip, u_char nxt, int len, int hlen, u_int dsum)
+{
+	u_int sum = dsum;
 	u_short *w;
 	union {
 		u_short phs[4];
@@ -128,11 +137,11 @@ u_short cksum6(ip6hdr *ip, u_char nxt, int len)
 	
 	w = (u_short *)(ip + 1);
 
-	while (len > 1) { 
+	while (hlen > 1) { 
 		sum += *w++; 
-		len -= sizeof(u_short); 
+		hlen -= sizeof(u_short); 
 	}
-	if (len) sum += *(unsigned char *) w;
+	if (hlen) sum += *(unsigned char *) w;
 	
 	sum = (sum >> 16) + (sum & 0xffff); 
 	sum += (sum >> 16); 
@@ -140,6 +149,31 @@ u_short cksum6(ip6hdr *ip, u_char nxt, int len)
 	return (u_short) (~sum);	
 }
 
+/* the sum of size bytes not folded, the ones of the parts of a packet add up */
+u_int cksum_part(const void *buffer, int size)
+{
+	const u_short *w = buffer;
+	u_int sum = 0;
+
+	while (size > 1) {
+		sum += *w++;
+		size -= sizeof(u_short);
+	}
+	if (size)
+		sum += *(const u_char *)w;
+
+	return sum;
+}
+
+/* the checksum of a sum of cksum_part */
+u_short cksum_fold(u_int sum)
+{
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum += (sum >> 16);
+
+	return (u_short)(~sum);
+}
+
 int sameNet(u_long ip1, u_long ip2, int cidr)
 {
 	return ((ip_masks[cidr] & ntohl(ip1)) == (ip_masks[cidr] & ntohl(ip2)));
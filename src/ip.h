@@ -231,12 +231,41 @@ typedef struct tcpiphdr tcpiphdr;
 #define	ti_urp		ti_t.th_urp
 
 
+#define TCPOPT_EOL              0
+#define TCPOPT_NOP              1
 #define TCPOPT_MAXSEG           2
 #define TCPOLEN_MAXSEG          4
 #define TCPOPT_WINDOW           3
 #define TCPOLEN_WINDOW          3
+#define TCPOPT_SACK_PERMITTED   4
+#define TCPOLEN_SACK_PERMITTED  2
+#define TCPOPT_SACK             5
+#define TCPOLEN_SACK            8	/* a block */
 #define TCPOPT_TIMESTAMP        8
 #define TCPOLEN_TIMESTAMP       10
+#define TCP_MAXOLEN             40
+
+/* 
+ * sesscb.topts, the options of the SYN of the peer, or those my SYN 
+ * offers till the SYN|ACK tells
+ */
+#define TOF_SCALE	0x1
+#define TOF_TS		0x2
+#define TOF_SACK	0x4
+
+#define TCP_MAXOOO	16		/* blocks held beyond the hole */
+#define TCP_RCVBUF	(2 << 20)	/* the window of a session */
+#define TCP_RCVSHIFT	6		/* TCP_RCVBUF >> 6 fits th_win */
+
+#define SEQ_LT(a, b)	((int)((a) - (b)) < 0)
+#define SEQ_LEQ(a, b)	((int)((a) - (b)) <= 0)
+#define SEQ_GT(a, b)	((int)((a) - (b)) > 0)
+#define SEQ_GEQ(a, b)	((int)((a) - (b)) >= 0)
+
+struct tcpblk {
+	u_int start;
+	u_int end;
+};
 
 #define PKT_MAXSIZE 1520
 #define ARP_PSIZE 64
@@ -451,11 +480,13 @@ typedef struct {
 #define DMP_DETAIL 4
 #define DMP_ALL    0x80
 #define DMP_FILE   0x1000
+#define DMP_PCAPNG 0x2000
 
 struct packet; /* defined in queue.h */
 
 typedef struct sesscb {
 	int sock;
+	int nports; /* sport up to sport + nports - 1 are the app's too */
 	u_int timeout;
 	u_int sn;
 	u_int waittime;
@@ -483,12 +514,23 @@ typedef struct sesscb {
 	u_char ttl;
 	u_char rttl;
 	u_short rmss; /* TCP MSS */
+	u_short rwin; /* remote window, as sent */
+	u_char rwscale; /* remote window shift */
+	u_char topts; /* TOF_* */
+	u_char cc; /* TCPCC_*, congestion control of the sender */
+	u_short lmss; /* my MSS, told in SYN|ACK */
+	u_int tsrecent; /* TSval of the peer to echo, RFC 7323 */
+	int nooo;
+	struct tcpblk ooo[TCP_MAXOOO]; /* data beyond ack, the freshest first */
 	int aproto;
 	u_char icmptype;
 	u_char icmpcode;
 	int mtu;
 	int frag;
 	char *data;
+	const char *sdata; /* TCP payload to send, made up if NULL */
+	u_int dsum; /* cksum_part of sdata, 0 if not known */
+	u_int64_t rbytes; /* data taken in order by the responder */
 } sesscb;
 
 void encap_ehead(char *mbuf, const u_char *sea, const u_char *dea, const u_short type);
@@ -497,6 +539,9 @@ void swap_ehead(char *mbuf);
 u_short cksum(register unsigned short *buffer, register int size);
 u_short cksum_fixup(u_short cksum, u_short old, u_short new, u_short udp);
 u_short cksum6(ip6hdr *ip, u_char nxt, int len);
+u_short cksum6_part(ip6hdr *ip, u_char nxt, int len, int hlen, u_int dsum);
+u_int cksum_part(const void *buffer, int size);
+u_short cksum_fold(u_int sum);
 
 int etherIsZero(u_char *mac);
 int etherIsMulticast(u_char *mac);
@@ -0,0 +1,423 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+/*
+ * A small Prometheus text exposition endpoint. The counters are read
+ * as they are, the reader, writer and output threads never wait for
+ * a scrape.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "globle.h"
+#include "vpcs.h"
+#include "tcp.h"
+#include "relay.h"
+#include "metrics.h"
+
+struct mbuf {
+	char *buf;
+	int len;
+	int size;
+};
+
+static int metrics_fd = -1;
+
+extern int num_pths;
+extern u_int time_tick;
+extern int runRelay;
+
+static void *pth_metrics(void *arg);
+static void metrics_serve(int s);
+static void metrics_collect(struct mbuf *mb);
+static void mprintf(struct mbuf *mb, const char *fmt, ...);
+static void mhead(struct mbuf *mb, const char *name, const char *type, 
+    const char *help);
+static double thread_cpu(pthread_t tid);
+
+int start_metrics(int port)
+{
+	struct sockaddr_in serv;
+	pthread_t pid;
+	int on = 1;
+
+	metrics_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (metrics_fd < 0)
+		return -1;
+
+	(void) setsockopt(metrics_fd, SOL_SOCKET, SO_REUSEADDR,
+	    (char *)&on, sizeof(on));
+
+	bzero((char *) &serv, sizeof(serv));
+	serv.sin_family = AF_INET;
+	serv.sin_addr.s_addr = htonl(INADDR_ANY);
+	serv.sin_port = htons(port);
+
+	if (bind(metrics_fd, (struct sockaddr *) &serv, sizeof(serv)) < 0 ||
+	    listen(metrics_fd, 5) < 0) {
+		close(metrics_fd);
+		metrics_fd = -1;
+		return -1;
+	}
+
+	if (pthread_create(&pid, NULL, pth_metrics, NULL) != 0) {
+		close(metrics_fd);
+		metrics_fd = -1;
+		return -1;
+	}
+	pthread_detach(pid);
+
+	return 0;
+}
+
+static void *pth_metrics(void *arg)
+{
+	struct sockaddr_in cli;
+	socklen_t slen;
+	struct timeval tv;
+	int s;
+
+	while (1) {
+		slen = sizeof(cli);
+		s = accept(metrics_fd, (struct sockaddr *) &cli, &slen);
+		if (s < 0) {
+			if (errno == EINTR)
+				continue;
+			sleep(1);
+			continue;
+		}
+
+		/* a stalled scraper should not hold the listener */
+		tv.tv_sec = 2;
+		tv.tv_usec = 0;
+		(void) setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		(void) setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+		metrics_serve(s);
+		close(s);
+	}
+
+	return NULL;
+}
+
+static void metrics_serve(int s)
+{
+	char req[1024];
+	char hdr[256];
+	struct mbuf mb;
+	int n, i, len;
+	const char *status = "200 OK";
+
+	/* read the request line, the headers are not needed */
+	len = 0;
+	while (len < sizeof(req) - 1) {
+		n = read(s, req + len, sizeof(req) - 1 - len);
+		if (n <= 0)
+			break;
+		len += n;
+		req[len] = '\0';
+		if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n"))
+			break;
+	}
+	if (len == 0)
+		return;
+	req[len] = '\0';
+
+	memset(&mb, 0, sizeof(mb));
+	if (strncmp(req, "GET ", 4)) {
+		status = "405 Method Not Allowed";
+		mprintf(&mb, "method not allowed\n");
+	} else if (strncmp(req + 4, "/metrics", 8) || 
+	    (req[12] != ' ' && req[12] != '?')) {
+		status = "404 Not Found";
+		mprintf(&mb, "try /metrics\n");
+	} else
+		metrics_collect(&mb);
+
+	if (mb.buf == NULL)
+		return;
+
+	n = snprintf(hdr, sizeof(hdr), "HTTP/1.0 %s\r\n"
+	    "Content-Type: text/plain; version=0.0.4\r\n"
+	    "Content-Length: %d\r\n"
+	    "Connection: close\r\n\r\n", status, mb.len);
+
+	if (write(s, hdr, n) == n) {
+		for (i = 0; i < mb.len; i += n) {
+			n = write(s, mb.buf + i, mb.len - i);
+			if (n <= 0)
+				break;
+		}
+	}
+	free(mb.buf);
+}
+
+static void metrics_collect(struct mbuf *mb)
+{
+	struct relaystats rst;
+	struct pq *qs[4];
+	const char *qn[4] = {"iq", "oq", "bgiq", "bgoq"};
+	struct timespec ts;
+	pcs *pc;
+	int i, j, n, port;
+
+#define EACH_VPC	for (i = 0, pc = vpc; i < num_pths; i++, pc++)
+
+	mhead(mb, "vpcs_rx_frames_total", "counter", 
+	    "Frames read from the device");
+	EACH_VPC
+		mprintf(mb, "vpcs_rx_frames_total{vpc=\"%d\"} %lu\n", 
+		    i + 1, pc->stats.rx.frames);
+	mhead(mb, "vpcs_rx_bytes_total", "counter", 
+	    "Bytes read from the device");
+	EACH_VPC
+		mprintf(mb, "vpcs_rx_bytes_total{vpc=\"%d\"} %lu\n", 
+		    i + 1, pc->stats.rx.bytes);
+	mhead(mb, "vpcs_tx_frames_total", "counter", 
+	    "Frames written to the device");
+	EACH_VPC
+		mprintf(mb, "vpcs_tx_frames_total{vpc=\"%d\"} %lu\n", 
+		    i + 1, pc->stats.tx.frames);
+	mhead(mb, "vpcs_tx_bytes_total", "counter", 
+	    "Bytes written to the device");
+	EACH_VPC
+		mprintf(mb, "vpcs_tx_bytes_total{vpc=\"%d\"} %lu\n", 
+		    i + 1, pc->stats.tx.bytes);
+	mhead(mb, "vpcs_tx_errors_total", "counter", 
+	    "Frames the device did not accept");
+	EACH_VPC
+		mprintf(mb, "vpcs_tx_errors_total{vpc=\"%d\"} %lu\n", 
+		    i + 1, pc->stats.tx.errors);
+
+	mhead(mb, "vpcs_rx_drops_total", "counter", 
+	    "Received frames dropped, by reason");
+	EACH_VPC {
+		mprintf(mb, "vpcs_rx_drops_total{vpc=\"%d\",reason=\"type\"} "
+		    "%lu\n", i + 1, pc->stats.rx.drop_type);
+		mprintf(mb, "vpcs_rx_drops_total{vpc=\"%d\",reason=\"mcast\"} "
+		    "%lu\n", i + 1, pc->stats.rx.drop_mcast);
+		mprintf(mb, "vpcs_rx_drops_total{vpc=\"%d\",reason=\"addr\"} "
+		    "%lu\n", i + 1, pc->stats.rx.drop_addr);
+		mprintf(mb, "vpcs_rx_drops_total{vpc=\"%d\",reason=\"mtu\"} "
+		    "%lu\n", i + 1, pc->stats.rx.drop_mtu);
+		mprintf(mb, "vpcs_rx_drops_total{vpc=\"%d\",reason=\"noapp\"} "
+		    "%lu\n", i + 1, pc->stats.rx.drop_noapp);
+	}
+
+	mhead(mb, "vpcs_queue_depth", "gauge", "Packets in the queue");
+	EACH_VPC {
+		qs[0] = &pc->iq;
+		qs[1] = &pc->oq;
+		qs[2] = &pc->bgiq;
+		qs[3] = &pc->bgoq;
+		for (j = 0; j < 4; j++)
+			mprintf(mb, "vpcs_queue_depth{vpc=\"%d\",queue=\"%s\"} "
+			    "%d\n", i + 1, qn[j], qs[j]->size);
+	}
+	mhead(mb, "vpcs_queue_high_water", "gauge", 
+	    "Highest depth of the queue");
+	EACH_VPC {
+		qs[0] = &pc->iq;
+		qs[1] = &pc->oq;
+		qs[2] = &pc->bgiq;
+		qs[3] = &pc->bgoq;
+		for (j = 0; j < 4; j++)
+			mprintf(mb, "vpcs_queue_high_water{vpc=\"%d\","
+			    "queue=\"%s\"} %d\n", i + 1, qn[j], qs[j]->hwm);
+	}
+	mhead(mb, "vpcs_queue_drops_total", "counter", 
+	    "Packets dropped while the queue was full");
+	EACH_VPC {
+		qs[0] = &pc->iq;
+		qs[1] = &pc->oq;
+		qs[2] = &pc->bgiq;
+		qs[3] = &pc->bgoq;
+		for (j = 0; j < 4; j++)
+			mprintf(mb, "vpcs_queue_drops_total{vpc=\"%d\","
+			    "queue=\"%s\"} %lu\n", i + 1, qn[j], qs[j]->drops);
+	}
+
+	mhead(mb, "vpcs_arp_requests_total", "counter", 
+	    "ARP requests sent");
+	EACH_VPC
+		mprintf(mb, "vpcs_arp_requests_total{vpc=\"%d\"} %lu\n", 
+		    i + 1, pc->stats.ev.arp_req);
+	mhead(mb, "vpcs_arp_cache_hits_total", "counter", 
+	    "ARP lookups answered by the cache");
+	EACH_VPC
+		mprintf(mb, "vpcs_arp_cache_hits_total{vpc=\"%d\"} %lu\n", 
+		    i + 1, pc->stats.ev.arp_hit);
+	mhead(mb, "vpcs_arp_cache_entries", "gauge", 
+	    "Valid entries in the ARP cache");
+	EACH_VPC {
+		for (j = 0, n = 0; j < POOL_SIZE; j++) {
+			if (pc->ipmac4[j].ip != 0 && 
+			    time_tick - pc->ipmac4[j].timeout < POOL_TIMEOUT)
+				n++;
+		}
+		mprintf(mb, "vpcs_arp_cache_entries{vpc=\"%d\"} %d\n", 
+		    i + 1, n);
+	}
+	mhead(mb, "vpcs_nd_requests_total", "counter", 
+	    "Neighbor solicitations sent");
+	EACH_VPC
+		mprintf(mb, "vpcs_nd_requests_total{vpc=\"%d\"} %lu\n", 
+		    i + 1, pc->stats.ev.nd_req);
+	mhead(mb, "vpcs_nd_cache_entries", "gauge", 
+	    "Valid entries in the neighbor cache");
+	EACH_VPC {
+		for (j = 0, n = 0; j < POOL_SIZE; j++) {
+			if (pc->ipmac6[j].timeout != 0 && 
+			    time_tick - pc->ipmac6[j].timeout < POOL_TIMEOUT)
+				n++;
+		}
+		mprintf(mb, "vpcs_nd_cache_entries{vpc=\"%d\"} %d\n", 
+		    i + 1, n);
+	}
+
+	mhead(mb, "vpcs_tcp_sessions", "gauge", "Active TCP sessions");
+	EACH_VPC {
+		for (j = 0, n = 0; j < MAX_SESSIONS; j++) {
+			if (pc->sesscb[j].timeout != 0 &&
+			    time_tick - pc->sesscb[j].timeout <= TCP_TIMEOUT)
+				n++;
+		}
+		mprintf(mb, "vpcs_tcp_sessions{vpc=\"%d\"} %d\n", i + 1, n);
+	}
+	mhead(mb, "vpcs_tcp_opened_total", "counter", 
+	    "TCP sessions accepted");
+	EACH_VPC
+		mprintf(mb, "vpcs_tcp_opened_total{vpc=\"%d\"} %lu\n", 
+		    i + 1, pc->stats.ev.tcp_open);
+	mhead(mb, "vpcs_tcp_resets_total", "counter", 
+	    "TCP requests answered with a reset");
+	EACH_VPC
+		mprintf(mb, "vpcs_tcp_resets_total{vpc=\"%d\"} %lu\n", 
+		    i + 1, pc->stats.ev.tcp_reset);
+
+	mhead(mb, "vpcs_thread_cpu_seconds_total", "counter", 
+	    "CPU time of the data path threads");
+	EACH_VPC {
+		mprintf(mb, "vpcs_thread_cpu_seconds_total{vpc=\"%d\","
+		    "thread=\"reader\"} %.6f\n", i + 1, thread_cpu(pc->rpid));
+		mprintf(mb, "vpcs_thread_cpu_seconds_total{vpc=\"%d\","
+		    "thread=\"writer\"} %.6f\n", i + 1, thread_cpu(pc->wpid));
+		mprintf(mb, "vpcs_thread_cpu_seconds_total{vpc=\"%d\","
+		    "thread=\"output\"} %.6f\n", i + 1, thread_cpu(pc->outid));
+	}
+	mhead(mb, "process_cpu_seconds_total", "counter", 
+	    "Total user and system CPU time");
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	mprintf(mb, "process_cpu_seconds_total %ld.%06ld\n", 
+	    (long)ts.tv_sec, ts.tv_nsec / 1000);
+
+	if (runRelay) {
+		port = relay_getstats(&rst);
+		mhead(mb, "vpcs_relay_port", "gauge", 
+		    "UDP port of the relay, 0 if closed");
+		mprintf(mb, "vpcs_relay_port %d\n", port);
+		mhead(mb, "vpcs_relay_packets_total", "counter", 
+		    "Packets seen by the relay");
+		mprintf(mb, "vpcs_relay_packets_total{dir=\"rx\"} %lu\n", 
+		    rst.rx_pkts);
+		mprintf(mb, "vpcs_relay_packets_total{dir=\"fwd\"} %lu\n", 
+		    rst.fwd_pkts);
+		mhead(mb, "vpcs_relay_bytes_total", "counter", 
+		    "Bytes seen by the relay");
+		mprintf(mb, "vpcs_relay_bytes_total{dir=\"rx\"} %lu\n", 
+		    rst.rx_bytes);
+		mprintf(mb, "vpcs_relay_bytes_total{dir=\"fwd\"} %lu\n", 
+		    rst.fwd_bytes);
+		mhead(mb, "vpcs_relay_drops_total", "counter", 
+		    "Packets the relay could not forward");
+		mprintf(mb, "vpcs_relay_drops_total %lu\n", rst.drops);
+	}
+
+#undef EACH_VPC
+}
+
+static void mhead(struct mbuf *mb, const char *name, const char *type, 
+    const char *help)
+{
+	mprintf(mb, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void mprintf(struct mbuf *mb, const char *fmt, ...)
+{
+	va_list ap;
+	char *p;
+	int n, need = 256;
+
+	while (1) {
+		if (mb->size - mb->len < need) {
+			p = realloc(mb->buf, mb->len + need + METRICS_BUFSIZE);
+			if (p == NULL)
+				return;
+			mb->buf = p;
+			mb->size = mb->len + need + METRICS_BUFSIZE;
+		}
+		va_start(ap, fmt);
+		n = vsnprintf(mb->buf + mb->len, mb->size - mb->len, fmt, ap);
+		va_end(ap);
+		if (n < 0)
+			return;
+		if (n < mb->size - mb->len) {
+			mb->len += n;
+			return;
+		}
+		/* too long, grow and print again */
+		need = n + 1;
+	}
+}
+
+static double thread_cpu(pthread_t tid)
+{
+#ifndef Darwin
+	clockid_t cid;
+	struct timespec ts;
+
+	if (tid == 0 || pthread_getcpuclockid(tid, &cid) != 0 ||
+	    clock_gettime(cid, &ts) != 0)
+		return 0;
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+	return 0;
+#endif
+}
+
+/* end of file */
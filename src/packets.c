@@ -34,6 +34,7 @@
 
 #include "packets.h"
 #include "vpcs.h"
+#include "tcp.h"
 #include "utils.h"
 
 #define IPFRG_MAXHASH  (1 << 10)
@@ -83,11 +84,15 @@ int upv4(pcs *pc, struct packet **m0)
 		
 	/* not ipv4 or arp */
 	if ((eh->type != htons(ETHERTYPE_IP)) && 
-	    (eh->type != htons(ETHERTYPE_ARP))) 
+	    (eh->type != htons(ETHERTYPE_ARP))) {
+		STATS_INC(pc, rx.drop_type);
 		return PKT_DROP;
+	}
 		
-	if (etherIsMulticast(eh->src)) 
+	if (etherIsMulticast(eh->src)) {
+		STATS_INC(pc, rx.drop_mcast);
 		return PKT_DROP;
+	}
 
 	if ( (memcmp(eh->dst, pc->ip4.mac, ETH_ALEN) == 0 ||
 		memcmp(eh->dst, broadcast, ETH_ALEN) == 0)
@@ -95,11 +100,13 @@ int upv4(pcs *pc, struct packet **m0)
 		iphdr *ip = (iphdr *)(eh + 1);
 
 		if (ntohs(ip->len) > pc->mtu) {
+			STATS_INC(pc, rx.drop_mtu);
 			p = icmpReply(m, ICMP_UNREACH, ICMP_UNREACH_NEEDFRAG);
 			if (p) {
 				fix_dmac(pc, p);
 				if (pc->ip4.flags & IPF_FRAG) {
 					p = ipfrag(p, pc->mtu);
+					STATS_FRAGS(pc, p);
 				}
 				enq(&pc->oq, p);
 			}
@@ -107,11 +114,13 @@ int upv4(pcs *pc, struct packet **m0)
 		}
 
 		if (ntohs(ip->frag) & (IP_MF | IP_OFFMASK)) {
+			STATS_INC(pc, rx.frags);
 			m = ipreass(m);
 			if (m == NULL)
 				return PKT_ENQ;
 			else
 				*m0 = m;
+			STATS_INC(pc, rx.reass);
 			ip = (iphdr *)(m->data + sizeof(ethdr));
 		}
 
@@ -119,8 +128,10 @@ int upv4(pcs *pc, struct packet **m0)
 		if (ip->proto == IPPROTO_ICMP) {
 			icmphdr *icmp = (icmphdr *)(ip + 1);
 
-			if (ip->dip != pc->ip4.ip)
+			if (ip->dip != pc->ip4.ip) {
+				STATS_INC(pc, rx.drop_addr);
 				return PKT_DROP;
+			}
 
 			/* other type will be sent to application */
 			if (icmp->type != ICMP_ECHO)
@@ -136,15 +147,19 @@ int upv4(pcs *pc, struct packet **m0)
 			char *data = NULL;
 			ui = (udpiphdr *)ip;
 			
-			if (IN_MULTICAST(ntohl(ip->dip)))
+			if (IN_MULTICAST(ntohl(ip->dip))) {
+				STATS_INC(pc, rx.drop_addr);
 				return PKT_DROP;
+			}
 			
 			/* dhcp packet */
 			if (ui->ui_sport == htons(67) && ui->ui_dport == htons(68)) 
 				return PKT_UP;
 			
-			if (ip->dip != pc->ip4.ip)
+			if (ip->dip != pc->ip4.ip) {
+				STATS_INC(pc, rx.drop_addr);
 				return PKT_DROP;
+			}
 				
 			/* dns response */
 			if (ui->ui_sport == htons(53))
@@ -155,6 +170,13 @@ int upv4(pcs *pc, struct packet **m0)
 			/* udp echo reply */	
 			if (memcmp(data, eh->dst, ETH_ALEN) == 0)
 				return PKT_UP;
+			
+			/* to the app, from its peer or any if no peer */
+			if (pc->mscb.sock && pc->mscb.proto == IPPROTO_UDP &&
+			    app_port(&pc->mscb, ntohs(ui->ui_dport)) &&
+			    (pc->mscb.dip == 0 || (ip->sip == pc->mscb.dip &&
+			    ntohs(ui->ui_sport) == pc->mscb.dport)))
+				return PKT_UP;
 			else {
 				struct packet *p;
 				if (ip->ttl == 1)
@@ -169,8 +191,10 @@ int upv4(pcs *pc, struct packet **m0)
 			/* anyway tell caller to drop this packet */
 			return PKT_DROP;
 		} else if (ip->proto == IPPROTO_TCP) {
-			if (ip->dip != pc->ip4.ip)
+			if (ip->dip != pc->ip4.ip) {
+				STATS_INC(pc, rx.drop_addr);
 				return PKT_DROP;
+			}
 			return tcp(pc, m);	
 		}	
 
@@ -193,6 +217,7 @@ int upv4(pcs *pc, struct packet **m0)
 					
 			encap_ehead(m->data, pc->ip4.mac, eh->src, 
 			    ETHERTYPE_ARP);
+			TRACE_STAMP(m, TRC_UP);
 	
 			enq(&pc->oq, m);
 				
@@ -204,8 +229,10 @@ int upv4(pcs *pc, struct packet **m0)
 		
 		return PKT_DROP;
 	} else if (strncmp((const char *)eh->dst, (const char *)pc->ip4.mac, 
-	    ETH_ALEN) != 0)
+	    ETH_ALEN) != 0) {
+		STATS_INC(pc, rx.drop_addr);
 		return PKT_DROP;
+	}
 	
 	return PKT_UP;
 }
@@ -227,9 +254,11 @@ void send4(pcs *pc, struct packet *m)
 		del_pkt(m);
 		return;
 	}
+	TRACE_STAMP(m, TRC_ARP);
 	
 	if (pc->ip4.flags & IPF_FRAG) {
 		m = ipfrag(m, pc->mtu);
+		STATS_FRAGS(pc, m);
 	}
 
 	enq(&pc->oq, m);
@@ -239,7 +268,6 @@ int response(struct packet *m, sesscb *sesscb)
 {
 	ethdr *eh;
 	iphdr *ip;
-	int n;
 
 	eh = (ethdr *)(m->data);
 	ip = (iphdr *)(eh + 1);
@@ -301,32 +329,21 @@ int response(struct packet *m, sesscb *sesscb)
 	
 	if (ip->proto == IPPROTO_TCP && sesscb->proto == IPPROTO_TCP) {
 		tcpiphdr *ti = (tcpiphdr *)ip;		
-		char *data = ((char*)(ti + 1));
 		
 		sesscb->rseq = ntohl(ti->ti_seq);
 		sesscb->rack = ntohl(ti->ti_ack);
 		sesscb->rflags = ti->ti_flags;
+		sesscb->rwin = ntohs(ti->ti_win);
 		sesscb->rttl = ip->ttl;
 		sesscb->data = NULL;
 
-		n = sesscb->rdsize - (ip->ihl << 2) - (ti->ti_off << 2);
 		/* try to get MSS from options */
-		if (sesscb->flags == TH_SYN && sesscb->rflags == (TH_SYN | TH_ACK) && 
-			n > 0) {
-			int i = 0;
-
-			while (data[i] == 0x1 && i < sesscb->rdsize) i++;
-			
-			for (;i < n;) {
-				if (data[i] == TCPOPT_MAXSEG && 
-				    data[i + 1] == TCPOLEN_MAXSEG) {
-					sesscb->rmss = (data[i + 2] << 8) + data[i + 3];
-					break;
-				}
-				i += data[i + 1];
-			}
-		} else {
+		if (sesscb->flags == TH_SYN && sesscb->rflags == (TH_SYN | TH_ACK))
+			tcp_options(&ti->ti_t, sesscb);
+		else {
 			sesscb->data = ((char*)(ip + 1)) + (ti->ti_off << 2);
+			if (sesscb->topts & TOF_TS)
+				tcp_timestamp(&ti->ti_t, sesscb);
 		}
 		return IPPROTO_TCP;
 	}
@@ -347,6 +364,7 @@ int arpResolve(pcs *pc, u_int ip, u_char *dmac)
 		    (time_tick - pc->ipmac4[i].timeout) <= 120 &&
 		    !etherIsZero(pc->ipmac4[i].mac)) {
 			memcpy(dmac, pc->ipmac4[i].mac, ETH_ALEN);
+			STATS_ATOMIC_INC(pc, ev.arp_hit);
 			return 1;
 		}
 	}
@@ -357,6 +375,7 @@ int arpResolve(pcs *pc, u_int ip, u_char *dmac)
 			printf("out of memory\n");
 			return 0;
 		}
+		STATS_ATOMIC_INC(pc, ev.arp_req);
 		enq(&pc->oq, m);
 		gettimeofday(&(tv), (void*)0);
 		while (!timeout(tv, waittime)) {
@@ -376,7 +395,12 @@ int arpResolve(pcs *pc, u_int ip, u_char *dmac)
 
 struct packet *packet(pcs *pc)
 {
-	sesscb *sesscb = &pc->mscb;
+	return packetcb(pc, &pc->mscb);
+}
+
+/* build the packet of any session, not only the one of the command */
+struct packet *packetcb(pcs *pc, sesscb *sesscb)
+{
 	ethdr *eh;
 	iphdr *ip;
 	int i;
@@ -399,9 +423,22 @@ struct packet *packet(pcs *pc)
 				dlen = 0;
 			if (sesscb->flags == TH_SYN) {
 				/* mss(2 + 2), nop(1 + 1), timestamp ( 2 + 8), 
-				 * nop(1), winscale (2 + 1)*/
-				dlen = 4 + 2 + 2 + 8 + 1 + 3;	
-			} else {
+				 * nop(1), winscale (2 + 1), nop(1 + 1), 
+				 * sack permitted (2), those topts offers */
+				dlen = 4;
+				if (sesscb->topts & TOF_TS)
+					dlen += 2 + 2 + 8;
+				if (sesscb->topts & TOF_SCALE)
+					dlen += 1 + 3;
+				if (sesscb->topts & TOF_SACK)
+					dlen += 2 + 2;
+			} else if (sesscb->flags == (TH_SYN | TH_ACK)) {
+				/* mss(2 + 2), nop(1), winscale (2 + 1) */
+				dlen = 4;
+				if (sesscb->topts & TOF_SCALE)
+					dlen += 1 + 3;
+			} else if (sesscb->topts & TOF_TS) {
+				/* nop(1 + 1), timestamp (2 + 8) */
 				dlen = dlen + 2 + 2 + 8;
 			}
 			if (sesscb->rmss != 0 && dlen > sesscb->rmss)
@@ -475,7 +512,8 @@ struct packet *packet(pcs *pc)
 	} else if (sesscb->proto == IPPROTO_TCP) {
 		tcpiphdr *ti = (tcpiphdr *)ip;
 		char *data = ((char*)(ti + 1));
-		u_int t = htonl(time(0));
+		u_int t = htonl(tcp_tsval());
+		u_int ecr = htonl(sesscb->tsrecent);
 		int optlen = 0;
 		
 		ti->ti_sport = htons(sesscb->sport);
@@ -493,6 +531,48 @@ struct packet *packet(pcs *pc)
 			*data++ = TCPOLEN_MAXSEG;
 			*data++ = 0x5;
 			*data++ = 0xb4;
+			/* the options the caller can run, see topts */
+			if (sesscb->topts & TOF_TS) {
+				/* align */
+				*data++ = 0x1;
+				*data++ = 0x1;
+				/* timestamp */
+				*data++ = TCPOPT_TIMESTAMP;
+				*data++ = TCPOLEN_TIMESTAMP;
+				memcpy(data, (char *)&t, 4);
+				memset(data + 4, 0, 4);
+				data += 8;
+			}
+			if (sesscb->topts & TOF_SCALE) {
+				/* align */
+				*data++ = 0x1;
+				*data++ = TCPOPT_WINDOW;
+				*data++ = TCPOLEN_WINDOW;
+				*data++ = 1;
+			}
+			if (sesscb->topts & TOF_SACK) {
+				/* align */
+				*data++ = 0x1;
+				*data++ = 0x1;
+				*data++ = TCPOPT_SACK_PERMITTED;
+				*data++ = TCPOLEN_SACK_PERMITTED;
+			}
+		} else if (sesscb->flags == (TH_SYN | TH_ACK)) {
+			/* mss 1460, the answer of a listener, see tcpsock.c */
+			*data++ = TCPOPT_MAXSEG;
+			*data++ = TCPOLEN_MAXSEG;
+			*data++ = 0x5;
+			*data++ = 0xb4;
+			/* only if the SYN of the peer had it, RFC 7323 2.2 */
+			if (sesscb->topts & TOF_SCALE) {
+				/* align */
+				*data++ = 0x1;
+				/* the window is not scaled, the peer's is */
+				*data++ = TCPOPT_WINDOW;
+				*data++ = TCPOLEN_WINDOW;
+				*data++ = 0;
+			}
+		} else if (sesscb->topts & TOF_TS) {
 			/* align */
 			*data++ = 0x1;
 			*data++ = 0x1;
@@ -500,20 +580,7 @@ struct packet *packet(pcs *pc)
 			*data++ = TCPOPT_TIMESTAMP;
 			*data++ = TCPOLEN_TIMESTAMP;
 			memcpy(data, (char *)&t, 4);
-			data += 8;
-			/* align */
-			*data++ = 0x1;
-			*data++ = TCPOPT_WINDOW;
-			*data++ = TCPOLEN_WINDOW;
-			*data++ = 1;
-		} else {
-			/* align */
-			*data++ = 0x1;
-			*data++ = 0x1;
-			/* timestamp */
-			*data++ = TCPOPT_TIMESTAMP;
-			*data++ = TCPOLEN_TIMESTAMP;
-			memcpy(data, (char *)&t, 4);
+			memcpy(data + 4, (char *)&ecr, 4);
 			data += 8;
 		}
 		
@@ -536,17 +603,27 @@ struct packet *packet(pcs *pc)
 	 	 */
 
 		/* fill the data */
-		for (i = optlen; i < dlen; i++) {
-			if ((i % 2) == 0)
-				*data++ = 0xd;
-			else
-				*data++ = 0xa;
+		if (sesscb->sdata != NULL)
+			memcpy(data, sesscb->sdata, dlen - optlen);
+		else {
+			for (i = optlen; i < dlen; i++) {
+				if ((i % 2) == 0)
+					*data++ = 0xd;
+				else
+					*data++ = 0xa;
+			}
 		}
 		
 		bcopy(((struct ipovly *)ip)->ih_x1, b, 9);
 		bzero(((struct ipovly *)ip)->ih_x1, 9);
 		
-		ti->ti_sum = cksum((u_short*)ti, hdr_len + dlen);
+		/* the sum of the data may be known, see tcpsock.c */
+		if (sesscb->sdata != NULL && sesscb->dsum != 0 && 
+		    dlen - optlen == sesscb->dsize)
+			ti->ti_sum = cksum_fold(cksum_part(ti, hdr_len + optlen) +
+			    sesscb->dsum);
+		else
+			ti->ti_sum = cksum((u_short*)ti, hdr_len + dlen);
 		bcopy(b, ((struct ipovly *)ip)->ih_x1, 9);
 	}
 	
@@ -556,8 +633,10 @@ struct packet *packet(pcs *pc)
 	ip->cksum = 0;
 	ip->cksum = cksum((u_short *)ip, sizeof(iphdr));
 		
-	if ((sesscb->frag & IPF_FRAG) == IPF_FRAG)
+	if ((sesscb->frag & IPF_FRAG) == IPF_FRAG) {
 		m = ipfrag(m, sesscb->mtu);
+		STATS_FRAGS(pc, m);
+	}
 	
 	return m;
 }
@@ -624,7 +703,8 @@ struct packet *udpReply(struct packet *m0)
 	ip->ttl = TTL;
 	
 	swap_ehead(m->data);
-	return m;	
+	TRACE_REPLY(m, m0);
+	return m;
 }
 
 struct packet *icmpReply(struct packet *m0, char icmptype, char icmpcode)
@@ -662,7 +742,8 @@ struct packet *icmpReply(struct packet *m0, char icmptype, char icmpcode)
 	
 		swap_ehead(m->data);
 		
-		return m;	
+		TRACE_REPLY(m, m0);
+		return m;
 	} 
 	
 	if (icmptype == ICMP_UNREACH) {
@@ -713,6 +794,7 @@ struct packet *icmpReply(struct packet *m0, char icmptype, char icmpcode)
 		
 		swap_ehead(m->data);
     	
+		TRACE_REPLY(m, m0);
 		return m;
 	}
 	
@@ -35,6 +35,7 @@
 #define PAYLOAD56 56
 
 struct packet *packet(pcs *pc);
+struct packet *packetcb(pcs *pc, sesscb *sesscb);
 int upv4(pcs *pc, struct packet **pkt);
 int response(struct packet *pkt, sesscb *sesscb);
 int arpResolve(pcs *pc, u_int ip, u_char *dmac);
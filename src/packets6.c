@@ -39,6 +39,7 @@
 #include <errno.h>
 
 #include "vpcs.h"
+#include "tcp.h"
 #include "packets6.h"
 #include "utils.h"
 #include "ip.h"
@@ -99,11 +100,13 @@ int upv6(pcs *pc, struct packet **m0)
 	
 	/* fragment */
 	if (ip6ehdr(ip, m->len - sizeof(ethdr), IPPROTO_FRAGMENT) > 0) {
+		STATS_INC(pc, rx.frags);
 		m = ipreass6(m);
 		if (m == NULL)
 			return PKT_ENQ;
 		else
 			*m0 = m;
+		STATS_INC(pc, rx.reass);
 		ip = (ip6hdr *)(m->data + sizeof(ethdr));
 	}
 		
@@ -186,6 +189,14 @@ int sub_udp(pcs *pc, struct packet *m)
 	if (memcmp(data, eh->dst, 6) == 0)
 		return PKT_UP;
 	
+	/* to the app, from its peer or any if no peer */
+	if (pc->mscb.sock && pc->mscb.proto == IPPROTO_UDP &&
+	    app_port(&pc->mscb, ntohs(ui->dport)) &&
+	    (IP6ZERO(&pc->mscb.dip6) ||
+	    (IP6EQ(&pc->mscb.dip6, &ip->src) && 
+	    ntohs(ui->sport) == pc->mscb.dport)))
+		return PKT_UP;
+	
 	p = (ip->ip6_hlim != 1) ? udp6Reply(m) :
 	    icmp6Reply(pc, m, ICMP6_DST_UNREACH, ICMP6_DST_UNREACH_NOPORT);
 		
@@ -366,9 +377,11 @@ void send6(pcs *pc, struct packet *m)
 	}
 	
 	fix_dmac6(pc, m);
+	TRACE_STAMP(m, TRC_ARP);
 	
 	ip = (ip6hdr *)(eh + 1);
 	m = ipfrag6(m, findmtu6(pc, &ip->dst));
+	STATS_FRAGS(pc, m);
 	
 	enq(&pc->oq, m);
 }
@@ -430,32 +443,22 @@ int response6(struct packet *m, sesscb *sesscb)
 	}
 	if (ip->ip6_nxt == IPPROTO_TCP) {
 		struct tcphdr *th = (struct tcphdr *)(ip + 1);
-		char *data = ((char*)(th + 1));
 		
 		sesscb->rseq = ntohl(th->th_seq);
 		sesscb->rack = ntohl(th->th_ack);
 		sesscb->rflags = th->th_flags;
+		sesscb->rwin = ntohs(th->th_win);
 		sesscb->rttl = ip->ip6_hlim;
 		sesscb->rdsize = ntohs(ip->ip6_plen) - sizeof(iphdr) - (th->th_off << 2);
 		sesscb->data = NULL;
 
 		/* try to get MSS from options */
-		if (sesscb->flags == TH_SYN && sesscb->rdsize > 0 &&
-		    sesscb->rflags == (TH_SYN | TH_ACK)) {
-			int i = 0;
-
-			while (data[i] == 0x1 && i < sesscb->rdsize) i++;
-			
-			for (;i < sesscb->rdsize;) {
-				if (data[i] == TCPOPT_MAXSEG && 
-				    data[i + 1] == TCPOLEN_MAXSEG) {
-					sesscb->rmss = (data[i + 2] << 8) + data[i + 3];
-					break;
-				}
-				i += data[i + 1];
-			}
-		} else {
+		if (sesscb->flags == TH_SYN && sesscb->rflags == (TH_SYN | TH_ACK))
+			tcp_options(th, sesscb);
+		else {
 			sesscb->data = ((char*)(ip + 1)) + (th->th_off << 2);
+			if (sesscb->topts & TOF_TS)
+				tcp_timestamp(th, sesscb);
 		}
 		
 		return IPPROTO_TCP;
@@ -464,9 +467,13 @@ int response6(struct packet *m, sesscb *sesscb)
 	return 0;
 }
 
-struct packet *packet6(pcs *pc) //sesscb *sesscb)
+struct packet *packet6(pcs *pc)
+{
+	return packet6cb(pc, &pc->mscb);
+}
+
+struct packet *packet6cb(pcs *pc, sesscb *sesscb)
 {
-	sesscb *sesscb = &pc->mscb;
 	int dlen = 0, len = 0, i;
 	struct packet *m = NULL;
 	ethdr *eh;
@@ -490,9 +497,22 @@ struct packet *packet6(pcs *pc) //sesscb *sesscb)
 				dlen = 0;
 			if (sesscb->flags == TH_SYN) {
 				/* mss(2 + 2), nop(1 + 1), timestamp ( 2 + 8), 
-				 * nop(1), winscale (2 + 1)*/
-				dlen = 4 + 2 + 2 + 8 + 1 + 3;	
-			} else {
+				 * nop(1), winscale (2 + 1), nop(1 + 1), 
+				 * sack permitted (2), those topts offers */
+				dlen = 4;
+				if (sesscb->topts & TOF_TS)
+					dlen += 2 + 2 + 8;
+				if (sesscb->topts & TOF_SCALE)
+					dlen += 1 + 3;
+				if (sesscb->topts & TOF_SACK)
+					dlen += 2 + 2;
+			} else if (sesscb->flags == (TH_SYN | TH_ACK)) {
+				/* mss(2 + 2), nop(1), winscale (2 + 1) */
+				dlen = 4;
+				if (sesscb->topts & TOF_SCALE)
+					dlen += 1 + 3;
+			} else if (sesscb->topts & TOF_TS) {
+				/* nop(1 + 1), timestamp (2 + 8) */
 				dlen = dlen + 2 + 2 + 8;
 			}
 			
@@ -548,9 +568,13 @@ struct packet *packet6(pcs *pc) //sesscb *sesscb)
 		ui->dport = htons(sesscb->dport);
 		ui->len = htons(len - sizeof(ethdr) - sizeof(ip6hdr));
 		
-		memcpy(data, sesscb->smac, 6);	
-		for (i = 6; i < dlen; i++)
-			data[i] = i + sizeof(udphdr);
+		if (sesscb->data != NULL)
+			memcpy(data, sesscb->data, dlen);
+		else {
+			memcpy(data, sesscb->smac, 6);	
+			for (i = 6; i < dlen; i++)
+				data[i] = i + sizeof(udphdr);
+		}
 		
 		ui->cksum = 0;
 		ui->cksum = cksum6(ip, IPPROTO_UDP, len - 
@@ -558,7 +582,8 @@ struct packet *packet6(pcs *pc) //sesscb *sesscb)
 	} else if (sesscb->proto == IPPROTO_TCP) {
 		struct tcphdr *th = (struct tcphdr *)(ip + 1);
 		char *data = ((char*)(th + 1));
-		u_int t = htonl(time(0));
+		u_int t = htonl(tcp_tsval());
+		u_int ecr = htonl(sesscb->tsrecent);
 		int optlen = 0;
 		
 		th->th_sport = htons(sesscb->sport);
@@ -574,6 +599,48 @@ struct packet *packet6(pcs *pc) //sesscb *sesscb)
 			*data++ = TCPOLEN_MAXSEG;
 			*data++ = 0x5;
 			*data++ = 0xb4;
+			/* the options the caller can run, see topts */
+			if (sesscb->topts & TOF_TS) {
+				/* align */
+				*data++ = 0x1;
+				*data++ = 0x1;
+				/* timestamp */
+				*data++ = TCPOPT_TIMESTAMP;
+				*data++ = TCPOLEN_TIMESTAMP;
+				memcpy(data, (char *)&t, 4);
+				memset(data + 4, 0, 4);
+				data += 8;
+			}
+			if (sesscb->topts & TOF_SCALE) {
+				/* align */
+				*data++ = 0x1;
+				*data++ = TCPOPT_WINDOW;
+				*data++ = TCPOLEN_WINDOW;
+				*data++ = 1;
+			}
+			if (sesscb->topts & TOF_SACK) {
+				/* align */
+				*data++ = 0x1;
+				*data++ = 0x1;
+				*data++ = TCPOPT_SACK_PERMITTED;
+				*data++ = TCPOLEN_SACK_PERMITTED;
+			}
+		} else if (sesscb->flags == (TH_SYN | TH_ACK)) {
+			/* mss 1460, the answer of a listener, see tcpsock.c */
+			*data++ = TCPOPT_MAXSEG;
+			*data++ = TCPOLEN_MAXSEG;
+			*data++ = 0x5;
+			*data++ = 0xb4;
+			/* only if the SYN of the peer had it, RFC 7323 2.2 */
+			if (sesscb->topts & TOF_SCALE) {
+				/* align */
+				*data++ = 0x1;
+				/* the window is not scaled, the peer's is */
+				*data++ = TCPOPT_WINDOW;
+				*data++ = TCPOLEN_WINDOW;
+				*data++ = 0;
+			}
+		} else if (sesscb->topts & TOF_TS) {
 			/* align */
 			*data++ = 0x1;
 			*data++ = 0x1;
@@ -581,20 +648,7 @@ struct packet *packet6(pcs *pc) //sesscb *sesscb)
 			*data++ = TCPOPT_TIMESTAMP;
 			*data++ = TCPOLEN_TIMESTAMP;
 			memcpy(data, (char *)&t, 4);
-			data += 8;
-			/* align */
-			*data++ = 0x1;
-			*data++ = TCPOPT_WINDOW;
-			*data++ = TCPOLEN_WINDOW;
-			*data++ = 1;
-		} else {
-			/* align */
-			*data++ = 0x1;
-			*data++ = 0x1;
-			/* timestamp */
-			*data++ = TCPOPT_TIMESTAMP;
-			*data++ = TCPOLEN_TIMESTAMP;
-			memcpy(data, (char *)&t, 4);
+			memcpy(data + 4, (char *)&ecr, 4);
 			data += 8;
 		}
 		
@@ -602,20 +656,33 @@ struct packet *packet6(pcs *pc) //sesscb *sesscb)
 		th->th_off = (sizeof(tcphdr) + optlen) >> 2;
 		
 		/* fill the data */
-		for (i = optlen; i < dlen; i++) {
-			if ((i % 2) == 0)
-				*data++ = 0xd;
-			else
-				*data++ = 0xa;
+		if (sesscb->sdata != NULL)
+			memcpy(data, sesscb->sdata, dlen - optlen);
+		else {
+			for (i = optlen; i < dlen; i++) {
+				if ((i % 2) == 0)
+					*data++ = 0xd;
+				else
+					*data++ = 0xa;
+			}
 		}
 
 		th->th_sum = 0;
-		th->th_sum = cksum6(ip, IPPROTO_TCP, len - 
-		    sizeof(ethdr) - sizeof(ip6hdr));
+		/* the sum of the data may be known, see tcpsock.c */
+		if (sesscb->sdata != NULL && sesscb->dsum != 0 && 
+		    dlen - optlen == sesscb->dsize)
+			th->th_sum = cksum6_part(ip, IPPROTO_TCP, len - 
+			    sizeof(ethdr) - sizeof(ip6hdr), 
+			    sizeof(tcphdr) + optlen, sesscb->dsum);
+		else
+			th->th_sum = cksum6(ip, IPPROTO_TCP, len - 
+			    sizeof(ethdr) - sizeof(ip6hdr));
 	}
 	
-	if ((sesscb->frag & IPF_FRAG) == IPF_FRAG)
+	if ((sesscb->frag & IPF_FRAG) == IPF_FRAG) {
 		m = ipfrag6(m, findmtu6(pc, &(sesscb->dip6)));
+		STATS_FRAGS(pc, m);
+	}
 	
 	return m;
 	
@@ -685,6 +752,7 @@ struct packet *icmp6Reply(pcs *pc, struct packet *m0, char icmptype, char icmpco
 	icmp->cksum = 0;
 	icmp->cksum = cksum6(ip, IPPROTO_ICMPV6, hlen);
 
+	TRACE_REPLY(m, m0);
 	return m;
 }
 
@@ -717,7 +785,8 @@ struct packet *udp6Reply(struct packet *m0)
 	ui->cksum = 0;
 	ui->cksum = cksum6(ip, IPPROTO_UDP, ntohs(ui->len));
 			
-	return m;	
+	TRACE_REPLY(m, m0);
+	return m;
 }
 
 /*
@@ -754,14 +823,17 @@ u_char *nbDiscovery(pcs *pc, ip6 *dst)
 		while (!timeout(tv, waittime)) {
 			struct packet *m;
 			
-			if (memcmp(pc->ip6.gmac, (const char *)mac, ETH_ALEN) != 0)
+			if (memcmp(pc->ip6.gmac, (const char *)mac, ETH_ALEN) != 0) {
+				STATS_ATOMIC_INC(pc, ev.nd_hit);
 				return (pc->ip6.gmac);
+			}
 			
 			m = nbr_sol(pc);
 			if (m == NULL) {
 				printf("out of memory\n");
 				return NULL;
 			}
+			STATS_ATOMIC_INC(pc, ev.nd_req);
 			enq(&pc->oq, m);
 			delay_ms(10);
 		}
@@ -770,8 +842,10 @@ u_char *nbDiscovery(pcs *pc, ip6 *dst)
 		/* search neightbor cache */
 		for (i = 0; i < POOL_SIZE; i++) {
 			if (sameNet6((char *)pc->ipmac6[i].ip.addr8, 
-			    (char *)dst->addr8, 128))
+			    (char *)dst->addr8, 128)) {
+				STATS_ATOMIC_INC(pc, ev.nd_hit);
 				return (pc->ipmac6[i].mac);
+			}
 		}
 	}
 	
@@ -787,6 +861,7 @@ u_char *nbDiscovery(pcs *pc, ip6 *dst)
 			printf("out of memory\n");
 			return NULL;
 		}
+		STATS_ATOMIC_INC(pc, ev.nd_req);
 		enq(&pc->oq, m);
 		
 		gettimeofday(&(tv), (void*)0);
@@ -49,7 +49,8 @@
 
 int upv6(pcs *pc, struct packet **m);
 
-struct packet *packet6(pcs *pc); //, sesscb *sesscb);
+struct packet *packet6(pcs *pc);
+struct packet *packet6cb(pcs *pc, sesscb *sesscb);
 
 int response6(struct packet *pkt, sesscb *sesscb);
 struct packet *tcp6Reply(struct packet *m0, sesscb *cb);
@@ -0,0 +1,1088 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vpcs.h"
+#include "perf.h"
+#include "tcp.h"
+#include "tcpstream.h"
+#include "packets.h"
+#include "packets6.h"
+#include "dns.h"
+#include "help.h"
+#include "utils.h"
+
+extern int pcid;
+extern int ctrl_c;
+extern u_int time_tick;
+
+extern int vinet_pton6(int af, const char * __restrict src, 
+    void * __restrict dst);
+extern const char *vinet_ntop6(int af, const void *src, char *dst, 
+    socklen_t cnt);
+
+struct perfopt {
+	int server;
+	int proto;
+	int port;
+	int sec;			/* duration, 0 till Ctrl+C */
+	int interval;			/* seconds between reports, 0 none */
+	int size;			/* of the datagrams or the segments */
+	int streams;
+	u_int64_t rate;			/* bits per second, 0 no limit */
+	int cc;				/* TCPCC_* */
+};
+
+/* one run of the client */
+struct perfrun {
+	struct perfopt *po;
+	u_int64_t start;		/* usec */
+	u_int64_t end;
+	u_int64_t next;			/* the next report */
+	u_int64_t last[PERF_MAXSTREAMS]; /* bytes at the last report */
+	u_long lastrx[PERF_MAXSTREAMS];	/* retransmissions */
+};
+
+/* a connection or a udp flow seen by the server */
+struct perfflow {
+	int used;
+	int done;
+	int id;
+	int proto;
+	int ipv;
+	u_int ip;			/* of the peer */
+	ip6 ip6;
+	u_int port;			/* network order */
+	u_int64_t start;		/* usec */
+	u_int64_t end;
+	u_int64_t next;			/* the next report */
+	u_int64_t bytes;
+	u_int64_t last;			/* bytes at the last report */
+	u_long pkts;
+	u_long lastpkts;
+	u_long lost;			/* from the gaps of the ids */
+	u_long lastlost;
+	u_long total;			/* as told by the last datagram */
+	u_long outorder;
+	int32_t expect;			/* the id expected */
+	double transit;			/* seconds, of the last datagram */
+	double jitter;
+};
+
+#define PERF_NOLIMIT	((u_int64_t)1 << 62)
+#define PERF_OQMAX	(PKTQ_SIZE * 3 / 4)
+
+static int perf_args(int argc, char **argv, struct perfopt *po, 
+    char **host);
+static u_int64_t perf_rate(const char *arg);
+static int perf_tcp(pcs *pc, struct perfopt *po, int ipv, const char *host);
+static int perf_tcptick(struct tcpstream *ts, int n, void *arg);
+static int perf_udp(pcs *pc, struct perfopt *po, int ipv, const char *host);
+static int perf_udpreport(pcs *pc, int ipv, sesscb *cb, struct packet *m);
+static int perf_tcpserver(pcs *pc, struct perfopt *po);
+static int perf_udpserver(pcs *pc, struct perfopt *po);
+static void perf_udpin(pcs *pc, struct perfopt *po, struct perfflow *fl, 
+    int *ids, struct packet *m);
+static void perf_udpack(pcs *pc, struct perfflow *f, struct packet *m0);
+static void perf_interval(struct perfflow *f, int interval, u_int64_t now);
+static void perf_flowreport(struct perfflow *f);
+static u_long perf_lost(struct perfflow *f);
+static void perf_line(int id, double t0, double t1, u_int64_t bytes, 
+    const char *extra);
+static void perf_cc(int id, struct tcpstream *ts);
+static const char *perf_peer(struct perfflow *f);
+static u_int64_t now_us(void);
+
+int run_perf(int argc, char **argv)
+{
+	pcs *pc = &vpc[pcid];
+	struct perfopt po;
+	char *host = NULL;
+	int ipv = 4;
+
+	if (argc < 2 || (argc == 2 && (!strcmp(argv[1], "?") || 
+	    !strcmp(argv[1], "help"))))
+		return help_perf(argc, argv);
+
+	if (!perf_args(argc, argv, &po, &host))
+		return 0;
+
+	if (po.server) {
+		if (po.proto == IPPROTO_UDP)
+			return perf_udpserver(pc, &po);
+		return perf_tcpserver(pc, &po);
+	}
+
+	if (host == NULL) {
+		printf("No host given, or use -s for the server\n");
+		return 0;
+	}
+
+	pc->mscb.frag = IPF_FRAG;
+	pc->mscb.mtu = pc->mtu;
+	pc->mscb.waittime = 1000;
+	pc->mscb.ipid = time(0) & 0xffff;
+	pc->mscb.ttl = TTL;
+	pc->mscb.winsize = 0xb68; /* 1460 * 4 */
+	pc->mscb.sport = (random() % (65000 - 1024 - PERF_MAXSTREAMS)) + 1024;
+	pc->mscb.dport = po.port;
+	pc->mscb.proto = po.proto;
+
+	if (!perf_route(pc, host, &ipv))
+		return 0;
+
+	if (po.proto == IPPROTO_UDP)
+		return perf_udp(pc, &po, ipv, host);
+	return perf_tcp(pc, &po, ipv, host);
+}
+
+static int perf_args(int argc, char **argv, struct perfopt *po, 
+    char **host)
+{
+	int i;
+
+	memset(po, 0, sizeof(struct perfopt));
+	po->proto = IPPROTO_TCP;
+	po->port = PERF_PORT;
+	po->sec = -1;
+	po->interval = 1;
+	po->streams = 1;
+
+	for (i = 1; i < argc; i++) {
+		if (argv[i][0] != '-') {
+			*host = argv[i];
+			continue;
+		}
+		switch (argv[i][1]) {
+			case 's':
+				po->server = 1;
+				break;
+			case 'u':
+				po->proto = IPPROTO_UDP;
+				break;
+			case 'p':
+				if (i + 1 < argc)
+					po->port = atoi(argv[++i]);
+				if (po->port < 1 || po->port > 65535) {
+					printf("Invalid port\n");
+					return 0;
+				}
+				break;
+			case 't':
+				if (i + 1 < argc)
+					po->sec = atoi(argv[++i]);
+				break;
+			case 'i':
+				if (i + 1 < argc)
+					po->interval = atoi(argv[++i]);
+				break;
+			case 'l':
+				if (i + 1 < argc)
+					po->size = arg2size(argv[++i]);
+				if (po->size < sizeof(struct perfudp) || 
+				    po->size > 65000) {
+					printf("Invalid size\n");
+					return 0;
+				}
+				break;
+			case 'P':
+				if (i + 1 < argc)
+					po->streams = atoi(argv[++i]);
+				if (po->streams < 1 || 
+				    po->streams > PERF_MAXSTREAMS) {
+					printf("Parallel streams range 1 to %d\n",
+					    PERF_MAXSTREAMS);
+					return 0;
+				}
+				break;
+			case 'b':
+				if (i + 1 < argc)
+					po->rate = perf_rate(argv[++i]);
+				break;
+			case 'C':
+				if (i + 1 < argc)
+					po->cc = tcpcc_lookup(argv[++i]);
+				if (po->cc == TCPCC_DEFAULT) {
+					printf("Invalid congestion control\n");
+					return 0;
+				}
+				break;
+			default:
+				printf("Invalid options\n");
+				return 0;
+		}
+	}
+
+	/* the client stops, the server runs till Ctrl+C */
+	if (po->sec < 0)
+		po->sec = po->server ? 0 : PERF_TIME;
+	if (po->sec == 0 && !po->server)
+		po->sec = PERF_TIME;
+	if (po->interval < 0)
+		po->interval = 0;
+	if (po->proto == IPPROTO_UDP && po->rate == 0)
+		po->rate = PERF_RATE;
+
+	return 1;
+}
+
+/* bits per second, k, m and g are 1000 as iperf does */
+static u_int64_t perf_rate(const char *arg)
+{
+	char *p;
+	double v;
+
+	v = strtod(arg, &p);
+	switch (*p | 0x20) {
+		case 'k':
+			v *= 1000;
+			break;
+		case 'm':
+			v *= 1000000;
+			break;
+		case 'g':
+			v *= 1000000000;
+			break;
+	}
+	return (v > 0) ? (u_int64_t)v : 0;
+}
+
+/* 
+ * find the ether address of the host or the gateway, mscb takes the
+ * addresses, see also webload
+ */
+int perf_route(pcs *pc, char *host, int *ipv)
+{
+	char dname[256];
+	char ipstr[64];
+	struct in6_addr ipaddr;
+	struct in_addr in;
+	u_char *mac;
+	u_int gip;
+
+	if (strchr(host, ':') == NULL) {
+		pc->mscb.dip = inet_addr(host);
+		if (pc->mscb.dip == -1 || pc->mscb.dip == 0) {
+			strncpy(dname, host, sizeof(dname) - 1);
+			dname[sizeof(dname) - 1] = '\0';
+			if (hostresolv(pc, dname, ipstr) == 0) {
+				printf("Cannot resolve %s\n", host);
+				return 0;
+			}
+			printf("%s resolved to %s\n", host, ipstr);
+			if (strchr(ipstr, ':') != NULL)
+				goto inet6;
+			pc->mscb.dip = inet_addr(ipstr);
+		}
+		if (pc->mscb.dip == pc->ip4.ip) {
+			printf("Cannot test to myself\n");
+			return 0;
+		}
+		pc->mscb.sip = pc->ip4.ip;
+		memcpy(pc->mscb.smac, pc->ip4.mac, ETH_ALEN);
+
+		if (sameNet(pc->mscb.dip, pc->ip4.ip, pc->ip4.cidr))
+			gip = pc->mscb.dip;
+		else if (pc->ip4.gw != 0)
+			gip = pc->ip4.gw;
+		else {
+			printf("No gateway found\n");
+			return 0;
+		}
+		if (!arpResolve(pc, gip, pc->mscb.dmac)) {
+			in.s_addr = gip;
+			printf("host (%s) not reachable\n", inet_ntoa(in));
+			return 0;
+		}
+		*ipv = 4;
+		return 1;
+	}
+	strncpy(ipstr, host, sizeof(ipstr) - 1);
+	ipstr[sizeof(ipstr) - 1] = '\0';
+
+inet6:
+	if (vinet_pton6(AF_INET6, ipstr, &ipaddr) != 1) {
+		printf("Invalid address: %s\n", ipstr);
+		return 0;
+	}
+	memcpy(pc->mscb.dip6.addr8, ipaddr.s6_addr, 16);
+	if (pc->mscb.dip6.addr16[0] != IPV6_ADDR_INT16_ULL)
+		memcpy(pc->mscb.sip6.addr8, pc->ip6.ip.addr8, 16);
+	else
+		memcpy(pc->mscb.sip6.addr8, pc->link6.ip.addr8, 16);
+	if (IP6EQ(&pc->mscb.sip6, &pc->mscb.dip6)) {
+		printf("Cannot test to myself\n");
+		return 0;
+	}
+	memcpy(pc->mscb.smac, pc->ip4.mac, ETH_ALEN);
+
+	mac = nbDiscovery(pc, &pc->mscb.dip6);
+	if (mac == NULL) {
+		printf("host (%s) not reachable\n", ipstr);
+		return 0;
+	}
+	memcpy(pc->mscb.dmac, mac, ETH_ALEN);
+	*ipv = IPV6_VERSION;
+	return 1;
+}
+
+/*
+ * The tcp client, the streams are opened one after another, then 
+ * sent together by tcp_streams. The ports are mscb.sport and up.
+ */
+static int perf_tcp(pcs *pc, struct perfopt *po, int ipv, const char *host)
+{
+	sesscb cb[PERF_MAXSTREAMS];
+	struct tcpstream ts[PERF_MAXSTREAMS];
+	struct perfrun run;
+	u_int64_t sum = 0;
+	u_long rexmits = 0;
+	char buf[32];
+	int base = pc->mscb.sport;
+	int i, k, n, optlen;
+
+	for (n = 0; n < po->streams && !ctrl_c; n++) {
+		pc->mscb.sport = base + n;
+		pc->mscb.dsize = PAYLOAD56;
+		k = tcp_open(pc, ipv);
+		if (k != 1) {
+			printf("Connect   %d@%s %s\n", po->port, host, 
+			    (k == 3) ? "RST returned" : 
+			    ((k == 2) ? "unreachable" : "timeout"));
+			break;
+		}
+		cb[n] = pc->mscb;
+		cb[n].cc = po->cc;
+		/* -l caps the segments, ts_init takes the timestamp off */
+		optlen = (cb[n].topts & TOF_TS) ? TCPS_OPTLEN : 0;
+		if (po->size > 0 && (cb[n].rmss == 0 || 
+		    cb[n].rmss > po->size + optlen))
+			cb[n].rmss = po->size + optlen;
+		memset(&ts[n], 0, sizeof(struct tcpstream));
+		ts[n].cb = &cb[n];
+		ts[n].ipv = ipv;
+		printf("[%3d] local port %d connected to %s port %d\n", n + 1, 
+		    base + n, host, po->port);
+	}
+	if (n == 0)
+		return 0;
+
+	/* all the streams go up to this command */
+	pc->mscb.sport = base;
+	pc->mscb.nports = n;
+
+	memset(&run, 0, sizeof(run));
+	run.po = po;
+	run.start = now_us();
+	run.end = run.start + po->sec * 1000000ULL;
+	run.next = run.start + po->interval * 1000000ULL;
+	printf("[ ID] Interval           Transfer      Bitrate          "
+	    "Retr  Cwnd\n");
+
+	tcp_streams(pc, ts, n, perf_tcptick, &run);
+
+	for (i = 0; i < n; i++) {
+		double sec = (ts[i].end - run.start) / 1000000.0;
+
+		sprintf(buf, "  %4lu", ts[i].rexmits);
+		perf_line(i + 1, 0, sec, ts[i].una, buf);
+		perf_cc(i + 1, &ts[i]);
+		sum += ts[i].una;
+		rexmits += ts[i].rexmits;
+		if (ts[i].rst)
+			printf("[%3d] RST returned\n", i + 1);
+		else if (ts[i].dead)
+			printf("[%3d] timeout\n", i + 1);
+	}
+	if (n > 1) {
+		sprintf(buf, "  %4lu", rexmits);
+		perf_line(0, 0, (now_us() - run.start) / 1000000.0, sum, buf);
+	}
+
+	/* one by one, the others are quiet now */
+	for (i = 0; i < n; i++) {
+		if (ts[i].rst)
+			continue;
+		pc->mscb = cb[i];
+		pc->mscb.nports = 0;
+		pc->mscb.dsize = PAYLOAD56;
+		if (tcp_close(pc, ipv) == 0)
+			printf("[%3d] Close timeout\n", i + 1);
+	}
+	return 1;
+}
+
+/* pace the streams and print the interval reports */
+static int perf_tcptick(struct tcpstream *ts, int n, void *arg)
+{
+	struct perfrun *run = arg;
+	struct perfopt *po = run->po;
+	u_int64_t now = now_us();
+	u_int64_t sum = 0;
+	u_long rx = 0;
+	double t0, t1;
+	char buf[64];
+	int i;
+
+	if (po->interval > 0 && now >= run->next) {
+		t1 = (run->next - run->start) / 1000000.0;
+		t0 = t1 - po->interval;
+		for (i = 0; i < n; i++) {
+			sprintf(buf, "  %4lu  %6.1f KBytes", 
+			    ts[i].rexmits - run->lastrx[i], ts[i].cwnd / 1024.0);
+			perf_line(i + 1, t0, t1, ts[i].una - run->last[i], buf);
+			sum += ts[i].una - run->last[i];
+			rx += ts[i].rexmits - run->lastrx[i];
+			run->last[i] = ts[i].una;
+			run->lastrx[i] = ts[i].rexmits;
+		}
+		if (n > 1) {
+			sprintf(buf, "  %4lu", rx);
+			perf_line(0, t0, t1, sum, buf);
+		}
+		run->next += po->interval * 1000000ULL;
+	}
+
+	if (now >= run->end) {
+		/* send no more, wait for the acks */
+		for (i = 0; i < n; i++)
+			ts[i].bytes = ts[i].max;
+		return 0;
+	}
+	for (i = 0; i < n; i++) {
+		if (po->rate == 0)
+			ts[i].bytes = PERF_NOLIMIT;
+		else
+			ts[i].bytes = po->rate * (now - run->start) / 8 / 
+			    1000000 / n;
+	}
+	return 1;
+}
+
+/*
+ * The udp client, the datagrams of each stream are sent at the rate,
+ * then the last one asks the server for its report.
+ */
+static int perf_udp(pcs *pc, struct perfopt *po, int ipv, const char *host)
+{
+	sesscb cb[PERF_MAXSTREAMS];
+	u_long sent[PERF_MAXSTREAMS];
+	u_int64_t last[PERF_MAXSTREAMS];
+	struct perfudp *hdr;
+	struct timeval tv;
+	struct packet *m;
+	u_int64_t start, end, next, now, due;
+	u_int64_t sum;
+	char *data;
+	int base = pc->mscb.sport;
+	int i, k, n, size, retry, done;
+	double t0, t1;
+
+	size = po->size;
+	if (size == 0)
+		size = (ipv == IPV6_VERSION) ? 1450 : 1470;
+	n = po->streams;
+
+	data = calloc(n, size);
+	if (data == NULL) {
+		printf("out of memory\n");
+		return 0;
+	}
+	for (i = 0; i < size; i++)
+		data[i] = (i & 0xf) + '0';
+	for (k = 0; k < n; k++) {
+		if (k > 0)
+			memcpy(data + k * size, data, size);
+		cb[k] = pc->mscb;
+		cb[k].sport = base + k;
+		cb[k].dsize = size;
+		cb[k].data = data + k * size;
+		sent[k] = 0;
+		last[k] = 0;
+		printf("[%3d] local port %d sending to %s port %d\n", k + 1, 
+		    base + k, host, po->port);
+	}
+	/* the reports of the server come up to this command */
+	pc->mscb.nports = n;
+	pc->mscb.timeout = time_tick;
+	printf("[ ID] Interval           Transfer      Bitrate\n");
+
+	start = now_us();
+	end = start + po->sec * 1000000ULL;
+	next = start + po->interval * 1000000ULL;
+	while (!ctrl_c) {
+		now = now_us();
+		if (now >= end)
+			break;
+
+		/* in turn, the queue is shared */
+		due = po->rate * (now - start) / 8 / 1000000 / size / n + 1;
+		do {
+			done = 0;
+			for (k = 0; k < n && pc->oq.size < PERF_OQMAX; k++) {
+				if (sent[k] >= due)
+					continue;
+				hdr = (struct perfudp *)cb[k].data;
+				gettimeofday(&tv, NULL);
+				hdr->id = htonl(sent[k]);
+				hdr->sec = htonl(tv.tv_sec);
+				hdr->usec = htonl(tv.tv_usec);
+				m = (ipv == IPV6_VERSION) ? 
+				    packet6cb(pc, &cb[k]) : packetcb(pc, &cb[k]);
+				if (m == NULL)
+					break;
+				enq(&pc->oq, m);
+				sent[k]++;
+				done++;
+			}
+		} while (done > 0);
+
+		if (po->interval > 0 && now >= next) {
+			t1 = (next - start) / 1000000.0;
+			t0 = t1 - po->interval;
+			sum = 0;
+			for (k = 0; k < n; k++) {
+				perf_line(k + 1, t0, t1, 
+				    (sent[k] - last[k]) * size, NULL);
+				sum += (sent[k] - last[k]) * size;
+				last[k] = sent[k];
+			}
+			if (n > 1)
+				perf_line(0, t0, t1, sum, NULL);
+			next += po->interval * 1000000ULL;
+		}
+
+		/* nothing is expected till the end */
+		m = timedwaitdeq(&pc->iq, 1);
+		while (m != NULL) {
+			del_pkt(m);
+			m = deq(&pc->iq);
+		}
+	}
+
+	t1 = (now_us() - start) / 1000000.0;
+	sum = 0;
+	for (k = 0; k < n; k++) {
+		perf_line(k + 1, 0, t1, sent[k] * size, NULL);
+		printf("[%3d] Sent %lu datagrams\n", k + 1, sent[k]);
+		sum += sent[k] * size;
+	}
+	if (n > 1)
+		perf_line(0, 0, t1, sum, NULL);
+
+	/* the last datagram, again till the server reports */
+	for (k = 0; k < n; k++) {
+		hdr = (struct perfudp *)cb[k].data;
+		hdr->id = htonl(-(int32_t)sent[k]);
+		done = 0;
+		for (retry = 0; retry < 10 && !done && !ctrl_c; retry++) {
+			pc->mscb.timeout = time_tick;
+			m = (ipv == IPV6_VERSION) ? 
+			    packet6cb(pc, &cb[k]) : packetcb(pc, &cb[k]);
+			if (m != NULL)
+				enq(&pc->oq, m);
+			m = timedwaitdeq(&pc->iq, 250);
+			while (m != NULL && !done) {
+				done = perf_udpreport(pc, ipv, &cb[k], m);
+				del_pkt(m);
+				if (!done)
+					m = deq(&pc->iq);
+			}
+		}
+		if (!done)
+			printf("[%3d] No report from the server\n", k + 1);
+	}
+	free(data);
+
+	return 1;
+}
+
+/* print the report of the server, return 1 if m is the one */
+static int perf_udpreport(pcs *pc, int ipv, sesscb *cb, struct packet *m)
+{
+	ethdr *eh = (ethdr *)(m->data);
+	iphdr *ip;
+	ip6hdr *ip6;
+	udphdr *uh;
+	struct perfreport *rp;
+	u_int64_t bytes;
+	u_long lost, total;
+	double sec, jitter;
+	char buf[64];
+	int id;
+
+	if (ipv == IPV6_VERSION) {
+		ip6 = (ip6hdr *)(eh + 1);
+		if (ip6->ip6_nxt != IPPROTO_UDP)
+			return 0;
+		uh = (udphdr *)(ip6 + 1);
+	} else {
+		ip = (iphdr *)(eh + 1);
+		if (ip->proto != IPPROTO_UDP)
+			return 0;
+		uh = (udphdr *)((char *)ip + (ip->ihl << 2));
+	}
+	if (ntohs(uh->dport) != cb->sport || 
+	    ntohs(uh->len) < sizeof(udphdr) + sizeof(struct perfudp) + 
+	    sizeof(struct perfreport))
+		return 0;
+	rp = (struct perfreport *)((char *)(uh + 1) + sizeof(struct perfudp));
+	if (!(ntohl(rp->flags) & PERF_REPORT))
+		return 0;
+
+	bytes = ((u_int64_t)ntohl(rp->total_len1) << 32) | 
+	    (u_int)ntohl(rp->total_len2);
+	sec = ntohl(rp->stop_sec) + ntohl(rp->stop_usec) / 1000000.0;
+	jitter = ntohl(rp->jitter1) * 1000.0 + ntohl(rp->jitter2) / 1000.0;
+	lost = ntohl(rp->error_cnt);
+	total = ntohl(rp->datagrams);
+
+	id = cb->sport - pc->mscb.sport + 1;
+	printf("[%3d] Server Report:\n", id);
+	sprintf(buf, "  %.3f ms  %lu/%lu (%.2g%%)", jitter, lost, total, 
+	    total ? lost * 100.0 / total : 0.0);
+	perf_line(id, 0, sec, bytes, buf);
+	if (ntohl(rp->outorder_cnt) != 0)
+		printf("[%3d] %d datagrams received out-of-order\n", id,
+		    ntohl(rp->outorder_cnt));
+	return 1;
+}
+
+/*
+ * The vpc answers tcp on every port, see tcp(), and counts the data
+ * taken in order. The server watches the sessions of its port.
+ */
+static int perf_tcpserver(pcs *pc, struct perfopt *po)
+{
+	struct perfflow fl[MAX_SESSIONS];
+	struct perfflow *f;
+	sesscb *cb;
+	u_int64_t start, now;
+	int i, match, ids = 0;
+
+	memset(fl, 0, sizeof(fl));
+	printf("Server listening on TCP port %d\n", po->port);
+
+	start = now_us();
+	while (!ctrl_c) {
+		now = now_us();
+		if (po->sec > 0 && now >= start + po->sec * 1000000ULL)
+			break;
+
+		for (i = 0; i < MAX_SESSIONS; i++) {
+			cb = &pc->sesscb[i];
+			f = &fl[i];
+			match = (cb->timeout != 0 && 
+			    time_tick - cb->timeout <= TCP_TIMEOUT &&
+			    ntohs(cb->dport) == po->port);
+
+			/* gone, or the slot was taken by another one */
+			if (f->used && (!match || cb->sport != f->port || 
+			    ((f->ipv == 4) ? (cb->sip != f->ip) : 
+			    !IP6EQ(&cb->sip6, &f->ip6)))) {
+				if (!f->done)
+					perf_flowreport(f);
+				f->used = 0;
+			}
+			if (!f->used && match) {
+				memset(f, 0, sizeof(struct perfflow));
+				f->used = 1;
+				f->id = ++ids;
+				f->proto = IPPROTO_TCP;
+				f->ipv = (cb->sip != 0) ? 4 : IPV6_VERSION;
+				f->ip = cb->sip;
+				f->ip6 = cb->sip6;
+				f->port = cb->sport;
+				f->start = f->end = now;
+				f->next = now + po->interval * 1000000ULL;
+				printf("[%3d] connected with %s port %d\n", f->id,
+				    perf_peer(f), ntohs(f->port));
+			}
+			if (!f->used || f->done)
+				continue;
+
+			/* the time of the last data, not of the close */
+			if (f->bytes != cb->rbytes) {
+				f->bytes = cb->rbytes;
+				f->end = now;
+			}
+			/* the peer closed, or we did after its FIN */
+			if ((cb->rflags | cb->flags) & TH_FIN) {
+				f->done = 1;
+				perf_flowreport(f);
+			} else
+				perf_interval(f, po->interval, now);
+		}
+		delay_ms(10);
+	}
+
+	for (i = 0; i < MAX_SESSIONS; i++) {
+		if (fl[i].used && !fl[i].done)
+			perf_flowreport(&fl[i]);
+	}
+	return 1;
+}
+
+/* the udp server, the datagrams of its port come up from upv4/upv6 */
+static int perf_udpserver(pcs *pc, struct perfopt *po)
+{
+	struct perfflow fl[PERF_MAXSTREAMS];
+	struct packet *m;
+	u_int64_t start, now;
+	int i, ids = 0;
+
+	memset(fl, 0, sizeof(fl));
+	pc->mscb.proto = IPPROTO_UDP;
+	pc->mscb.sport = po->port;
+	printf("Server listening on UDP port %d\n", po->port);
+
+	start = now_us();
+	while (!ctrl_c) {
+		now = now_us();
+		if (po->sec > 0 && now >= start + po->sec * 1000000ULL)
+			break;
+		pc->mscb.timeout = time_tick;
+
+		m = timedwaitdeq(&pc->iq, 10);
+		while (m != NULL) {
+			perf_udpin(pc, po, fl, &ids, m);
+			del_pkt(m);
+			m = deq(&pc->iq);
+		}
+
+		now = now_us();
+		for (i = 0; i < PERF_MAXSTREAMS; i++) {
+			if (fl[i].used && !fl[i].done)
+				perf_interval(&fl[i], po->interval, now);
+		}
+	}
+
+	now = now_us();
+	for (i = 0; i < PERF_MAXSTREAMS; i++) {
+		if (fl[i].used && !fl[i].done) {
+			fl[i].end = now;
+			perf_flowreport(&fl[i]);
+		}
+	}
+	return 1;
+}
+
+static void perf_udpin(pcs *pc, struct perfopt *po, struct perfflow *fl, 
+    int *ids, struct packet *m)
+{
+	ethdr *eh = (ethdr *)(m->data);
+	iphdr *ip = NULL;
+	ip6hdr *ip6 = NULL;
+	udphdr *uh;
+	struct perfudp *hdr;
+	struct perfflow *f = NULL, *fr = NULL;
+	double transit, d;
+	int32_t id;
+	int i, ipv, len;
+
+	if (eh->type == htons(ETHERTYPE_IPV6)) {
+		ip6 = (ip6hdr *)(eh + 1);
+		if (ip6->ip6_nxt != IPPROTO_UDP)
+			return;
+		uh = (udphdr *)(ip6 + 1);
+		ipv = IPV6_VERSION;
+	} else {
+		ip = (iphdr *)(eh + 1);
+		if (ip->proto != IPPROTO_UDP)
+			return;
+		uh = (udphdr *)((char *)ip + (ip->ihl << 2));
+		ipv = 4;
+	}
+	if (ntohs(uh->dport) != po->port)
+		return;
+	len = ntohs(uh->len) - sizeof(udphdr);
+	if (len < (int)sizeof(struct perfudp))
+		return;
+	hdr = (struct perfudp *)(uh + 1);
+	id = ntohl(hdr->id);
+
+	for (i = 0; i < PERF_MAXSTREAMS; i++) {
+		if (!fl[i].used || fl[i].done) {
+			if (fr == NULL || fr->used)
+				fr = &fl[i];
+			if (!fl[i].used)
+				continue;
+		}
+		if (fl[i].ipv == ipv && fl[i].port == uh->sport && 
+		    ((ipv == 4) ? (fl[i].ip == ip->sip) : 
+		    IP6EQ(&fl[i].ip6, &ip6->src))) {
+			f = &fl[i];
+			break;
+		}
+	}
+
+	/* the client asks again for the report */
+	if (f != NULL && f->done && id < 0) {
+		perf_udpack(pc, f, m);
+		return;
+	}
+	/* a new flow, or the same ports once more */
+	if (f == NULL || f->done) {
+		if (id < 0)
+			return;
+		if (f == NULL)
+			f = fr;
+		if (f == NULL) {
+			printf("Too many flows, %d at most\n", PERF_MAXSTREAMS);
+			return;
+		}
+		memset(f, 0, sizeof(struct perfflow));
+		f->used = 1;
+		f->id = ++(*ids);
+		f->proto = IPPROTO_UDP;
+		f->ipv = ipv;
+		if (ipv == 4)
+			f->ip = ip->sip;
+		else
+			f->ip6 = ip6->src;
+		f->port = uh->sport;
+		f->start = now_us();
+		f->next = f->start + po->interval * 1000000ULL;
+		printf("[%3d] connected with %s port %d\n", f->id, perf_peer(f),
+		    ntohs(f->port));
+	}
+
+	if (id < 0) {
+		f->total = -id;
+		f->end = now_us();
+		f->done = 1;
+		perf_flowreport(f);
+		perf_udpack(pc, f, m);
+		return;
+	}
+
+	f->pkts++;
+	f->bytes += len;
+	if (id >= f->expect) {
+		f->lost += id - f->expect;
+		f->expect = id + 1;
+	} else {
+		f->outorder++;
+		if (f->lost > 0)
+			f->lost--;
+	}
+
+	/* RFC 3550 A.8, the clocks of the two ends need not agree */
+	transit = ((double)m->ts.tv_sec - ntohl(hdr->sec)) + 
+	    ((double)m->ts.tv_usec - ntohl(hdr->usec)) / 1000000.0;
+	if (f->pkts > 1) {
+		d = transit - f->transit;
+		if (d < 0)
+			d = -d;
+		f->jitter += (d - f->jitter) / 16.0;
+	}
+	f->transit = transit;
+}
+
+/* send the report to the client, the header of its datagram first */
+static void perf_udpack(pcs *pc, struct perfflow *f, struct packet *m0)
+{
+	ethdr *eh = (ethdr *)(m0->data);
+	char buf[sizeof(struct perfudp) + sizeof(struct perfreport)];
+	struct perfreport *rp;
+	struct packet *m;
+	udphdr *uh;
+	iphdr *ip;
+	ip6hdr *ip6;
+	sesscb cb;
+	u_int64_t usec = f->end - f->start;
+
+	memset(&cb, 0, sizeof(cb));
+	if (f->ipv == IPV6_VERSION) {
+		ip6 = (ip6hdr *)(eh + 1);
+		uh = (udphdr *)(ip6 + 1);
+		cb.sip6 = ip6->dst;
+		cb.dip6 = ip6->src;
+	} else {
+		ip = (iphdr *)(eh + 1);
+		uh = (udphdr *)((char *)ip + (ip->ihl << 2));
+		cb.sip = ip->dip;
+		cb.dip = ip->sip;
+	}
+
+	memset(buf, 0, sizeof(buf));
+	memcpy(buf, uh + 1, sizeof(struct perfudp));
+	rp = (struct perfreport *)(buf + sizeof(struct perfudp));
+	rp->flags = htonl(PERF_REPORT);
+	rp->total_len1 = htonl(f->bytes >> 32);
+	rp->total_len2 = htonl(f->bytes & 0xffffffff);
+	rp->stop_sec = htonl(usec / 1000000);
+	rp->stop_usec = htonl(usec % 1000000);
+	rp->error_cnt = htonl(perf_lost(f));
+	rp->outorder_cnt = htonl(f->outorder);
+	rp->datagrams = htonl(f->total);
+	rp->jitter1 = htonl((int)f->jitter);
+	rp->jitter2 = htonl((int)((f->jitter - (int)f->jitter) * 1000000));
+
+	memcpy(cb.smac, eh->dst, ETH_ALEN);
+	memcpy(cb.dmac, eh->src, ETH_ALEN);
+	cb.proto = IPPROTO_UDP;
+	cb.ttl = TTL;
+	cb.mtu = pc->mtu;
+	cb.frag = IPF_FRAG;
+	cb.ipid = random() & 0xffff;
+	cb.sport = ntohs(uh->dport);
+	cb.dport = ntohs(uh->sport);
+	cb.data = buf;
+	cb.dsize = sizeof(buf);
+
+	m = (f->ipv == IPV6_VERSION) ? packet6cb(pc, &cb) : packetcb(pc, &cb);
+	if (m != NULL)
+		enq(&pc->oq, m);
+}
+
+/* the report of the last interval of a flow at the server */
+static void perf_interval(struct perfflow *f, int interval, u_int64_t now)
+{
+	double t0, t1;
+	u_long lost, pkts;
+	char buf[64];
+
+	if (interval <= 0 || now < f->next)
+		return;
+
+	t1 = (f->next - f->start) / 1000000.0;
+	t0 = t1 - interval;
+	if (f->proto == IPPROTO_UDP) {
+		lost = f->lost - f->lastlost;
+		pkts = f->pkts - f->lastpkts + lost;
+		sprintf(buf, "  %.3f ms  %lu/%lu (%.2g%%)", f->jitter * 1000,
+		    lost, pkts, pkts ? lost * 100.0 / pkts : 0.0);
+		perf_line(f->id, t0, t1, f->bytes - f->last, buf);
+		f->lastlost = f->lost;
+		f->lastpkts = f->pkts;
+	} else
+		perf_line(f->id, t0, t1, f->bytes - f->last, NULL);
+	f->last = f->bytes;
+	f->next += interval * 1000000ULL;
+}
+
+static void perf_flowreport(struct perfflow *f)
+{
+	double sec = (f->end - f->start) / 1000000.0;
+	u_long lost, total;
+	char buf[64];
+
+	if (f->proto == IPPROTO_UDP) {
+		lost = perf_lost(f);
+		total = (f->total != 0) ? f->total : f->pkts + lost;
+		sprintf(buf, "  %.3f ms  %lu/%lu (%.2g%%)", f->jitter * 1000,
+		    lost, total, total ? lost * 100.0 / total : 0.0);
+		perf_line(f->id, 0, sec, f->bytes, buf);
+		if (f->outorder != 0)
+			printf("[%3d] %lu datagrams received out-of-order\n", 
+			    f->id, f->outorder);
+	} else
+		perf_line(f->id, 0, sec, f->bytes, NULL);
+}
+
+/* the count of the last datagram is the one to trust */
+static u_long perf_lost(struct perfflow *f)
+{
+	if (f->total != 0)
+		return (f->total > f->pkts) ? f->total - f->pkts : 0;
+	return f->lost;
+}
+
+/* [  1]   0.00-1.00   sec  1.19 MBytes  10.0 Mbits/sec, as iperf */
+static void perf_line(int id, double t0, double t1, u_int64_t bytes, 
+    const char *extra)
+{
+	double b = bytes;
+	double bits = (t1 > t0) ? bytes * 8 / (t1 - t0) : 0;
+	const char *bu = " Bytes", *ru = " bits/sec";
+
+	if (b >= 1024 * 1024 * 1024) {
+		b /= 1024 * 1024 * 1024;
+		bu = "GBytes";
+	} else if (b >= 1024 * 1024) {
+		b /= 1024 * 1024;
+		bu = "MBytes";
+	} else if (b >= 1024) {
+		b /= 1024;
+		bu = "KBytes";
+	}
+	if (bits >= 1000000000) {
+		bits /= 1000000000;
+		ru = "Gbits/sec";
+	} else if (bits >= 1000000) {
+		bits /= 1000000;
+		ru = "Mbits/sec";
+	} else if (bits >= 1000) {
+		bits /= 1000;
+		ru = "Kbits/sec";
+	}
+
+	if (id > 0)
+		printf("[%3d] ", id);
+	else
+		printf("[SUM] ");
+	printf("%6.2f-%-6.2f sec  %6.4g %s  %6.4g %s%s\n", t0, t1, b, bu, 
+	    bits, ru, (extra != NULL) ? extra : "");
+}
+
+/* the congestion control of a stream at the end */
+static void perf_cc(int id, struct tcpstream *ts)
+{
+	printf("[%3d] %s, cwnd %.1f KBytes, ssthresh ", id, ts->cc->name, 
+	    ts->cwnd / 1024.0);
+	if (ts->ssthresh == TCPCC_NOSSTHRESH)
+		printf("-");
+	else
+		printf("%.1f KBytes", ts->ssthresh / 1024.0);
+	printf(", srtt %.3f ms, rttvar %.3f ms\n", ts->srtt / 1000.0, 
+	    ts->rttvar / 1000.0);
+}
+
+static const char *perf_peer(struct perfflow *f)
+{
+	static char buf[INET6_ADDRSTRLEN + 1];
+	struct in_addr in;
+
+	if (f->ipv == IPV6_VERSION)
+		vinet_ntop6(AF_INET6, &f->ip6, buf, INET6_ADDRSTRLEN + 1);
+	else {
+		in.s_addr = f->ip;
+		strcpy(buf, inet_ntoa(in));
+	}
+	return buf;
+}
+
+static u_int64_t now_us(void)
+{
+	return trace_now() / 1000;
+}
+
+/* end of file */
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef _PERF_H_
+#define _PERF_H_
+
+#include <sys/types.h>
+
+#include "vpcs.h"
+
+#define PERF_PORT	5001		/* the one of iperf 2 */
+#define PERF_TIME	10		/* seconds */
+#define PERF_RATE	1000000		/* bits per second of udp */
+#define PERF_MAXSTREAMS	8
+
+/*
+ * The datagrams and the report of the server are the ones of iperf 2,
+ * so either end may be iperf. All the fields are in network order.
+ */
+struct perfudp {
+	int32_t id;			/* -count on the last one */
+	u_int32_t sec;			/* sent at */
+	u_int32_t usec;
+};
+
+struct perfreport {
+	int32_t flags;			/* PERF_REPORT */
+	int32_t total_len1;		/* bytes, high 32 bits */
+	int32_t total_len2;
+	int32_t stop_sec;		/* duration */
+	int32_t stop_usec;
+	int32_t error_cnt;		/* lost */
+	int32_t outorder_cnt;
+	int32_t datagrams;
+	int32_t jitter1;		/* seconds */
+	int32_t jitter2;		/* microseconds */
+};
+
+#define PERF_REPORT	0x80000000
+
+int run_perf(int argc, char **argv);
+int perf_route(pcs *pc, char *host, int *ipv);
+
+#endif
+
+/* end of file */
@@ -60,14 +60,18 @@ struct packet *new_pkt(int len)
 		return NULL;
 }
 
-struct packet *deq_impl(struct pq *pq, int cond)
+struct packet *deq_impl(struct pq *pq, int cond, const struct timespec *ts)
 {
 	struct packet *m = NULL;
 	
 	lock_q(pq);
 	
-	if (cond && (pq->q == NULL))
-		pthread_cond_wait(&(pq->cond), &(pq->locker));
+	if (cond && (pq->q == NULL)) {
+		if (ts != NULL)
+			pthread_cond_timedwait(&(pq->cond), &(pq->locker), ts);
+		else
+			pthread_cond_wait(&(pq->cond), &(pq->locker));
+	}
 
 	if (pq->q != NULL) {
 		m = pq->q;
@@ -83,26 +87,46 @@ struct packet *deq_impl(struct pq *pq, int cond)
 
 struct packet *deq(struct pq *pq)
 {
-	return deq_impl(pq, 0);
+	return deq_impl(pq, 0, NULL);
 }
 
 struct packet *waitdeq(struct pq *pq)
 {
-	return deq_impl(pq, 1);
+	return deq_impl(pq, 1, NULL);
+}
+
+/* wait up to ms milliseconds, NULL if nothing came */
+struct packet *timedwaitdeq(struct pq *pq, int ms)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (ms % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	return deq_impl(pq, 1, &ts);
 }
 
 struct packet *enq(struct pq *pq, struct packet *m)
 {
 	struct packet *q = NULL;
 	
-	if (pq->size == PKTQ_SIZE) {
-		printf("queue is full \n");
+	lock_q(pq);
+
+	/* drop it, the caller has given it up */
+	if (pq->size >= PKTQ_SIZE) {
+		pq->drops++;
+		ulock_q(pq);
+		free_pkts(m);
 		return NULL;
 	}
 
-	lock_q(pq);
-
 	gettimeofday(&(m->ts), (void*)0);
+	if (pq->stage != TRC_NONE)
+		TRACE_STAMP(m, pq->stage);
 	
 	if (pq->q == NULL)
 		pq->q = m;
@@ -116,6 +140,8 @@ struct packet *enq(struct pq *pq, struct packet *m)
 		pq->size ++;
 		m = m->next;
 	}
+	if (pq->size > pq->hwm)
+		pq->hwm = pq->size;
 	pthread_cond_signal(&(pq->cond));
 
 	ulock_q(pq);
@@ -129,6 +155,9 @@ void init_queue(struct pq *pq)
 	pthread_cond_init(&(pq->cond), NULL);
 	pq->ip = 0;
 	pq->size = 0;
+	pq->hwm = 0;
+	pq->drops = 0;
+	pq->stage = TRC_NONE;
 }
 
 void lock_q(struct pq *pq)
@@ -31,6 +31,8 @@
 #include <pthread.h>		
 #include <sys/time.h>
 
+#include "trace.h"
+
 #define PKTQ_SIZE	(101)
 
 #define PKT_DROP	0	/* drop it */
@@ -41,6 +43,7 @@ struct packet {
 	struct packet *next;
 	int len;
 	struct timeval ts;
+	u_int64_t stamp[TRC_STAGES];	/* see trace.h */
 	char data[0];
 };
 
@@ -48,6 +51,9 @@ struct pq {
 	int type;				/* for debug */
 	int ip;					/* pointer of the queue */
 	int size;				/* size of queue */
+	int hwm;				/* high-water mark of size */
+	u_long drops;				/* dropped while full */
+	int stage;				/* stamped by enq, see trace.h */
 	pthread_mutex_t locker;
 	pthread_cond_t cond;
 	struct packet *q;
@@ -57,12 +63,14 @@ struct pq {
 	dst->len = src->len; \
 	memcpy(dst->data, src->data, src->len); \
 	dst->ts = src->ts; \
+	memcpy(dst->stamp, src->stamp, sizeof(dst->stamp)); \
 }
 
 void init_queue(struct pq*);
 struct packet *enq(struct pq*, struct packet *pkt);
 struct packet *deq(struct pq*);
 struct packet *waitdeq(struct pq *pq);
+struct packet *timedwaitdeq(struct pq *pq, int ms);
 void lock_q(struct pq*);
 void ulock_q(struct pq*);
 struct packet *new_pkt(int len);
@@ -50,8 +50,13 @@ struct peerlist {
 static struct peerlist *peerlist = NULL;
 static int relay_fd = 0;
 static int relay_port = 0;
-static FILE *relay_dumpfile = NULL;
+static struct dmpfile *relay_dumpfile = NULL;
 static int relaydump = 0;
+static struct relaystats relaystats;
+
+#define RELAY_DUMP_FILE		1	/* relay_yyyymmddHHMMSS.pcap */
+#define RELAY_DUMP_PCAPNG	2	/* the shared pcapng file */
+
 extern int runRelay;
 
 int run_relay(int argc, char **argv)
@@ -69,20 +74,33 @@ int run_relay(int argc, char **argv)
 	}
 	
 	if (argc == 3 && !strcmp(argv[1], "dump")) {
-		if (!strcasecmp(argv[2], "on"))
-			relaydump = 1;
-		else if (!strcasecmp(argv[2], "off"))
-			relaydump = 0;
-		if (relaydump)
-			printf("dump on\n");
-		else
-			printf("dump off\n");
-		return 0;
+		if (!strcasecmp(argv[2], "pcapng")) {
+			if (relaydump != RELAY_DUMP_PCAPNG) {
+				if (open_pcapng() != 0) {
+					printf("Open pcapng file error [%s]\n", 
+					    strerror(errno));
+					return 0;
+				}
+				relaydump = RELAY_DUMP_PCAPNG;
+			}
+		} else {
+			if (relaydump == RELAY_DUMP_PCAPNG) {
+				relaydump = 0;
+				usleep(1000);
+				close_pcapng();
+			}
+			if (!strcasecmp(argv[2], "on"))
+				relaydump = RELAY_DUMP_FILE;
+			else if (!strcasecmp(argv[2], "off"))
+				relaydump = 0;
+		}
 	}
 	
-	if (argc == 2 && !strcmp(argv[1], "dump")) {
-		if (relaydump)
+	if ((argc == 2 || argc == 3) && !strcmp(argv[1], "dump")) {
+		if (relaydump == RELAY_DUMP_FILE)
 			printf("dump on\n");
+		else if (relaydump == RELAY_DUMP_PCAPNG)
+			printf("dump pcapng\n");
 		else
 			printf("dump off\n");
 		return 0;
@@ -311,6 +329,14 @@ void save_relay(FILE *fp)
 	}
 }
 
+/* returns the relay port, 0 if the relay is not running */
+int relay_getstats(struct relaystats *st)
+{
+	memcpy(st, &relaystats, sizeof(struct relaystats));
+	
+	return relay_fd ? relay_port : 0;
+}
+
 void *pth_relay(void *dummy)
 {
 	char buf[1600];
@@ -320,6 +346,7 @@ void *pth_relay(void *dummy)
 	struct sockaddr_in addr;
 	socklen_t size;
 	struct peerlist *peerhost;
+	struct timespec ts;
 	
 	if (!runRelay)
 		return NULL;
@@ -338,15 +365,23 @@ void *pth_relay(void *dummy)
 		n = recvfrom(relay_fd, buf, len, 0, 
 		    (struct sockaddr *)&peeraddr, &size);
 		
-		if (relaydump && relay_dumpfile == NULL)
-			relay_dumpfile = open_dmpfile("relay");
+		if (n > 0) {
+			relaystats.rx_pkts++;
+			relaystats.rx_bytes += n;
+		}
 
-		if (relaydump)
-			dmp_buffer2file(buf, n, relay_dumpfile);
-		else if (relay_dumpfile) {
-			close_dmpfile(relay_dumpfile);
-			relay_dumpfile = NULL;
+		if (relaydump == RELAY_DUMP_PCAPNG && n > 0) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			dmp_packet2pcapng(DMP_IF_RELAY, DMP_DIR_IN, buf, n, &ts);
 		}
+
+		if (relaydump == RELAY_DUMP_FILE && relay_dumpfile == NULL)
+			relay_dumpfile = open_dmpfile("relay");
+
+		if (relaydump == RELAY_DUMP_FILE)
+			dmp_buffer2file(buf, n, &relay_dumpfile);
+		else if (relay_dumpfile)
+			close_dmpfile(&relay_dumpfile);
 			
 		bzero(&addr, sizeof(addr));
 		addr.sin_family = AF_INET;
@@ -371,9 +406,14 @@ void *pth_relay(void *dummy)
 			peerhost = peerhost->next;
 		}
 		if (addr.sin_port) {
-			sendto(relay_fd, buf, n, 0, 
-			    (struct sockaddr *)&addr, sizeof(addr));
-		}
+			if (sendto(relay_fd, buf, n, 0, 
+			    (struct sockaddr *)&addr, sizeof(addr)) == n) {
+				relaystats.fwd_pkts++;
+				relaystats.fwd_bytes += n;
+			} else
+				relaystats.drops++;
+		} else if (n > 0)
+			relaystats.drops++;
 		
 	}
 	return NULL;
@@ -30,9 +30,19 @@
 #include <sys/types.h>
 #include "vpcs.h"
 
+/* updated by the relay thread only */
+struct relaystats {
+	u_long rx_pkts;
+	u_long rx_bytes;
+	u_long fwd_pkts;
+	u_long fwd_bytes;
+	u_long drops;		/* no peer for the source */
+};
+
 int run_relay(int argc, char **argv);
 void *pth_relay(void *dummy);
 void save_relay(FILE *fp);
+int relay_getstats(struct relaystats *st);
 
 #endif
 /* end of file */
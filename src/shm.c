@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm.h"
+
+static int shm_init(struct shmhdr *hdr);
+static int shm_size(int fd);
+static int shm_wait(struct shmhdr *hdr);
+static int shm_alive(pid_t pid);
+static void shm_lock(struct shmring *r);
+
+/* create the link or attach to the one created by the peer */
+struct shmdev *
+shm_attach(const char *name)
+{
+	struct shmdev *sd;
+	struct shmhdr *hdr;
+	char path[80];
+	int fd, side, rc;
+	int stale = 0;
+
+	if (strlen(name) >= sizeof(sd->name) || strchr(name, '/')) {
+		errno = EINVAL;
+		return NULL;
+	}
+	sd = (struct shmdev *)malloc(sizeof(struct shmdev));
+	if (sd == NULL)
+		return NULL;
+	snprintf(path, sizeof(path), "/vpcs-%s", name);
+
+again:
+	side = 0;
+	fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0 && errno == EEXIST) {
+		side = 1;
+		fd = shm_open(path, O_RDWR, 0600);
+	}
+	if (fd < 0)
+		goto err;
+
+	if (side == 0 && ftruncate(fd, sizeof(struct shmhdr)) < 0) {
+		close(fd);
+		goto err_unlink;
+	}
+	/* mapping it before the creator sized it would raise SIGBUS */
+	if (side == 1 && shm_size(fd) != 0) {
+		close(fd);
+		goto err_stale;
+	}
+
+	hdr = mmap(NULL, sizeof(struct shmhdr), PROT_READ | PROT_WRITE, 
+	    MAP_SHARED, fd, 0);
+	close(fd);
+	if (hdr == MAP_FAILED)
+		goto err_unlink;
+
+	rc = (side == 0) ? shm_init(hdr) : shm_wait(hdr);
+	if (rc != 0) {
+		munmap(hdr, sizeof(struct shmhdr));
+		if (rc > 0)
+			goto err_stale;
+		goto err_unlink;
+	}
+
+	strcpy(sd->name, name);
+	sd->hdr = hdr;
+	sd->side = side;
+
+	return sd;
+
+err_stale:
+	/* left by a dead creator, create it again once */
+	if (stale++ == 0) {
+		shm_unlink(path);
+		goto again;
+	}
+	errno = EBUSY;
+	goto err;
+err_unlink:
+	fd = errno;
+	if (side == 0)
+		shm_unlink(path);
+	errno = fd;
+err:
+	free(sd);
+	return NULL;
+}
+
+void 
+shm_detach(struct shmdev *sd)
+{
+	struct shmring *r = &sd->hdr->ring[0];
+	char path[80];
+
+	shm_lock(r);
+	sd->hdr->peers--;
+	sd->hdr->pid[sd->side] = 0;
+	pthread_mutex_unlock(&r->locker);
+
+	if (sd->side == 0) {
+		snprintf(path, sizeof(path), "/vpcs-%s", sd->name);
+		shm_unlink(path);
+	}
+	munmap(sd->hdr, sizeof(struct shmhdr));
+	free(sd);
+}
+
+/* wait up to one second like the select in VRead */
+int 
+shm_read(struct shmdev *sd, void *buf, int len)
+{
+	struct shmring *r = &sd->hdr->ring[!sd->side];
+	struct timespec ts;
+	int n;
+
+	shm_lock(r);
+	if (r->head == r->tail) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec++;
+		if (pthread_cond_timedwait(&r->cond, &r->locker, &ts) == 
+		    EOWNERDEAD)
+			pthread_mutex_consistent(&r->locker);
+	}
+	if (r->head == r->tail) {
+		pthread_mutex_unlock(&r->locker);
+		return 0;
+	}
+	n = r->len[r->head % SHM_SLOTS];
+	if (n > len)
+		n = len;
+	memcpy(buf, r->data[r->head % SHM_SLOTS], n);
+	r->head++;
+	pthread_mutex_unlock(&r->locker);
+
+	return n;
+}
+
+/* a full ring drops the frame, nobody may be reading it */
+int 
+shm_write(struct shmdev *sd, void *buf, int len)
+{
+	struct shmring *r = &sd->hdr->ring[sd->side];
+
+	if (len > SHM_SLOTSIZE)
+		return 0;
+
+	shm_lock(r);
+	if (r->tail - r->head < SHM_SLOTS) {
+		memcpy(r->data[r->tail % SHM_SLOTS], buf, len);
+		r->len[r->tail % SHM_SLOTS] = len;
+		r->tail++;
+		pthread_cond_signal(&r->cond);
+	}
+	pthread_mutex_unlock(&r->locker);
+
+	return len;
+}
+
+static int 
+shm_init(struct shmhdr *hdr)
+{
+	pthread_mutexattr_t ma;
+	pthread_condattr_t ca;
+	int i;
+
+	if (pthread_mutexattr_init(&ma) != 0)
+		return -1;
+	if (pthread_condattr_init(&ca) != 0) {
+		pthread_mutexattr_destroy(&ma);
+		return -1;
+	}
+	pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&ma, PTHREAD_MUTEX_ROBUST);
+	pthread_condattr_setpshared(&ca, PTHREAD_PROCESS_SHARED);
+	
+	for (i = 0; i < 2; i++) {
+		pthread_mutex_init(&hdr->ring[i].locker, &ma);
+		pthread_cond_init(&hdr->ring[i].cond, &ca);
+		hdr->ring[i].head = 0;
+		hdr->ring[i].tail = 0;
+	}
+	pthread_mutexattr_destroy(&ma);
+	pthread_condattr_destroy(&ca);
+
+	hdr->version = SHM_VERSION;
+	hdr->slots = SHM_SLOTS;
+	hdr->slotsize = SHM_SLOTSIZE;
+	hdr->peers = 1;
+	hdr->pid[0] = getpid();
+	hdr->pid[1] = 0;
+	__sync_synchronize();
+	hdr->magic = SHM_MAGIC;
+
+	return 0;
+}
+
+/* the creator may not have sized it yet, wait up to one second */
+static int 
+shm_size(int fd)
+{
+	struct stat st;
+	int i;
+
+	for (i = 0; i < 100; i++) {
+		if (fstat(fd, &st) < 0)
+			return -1;
+		if (st.st_size >= sizeof(struct shmhdr))
+			return 0;
+		usleep(10000);
+	}
+	return -1;
+}
+
+/* 
+ * the creator may still be initializing it, return 1 if the link is 
+ * stale, the creator died before it was ready or before it unlinked it
+ */
+static int 
+shm_wait(struct shmhdr *hdr)
+{
+	struct shmring *r = &hdr->ring[0];
+	int i, rc;
+
+	for (i = 0; i < 100 && hdr->magic != SHM_MAGIC; i++)
+		usleep(10000);
+	__sync_synchronize();
+
+	if (hdr->magic != SHM_MAGIC)
+		return 1;
+	if (hdr->version != SHM_VERSION ||
+	    hdr->slots != SHM_SLOTS || hdr->slotsize != SHM_SLOTSIZE) {
+		errno = EPROTO;
+		return -1;
+	}
+
+	rc = 0;
+	shm_lock(r);
+	if (!shm_alive(hdr->pid[0]))
+		rc = 1;
+	else if (hdr->peers >= 2 && shm_alive(hdr->pid[1])) {
+		errno = EBUSY;
+		rc = -1;
+	} else {
+		/* take the place of a dead attacher */
+		if (hdr->peers < 2)
+			hdr->peers++;
+		hdr->pid[1] = getpid();
+	}
+	pthread_mutex_unlock(&r->locker);
+
+	return rc;
+}
+
+static int
+shm_alive(pid_t pid)
+{
+	return (pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH));
+}
+
+/* 
+ * the peer may have died holding the lock, the ring is still usable
+ * since head and tail are only moved after the slot is complete
+ */
+static void
+shm_lock(struct shmring *r)
+{
+	if (pthread_mutex_lock(&r->locker) == EOWNERDEAD)
+		pthread_mutex_consistent(&r->locker);
+}
+
+/* end of file */
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef _SHM_H_
+#define _SHM_H_
+
+#include <sys/types.h>
+#include <pthread.h>
+
+/*
+ * Shared memory link between a VPC and a process on the same host.
+ *
+ * The link is the POSIX shared memory object "/vpcs-NAME" holding a
+ * struct shmhdr. The first end to open it creates and initializes it,
+ * the second one attaches. A peer (an emulator, another vpcs) works
+ * the same way:
+ *
+ *   1. shm_open("/vpcs-NAME", O_RDWR | O_CREAT | O_EXCL, 0600), on 
+ *      success ftruncate it to sizeof(struct shmhdr), map it, 
+ *      initialize the mutexes and condition variables of both rings 
+ *      with PTHREAD_PROCESS_SHARED, the mutexes also with 
+ *      PTHREAD_MUTEX_ROBUST, set the geometry and pid[0], and set 
+ *      magic last. The creator sends on ring[0] and receives on ring[1].
+ *   2. on EEXIST, open it, wait until fstat reports at least 
+ *      sizeof(struct shmhdr), map it, wait until magic is SHM_MAGIC, 
+ *      check version, slots and slotsize, then under ring[0].locker 
+ *      increase peers and set pid[1]. The attacher sends on ring[1] 
+ *      and receives on ring[0].
+ *   3. to send a frame, lock the ring, drop the frame if 
+ *      tail - head == slots, otherwise copy it to data[tail % slots], 
+ *      set len[tail % slots], increase tail, signal cond, unlock.
+ *   4. to receive, lock the ring, wait on cond while head == tail, 
+ *      take data[head % slots], increase head, unlock.
+ *   5. the creator unlinks the object when it detaches, both ends 
+ *      clear their pid.
+ *
+ * The object is stale if the size or magic is not set within a second,
+ * or if pid[0] is gone (kill(pid, 0) fails with ESRCH): the creator
+ * died before it could unlink it. The attacher then unlinks it and 
+ * creates it again as in 1. An attached end whose pid[1] is gone is 
+ * replaced by the next attacher. The pids are those of the host, both
+ * ends must share the pid namespace.
+ *
+ * A lock or a wait returning EOWNERDEAD means the peer died holding
+ * it, call pthread_mutex_consistent and carry on.
+ *
+ * Frames are raw ethernet frames without the FCS. head and tail are
+ * free running counters. The doorbell is the condition variable, so 
+ * both ends must use the same C library.
+ */
+#define SHM_MAGIC	0x56505348	/* "VPSH" */
+#define SHM_VERSION	2
+#define SHM_SLOTS	256		/* power of 2 */
+#define SHM_SLOTSIZE	1536
+
+struct shmring {
+	pthread_mutex_t locker;
+	pthread_cond_t cond;
+	volatile u_int32_t head;	/* next slot to read */
+	volatile u_int32_t tail;	/* next slot to write */
+	u_int32_t len[SHM_SLOTS];
+	u_char data[SHM_SLOTS][SHM_SLOTSIZE];
+};
+
+struct shmhdr {
+	volatile u_int32_t magic;
+	u_int32_t version;
+	u_int32_t slots;
+	u_int32_t slotsize;
+	u_int32_t peers;		/* ends attached, 2 at most */
+	volatile pid_t pid[2];		/* [0] creator, [1] attacher */
+	struct shmring ring[2];		/* [0] creator to attacher */
+};
+
+/* one end of the link, private to the process */
+struct shmdev {
+	char name[64];
+	struct shmhdr *hdr;
+	int side;			/* 0 created, 1 attached */
+};
+
+struct shmdev *shm_attach(const char *name);
+void shm_detach(struct shmdev *sd);
+int shm_read(struct shmdev *sd, void *buf, int len);
+int shm_write(struct shmdev *sd, void *buf, int len);
+
+#endif
+
+/* end of file */
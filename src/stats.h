@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <sys/types.h>
+
+#define CACHELINE_SIZE	64
+
+/* 
+ * The counters of a VPC. Each group is written by one thread, or 
+ * atomically, and sits in its own cache line, so the data path never 
+ * takes a lock for them and the threads do not share the lines.
+ */
+
+/* updated by pth_reader only */
+struct rxstats {
+	u_long frames;
+	u_long bytes;
+	u_long up;			/* to the application */
+	u_long drop_type;		/* unknown ethertype */
+	u_long drop_mcast;		/* multicast source address */
+	u_long drop_addr;		/* not for me */
+	u_long drop_mtu;		/* bigger than mtu */
+	u_long drop_noapp;		/* nobody is waiting for it */
+	u_long frags;			/* fragments received */
+	u_long reass;			/* datagrams reassembled */
+} __attribute__((aligned(CACHELINE_SIZE)));
+
+/* updated by pth_writer only */
+struct txstats {
+	u_long frames;
+	u_long bytes;
+	u_long errors;			/* VWrite failed */
+} __attribute__((aligned(CACHELINE_SIZE)));
+
+/* updated by any thread with STATS_ATOMIC_INC/ADD */
+struct evstats {
+	u_long arp_req;			/* arp requests sent */
+	u_long arp_hit;			/* found in the arp cache */
+	u_long nd_req;			/* neighbor solicitations sent */
+	u_long nd_hit;			/* found in the neighbor cache */
+	u_long frags;			/* fragments sent */
+	u_long tcp_open;		/* tcp sessions accepted */
+	u_long tcp_close;		/* tcp sessions closed */
+	u_long tcp_reset;		/* tcp requests reset */
+	u_long tcp_full;		/* out of tcp sessions */
+} __attribute__((aligned(CACHELINE_SIZE)));
+
+struct pcstats {
+	struct rxstats rx;
+	struct txstats tx;
+	struct evstats ev;
+};
+
+#define STATS_INC(pc, f)		((pc)->stats.f++)
+#define STATS_ADD(pc, f, n)		((pc)->stats.f += (n))
+#define STATS_ATOMIC_INC(pc, f)		__sync_fetch_and_add(&(pc)->stats.f, 1)
+#define STATS_ATOMIC_ADD(pc, f, n)	__sync_fetch_and_add(&(pc)->stats.f, (n))
+
+/* count the fragments if the packet was fragmented */
+#define STATS_FRAGS(pc, m) do { \
+	struct packet *_p; \
+	int _n = 0; \
+	for (_p = (m); _p; _p = _p->next) \
+		_n++; \
+	if (_n > 1) \
+		STATS_ATOMIC_ADD(pc, ev.frags, _n); \
+} while (0)
+
+#endif
+
+/* end of file */
@@ -31,6 +31,7 @@
 
 #include "vpcs.h"
 #include "tcp.h"
+#include "tcpsock.h"
 #include "packets.h"
 #include "packets6.h"
 #include "utils.h"
@@ -40,6 +41,10 @@ extern int ctrl_c;
 extern u_int time_tick;
 extern int dmpflag;
 
+static u_int tcp_reass(sesscb *cb, u_int seq, int dsize);
+static int tcp_rcvwin(sesscb *cb);
+static int tcp_putopts(tcphdr *th, sesscb *cb);
+
 /*******************************************************
  *      client                  server
  *                 SYN  ->
@@ -107,6 +112,7 @@ int tcp_open(pcs *pc, int ipv)
 		struct timeval tv;
 		
 		pc->mscb.flags = TH_SYN;
+		pc->mscb.topts = TOF_SCALE | TOF_TS | TOF_SACK;
 		pc->mscb.timeout = time_tick;
 		pc->mscb.seq = rand();
 		pc->mscb.ack = 0;
@@ -432,47 +438,74 @@ int tcp_close(pcs *pc, int ipv)
 	return 0;			
 }
 
+/* the local ports of the app, more than one for the parallel streams */
+int app_port(sesscb *cb, u_int port)
+{
+	int n = (cb->nports > 1) ? cb->nports : 1;
+
+	return (port >= cb->sport && port < cb->sport + n);
+}
+
 /* tcp processor
  * return PKT_DROP/PKT_UP
  */
 int tcpReplyPacket(tcphdr *th, sesscb *cb, int tcplen)
 {
 	int clientfinack = 0; /* ack for fin was reply if 1 */
-	int dsize = 0;
+	int dsize = tcplen - (th->th_off << 2);
+	u_int seq = ntohl(th->th_seq);
+	int olen;
+
+	if (dsize < 0)
+		dsize = 0;
 
 	th->th_sport ^= th->th_dport;
 	th->th_dport ^= th->th_sport;
 	th->th_sport ^= th->th_dport;
 	
-	cb->ack = ntohl(th->th_seq);
 	cb->rflags = th->th_flags;
 	cb->winsize = ntohs(th->th_win);
+
+	/* the options of the request are read before ours are put */
+	if (th->th_flags == TH_SYN)
+		tcp_options(th, cb);
+	else if (cb->topts & TOF_TS)
+		tcp_timestamp(th, cb);
 	
-	if (cb->flags != (TH_RST | TH_FIN)) {		
+	if (cb->flags == (TH_RST | TH_FIN))
+		cb->ack = seq;
+	else {
 		switch (th->th_flags) {
 			case TH_SYN:
 				cb->flags = TH_ACK | TH_SYN;
-				cb->ack++;
+				cb->ack = seq + 1;
+				cb->nooo = 0;
 				break;
+			case TH_ACK:
+				/* the bulk data of a stack comes without PUSH */
+				if (dsize == 0)
+					return 0;
 			case TH_ACK | TH_PUSH:
 				cb->flags = TH_ACK;
-				dsize = tcplen - (th->th_off << 2);
+				cb->ack = tcp_reass(cb, seq, dsize);
 				break;
 			case TH_ACK | TH_FIN:
 				cb->flags = (TH_ACK | TH_FIN);
-				cb->ack++;
+				cb->ack = tcp_reass(cb, seq, dsize);
+				if (cb->ack == seq + dsize)
+					cb->ack++;
 				break;
 			case TH_ACK | TH_FIN | TH_PUSH:
 			case TH_FIN | TH_PUSH:
-				dsize = tcplen - (th->th_off << 2);
-
 			case TH_FIN:
+				/* FIN is taken after all the data */
+				cb->ack = tcp_reass(cb, seq, dsize);
+				if (cb->ack == seq + dsize)
+					cb->ack++;
 				if (cb->flags == (TH_ACK | TH_FIN))
 					cb->flags = TH_FIN | TH_ACK;
 				else
 					cb->flags = TH_ACK;
-				if (dsize == 0)
-					cb->ack++;
 				clientfinack = 1;
 				break;
 			default:
@@ -481,14 +514,14 @@ int tcpReplyPacket(tcphdr *th, sesscb *cb, int tcplen)
 	}
 	if (th->th_flags != TH_SYN)
 		cb->seq = ntohl(th->th_ack);
-	cb->ack += dsize;
 	th->th_ack = htonl(cb->ack);
 	th->th_seq = htonl(cb->seq);
 	th->th_flags = cb->flags;
+	th->th_win = htons(tcp_rcvwin(cb));
+	th->th_urp = 0;
 	
-	/* ignore the tcp options */
-	if ((th->th_off << 2) > sizeof(tcphdr))
-		th->th_off = sizeof(tcphdr) >> 2;
+	olen = tcp_putopts(th, cb);
+	th->th_off = (sizeof(tcphdr) + olen) >> 2;
 		
 	if (clientfinack == 1)
 		return 2;
@@ -496,6 +529,151 @@ int tcpReplyPacket(tcphdr *th, sesscb *cb, int tcplen)
 	return 1;
 }
 
+/*
+ * Take dsize bytes at seq, return the next sequence number expected.
+ * The data is dropped, only the ranges beyond a hole are kept for 
+ * SACK, the block of the latest segment first, RFC 2018 4.
+ */
+static u_int tcp_reass(sesscb *cb, u_int seq, int dsize)
+{
+	u_int rcvnxt = cb->ack;
+	u_int end = seq + dsize;
+	struct tcpblk b;
+	int i, n;
+
+	if (dsize <= 0 || SEQ_LEQ(end, rcvnxt) || 
+	    SEQ_GT(end, rcvnxt + TCP_RCVBUF))
+		return rcvnxt;
+	if (SEQ_LT(seq, rcvnxt))
+		seq = rcvnxt;
+
+	if (seq == rcvnxt) {
+		cb->rbytes += end - rcvnxt;
+		rcvnxt = end;
+		/* the blocks the hole was in front of */
+		i = 0;
+		while (i < cb->nooo) {
+			if (SEQ_GT(cb->ooo[i].start, rcvnxt)) {
+				i++;
+				continue;
+			}
+			if (SEQ_GT(cb->ooo[i].end, rcvnxt)) {
+				cb->rbytes += cb->ooo[i].end - rcvnxt;
+				rcvnxt = cb->ooo[i].end;
+			}
+			cb->nooo--;
+			memmove(&cb->ooo[i], &cb->ooo[i + 1], 
+			    (cb->nooo - i) * sizeof(struct tcpblk));
+			i = 0;
+		}
+		return rcvnxt;
+	}
+
+	/* merge the blocks it touches, no room for a new one, drop it */
+	b.start = seq;
+	b.end = end;
+	for (i = 0, n = 0; i < cb->nooo; i++) {
+		if (SEQ_LEQ(cb->ooo[i].start, end) && 
+		    SEQ_GEQ(cb->ooo[i].end, seq))
+			n++;
+	}
+	if (n == 0 && cb->nooo == TCP_MAXOOO)
+		return rcvnxt;
+
+	i = 0;
+	while (i < cb->nooo) {
+		if (SEQ_GT(cb->ooo[i].start, b.end) || 
+		    SEQ_LT(cb->ooo[i].end, b.start)) {
+			i++;
+			continue;
+		}
+		if (SEQ_LT(cb->ooo[i].start, b.start))
+			b.start = cb->ooo[i].start;
+		if (SEQ_GT(cb->ooo[i].end, b.end))
+			b.end = cb->ooo[i].end;
+		cb->nooo--;
+		memmove(&cb->ooo[i], &cb->ooo[i + 1], 
+		    (cb->nooo - i) * sizeof(struct tcpblk));
+	}
+	memmove(&cb->ooo[1], &cb->ooo[0], cb->nooo * sizeof(struct tcpblk));
+	cb->ooo[0] = b;
+	cb->nooo++;
+
+	return rcvnxt;
+}
+
+/* the window of a reply, the one of SYN is never scaled */
+static int tcp_rcvwin(sesscb *cb)
+{
+	if ((cb->topts & TOF_SCALE) && cb->flags != (TH_ACK | TH_SYN))
+		return TCP_RCVBUF >> TCP_RCVSHIFT;
+	return (TCP_RCVBUF > 0xffff) ? 0xffff : TCP_RCVBUF;
+}
+
+/* 
+ * put the options of a reply after th, those the SYN of the peer 
+ * had are answered. return the length, a multiple of 4.
+ */
+static int tcp_putopts(tcphdr *th, sesscb *cb)
+{
+	u_char *opt = (u_char *)(th + 1);
+	u_int t;
+	int i = 0, k, n;
+
+	if (cb->flags & TH_RST)
+		return 0;
+
+	if (cb->flags & TH_SYN) {
+		opt[i++] = TCPOPT_MAXSEG;
+		opt[i++] = TCPOLEN_MAXSEG;
+		opt[i++] = cb->lmss >> 8;
+		opt[i++] = cb->lmss & 0xff;
+		if (cb->topts & TOF_SCALE) {
+			opt[i++] = TCPOPT_NOP;
+			opt[i++] = TCPOPT_WINDOW;
+			opt[i++] = TCPOLEN_WINDOW;
+			opt[i++] = TCP_RCVSHIFT;
+		}
+		if (cb->topts & TOF_SACK) {
+			opt[i++] = TCPOPT_NOP;
+			opt[i++] = TCPOPT_NOP;
+			opt[i++] = TCPOPT_SACK_PERMITTED;
+			opt[i++] = TCPOLEN_SACK_PERMITTED;
+		}
+	}
+
+	if (cb->topts & TOF_TS) {
+		opt[i++] = TCPOPT_NOP;
+		opt[i++] = TCPOPT_NOP;
+		opt[i++] = TCPOPT_TIMESTAMP;
+		opt[i++] = TCPOLEN_TIMESTAMP;
+		t = htonl(tcp_tsval());
+		memcpy(opt + i, &t, 4);
+		t = htonl(cb->tsrecent);
+		memcpy(opt + i + 4, &t, 4);
+		i += 8;
+	}
+
+	if ((cb->topts & TOF_SACK) && cb->nooo > 0 && !(cb->flags & TH_SYN)) {
+		n = (cb->topts & TOF_TS) ? 3 : 4;
+		if (n > cb->nooo)
+			n = cb->nooo;
+		opt[i++] = TCPOPT_NOP;
+		opt[i++] = TCPOPT_NOP;
+		opt[i++] = TCPOPT_SACK;
+		opt[i++] = 2 + n * TCPOLEN_SACK;
+		for (k = 0; k < n; k++) {
+			t = htonl(cb->ooo[k].start);
+			memcpy(opt + i, &t, 4);
+			t = htonl(cb->ooo[k].end);
+			memcpy(opt + i + 4, &t, 4);
+			i += 8;
+		}
+	}
+
+	return i;
+}
+
 int tcp(pcs *pc, struct packet *m)
 {
 	ethdr *ethernet_header = (ethdr*)(m->data);
@@ -508,6 +686,10 @@ int tcp(pcs *pc, struct packet *m)
 	if (ip->dip != pc->ip4.ip)
 		return PKT_DROP;
 
+	/* the connections of the listening ports, see tcpsock.c */
+	if (tcp_sockinput(pc, m, 4))
+		return PKT_DROP;
+
 	// printf("sock: %d\n", pc->mscb.sock);
 	// printf("dport %d %d\n", ntohs(ti->ti_dport), pc->mscb.sport);
 	// printf("sport %d %d\n", ntohs(ti->ti_sport), pc->mscb.dport);
@@ -520,7 +702,7 @@ int tcp(pcs *pc, struct packet *m)
 	 * 3. destination is me
 	 * 4. mscb.proto is TCP
 	 */
-	if (pc->mscb.sock && ntohs(ti->ti_dport) == pc->mscb.sport && 
+	if (pc->mscb.sock && app_port(&pc->mscb, ntohs(ti->ti_dport)) && 
 	    ntohs(ti->ti_sport) == pc->mscb.dport && 
 	    ip->sip == pc->mscb.dip && pc->mscb.proto == ip->proto) {
 		/* mscb is actived, up to the upper application */
@@ -530,6 +712,7 @@ int tcp(pcs *pc, struct packet *m)
 		/* not mine, reset the request */
 		sesscb rcb;
 		
+		memset(&rcb, 0, sizeof(sesscb));
 		rcb.seq = random();
 		rcb.sip = ip->sip;
 		rcb.dip = ip->dip;
@@ -541,6 +724,7 @@ int tcp(pcs *pc, struct packet *m)
 		
 		/* push m into the background output queue which is watched by pth_output */
 		if (p != NULL) {
+			STATS_ATOMIC_INC(pc, ev.tcp_reset);
 			enq(&pc->bgoq, p);			
 		} else
 			printf("reply error\n");
@@ -562,8 +746,14 @@ int tcp(pcs *pc, struct packet *m)
 			     ti->ti_dport == pc->sesscb[i].dport)) {
 				/* get new scb */
 				cb = &pc->sesscb[i];
+				if (cb->timeout == 0 || 
+				    time_tick - cb->timeout > TCP_TIMEOUT)
+					STATS_ATOMIC_INC(pc, ev.tcp_open);
 				cb->timeout = time_tick;
 				cb->seq = random();
+				cb->rbytes = 0;
+				cb->lmss = pc->mtu - sizeof(iphdr) - 
+				    sizeof(tcphdr);
 				cb->sip = ip->sip;
 				cb->dip = ip->dip;
 				cb->sport = ti->ti_sport;
@@ -572,25 +762,6 @@ int tcp(pcs *pc, struct packet *m)
 				bcopy(ethernet_header->src, cb->dmac, ETH_ALEN);
 				bcopy(ethernet_header->dst, cb->smac, ETH_ALEN);
 				
-
-				// accept TCP connection as main
-				if(ntohs(cb->dport) == pc->tcp_listen_port){
-					pc->mscb = *cb;
-					u_int temp;
-
-					temp = pc->mscb.dport;
-					pc->mscb.dport = ntohs(pc->mscb.sport);
-					pc->mscb.sport = ntohs(temp);
-
-					temp = pc->mscb.sip;
-					pc->mscb.sip = pc->mscb.dip;
-					pc->mscb.dip = temp;
-
-					pc->mscb.sock = 1;
-					
-					pc->tcp_listen_port = 0;
-				}
-				
 				break;
 			}
 		} else {
@@ -609,6 +780,7 @@ int tcp(pcs *pc, struct packet *m)
 	
 	if (ti->ti_flags == TH_SYN && cb == NULL) {
 		printf("VPCS %d out of session\n", pc->id);
+		STATS_ATOMIC_INC(pc, ev.tcp_full);
 		return PKT_DROP;
 	}
 	
@@ -616,6 +788,7 @@ int tcp(pcs *pc, struct packet *m)
 		if (ti->ti_flags == TH_ACK && cb->flags == TH_FIN) {
 			/* clear session */
 			memset(cb, 0, sizeof(sesscb));
+			STATS_ATOMIC_INC(pc, ev.tcp_close);
 		} else {
 			cb->timeout = time_tick;
 			p = tcpReply(m, cb);
@@ -646,21 +819,21 @@ struct packet *tcpReply(struct packet *m0, sesscb *cb)
 {
 	struct packet *m;
 
-	m = new_pkt(sizeof(ethdr) + sizeof(iphdr) + sizeof(tcphdr));
+	/* the header and the options of the request, room for mine */
+	m = new_pkt(sizeof(ethdr) + sizeof(iphdr) + sizeof(tcphdr) + 
+	    TCP_MAXOLEN);
 	if (m == NULL)
 		return NULL;
 	
-	memcpy(m->data, m0->data, m->len);
+	memcpy(m->data, m0->data, (m0->len < m->len) ? m0->len : m->len);
 
 	ethdr *eh = (ethdr *)(m->data);
 	iphdr *ip = (iphdr *)(eh + 1);
 	tcpiphdr *ti = (tcpiphdr *)ip;
 	tcphdr *th = (tcphdr *)(ip + 1);
-	char *end_of_message = (char*)(m->data) + m->len;
 	
 	int received_tcp_length = ntohs(ip->len) - sizeof(iphdr);
 
-	ip->len = htons(end_of_message - (char*)ip);
 	ip->dip ^= ip->sip;
 	ip->sip ^= ip->dip;
 	ip->dip ^= ip->sip;
@@ -670,12 +843,16 @@ struct packet *tcpReply(struct packet *m0, sesscb *cb)
 		del_pkt(m);
 		return NULL;
 	} 
+
+	m->len = sizeof(ethdr) + sizeof(iphdr) + (th->th_off << 2);
+	char *end_of_message = (char*)(m->data) + m->len;
+	ip->len = htons(end_of_message - (char*)ip);
 	
 	// TCP pseudo header for purposes of TCP checksum calculation
 	char *tcp_pseudo_header = ((char*)ti) + 8;
 	ip->ttl = 0;
 	ip->cksum = sizeof(tcpiphdr);
-	ti->ti_len = htons(sizeof(tcphdr));
+	ti->ti_len = htons(th->th_off << 2);
 	
 	ti->ti_sum = 0;
 	ti->ti_sum = cksum((u_short*)tcp_pseudo_header, end_of_message - tcp_pseudo_header);
@@ -695,7 +872,8 @@ struct packet *tcpReply(struct packet *m0, sesscb *cb)
 	if (rt == 2)
 		cb->flags = (TH_ACK | TH_FIN);
 		
-	return m;	
+	TRACE_REPLY(m, m0);
+	return m;
 }
 
 int tcp6(pcs *pc, struct packet *m)
@@ -715,6 +893,9 @@ int tcp6(pcs *pc, struct packet *m)
 			return PKT_DROP;
 	}
 
+	if (tcp_sockinput(pc, m, IPV6_VERSION))
+		return PKT_DROP;
+
 	/* response packet 
 	 * 1. socket opened
 	 * 2. same port
@@ -722,7 +903,7 @@ int tcp6(pcs *pc, struct packet *m)
 	 * 4. mscb.proto is TCP
 	 */
 	if (pc->mscb.sock && pc->mscb.proto == ip->ip6_nxt &&
-	    ntohs(th->th_dport) == pc->mscb.sport && 
+	    app_port(&pc->mscb, ntohs(th->th_dport)) && 
 	    ntohs(th->th_sport) == pc->mscb.dport &&
 	    IP6EQ(&(pc->mscb.dip6), &(ip->src))) {
 		/* mscb is actived, up to the upper application */
@@ -732,6 +913,7 @@ int tcp6(pcs *pc, struct packet *m)
 		/* not mine, reset the request*/
 		sesscb rcb;
 		
+		memset(&rcb, 0, sizeof(sesscb));
 		rcb.seq = random();
 		memcpy(rcb.sip6.addr8, ip->src.addr8, 16);
 		memcpy(rcb.dip6.addr8, ip->dst.addr8, 16);
@@ -744,6 +926,7 @@ int tcp6(pcs *pc, struct packet *m)
 		
 		/* push m into the background output queue which is watched by pth_output */
 		if (p != NULL) {
+			STATS_ATOMIC_INC(pc, ev.tcp_reset);
 			enq(&pc->bgoq, p);
 		} else
 			printf("reply error\n");
@@ -764,8 +947,14 @@ int tcp6(pcs *pc, struct packet *m)
 				 th->th_dport == pc->sesscb[i].dport)) {
 				/* get new scb */
 				cb = &pc->sesscb[i];
+				if (cb->timeout == 0 || 
+				    time_tick - cb->timeout > TCP_TIMEOUT)
+					STATS_ATOMIC_INC(pc, ev.tcp_open);
 				cb->timeout = time_tick;
 				cb->seq = random();
+				cb->rbytes = 0;
+				cb->lmss = pc->mtu - sizeof(ip6hdr) - 
+				    sizeof(tcphdr);
 				memcpy(cb->sip6.addr8, ip->src.addr8, 16);
 				memcpy(cb->dip6.addr8, ip->dst.addr8, 16);
 				cb->sport = th->th_sport;
@@ -791,6 +980,7 @@ int tcp6(pcs *pc, struct packet *m)
 
 	if (th->th_flags == TH_SYN && cb == NULL) {
 		printf("VPCS %d out of session\n", pc->id);
+		STATS_ATOMIC_INC(pc, ev.tcp_full);
 		return PKT_DROP;
 	}
 
@@ -798,6 +988,7 @@ int tcp6(pcs *pc, struct packet *m)
 		if (th->th_flags == TH_ACK && cb->flags == TH_FIN) {
 			/* clear session */
 			memset(cb, 0, sizeof(sesscb));
+			STATS_ATOMIC_INC(pc, ev.tcp_close);
 		} else {
 			cb->timeout = time_tick;
 			p = tcp6Reply(m, cb);
@@ -831,12 +1022,13 @@ struct packet *tcp6Reply(struct packet *m0, sesscb *cb)
 	int len;
 	int tcplen = 0;
 	
-	len = sizeof(ethdr) + sizeof(ip6hdr) + sizeof(tcphdr);
+	/* the header and the options of the request, room for mine */
+	len = sizeof(ethdr) + sizeof(ip6hdr) + sizeof(tcphdr) + TCP_MAXOLEN;
 	m = new_pkt(len);
 	if (m == NULL)
 		return NULL;
 		
-	memcpy(m->data, m0->data, m->len);
+	memcpy(m->data, m0->data, (m0->len < m->len) ? m0->len : m->len);
 	
 	eh = (ethdr *)(m->data);
 	ip = (ip6hdr *)(eh + 1);
@@ -847,7 +1039,6 @@ struct packet *tcp6Reply(struct packet *m0, sesscb *cb)
 
 	ip->ip6_hlim = TTL;
 	tcplen = ntohs(ip->ip6_plen);
-	ip->ip6_plen = htons((u_short)sizeof(tcphdr));
 	
 	int rt = tcpReplyPacket(th, cb, tcplen);
 	if (rt == 0) {
@@ -855,8 +1046,12 @@ struct packet *tcp6Reply(struct packet *m0, sesscb *cb)
 		return NULL;
 	} 
 
+	tcplen = th->th_off << 2;
+	ip->ip6_plen = htons((u_short)tcplen);
+	m->len = sizeof(ethdr) + sizeof(ip6hdr) + tcplen;
+
 	th->th_sum = 0;
-	th->th_sum = cksum6(ip, IPPROTO_TCP, len);
+	th->th_sum = cksum6(ip, IPPROTO_TCP, tcplen);
 	
 	/* save the status, ACK for TH_FIN of client was sent 
 	 * so send FIN on the next time
@@ -864,89 +1059,99 @@ struct packet *tcp6Reply(struct packet *m0, sesscb *cb)
 	if (rt == 2)
 		cb->flags = (TH_ACK | TH_FIN);
 		
-	return m;	
+	TRACE_REPLY(m, m0);
+	return m;
 }
 
-char *tcp_get_data(struct packet *m){
-	ethdr *eh = (ethdr *)(m->data);
-	iphdr *ip = (iphdr *)(eh + 1);
-	tcphdr *th = (tcphdr *)(ip + 1);
-
-	return (char*)(th) + 4*th->th_off;
+/* pick the MSS, the window shift and what else the SYN offers */
+void tcp_options(tcphdr *th, sesscb *cb)
+{
+	u_char *opt;
+
+	cb->rwscale = 0;
+	cb->topts = 0;
+	cb->tsrecent = 0;
+	cb->rmss = 0;
+	if ((opt = tcp_getopt(th, TCPOPT_MAXSEG, TCPOLEN_MAXSEG)) != NULL)
+		cb->rmss = (opt[2] << 8) + opt[3];
+	if ((opt = tcp_getopt(th, TCPOPT_WINDOW, TCPOLEN_WINDOW)) != NULL) {
+		cb->rwscale = (opt[2] > 14) ? 14 : opt[2];
+		cb->topts |= TOF_SCALE;
+	}
+	if (tcp_getopt(th, TCPOPT_SACK_PERMITTED, 
+	    TCPOLEN_SACK_PERMITTED) != NULL)
+		cb->topts |= TOF_SACK;
+	if (tcp_getopt(th, TCPOPT_TIMESTAMP, TCPOLEN_TIMESTAMP) != NULL) {
+		cb->topts |= TOF_TS;
+		tcp_timestamp(th, cb);
+	}
 }
 
-int tcp_get_length(struct packet *m){
-	return m->data + m->len - tcp_get_data(m);
+/* keep the TSval of the peer to echo, RFC 7323 4.3 */
+void tcp_timestamp(tcphdr *th, sesscb *cb)
+{
+	u_char *opt;
+	u_int val;
+
+	opt = tcp_getopt(th, TCPOPT_TIMESTAMP, TCPOLEN_TIMESTAMP);
+	if (opt == NULL)
+		return;
+	memcpy(&val, opt + 2, 4);
+	val = ntohl(val);
+	if (cb->tsrecent == 0 || SEQ_GEQ(val, cb->tsrecent))
+		cb->tsrecent = val;
 }
 
-struct packet *tcp_prepare_packet(sesscb *cb, const char* data, int len){
-	struct packet* p = new_pkt(sizeof(ethdr) + sizeof(tcpiphdr) + len);
-
-	ethdr *eh = (ethdr *)(p->data);
-	iphdr *ip = (iphdr *)(eh + 1);
-	tcpiphdr *ti = (tcpiphdr *)ip;
-	tcphdr *th = (tcphdr *)(ip + 1);
-	char *payload = (char*)(th + 1);
-	char *end_of_message = (char*)(p->data) + p->len;
-
-
-	// payload
-	bcopy(data, payload, len);
-
-	// tcp
-	th->th_sport = htons(cb->sport);
-	th->th_dport = htons(cb->dport);
-	th->th_seq = htonl(cb->seq);
-	th->th_ack = htonl(cb->ack);
-	cb->flags = TH_PUSH | TH_ACK;
-	th->th_flags = cb->flags;
-	th->th_off = sizeof(tcphdr) >> 2;
-	th->th_win = htons(1000);
-
-
-	cb->seq += len;
-
-	// ip
-	ip->ver = 4;
-	ip->ihl = sizeof *ip >> 2;
-	ip->tos = 0x10;
-	ip->id = 0;
-	ip->ttl = TTL;
-	ip->proto = cb->proto;
-	ip->dip = cb->dip;
-	ip->sip = cb->sip;
-	ip->len = htons(end_of_message - (char*)ip);
-	ip->proto = IPPROTO_TCP;
-
-
-
-	// TCP pseudo header for purposes of TCP checksum calculation
-	char *tcp_pseudo_header = ((char*)ti) + 8;
-	ip->ttl = 0;
-	ip->cksum = sizeof(tcpiphdr);
-	ti->ti_len = htons(end_of_message - (char*)th);
-	
-	ti->ti_sum = 0;
-	ti->ti_sum = cksum((u_short*)tcp_pseudo_header, end_of_message - tcp_pseudo_header);
-
-	// restore values in IP header
-	ip->ttl = TTL;
+/* my clock of the timestamps, in ms */
+u_int tcp_tsval(void)
+{
+	return (u_int)(trace_now() / 1000000);
+}
 
-	// calculate checksum of IP header
-	ip->cksum = 0;
-	ip->cksum = cksum((u_short *)ip, sizeof(iphdr));
+/* the SACK blocks of an ack, return the count */
+int tcp_sackblocks(tcphdr *th, struct tcpblk *blk, int max)
+{
+	u_char *opt;
+	u_int v;
+	int i, n;
 
-	// ethernet
-	encap_ehead(p->data, cb->smac, cb->dmac, ETHERTYPE_IP);
+	opt = tcp_getopt(th, TCPOPT_SACK, 0);
+	if (opt == NULL)
+		return 0;
 
-	return p;
+	n = (opt[1] - 2) / TCPOLEN_SACK;
+	if (n > max)
+		n = max;
+	for (i = 0; i < n; i++) {
+		memcpy(&v, opt + 2 + i * TCPOLEN_SACK, 4);
+		blk[i].start = ntohl(v);
+		memcpy(&v, opt + 6 + i * TCPOLEN_SACK, 4);
+		blk[i].end = ntohl(v);
+	}
+	return n;
 }
 
-sesscb *tcp_accept(pcs *pc, int port){
-	pc->tcp_listen_port = port;
-	while(pc->tcp_listen_port);
+/* return the option kind of length olen, any if 0, NULL if none */
+u_char *tcp_getopt(tcphdr *th, int kind, int olen)
+{
+	u_char *opt = (u_char *)(th + 1);
+	int len = (th->th_off << 2) - sizeof(tcphdr);
+	int i = 0;
 
-	return &pc->mscb;
+	while (i < len) {
+		if (opt[i] == TCPOPT_EOL)
+			break;
+		if (opt[i] == TCPOPT_NOP) {
+			i++;
+			continue;
+		}
+		if (i + 1 >= len || opt[i + 1] < 2 || i + opt[i + 1] > len)
+			break;
+		if (opt[i] == kind && (olen == 0 || opt[i + 1] == olen))
+			return opt + i;
+		i += opt[i + 1];
+	}
+	return NULL;
 }
 
 /* end of file */
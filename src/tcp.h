@@ -31,18 +31,15 @@
 int tcp_open(pcs *pc, int ipv);
 int tcp_send(pcs *pc, int ipv);
 int tcp_close(pcs *pc, int ipv);
-sesscb *tcp_accept(pcs *pc, int port);
+void tcp_options(tcphdr *th, sesscb *cb);
+void tcp_timestamp(tcphdr *th, sesscb *cb);
+u_int tcp_tsval(void);
+int tcp_sackblocks(tcphdr *th, struct tcpblk *blk, int max);
+u_char *tcp_getopt(tcphdr *th, int kind, int olen);
+int app_port(sesscb *cb, u_int port);
 
 int tcp(pcs *pc, struct packet *m0);
 struct packet *tcpReply(struct packet *m0, sesscb *cb);
 
-
-char *tcp_get_data(struct packet *m);
-int tcp_get_length(struct packet *m);
-struct packet *tcp_prepare_packet(sesscb *cb, const char* data, int len);
-
-
-
-
 #endif
 /* end of file */
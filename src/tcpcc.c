@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "vpcs.h"
+#include "tcpstream.h"
+#include "tcpcc.h"
+
+/* RFC 9438 */
+#define CUBIC_C		0.4
+#define CUBIC_BETA	0.7
+#define CUBIC_ALPHA	(3 * (1 - CUBIC_BETA) / (1 + CUBIC_BETA))
+
+int tcpcc_default = TCPCC_CUBIC;
+
+static void newreno_init(struct tcpstream *ts);
+static void newreno_ack(struct tcpstream *ts, u_int acked, u_int64_t now);
+static void newreno_loss(struct tcpstream *ts);
+static void cubic_init(struct tcpstream *ts);
+static void cubic_ack(struct tcpstream *ts, u_int acked, u_int64_t now);
+static void cubic_loss(struct tcpstream *ts);
+static double cubic_w(struct tcpstream *ts, double t);
+static double cbroot(double x);
+
+static const struct tcpcc ccs[TCPCC_MAX + 1] = {
+	{NULL, NULL, NULL, NULL},
+	{"newreno", newreno_init, newreno_ack, newreno_loss},
+	{"cubic", cubic_init, cubic_ack, cubic_loss},
+};
+
+/* TCPCC_DEFAULT and the unknown ones are the default */
+const struct tcpcc *tcpcc_get(int id)
+{
+	if (id <= TCPCC_DEFAULT || id > TCPCC_MAX)
+		id = tcpcc_default;
+	return &ccs[id];
+}
+
+/* return the id of the name, 0 if none */
+int tcpcc_lookup(const char *name)
+{
+	int i;
+
+	for (i = 1; i <= TCPCC_MAX; i++) {
+		if (!strcasecmp(name, ccs[i].name))
+			return i;
+	}
+	if (!strcasecmp(name, "reno"))
+		return TCPCC_NEWRENO;
+	return 0;
+}
+
+const char *tcpcc_name(int id)
+{
+	return tcpcc_get(id)->name;
+}
+
+/* RFC 5681 and 6582 */
+static void newreno_init(struct tcpstream *ts)
+{
+	ts->bytes_acked = 0;
+}
+
+/* one segment a round trip, RFC 3465 2.1 */
+static void newreno_ack(struct tcpstream *ts, u_int acked, u_int64_t now)
+{
+	ts->bytes_acked += acked;
+	if (ts->bytes_acked >= ts->cwnd) {
+		ts->bytes_acked -= ts->cwnd;
+		ts->cwnd += ts->mss;
+	}
+}
+
+/* half of the flight, RFC 5681 (4) */
+static void newreno_loss(struct tcpstream *ts)
+{
+	u_int flight = ts->max - ts->una;
+
+	ts->ssthresh = flight / 2;
+	if (ts->ssthresh < 2 * ts->mss)
+		ts->ssthresh = 2 * ts->mss;
+	ts->bytes_acked = 0;
+}
+
+static void cubic_init(struct tcpstream *ts)
+{
+	ts->epoch = 0;
+	ts->w_max = 0;
+	ts->w_est = 0;
+	ts->k = 0;
+}
+
+/* RFC 9438 4.2 to 4.4, the window is counted in segments */
+static void cubic_ack(struct tcpstream *ts, u_int acked, u_int64_t now)
+{
+	double cwnd = (double)ts->cwnd / ts->mss;
+	double segs = (double)acked / ts->mss;
+	double t, target;
+
+	if (ts->epoch == 0) {
+		ts->epoch = now;
+		ts->w_est = cwnd;
+		if (cwnd < ts->w_max)
+			ts->k = cbroot((ts->w_max - cwnd) / CUBIC_C);
+		else {
+			ts->k = 0;
+			ts->w_max = cwnd;
+		}
+	}
+	t = (now - ts->epoch) / 1000000.0;
+
+	/* the Reno friendly region, 4.3 */
+	ts->w_est += ((ts->w_est < ts->w_max) ? CUBIC_ALPHA : 1) * 
+	    segs / cwnd;
+	if (cubic_w(ts, t) < ts->w_est) {
+		if (ts->w_est > cwnd)
+			ts->cwnd = ts->w_est * ts->mss;
+		return;
+	}
+
+	/* the concave and convex regions, one round trip ahead, 4.4 */
+	target = cubic_w(ts, t + ts->srtt / 1000000.0);
+	if (target < cwnd)
+		target = cwnd;
+	if (target > 1.5 * cwnd)
+		target = 1.5 * cwnd;
+	ts->cwnd += (target - cwnd) * segs / cwnd * ts->mss;
+}
+
+/* 4.6 and the fast convergence, 4.7 */
+static void cubic_loss(struct tcpstream *ts)
+{
+	double cwnd = (double)ts->cwnd / ts->mss;
+
+	if (cwnd < ts->w_max)
+		ts->w_max = cwnd * (1 + CUBIC_BETA) / 2;
+	else
+		ts->w_max = cwnd;
+	ts->ssthresh = ts->cwnd * CUBIC_BETA;
+	if (ts->ssthresh < 2 * ts->mss)
+		ts->ssthresh = 2 * ts->mss;
+	ts->epoch = 0;
+}
+
+/* W_cubic(t) = C * (t - K)^3 + W_max */
+static double cubic_w(struct tcpstream *ts, double t)
+{
+	double d = t - ts->k;
+
+	return CUBIC_C * d * d * d + ts->w_max;
+}
+
+/* Newton, without libm */
+static double cbroot(double x)
+{
+	double r = (x > 1) ? x / 3 : 1;
+	int i;
+
+	if (x <= 0)
+		return 0;
+	for (i = 0; i < 50; i++)
+		r = (2 * r + x / (r * r)) / 3;
+	return r;
+}
+
+/* end of file */
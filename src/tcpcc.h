@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef _TCPCC_H_
+#define _TCPCC_H_
+
+#include <sys/types.h>
+
+#define TCPCC_DEFAULT	0		/* sesscb.cc, the one of set tcpcc */
+#define TCPCC_NEWRENO	1
+#define TCPCC_CUBIC	2
+#define TCPCC_MAX	2
+
+#define TCPCC_INITWND	10		/* segments, RFC 6928 */
+#define TCPCC_NOSSTHRESH	0x7fffffff	/* not set by a loss yet */
+
+struct tcpstream;
+
+/*
+ * A congestion control of the stream sender. tcpstream does the slow
+ * start, the fast recovery of RFC 6582 and the timeout, the algorithm
+ * grows cwnd above ssthresh and sets ssthresh on a loss. cwnd and 
+ * ssthresh are in bytes.
+ */
+struct tcpcc {
+	const char *name;
+	void (*init)(struct tcpstream *ts);
+	/* acked bytes moved una in the congestion avoidance, now in usec */
+	void (*ack)(struct tcpstream *ts, u_int acked, u_int64_t now);
+	/* a loss, by the duplicate acks or the timer */
+	void (*loss)(struct tcpstream *ts);
+};
+
+extern int tcpcc_default;
+
+const struct tcpcc *tcpcc_get(int id);
+int tcpcc_lookup(const char *name);
+const char *tcpcc_name(int id);
+
+#endif
+
+/* end of file */
@@ -0,0 +1,1113 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vpcs.h"
+#include "tcp.h"
+#include "tcpsock.h"
+#include "packets.h"
+#include "packets6.h"
+#include "utils.h"
+
+extern int ctrl_c;
+extern u_int time_tick;
+
+/* the listener slots of all the vpcs */
+static pthread_mutex_t lsnlock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct tcplistener *so_create(pcs *pc, int port, int nports);
+static struct tcplistener *so_lookup(pcs *pc, int port);
+static void so_release(struct tcplistener *lsn);
+static void so_new(struct tcplistener *lsn, struct packet *m, tcphdr *th, 
+    int ipv);
+static void so_options(struct tcpconn *c, tcphdr *th, int offer);
+static void so_connected(struct tcpconn *c, tcphdr *th);
+static void so_input(struct tcpconn *c, tcphdr *th, int dlen);
+static void so_output(struct tcpconn *c, int flags, u_int seq, 
+    const char *data, int len);
+static void so_push(struct tcpconn *c);
+static const char *so_data(struct tcpconn *c, u_int seq, int *n, 
+    u_int *sum);
+static void so_timer(struct tcpconn *c, u_int64_t now);
+static int so_left(struct tcpconn *c);
+static int so_window(struct tcpconn *c);
+static void so_eof(struct tcpconn *c);
+static void so_unlink(struct tcpconn *c);
+static void so_free(struct tcpconn *c);
+static void so_reap(struct tcplistener *lsn);
+static void so_wait(struct tcplistener *lsn, int ms);
+static void so_wakeup(struct tcplistener *lsn);
+static u_int64_t now_ms(void);
+
+/*
+ * Take the connections to port, at most backlog of them wait for 
+ * tcp_accept. The responder of the vpc answers the port no more.
+ * return NULL if the port is taken or all the slots are.
+ */
+struct tcplistener *tcp_listen(pcs *pc, int port, int backlog)
+{
+	struct tcplistener *lsn;
+
+	if (backlog <= 0)
+		backlog = TCPSO_BACKLOG;
+	if (backlog > TCPSO_MAXBACKLOG)
+		backlog = TCPSO_MAXBACKLOG;
+
+	lsn = so_create(pc, port, 1);
+	if (lsn != NULL)
+		lsn->backlog = backlog;
+
+	return lsn;
+}
+
+/*
+ * Take the nports ports from port for tcp_connect, release them with
+ * tcp_unlisten. 
+ * return NULL if one of them is taken or all the slots are.
+ */
+struct tcplistener *tcp_bind(pcs *pc, int port, int nports)
+{
+	struct tcplistener *lsn;
+	struct tcpconn **ports;
+
+	ports = calloc(nports, sizeof(struct tcpconn *));
+	if (ports == NULL) {
+		printf("out of memory\n");
+		return NULL;
+	}
+	lsn = so_create(pc, port, nports);
+	if (lsn == NULL) {
+		free(ports);
+		return NULL;
+	}
+	/* the reader may look for them from now on */
+	pthread_mutex_lock(&lsn->locker);
+	lsn->ports = ports;
+	pthread_mutex_unlock(&lsn->locker);
+
+	return lsn;
+}
+
+/*
+ * Reset the connections not accepted or released and take no more. 
+ * The accepted ones are left to their owners, the listener goes with 
+ * the last.
+ */
+void tcp_unlisten(struct tcplistener *lsn)
+{
+	struct tcpconn *c, *next;
+	int gone;
+
+	pthread_mutex_lock(&lsn->locker);
+	lsn->closed = 1;
+	for (c = lsn->conns; c != NULL; c = next) {
+		next = c->next;
+		if (c->accepted && !c->detached)
+			continue;
+		if (c->state != TCPSO_CLOSED)
+			so_output(c, TH_RST | TH_ACK, c->nxt, NULL, 0);
+		so_unlink(c);
+		so_free(c);
+	}
+	gone = (lsn->conns == NULL);
+	pthread_mutex_unlock(&lsn->locker);
+
+	if (gone)
+		so_release(lsn);
+}
+
+/*
+ * Wait up to ms milliseconds, or till Ctrl+C if ms is 0, for an 
+ * established connection. Do not wait if ms is negative.
+ */
+struct tcpconn *tcp_accept(struct tcplistener *lsn, int ms)
+{
+	struct tcpconn *c = NULL;
+	u_int64_t deadline = now_ms() + ms;
+
+	pthread_mutex_lock(&lsn->locker);
+	for (;;) {
+		for (c = lsn->conns; c != NULL; c = c->next) {
+			if (!c->accepted && c->state != TCPSO_SYNRCVD)
+				break;
+		}
+		if (c != NULL) {
+			c->accepted = 1;
+			lsn->queued--;
+			break;
+		}
+		if (ms < 0 || ctrl_c || (ms > 0 && now_ms() >= deadline))
+			break;
+		so_wait(lsn, 100);
+	}
+	pthread_mutex_unlock(&lsn->locker);
+
+	return c;
+}
+
+/*
+ * Open a connection from a free port of lsn, see tcp_bind, to the 
+ * address and port of to, its ether addresses and mine are taken too.
+ * Do not wait, tcp_sent counts the SYN till it is acked and is -1 if
+ * the peer resets it or tcp_poll gives up sending it. The connection 
+ * is the caller's as an accepted one. If the listener is halfopen, 
+ * SYN|ACK is taken but not acked, the connection stays TCPSO_SYNSENT.
+ * return NULL if all the ports are taken.
+ */
+struct tcpconn *tcp_connect(struct tcplistener *lsn, int ipv, 
+    const sesscb *to)
+{
+	struct tcpconn *c;
+	sesscb *cb;
+	int i, k = 0;
+
+	c = calloc(1, sizeof(struct tcpconn));
+	if (c == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&lsn->locker);
+	for (i = 0; i < lsn->nports && !lsn->closed; i++) {
+		k = (lsn->nextport + i) % lsn->nports;
+		if (lsn->ports[k] == NULL)
+			break;
+	}
+	if (lsn->closed || i == lsn->nports) {
+		pthread_mutex_unlock(&lsn->locker);
+		free(c);
+		return NULL;
+	}
+	/* the ports in turn, the peer may still hold the last one's */
+	lsn->nextport = k + 1;
+	lsn->ports[k] = c;
+
+	c->lsn = lsn;
+	c->ipv = ipv;
+	c->state = TCPSO_SYNSENT;
+	c->accepted = 1;
+	c->timeout = time_tick;
+	init_queue(&c->rq);
+
+	cb = &c->cb;
+	cb->proto = IPPROTO_TCP;
+	cb->ttl = TTL;
+	cb->mtu = lsn->pc->mtu;
+	memcpy(cb->smac, to->smac, ETH_ALEN);
+	memcpy(cb->dmac, to->dmac, ETH_ALEN);
+	if (ipv == IPV6_VERSION) {
+		memcpy(cb->sip6.addr8, to->sip6.addr8, 16);
+		memcpy(cb->dip6.addr8, to->dip6.addr8, 16);
+	} else {
+		cb->sip = to->sip;
+		cb->dip = to->dip;
+	}
+	cb->sport = lsn->port + k;
+	cb->dport = to->dport;
+	/* till SYN|ACK tells, no SACK, the blocks are not looked at */
+	c->mss = 536 - TCPSO_OPTLEN;
+	cb->topts = TCPSO_SYNOPTS;
+
+	c->una = random();
+	c->nxt = c->max = c->send = c->una + 1;
+	c->rto = TCPSO_RTO;
+	c->rxt_at = now_ms() + c->rto;
+
+	c->next = lsn->conns;
+	lsn->conns = c;
+
+	so_output(c, TH_SYN, c->una, NULL, 0);
+	pthread_mutex_unlock(&lsn->locker);
+
+	return c;
+}
+
+/*
+ * Read at most len bytes, waiting up to ms milliseconds, or till 
+ * Ctrl+C if ms is 0, for the first. Do not wait if ms is negative.
+ * return the bytes read, 0 at the end of the stream, -1 if none came.
+ */
+int tcp_recv(struct tcpconn *c, char *buf, int len, int ms)
+{
+	u_int64_t deadline = now_ms() + ms;
+	int n = 0, k;
+
+	while (n < len) {
+		if (c->rm == NULL) {
+			c->rm = deq(&c->rq);
+			while (c->rm == NULL && n == 0 && !ctrl_c &&
+			    (ms == 0 || now_ms() < deadline))
+				c->rm = timedwaitdeq(&c->rq, 100);
+			if (c->rm == NULL)
+				break;
+			c->roff = 0;
+		}
+		/* the end, kept for the next call */
+		if (c->rm->len == 0)
+			break;
+
+		k = c->rm->len - c->roff;
+		if (k > len - n)
+			k = len - n;
+		memcpy(buf + n, c->rm->data + c->roff, k);
+		c->roff += k;
+		n += k;
+		if (c->roff < c->rm->len)
+			continue;
+
+		del_pkt(c->rm);
+		c->rm = NULL;
+
+		/* reopen the window the peer may be waiting for */
+		pthread_mutex_lock(&c->lsn->locker);
+		if ((c->cb.winsize << c->wshift) < 2 * c->mss && 
+		    so_window(c) >= 2 * c->mss &&
+		    c->state < TCPSO_CLOSED)
+			so_output(c, TH_ACK, c->nxt, NULL, 0);
+		pthread_mutex_unlock(&c->lsn->locker);
+	}
+
+	if (n == 0 && (c->rm == NULL || c->rm->len != 0))
+		return -1;
+	return n;
+}
+
+/*
+ * Send len bytes and wait till the peer has acked all of them. The
+ * segments not acked in time are sent again from the oldest, the 
+ * connection is reset after TCPSO_MAXRXT tries.
+ * return len, or -1 if the connection is gone.
+ */
+int tcp_write(struct tcpconn *c, const char *buf, int len)
+{
+	struct tcplistener *lsn = c->lsn;
+	struct tcpiov iov;
+	int k;
+
+	memset(&iov, 0, sizeof(iov));
+	iov.base = buf;
+	iov.len = len;
+	if (tcp_push(c, &iov, 1) < 0)
+		return -1;
+
+	pthread_mutex_lock(&lsn->locker);
+	while ((k = so_left(c)) > 0 && !ctrl_c) {
+		so_wait(lsn, lsn->stalled ? 1 : 100);
+		so_timer(c, now_ms());
+		if (lsn->stalled) {
+			lsn->stalled = 0;
+			so_push(c);
+		}
+	}
+	if (k == 0) {
+		pthread_mutex_unlock(&lsn->locker);
+		return len;
+	}
+
+	if (c->state != TCPSO_CLOSED) {
+		so_output(c, TH_RST | TH_ACK, c->nxt, NULL, 0);
+		c->state = TCPSO_CLOSED;
+	}
+	/* buf is the caller's again */
+	c->niov = 0;
+	c->send = c->nxt;
+	pthread_mutex_unlock(&lsn->locker);
+
+	return -1;
+}
+
+/*
+ * Send FIN after the data, wait for its ack and a while for the FIN 
+ * of the peer, then free the connection. Reset it if the peer is not 
+ * done.
+ */
+void tcp_disconnect(struct tcpconn *c)
+{
+	struct tcplistener *lsn = c->lsn;
+	int gone;
+
+	pthread_mutex_lock(&lsn->locker);
+	c->shut = 1;
+	so_push(c);
+	while (c->state != TCPSO_CLOSED && !ctrl_c &&
+	    (c->linger == 0 || now_ms() < c->linger)) {
+		so_wait(lsn, 100);
+		so_timer(c, now_ms());
+	}
+	if (c->state != TCPSO_CLOSED)
+		so_output(c, TH_RST | TH_ACK, c->nxt, NULL, 0);
+
+	so_unlink(c);
+	so_free(c);
+	gone = (lsn->closed && lsn->conns == NULL);
+	pthread_mutex_unlock(&lsn->locker);
+
+	if (gone)
+		so_release(lsn);
+}
+
+/*
+ * Wait up to ms milliseconds for an event of the listener: a new 
+ * connection, data, an ack or a change of state. Keep the timers of 
+ * the accepted connections, go on with the ones waiting for bgoq and 
+ * free the released ones that are done.
+ * return 1 if anything happened since the last call, 0 if not.
+ */
+int tcp_poll(struct tcplistener *lsn, int ms)
+{
+	struct tcpconn *c, *next;
+	u_int64_t now, deadline;
+	int n, stalled;
+
+	pthread_mutex_lock(&lsn->locker);
+	now = now_ms();
+	deadline = now + (lsn->stalled ? 1 : ms);
+	while (lsn->events == lsn->polled && now < deadline) {
+		so_wait(lsn, deadline - now);
+		now = now_ms();
+	}
+	n = (lsn->events != lsn->polled);
+	lsn->polled = lsn->events;
+	stalled = lsn->stalled;
+	lsn->stalled = 0;
+
+	for (c = lsn->conns; c != NULL; c = next) {
+		next = c->next;
+		if (!c->accepted)
+			continue;
+		so_timer(c, now);
+		if (stalled && SEQ_LT(c->nxt, c->send))
+			so_push(c);
+		if (!c->detached)
+			continue;
+		if (c->state != TCPSO_CLOSED) {
+			if (c->linger == 0 || now < c->linger)
+				continue;
+			so_output(c, TH_RST | TH_ACK, c->nxt, NULL, 0);
+		}
+		so_unlink(c);
+		so_free(c);
+	}
+	pthread_mutex_unlock(&lsn->locker);
+
+	return n;
+}
+
+/* return the connections of the listener not freed yet */
+int tcp_conns(struct tcplistener *lsn)
+{
+	struct tcpconn *c;
+	int n = 0;
+
+	pthread_mutex_lock(&lsn->locker);
+	for (c = lsn->conns; c != NULL; c = c->next)
+		n++;
+	pthread_mutex_unlock(&lsn->locker);
+
+	return n;
+}
+
+/*
+ * Send the n parts of iov one after the other without waiting, the 
+ * segments are taken from them as they are. They are the caller's 
+ * again once tcp_sent is not positive: the reader sends what the 
+ * window takes as the acks come, tcp_poll or tcp_write again what is 
+ * not acked in time.
+ * return 0, or -1 if the connection is gone or still sending.
+ */
+int tcp_push(struct tcpconn *c, const struct tcpiov *iov, int n)
+{
+	struct tcplistener *lsn = c->lsn;
+	u_int len = 0;
+	int i;
+
+	pthread_mutex_lock(&lsn->locker);
+	if (n > TCPSO_MAXIOV || c->shut || SEQ_LT(c->una, c->send) ||
+	    (c->state != TCPSO_ESTAB && c->state != TCPSO_CLOSEWAIT)) {
+		pthread_mutex_unlock(&lsn->locker);
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		c->siov[i] = iov[i];
+		len += iov[i].len;
+	}
+	c->niov = n;
+	c->sseq = c->nxt;
+	c->send = c->nxt + len;
+	so_push(c);
+	pthread_mutex_unlock(&lsn->locker);
+
+	return 0;
+}
+
+/*
+ * return the bytes of tcp_push not yet acked, -1 if the connection 
+ * is gone.
+ */
+int tcp_sent(struct tcpconn *c)
+{
+	int k;
+
+	pthread_mutex_lock(&c->lsn->locker);
+	k = so_left(c);
+	pthread_mutex_unlock(&c->lsn->locker);
+
+	return k;
+}
+
+/*
+ * Hand the connection back to the listener, which sends FIN after the
+ * data and frees it in tcp_poll once done.
+ */
+void tcp_release(struct tcpconn *c)
+{
+	pthread_mutex_lock(&c->lsn->locker);
+	c->shut = 1;
+	c->detached = 1;
+	/* the peer is answered by the responder if it ever does */
+	if (c->state == TCPSO_SYNSENT)
+		c->state = TCPSO_CLOSED;
+	so_push(c);
+	so_wakeup(c->lsn);
+	pthread_mutex_unlock(&c->lsn->locker);
+}
+
+/*
+ * Called by tcp()/tcp6() in the reader of the vpc.
+ * return 1 if the segment belongs to a listening or bound port, 0 if 
+ * it is the responder's.
+ */
+int tcp_sockinput(pcs *pc, struct packet *m, int ipv)
+{
+	ethdr *eh = (ethdr *)(m->data);
+	struct tcplistener *lsn;
+	struct tcpconn *c;
+	iphdr *ip = NULL;
+	ip6hdr *ip6 = NULL;
+	tcphdr *th;
+	int i, dlen;
+
+	/* nobody listens, mostly */
+	for (i = 0; i < MAX_LISTENERS; i++) {
+		if (pc->listener[i] != NULL)
+			break;
+	}
+	if (i == MAX_LISTENERS)
+		return 0;
+
+	if (ipv == IPV6_VERSION) {
+		ip6 = (ip6hdr *)(eh + 1);
+		th = (tcphdr *)(ip6 + 1);
+		dlen = ntohs(ip6->ip6_plen) - (th->th_off << 2);
+	} else {
+		ip = (iphdr *)(eh + 1);
+		th = (tcphdr *)((char *)ip + (ip->ihl << 2));
+		dlen = ntohs(ip->len) - (ip->ihl << 2) - (th->th_off << 2);
+	}
+	if (dlen < 0)
+		return 0;
+
+	lsn = so_lookup(pc, ntohs(th->th_dport));
+	if (lsn == NULL)
+		return 0;
+
+	/* a bound port has a connection at most */
+	if (lsn->ports != NULL)
+		c = lsn->ports[ntohs(th->th_dport) - lsn->port];
+	else
+		c = lsn->conns;
+	for (; c != NULL; c = (lsn->ports != NULL) ? NULL : c->next) {
+		if (c->ipv != ipv || c->cb.dport != ntohs(th->th_sport))
+			continue;
+		if ((ipv == IPV6_VERSION) ? IP6EQ(&c->cb.dip6, &ip6->src) :
+		    (c->cb.dip == ip->sip))
+			break;
+	}
+
+	if (c != NULL)
+		so_input(c, th, dlen);
+	else if (lsn->halfopen)
+		/* the peer keeps its half, not reset by the responder */
+		;
+	else if ((th->th_flags & (TH_SYN | TH_ACK | TH_RST)) != TH_SYN || 
+	    lsn->closed || lsn->ports != NULL) {
+		pthread_mutex_unlock(&lsn->locker);
+		return 0;
+	} else {
+		so_reap(lsn);
+		/* drop it, the peer will try again */
+		if (lsn->pending + lsn->queued >= lsn->backlog)
+			STATS_ATOMIC_INC(pc, ev.tcp_full);
+		else
+			so_new(lsn, m, th, ipv);
+	}
+	pthread_mutex_unlock(&lsn->locker);
+
+	return 1;
+}
+
+/* a listener of nports ports from port, in a slot of the vpc */
+static struct tcplistener *so_create(pcs *pc, int port, int nports)
+{
+	struct tcplistener *lsn, *l;
+	int i, slot = -1;
+
+	lsn = calloc(1, sizeof(struct tcplistener));
+	if (lsn == NULL) {
+		printf("out of memory\n");
+		return NULL;
+	}
+	lsn->pc = pc;
+	lsn->port = port;
+	lsn->nports = nports;
+	pthread_mutex_init(&lsn->locker, NULL);
+	pthread_cond_init(&lsn->cond, NULL);
+
+	pthread_mutex_lock(&lsnlock);
+	for (i = 0; i < MAX_LISTENERS; i++) {
+		l = pc->listener[i];
+		if (l == NULL) {
+			if (slot == -1)
+				slot = i;
+		} else if (port < l->port + l->nports && l->port < port + nports) {
+			slot = -2;
+			break;
+		}
+	}
+	if (slot >= 0)
+		pc->listener[slot] = lsn;
+	pthread_mutex_unlock(&lsnlock);
+
+	if (slot < 0) {
+		if (slot == -2 && nports == 1)
+			printf("Port %d is in use\n", port);
+		else if (slot == -2)
+			printf("Ports %d-%d are in use\n", port, 
+			    port + nports - 1);
+		else
+			printf("Too many listening ports, at most %d\n", 
+			    MAX_LISTENERS);
+		pthread_cond_destroy(&lsn->cond);
+		pthread_mutex_destroy(&lsn->locker);
+		free(lsn);
+		return NULL;
+	}
+
+	return lsn;
+}
+
+/* return the listener of port, locked */
+static struct tcplistener *so_lookup(pcs *pc, int port)
+{
+	struct tcplistener *lsn = NULL, *l;
+	int i;
+
+	pthread_mutex_lock(&lsnlock);
+	for (i = 0; i < MAX_LISTENERS; i++) {
+		l = pc->listener[i];
+		if (l != NULL && port >= l->port && port < l->port + l->nports) {
+			lsn = pc->listener[i];
+			pthread_mutex_lock(&lsn->locker);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&lsnlock);
+
+	return lsn;
+}
+
+static void so_release(struct tcplistener *lsn)
+{
+	pcs *pc = lsn->pc;
+	int i;
+
+	pthread_mutex_lock(&lsnlock);
+	for (i = 0; i < MAX_LISTENERS; i++) {
+		if (pc->listener[i] == lsn)
+			pc->listener[i] = NULL;
+	}
+	pthread_mutex_unlock(&lsnlock);
+
+	/* the reader may still be in so_lookup's hands */
+	pthread_mutex_lock(&lsn->locker);
+	pthread_mutex_unlock(&lsn->locker);
+
+	pthread_cond_destroy(&lsn->cond);
+	pthread_mutex_destroy(&lsn->locker);
+	free(lsn->ports);
+	free(lsn);
+}
+
+/* SYN to the listening port, answer SYN|ACK */
+static void so_new(struct tcplistener *lsn, struct packet *m, tcphdr *th, 
+    int ipv)
+{
+	ethdr *eh = (ethdr *)(m->data);
+	struct tcpconn *c;
+	sesscb *cb;
+
+	c = calloc(1, sizeof(struct tcpconn));
+	if (c == NULL)
+		return;
+
+	c->lsn = lsn;
+	c->ipv = ipv;
+	c->state = TCPSO_SYNRCVD;
+	c->timeout = time_tick;
+	init_queue(&c->rq);
+
+	cb = &c->cb;
+	cb->proto = IPPROTO_TCP;
+	cb->ttl = TTL;
+	cb->mtu = lsn->pc->mtu;
+	memcpy(cb->smac, eh->dst, ETH_ALEN);
+	memcpy(cb->dmac, eh->src, ETH_ALEN);
+	if (ipv == IPV6_VERSION) {
+		ip6hdr *ip6 = (ip6hdr *)(eh + 1);
+
+		memcpy(cb->sip6.addr8, ip6->dst.addr8, 16);
+		memcpy(cb->dip6.addr8, ip6->src.addr8, 16);
+	} else {
+		iphdr *ip = (iphdr *)(eh + 1);
+
+		cb->sip = ip->dip;
+		cb->dip = ip->sip;
+	}
+	cb->sport = ntohs(th->th_dport);
+	cb->dport = ntohs(th->th_sport);
+	cb->ack = ntohl(th->th_seq) + 1;
+	/* SYN|ACK answers the window scale only, see packetcb */
+	so_options(c, th, TOF_SCALE);
+
+	c->una = random();
+	c->nxt = c->max = c->send = c->una + 1;
+	c->rto = TCPSO_RTO;
+
+	c->next = lsn->conns;
+	lsn->conns = c;
+	lsn->pending++;
+
+	so_output(c, TH_SYN | TH_ACK, c->una, NULL, 0);
+}
+
+/* 
+ * the options of the SYN of the peer, only those my SYN or SYN|ACK 
+ * has too (offer) are in use
+ */
+static void so_options(struct tcpconn *c, tcphdr *th, int offer)
+{
+	sesscb *cb = &c->cb;
+	int mss, hdr;
+
+	if (c->ipv == IPV6_VERSION)
+		hdr = sizeof(ip6hdr) + sizeof(tcphdr);
+	else
+		hdr = sizeof(iphdr) + sizeof(tcphdr);
+
+	tcp_options(th, cb);
+	cb->topts &= offer;
+	mss = (cb->rmss != 0) ? cb->rmss : 536;
+	if (mss > cb->mtu - hdr)
+		mss = cb->mtu - hdr;
+	/* packet() clips the segment to rmss if any */
+	cb->rmss = 0;
+	c->mss = mss;
+	if (cb->topts & TOF_TS)
+		c->mss -= TCPSO_OPTLEN;
+	/* the window of SYN is never scaled */
+	c->wnd = ntohs(th->th_win);
+}
+
+/* SYN|ACK to the SYN of tcp_connect, ack it */
+static void so_connected(struct tcpconn *c, tcphdr *th)
+{
+	so_options(c, th, TCPSO_SYNOPTS);
+	/* my SYN told a shift of 1, see packetcb */
+	if (c->cb.topts & TOF_SCALE)
+		c->wshift = 1;
+	c->cb.ack = ntohl(th->th_seq) + 1;
+	c->una = c->nxt;
+	c->state = TCPSO_ESTAB;
+	c->opened = 1;
+	c->tries = 0;
+	c->rto = TCPSO_RTO;
+	c->rxt_at = 0;
+	STATS_ATOMIC_INC(c->lsn->pc, ev.tcp_open);
+
+	so_output(c, TH_ACK, c->nxt, NULL, 0);
+	so_wakeup(c->lsn);
+}
+
+static void so_input(struct tcpconn *c, tcphdr *th, int dlen)
+{
+	struct tcplistener *lsn = c->lsn;
+	struct packet *p;
+	char *data = (char *)th + (th->th_off << 2);
+	u_int seq = ntohl(th->th_seq);
+	u_int ack = ntohl(th->th_ack);
+	int fin = th->th_flags & TH_FIN;
+
+	c->timeout = time_tick;
+
+	if (th->th_flags & TH_RST) {
+		if (c->accepted) {
+			c->state = TCPSO_CLOSED;
+			so_eof(c);
+		} else {
+			so_unlink(c);
+			so_free(c);
+		}
+		so_wakeup(lsn);
+		return;
+	}
+
+	if (c->state == TCPSO_SYNSENT) {
+		if ((th->th_flags & (TH_SYN | TH_ACK)) != (TH_SYN | TH_ACK) ||
+		    ack != c->una + 1)
+			return;
+		c->synack = trace_now();
+		if (!lsn->halfopen) {
+			so_connected(c, th);
+			return;
+		}
+		c->una = ack;
+		c->rxt_at = 0;
+		so_wakeup(lsn);
+		return;
+	}
+
+	/* the TSval to echo, RFC 7323 4.3 */
+	if (c->cb.topts & TOF_TS)
+		tcp_timestamp(th, &c->cb);
+
+	if (th->th_flags & TH_SYN) {
+		/* SYN|ACK was lost, or my ack of it */
+		if (c->state == TCPSO_SYNRCVD)
+			so_output(c, TH_SYN | TH_ACK, c->una, NULL, 0);
+		else if (c->state != TCPSO_CLOSED)
+			so_output(c, TH_ACK, c->nxt, NULL, 0);
+		return;
+	}
+
+	if (!(th->th_flags & TH_ACK) || c->state == TCPSO_CLOSED)
+		return;
+
+	if (c->state == TCPSO_SYNRCVD) {
+		if (ack != c->una + 1)
+			return;
+		c->state = TCPSO_ESTAB;
+		c->opened = 1;
+		c->una = ack;
+		lsn->pending--;
+		lsn->queued++;
+		STATS_ATOMIC_INC(lsn->pc, ev.tcp_open);
+		so_wakeup(lsn);
+	}
+
+	c->wnd = ntohs(th->th_win) << c->cb.rwscale;
+	if (SEQ_GT(ack, c->una) && SEQ_LEQ(ack, c->max)) {
+		c->una = ack;
+		if (SEQ_GT(ack, c->nxt))
+			c->nxt = ack;
+		c->tries = 0;
+		c->rto = TCPSO_RTO;
+		c->rxt_at = 0;
+		/* FIN acked, the peer has not sent its own */
+		if (c->state == TCPSO_FINSENT && c->una == c->max && 
+		    !c->rfin && c->linger == 0)
+			c->linger = now_ms() + TCPSO_LINGER;
+		so_push(c);
+		so_wakeup(lsn);
+	} else if (c->wnd > 0 && SEQ_LT(c->nxt, c->send))
+		/* the window opened */
+		so_push(c);
+
+	if (dlen > 0 || fin) {
+		/* take the data in order, ack the hole again */
+		if (seq == c->cb.ack && !c->rfin) {
+			if (dlen > 0) {
+				/* a slot is kept for the end */
+				p = NULL;
+				if (c->rq.size < PKTQ_SIZE - 1)
+					p = new_pkt(dlen);
+				if (p != NULL) {
+					memcpy(p->data, data, dlen);
+					enq(&c->rq, p);
+					c->cb.ack += dlen;
+					so_wakeup(lsn);
+				} else
+					fin = 0;
+			}
+			if (fin) {
+				c->cb.ack++;
+				c->rfin = 1;
+				so_eof(c);
+				if (c->state == TCPSO_ESTAB)
+					c->state = TCPSO_CLOSEWAIT;
+				so_wakeup(lsn);
+			}
+		}
+		so_output(c, TH_ACK, c->nxt, NULL, 0);
+	}
+
+	if (c->state == TCPSO_FINSENT && c->rfin && c->una == c->max) {
+		c->state = TCPSO_CLOSED;
+		so_wakeup(lsn);
+	}
+}
+
+/* call with the listener locked */
+static void so_output(struct tcpconn *c, int flags, u_int seq, 
+    const char *data, int len)
+{
+	pcs *pc = c->lsn->pc;
+	sesscb *cb = &c->cb;
+	struct packet *m;
+
+	cb->flags = flags;
+	cb->seq = seq;
+	cb->dsize = len;
+	cb->sdata = data;
+	cb->winsize = so_window(c) >> c->wshift;
+
+	m = (c->ipv == IPV6_VERSION) ? packet6cb(pc, cb) : packetcb(pc, cb);
+	cb->sdata = NULL;
+	cb->dsum = 0;
+	if (m == NULL)
+		return;
+
+	/* push m into the background output queue which is watched 
+	   by pth_output */
+	enq(&pc->bgoq, m);
+}
+
+/* 
+ * Send what the window takes of the data, a byte to probe a closed 
+ * one, and FIN after the last if shut. Stop at TCPSO_OQMAX packets on
+ * the way out as tcpstream does, tcp_poll goes on. Call with the 
+ * listener locked.
+ */
+static void so_push(struct tcpconn *c)
+{
+	const char *data;
+	u_int lim;
+	int n;
+
+	if (c->state != TCPSO_ESTAB && c->state != TCPSO_CLOSEWAIT &&
+	    c->state != TCPSO_FINSENT)
+		return;
+
+	lim = c->una + ((c->wnd > 0) ? c->wnd : 1);
+	while (SEQ_LT(c->nxt, c->send) && SEQ_LT(c->nxt, lim)) {
+		if (c->lsn->pc->bgoq.size + c->lsn->pc->oq.size >= 
+		    TCPSO_OQMAX) {
+			c->lsn->stalled = 1;
+			break;
+		}
+		n = c->mss;
+		if (n > (int)(lim - c->nxt))
+			n = lim - c->nxt;
+		data = so_data(c, c->nxt, &n, &c->cb.dsum);
+		so_output(c, TH_ACK | TH_PUSH, c->nxt, data, n);
+		c->nxt += n;
+	}
+	if (c->shut && c->nxt == c->send) {
+		so_output(c, TH_FIN | TH_ACK, c->nxt, NULL, 0);
+		c->nxt++;
+		c->state = TCPSO_FINSENT;
+	}
+	if (SEQ_GT(c->nxt, c->max))
+		c->max = c->nxt;
+
+	if (c->rxt_at == 0 && c->una != c->max)
+		c->rxt_at = now_ms() + c->rto;
+}
+
+/* 
+ * the data at seq, n is clipped to the end of its part. sum is its 
+ * cksum_part if known, 0 if not.
+ */
+static const char *so_data(struct tcpconn *c, u_int seq, int *n, 
+    u_int *sum)
+{
+	struct tcpiov *v = c->siov;
+	u_int off = seq - c->sseq;
+
+	while (off >= v->len) {
+		off -= v->len;
+		v++;
+	}
+	if (*n > (int)(v->len - off))
+		*n = v->len - off;
+
+	*sum = 0;
+	if (v->sums != NULL && off % v->sumlen == 0 &&
+	    (*n == v->sumlen || off + *n == v->len))
+		*sum = v->sums[off / v->sumlen];
+
+	return v->base + (v->period ? off % v->period : off);
+}
+
+/* 
+ * Send again from the oldest, or SYN, if not acked in time, reset the 
+ * connection after TCPSO_MAXRXT tries. Call with the listener locked.
+ */
+static void so_timer(struct tcpconn *c, u_int64_t now)
+{
+	if (c->state == TCPSO_CLOSED || c->rxt_at == 0 || now < c->rxt_at)
+		return;
+
+	if (c->una == c->max) {
+		c->rxt_at = 0;
+		return;
+	}
+	if (++c->tries >= TCPSO_MAXRXT) {
+		if (c->state != TCPSO_SYNSENT)
+			so_output(c, TH_RST | TH_ACK, c->nxt, NULL, 0);
+		c->state = TCPSO_CLOSED;
+		if (!c->rfin)
+			so_eof(c);
+		so_wakeup(c->lsn);
+		return;
+	}
+	c->rto <<= 1;
+	c->rxt_at = now + c->rto;
+	if (c->state == TCPSO_SYNSENT) {
+		so_output(c, TH_SYN, c->una, NULL, 0);
+		return;
+	}
+	c->nxt = c->una;
+	so_push(c);
+}
+
+/* the bytes of tcp_push not acked, -1 if the connection is gone */
+static int so_left(struct tcpconn *c)
+{
+	if (c->state == TCPSO_CLOSED)
+		return -1;
+	return SEQ_LT(c->una, c->send) ? (int)(c->send - c->una) : 0;
+}
+
+/* what rq still holds, a segment a slot */
+static int so_window(struct tcpconn *c)
+{
+	int n = (PKTQ_SIZE - 2 - c->rq.size) * c->mss;
+
+	if (n < 0)
+		return 0;
+	return (n > TCPSO_RCVWIN) ? TCPSO_RCVWIN : n;
+}
+
+/* a packet without data wakes up tcp_recv at the end */
+static void so_eof(struct tcpconn *c)
+{
+	struct packet *p = new_pkt(0);
+
+	if (p != NULL)
+		enq(&c->rq, p);
+}
+
+static void so_unlink(struct tcpconn *c)
+{
+	struct tcplistener *lsn = c->lsn;
+	struct tcpconn **pp;
+
+	for (pp = &lsn->conns; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == c) {
+			*pp = c->next;
+			break;
+		}
+	}
+	if (lsn->ports != NULL)
+		lsn->ports[c->cb.sport - lsn->port] = NULL;
+	if (!c->accepted) {
+		if (c->state == TCPSO_SYNRCVD)
+			lsn->pending--;
+		else
+			lsn->queued--;
+	}
+	if (c->opened)
+		STATS_ATOMIC_INC(lsn->pc, ev.tcp_close);
+}
+
+static void so_free(struct tcpconn *c)
+{
+	struct packet *m;
+
+	while ((m = deq(&c->rq)) != NULL)
+		del_pkt(m);
+	if (c->rm != NULL)
+		del_pkt(c->rm);
+	pthread_cond_destroy(&c->rq.cond);
+	pthread_mutex_destroy(&c->rq.locker);
+	free(c);
+}
+
+/* the handshakes given up by the peer */
+static void so_reap(struct tcplistener *lsn)
+{
+	struct tcpconn *c, *next;
+
+	for (c = lsn->conns; c != NULL; c = next) {
+		next = c->next;
+		if (c->state == TCPSO_SYNRCVD && 
+		    time_tick - c->timeout > TCP_TIMEOUT) {
+			so_unlink(c);
+			so_free(c);
+		}
+	}
+}
+
+/* call with the listener locked */
+static void so_wait(struct tcplistener *lsn, int ms)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (ms % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	pthread_cond_timedwait(&lsn->cond, &lsn->locker, &ts);
+}
+
+/* call with the listener locked */
+static void so_wakeup(struct tcplistener *lsn)
+{
+	lsn->events++;
+	pthread_cond_broadcast(&lsn->cond);
+}
+
+static u_int64_t now_ms(void)
+{
+	return trace_now() / 1000000;
+}
+
+/* end of file */
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef _TCPSOCK_H_
+#define _TCPSOCK_H_
+
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "vpcs.h"
+
+#define TCPSO_BACKLOG	8		/* default backlog */
+#define TCPSO_MAXBACKLOG	64
+#define TCPSO_RCVWIN	0x4000		/* at most, less as rq fills */
+#define TCPSO_OPTLEN	12		/* nop, nop, timestamp, see packet() */
+#define TCPSO_SYNOPTS	(TOF_SCALE | TOF_TS)	/* offered by tcp_connect */
+#define TCPSO_RTO	1000		/* ms, doubled on every try */
+#define TCPSO_MAXRXT	4		/* tries of a segment */
+#define TCPSO_LINGER	2000		/* ms to wait for the FIN of the peer */
+#define TCPSO_MAXIOV	16		/* parts of the data of tcp_push */
+#define TCPSO_OQMAX	(PKTQ_SIZE * 3 / 4)	/* bgoq and oq, see so_push */
+
+/* the states of a connection */
+#define TCPSO_SYNSENT	1		/* active open, see tcp_connect */
+#define TCPSO_SYNRCVD	2
+#define TCPSO_ESTAB	3
+#define TCPSO_CLOSEWAIT	4		/* FIN received */
+#define TCPSO_FINSENT	5		/* FIN sent, maybe also received */
+#define TCPSO_CLOSED	6		/* reset, or both FINs acked */
+
+struct tcplistener;
+
+/* 
+ * A part of the data to send, a segment never takes two. If period is 
+ * not 0, the data repeats the first period bytes of base, which holds 
+ * a segment more. If sums is not NULL, sums[i] is the cksum_part of 
+ * the i-th sumlen bytes, sumlen being the mss of the connection.
+ */
+struct tcpiov {
+	const char *base;
+	u_int len;
+	u_int period;
+	const u_int *sums;
+	int sumlen;
+};
+
+/*
+ * A connection on a listening port or of tcp_connect. cb is seen from this side as 
+ * mscb is: sip and sport are mine, the ports are in host order. The 
+ * reader of the vpc puts the data taken in order on rq, a packet 
+ * without data is the end of the stream. The data to send is the 
+ * caller's till acked, siov from sseq up to send, the reader sends 
+ * more as the acks come. All but rq is guarded by the locker of the
+ * listener.
+ */
+struct tcpconn {
+	struct tcpconn *next;
+	struct tcplistener *lsn;
+	int ipv;			/* 4 or IPV6_VERSION */
+	int state;
+	int accepted;
+	int opened;			/* was established */
+	u_int64_t synack;		/* ns, SYN|ACK to tcp_connect taken */
+	int rfin;			/* FIN of the peer taken */
+	sesscb cb;			/* ack is the next to take */
+	u_int una;			/* oldest sequence number not acked */
+	u_int nxt;			/* next to send */
+	u_int max;			/* highest sent + 1 */
+	u_int wnd;			/* peer window, scaled */
+	int mss;			/* payload of a segment */
+	int wshift;			/* of the window I tell */
+	struct tcpiov siov[TCPSO_MAXIOV];	/* being sent, see tcp_push */
+	int niov;
+	u_int sseq;			/* of the first byte of siov */
+	u_int send;			/* end of the data to send */
+	int shut;			/* FIN after the data */
+	int detached;			/* freed by the listener, tcp_release */
+	int tries;			/* of the oldest segment */
+	int rto;			/* ms */
+	u_int64_t rxt_at;		/* ms, 0 if nothing in flight */
+	u_int64_t linger;		/* ms, wait for the FIN of the peer */
+	u_int timeout;			/* time_tick of the last segment */
+	struct pq rq;			/* in-order data */
+	struct packet *rm;		/* partly read */
+	int roff;
+};
+
+/*
+ * A listening port, the connections are queued till tcp_accept 
+ * takes them. A closed listener takes no more SYNs and goes away 
+ * with its last connection. The one of tcp_bind takes no SYN at all,
+ * it holds the ports of tcp_connect, a connection a port.
+ */
+struct tcplistener {
+	pcs *pc;
+	int port;
+	int nports;			/* port up to port + nports - 1 */
+	struct tcpconn **ports;		/* by port - port, tcp_bind only */
+	int nextport;			/* tried first by tcp_connect */
+	int halfopen;			/* SYN|ACK to tcp_connect not acked */
+	int backlog;
+	int queued;			/* established, not accepted */
+	int pending;			/* SYN received */
+	int closed;
+	u_int events;			/* connection, data, ack, state change */
+	u_int polled;			/* events seen by tcp_poll */
+	int stalled;			/* a connection waits for bgoq */
+	pthread_mutex_t locker;
+	pthread_cond_t cond;		/* on every event */
+	struct tcpconn *conns;
+};
+
+struct tcplistener *tcp_listen(pcs *pc, int port, int backlog);
+struct tcplistener *tcp_bind(pcs *pc, int port, int nports);
+void tcp_unlisten(struct tcplistener *lsn);
+struct tcpconn *tcp_connect(struct tcplistener *lsn, int ipv, 
+    const sesscb *to);
+struct tcpconn *tcp_accept(struct tcplistener *lsn, int ms);
+int tcp_recv(struct tcpconn *c, char *buf, int len, int ms);
+int tcp_write(struct tcpconn *c, const char *buf, int len);
+void tcp_disconnect(struct tcpconn *c);
+int tcp_poll(struct tcplistener *lsn, int ms);
+int tcp_conns(struct tcplistener *lsn);
+int tcp_push(struct tcpconn *c, const struct tcpiov *iov, int n);
+int tcp_sent(struct tcpconn *c);
+void tcp_release(struct tcpconn *c);
+int tcp_sockinput(pcs *pc, struct packet *m, int ipv);
+
+#endif
+
+/* end of file */
@@ -0,0 +1,651 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "vpcs.h"
+#include "tcp.h"
+#include "tcpstream.h"
+#include "packets.h"
+#include "packets6.h"
+#include "utils.h"
+
+extern int ctrl_c;
+extern u_int time_tick;
+
+static u_int64_t now_us(void);
+static void ts_init(struct tcpstream *ts);
+static void ts_fini(struct tcpstream *ts);
+static int ts_active(struct tcpstream *ts);
+static void ts_send(pcs *pc, struct tcpstream *ts, u_int64_t off, int len);
+static void ts_ack(pcs *pc, struct tcpstream *ts);
+static void ts_output(pcs *pc, struct tcpstream *ts);
+static int ts_input(pcs *pc, struct tcpstream *ts, struct packet *m);
+static void ts_newack(pcs *pc, struct tcpstream *ts, u_int64_t off, 
+    u_int wnd);
+static void ts_dupack(pcs *pc, struct tcpstream *ts);
+static void ts_timeout(pcs *pc, struct tcpstream *ts, u_int64_t now);
+static void ts_rexmit(pcs *pc, struct tcpstream *ts);
+static void ts_sack(struct tcpstream *ts, tcphdr *th);
+static void ts_sackadd(struct tcpstream *ts, u_int64_t start, 
+    u_int64_t end);
+static void ts_sacktrim(struct tcpstream *ts);
+static int ts_nexthole(struct tcpstream *ts, u_int64_t *off, 
+    u_int64_t *len);
+static void ts_rtt(struct tcpstream *ts, int rtt);
+
+/* keep the writer of the vpc busy, but never fill its queue */
+#define TCPS_OQMAX	(PKTQ_SIZE * 3 / 4)
+
+/*
+ * Send ts->bytes on the connection in pc->mscb, which tcp_open has 
+ * set up. The window is the smaller one of the peer window and cwnd
+ * of the congestion control in cb->cc, the lost segments
+ * are sent again after three duplicate acks or the timeout.
+ * return 1 if all the data was acked, 3 if RST returned, 0 if timeout
+ * or interrupted. pc->mscb is left ready for tcp_close.
+ */
+int tcp_stream(pcs *pc, int ipv, struct tcpstream *ts)
+{
+	ts->cb = &pc->mscb;
+	ts->ipv = ipv;
+
+	tcp_streams(pc, ts, 1, NULL, NULL);
+
+	if (ts->rst)
+		return 3;
+	return (ts->una >= ts->bytes);
+}
+
+/*
+ * Run n streams at once, each on its own connection in ts[i].cb.
+ * tick, if any, is called every round, at least once a millisecond, 
+ * and may move ts[i].bytes, it returns 0 once the counts are final.
+ * return the number of the streams all of whose data was acked.
+ */
+int tcp_streams(pcs *pc, struct tcpstream *ts, int n, 
+    int (*tick)(struct tcpstream *ts, int n, void *arg), void *arg)
+{
+	struct packet *m;
+	u_int64_t now;
+	int i, more, active, wait, done;
+
+	for (i = 0; i < n; i++)
+		ts_init(&ts[i]);
+
+	more = (tick != NULL);
+	while (!ctrl_c) {
+		if (more)
+			more = tick(ts, n, arg);
+		active = 0;
+		for (i = 0; i < n; i++)
+			active += ts_active(&ts[i]);
+		if (active == 0 && !more)
+			break;
+		pc->mscb.timeout = time_tick;
+
+		for (i = 0; i < n; i++) {
+			if (ts_active(&ts[i]))
+				ts_output(pc, &ts[i]);
+		}
+
+		/* sleep till the first timer, or a moment if the queue is full */
+		now = now_us();
+		wait = more ? 1 : 100;
+		if (pc->oq.size >= TCPS_OQMAX)
+			wait = 1;
+		for (i = 0; i < n && wait > 0; i++) {
+			if (ts[i].rxt_at == 0 || !ts_active(&ts[i]))
+				continue;
+			if (ts[i].rxt_at <= now)
+				wait = 0;
+			else if (ts[i].rxt_at - now < wait * 1000)
+				wait = (ts[i].rxt_at - now + 999) / 1000;
+		}
+		m = (wait > 0) ? timedwaitdeq(&pc->iq, wait) : deq(&pc->iq);
+		while (m != NULL) {
+			for (i = 0; i < n; i++) {
+				if (ts_input(pc, &ts[i], m))
+					break;
+			}
+			del_pkt(m);
+			m = deq(&pc->iq);
+		}
+
+		now = now_us();
+		for (i = 0; i < n; i++) {
+			if (ts[i].ackpending)
+				ts_ack(pc, &ts[i]);
+			if (ts_active(&ts[i]) && ts[i].rxt_at != 0 && 
+			    now >= ts[i].rxt_at)
+				ts_timeout(pc, &ts[i], now);
+		}
+	}
+
+	done = 0;
+	for (i = 0; i < n; i++) {
+		ts_fini(&ts[i]);
+		if (!ts[i].rst && ts[i].una >= ts[i].bytes)
+			done++;
+	}
+	return done;
+}
+
+void tcp_stream_report(struct tcpstream *ts, int port, const char *host)
+{
+	double sec = (ts->end - ts->start) / 1000000.0;
+
+	if (sec <= 0)
+		sec = 0.000001;
+	printf("Stream    %d@%s %llu bytes in %.3f s, %.3f Mbps\n", port, host,
+	    (unsigned long long)ts->una, sec, ts->una * 8 / sec / 1000000);
+	printf("          %lu segments, %lu retransmitted (%lu fast, "
+	    "%lu timeout), srtt %.3f ms, rto %.3f ms\n", ts->segs, ts->rexmits, 
+	    ts->fastrexmits, ts->timeouts, ts->srtt / 1000.0, 
+	    ts->rto / 1000.0);
+	printf("          %s, cwnd %u bytes, ssthresh ", ts->cc->name, ts->cwnd);
+	if (ts->ssthresh == TCPCC_NOSSTHRESH)
+		printf("-\n");
+	else
+		printf("%u bytes\n", ts->ssthresh);
+}
+
+static u_int64_t now_us(void)
+{
+	return trace_now() / 1000;
+}
+
+static void ts_init(struct tcpstream *ts)
+{
+	sesscb *cb = ts->cb;
+	int mss;
+
+	ts->iss = cb->seq;
+	ts->rcv_nxt = cb->ack;
+	ts->una = ts->nxt = ts->max = ts->recover = 0;
+	ts->rxt_nxt = 0;
+	ts->nsacked = 0;
+	/* the window of SYN is never scaled */
+	ts->wnd = cb->rwin;
+	ts->rto = TCPS_RTO_INIT;
+	ts->srtt = ts->rttvar = 0;
+	ts->inrecovery = ts->dupacks = 0;
+
+	mss = (cb->rmss != 0) ? cb->rmss : 536;
+	if (ts->ipv == IPV6_VERSION) {
+		if (mss > cb->mtu - (int)(sizeof(ip6hdr) + sizeof(tcphdr)))
+			mss = cb->mtu - sizeof(ip6hdr) - sizeof(tcphdr);
+	} else {
+		if (mss > cb->mtu - (int)(sizeof(iphdr) + sizeof(tcphdr)))
+			mss = cb->mtu - sizeof(iphdr) - sizeof(tcphdr);
+	}
+	ts->mss = mss;
+	if (cb->topts & TOF_TS)
+		ts->mss -= TCPS_OPTLEN;
+
+	ts->cc = tcpcc_get(cb->cc);
+	ts->cwnd = TCPCC_INITWND * ts->mss;
+	ts->ssthresh = TCPCC_NOSSTHRESH;
+	ts->cc->init(ts);
+	ts->winsize = cb->winsize;
+	cb->winsize = TCPS_RCVWIN;
+	ts->start = now_us();
+}
+
+/* leave the session ready for tcp_close */
+static void ts_fini(struct tcpstream *ts)
+{
+	ts->end = now_us();
+	ts->cb->seq = ts->iss + (u_int)ts->una;
+	ts->cb->ack = ts->rcv_nxt;
+	ts->cb->winsize = ts->winsize;
+}
+
+static int ts_active(struct tcpstream *ts)
+{
+	return (!ts->rst && !ts->dead && ts->una < ts->bytes);
+}
+
+static void ts_send(pcs *pc, struct tcpstream *ts, u_int64_t off, int len)
+{
+	sesscb *cb = ts->cb;
+	struct packet *m;
+
+	cb->seq = ts->iss + (u_int)off;
+	cb->ack = ts->rcv_nxt;
+	cb->dsize = len;
+	cb->flags = TH_ACK | TH_PUSH;
+
+	m = (ts->ipv == IPV6_VERSION) ? packet6cb(pc, cb) : 
+	    packetcb(pc, cb);
+	if (m == NULL)
+		return;
+
+	/* the ether address was resolved before tcp_open */
+	enq(&pc->oq, m);
+	ts->segs++;
+	ts->ackpending = 0;
+}
+
+static void ts_ack(pcs *pc, struct tcpstream *ts)
+{
+	sesscb *cb = ts->cb;
+	struct packet *m;
+
+	cb->seq = ts->iss + (u_int)ts->nxt;
+	cb->ack = ts->rcv_nxt;
+	cb->flags = TH_ACK;
+
+	m = (ts->ipv == IPV6_VERSION) ? packet6cb(pc, cb) : 
+	    packetcb(pc, cb);
+	if (m != NULL)
+		enq(&pc->oq, m);
+	ts->ackpending = 0;
+}
+
+static void ts_output(pcs *pc, struct tcpstream *ts)
+{
+	u_int64_t limit, left;
+	u_int wnd;
+	int len;
+
+	while (ts->nxt < ts->bytes && pc->oq.size < TCPS_OQMAX) {
+		/* probe a closed window with one byte */
+		wnd = (ts->wnd < ts->cwnd) ? ts->wnd : ts->cwnd;
+		limit = ts->una + ((wnd > 0) ? wnd : 1);
+		if (ts->nxt >= limit)
+			break;
+
+		len = ts->mss;
+		left = ts->bytes - ts->nxt;
+		if (left < len) {
+			/* Nagle, the count may still grow, see tcp_streams */
+			if (ts->nxt > ts->una)
+				break;
+			len = left;
+		}
+		if (limit - ts->nxt < len) {
+			/* no small segments while the data is in flight */
+			if (ts->nxt > ts->una)
+				break;
+			len = limit - ts->nxt;
+		}
+
+		if (!ts->rtt_on) {
+			ts->rtt_on = 1;
+			ts->rtt_off = ts->nxt;
+			ts->rtt_start = now_us();
+		}
+		ts_send(pc, ts, ts->nxt, len);
+
+		ts->nxt += len;
+		ts->max = ts->nxt;
+		if (ts->rxt_at == 0)
+			ts->rxt_at = now_us() + ts->rto;
+	}
+}
+
+/* return 1 if the segment is of the stream */
+static int ts_input(pcs *pc, struct tcpstream *ts, struct packet *m)
+{
+	ethdr *eh = (ethdr *)(m->data);
+	iphdr *ip;
+	ip6hdr *ip6;
+	tcphdr *th;
+	u_int64_t off;
+	u_int seq, wnd, ecr;
+	u_char *opt;
+	int dlen, delta;
+
+	if (ts->ipv == IPV6_VERSION) {
+		ip6 = (ip6hdr *)(eh + 1);
+		if (ip6->ip6_nxt != IPPROTO_TCP)
+			return 0;
+		th = (tcphdr *)(ip6 + 1);
+		dlen = ntohs(ip6->ip6_plen) - (th->th_off << 2);
+	} else {
+		ip = (iphdr *)(eh + 1);
+		if (ip->proto != IPPROTO_TCP)
+			return 0;
+		th = (tcphdr *)((char *)ip + (ip->ihl << 2));
+		dlen = ntohs(ip->len) - (ip->ihl << 2) - (th->th_off << 2);
+	}
+	if (ntohs(th->th_sport) != ts->cb->dport || 
+	    ntohs(th->th_dport) != ts->cb->sport)
+		return 0;
+
+	if (th->th_flags & TH_RST) {
+		ts->rst = 1;
+		return 1;
+	}
+	if (ts->cb->topts & TOF_TS)
+		tcp_timestamp(th, ts->cb);
+
+	/* the data of the peer is taken in order, and dropped */
+	seq = ntohl(th->th_seq);
+	if (dlen > 0 || (th->th_flags & TH_FIN)) {
+		if (seq == ts->rcv_nxt) {
+			ts->rcv_nxt += dlen;
+			if (th->th_flags & TH_FIN)
+				ts->rcv_nxt++;
+		}
+		ts->ackpending = 1;
+	}
+
+	if (!(th->th_flags & TH_ACK))
+		return 1;
+
+	if (ts->cb->topts & TOF_SACK)
+		ts_sack(ts, th);
+
+	wnd = ntohs(th->th_win) << ts->cb->rwscale;
+	delta = ntohl(th->th_ack) - (ts->iss + (u_int)ts->una);
+	if (delta < 0)
+		return 1;
+	off = ts->una + delta;
+	if (off > ts->max)
+		return 1;
+
+	if (off > ts->una) {
+		/* RFC 7323 4.1, the echo times the retransmissions too */
+		opt = NULL;
+		if (ts->cb->topts & TOF_TS)
+			opt = tcp_getopt(th, TCPOPT_TIMESTAMP, 
+			    TCPOLEN_TIMESTAMP);
+		if (opt != NULL) {
+			memcpy(&ecr, opt + 6, 4);
+			ecr = tcp_tsval() - ntohl(ecr);
+			if (ecr < TCPS_RTO_MAX / 1000) {
+				ts_rtt(ts, ecr * 1000);
+				ts->rtt_on = 0;
+			}
+		}
+		ts_newack(pc, ts, off, wnd);
+		return 1;
+	}
+	/* 
+	 * the window is not compared, the peer shrinks it while it
+	 * holds the segments after the hole
+	 */
+	ts->wnd = wnd;
+	if (dlen == 0 && !(th->th_flags & TH_FIN) && ts->max > ts->una)
+		ts_dupack(pc, ts);
+	return 1;
+}
+
+static void ts_newack(pcs *pc, struct tcpstream *ts, u_int64_t off, 
+    u_int wnd)
+{
+	u_int64_t now = now_us();
+	u_int acked = off - ts->una;
+	u_int64_t flight = ts->max - ts->una;
+
+	/* Karn, the timed segment was not sent again */
+	if (ts->rtt_on && off > ts->rtt_off) {
+		ts_rtt(ts, now - ts->rtt_start);
+		ts->rtt_on = 0;
+	}
+	ts->una = off;
+	if (ts->nxt < ts->una)
+		ts->nxt = ts->una;
+	ts_sacktrim(ts);
+	ts->wnd = wnd;
+	ts->rxtshift = 0;
+	ts->acks++;
+
+	if (ts->inrecovery == 1) {
+		if (off >= ts->recover) {
+			/* deflate the window, RFC 6582 3.2 (3) */
+			ts->cwnd = ts->ssthresh;
+			ts->inrecovery = 0;
+			ts->dupacks = 0;
+		} else {
+			/* partial ack, the next hole, 3.2 (5) */
+			ts->cwnd -= (acked < ts->cwnd) ? acked : ts->cwnd;
+			ts->cwnd += ts->mss;
+			ts_rexmit(pc, ts);
+		}
+	} else {
+		/* 
+		 * the slow start, L = 2 of RFC 3465. cwnd stays while the 
+		 * peer or the data limits the flight, RFC 7661
+		 */
+		if (flight + ts->mss < ts->cwnd)
+			acked = 0;
+		if (ts->cwnd < ts->ssthresh)
+			ts->cwnd += (acked < 2 * ts->mss) ? acked : 2 * ts->mss;
+		else if (acked > 0)
+			ts->cc->ack(ts, acked, now);
+		/* after the timeout, the holes are sent again meanwhile */
+		if (ts->inrecovery == 2) {
+			if (off >= ts->recover)
+				ts->inrecovery = 0;
+			else
+				ts_rexmit(pc, ts);
+		}
+		ts->dupacks = 0;
+	}
+
+	ts->rxt_at = (ts->una < ts->max) ? now + ts->rto : 0;
+}
+
+static void ts_dupack(pcs *pc, struct tcpstream *ts)
+{
+	/* 
+	 * a segment has left for every dupack, fill a hole with SACK, 
+	 * or inflate the window, RFC 6582 3.2 (4)
+	 */
+	if (ts->inrecovery) {
+		if (ts->nsacked > 0)
+			ts_rexmit(pc, ts);
+		else if (ts->inrecovery == 1)
+			ts->cwnd += ts->mss;
+		return;
+	}
+	if (++ts->dupacks != TCPS_DUPACKS || ts->una < ts->recover)
+		return;
+
+	ts->cc->loss(ts);
+	ts->cwnd = ts->ssthresh + TCPS_DUPACKS * ts->mss;
+	ts->recover = ts->max;
+	ts->inrecovery = 1;
+	ts->rxt_nxt = ts->una;
+	ts->fastrexmits++;
+	ts_rexmit(pc, ts);
+}
+
+/*
+ * the timer, send the oldest again and recover like the fast 
+ * retransmit, every partial ack fills the next hole
+ */
+static void ts_timeout(pcs *pc, struct tcpstream *ts, u_int64_t now)
+{
+	ts->timeouts++;
+	if (++ts->rxtshift > TCPS_MAXRXT) {
+		ts->dead = 1;
+		return;
+	}
+	ts->rto = (ts->rto * 2 > TCPS_RTO_MAX) ? TCPS_RTO_MAX : ts->rto * 2;
+	/* the loss window, once for the timeouts in a row, RFC 5681 3.1 */
+	if (ts->rxtshift == 1 && ts->inrecovery != 1)
+		ts->cc->loss(ts);
+	ts->cwnd = ts->mss;
+	ts->recover = ts->max;
+	ts->inrecovery = 2;
+	ts->dupacks = 0;
+	ts->rtt_on = 0;
+	/* the peer may have dropped what it SACKed, RFC 2018 8 */
+	ts->nsacked = 0;
+	ts->rxt_nxt = ts->una;
+	ts_rexmit(pc, ts);
+	ts->rxt_at = now + ts->rto;
+}
+
+/* send the segment at una again, or the next hole the peer SACKed */
+static void ts_rexmit(pcs *pc, struct tcpstream *ts)
+{
+	u_int64_t off = ts->una;
+	u_int64_t len = ts->max - ts->una;
+
+	/* 
+	 * the acks still come when all holes were sent, one of the 
+	 * retransmissions was lost, start over from una
+	 */
+	if (ts->nsacked > 0 && !ts_nexthole(ts, &off, &len)) {
+		ts->rxt_nxt = ts->una;
+		if (!ts_nexthole(ts, &off, &len))
+			return;
+	}
+	if (len > ts->mss)
+		len = ts->mss;
+	if (len == 0)
+		return;
+	/* Karn, only the timed segment loses its sample */
+	if (ts->rtt_on && ts->rtt_off >= off && ts->rtt_off < off + len)
+		ts->rtt_on = 0;
+	ts->rexmits++;
+	ts_send(pc, ts, off, len);
+	ts->rxt_nxt = off + len;
+}
+
+/* take the SACK blocks of an ack into the scoreboard, RFC 2018 */
+static void ts_sack(struct tcpstream *ts, tcphdr *th)
+{
+	struct tcpblk blk[4];
+	u_int base = ts->iss + (u_int)ts->una;
+	int i, n, start, end;
+
+	n = tcp_sackblocks(th, blk, 4);
+	for (i = 0; i < n; i++) {
+		start = blk[i].start - base;
+		end = blk[i].end - base;
+		if (end <= 0 || start >= end || ts->una + end > ts->max)
+			continue;
+		if (start < 0)
+			start = 0;
+		ts_sackadd(ts, ts->una + start, ts->una + end);
+	}
+}
+
+static void ts_sackadd(struct tcpstream *ts, u_int64_t start, 
+    u_int64_t end)
+{
+	int i, j;
+
+	/* the first range not below, merge what the new one touches */
+	for (i = 0; i < ts->nsacked && ts->sacked[i].end < start; i++)
+		;
+	j = i;
+	while (j < ts->nsacked && ts->sacked[j].start <= end) {
+		if (ts->sacked[j].start < start)
+			start = ts->sacked[j].start;
+		if (ts->sacked[j].end > end)
+			end = ts->sacked[j].end;
+		j++;
+	}
+	if (i == j) {
+		/* a new range, forget the highest if full */
+		if (ts->nsacked == TCPS_MAXSACK) {
+			if (i == TCPS_MAXSACK)
+				return;
+			ts->nsacked--;
+		}
+		memmove(&ts->sacked[i + 1], &ts->sacked[i], 
+		    (ts->nsacked - i) * sizeof(ts->sacked[0]));
+		ts->nsacked++;
+	} else if (j > i + 1) {
+		memmove(&ts->sacked[i + 1], &ts->sacked[j], 
+		    (ts->nsacked - j) * sizeof(ts->sacked[0]));
+		ts->nsacked -= j - i - 1;
+	}
+	ts->sacked[i].start = start;
+	ts->sacked[i].end = end;
+}
+
+/* drop the ranges una has passed */
+static void ts_sacktrim(struct tcpstream *ts)
+{
+	int i = 0;
+
+	while (i < ts->nsacked && ts->sacked[i].end <= ts->una)
+		i++;
+	if (i > 0) {
+		memmove(&ts->sacked[0], &ts->sacked[i], 
+		    (ts->nsacked - i) * sizeof(ts->sacked[0]));
+		ts->nsacked -= i;
+	}
+	if (ts->nsacked > 0 && ts->sacked[0].start < ts->una)
+		ts->sacked[0].start = ts->una;
+}
+
+/*
+ * the first hole from rxt_nxt on, below the highest range SACKed, 
+ * what is above may still be on the way. return 0 if none.
+ */
+static int ts_nexthole(struct tcpstream *ts, u_int64_t *off, 
+    u_int64_t *len)
+{
+	u_int64_t o = (ts->rxt_nxt > ts->una) ? ts->rxt_nxt : ts->una;
+	int i;
+
+	for (i = 0; i < ts->nsacked; i++) {
+		if (o < ts->sacked[i].start) {
+			*off = o;
+			*len = ts->sacked[i].start - o;
+			return 1;
+		}
+		if (o < ts->sacked[i].end)
+			o = ts->sacked[i].end;
+	}
+	return 0;
+}
+
+/* RFC 6298 2.2, 2.3, the clock granularity is 1ms */
+static void ts_rtt(struct tcpstream *ts, int rtt)
+{
+	int delta;
+
+	if (rtt < 1)
+		rtt = 1;
+	if (ts->srtt == 0) {
+		ts->srtt = rtt;
+		ts->rttvar = rtt / 2;
+	} else {
+		delta = ts->srtt - rtt;
+		if (delta < 0)
+			delta = -delta;
+		ts->rttvar = (3 * ts->rttvar + delta) / 4;
+		ts->srtt = (7 * ts->srtt + rtt) / 8;
+	}
+	ts->rto = ts->srtt + ((4 * ts->rttvar > 1000) ? 4 * ts->rttvar : 1000);
+	if (ts->rto < TCPS_RTO_MIN)
+		ts->rto = TCPS_RTO_MIN;
+	if (ts->rto > TCPS_RTO_MAX)
+		ts->rto = TCPS_RTO_MAX;
+}
+
+/* end of file */
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef _TCPSTREAM_H_
+#define _TCPSTREAM_H_
+
+#include <sys/types.h>
+
+#include "vpcs.h"
+#include "tcpcc.h"
+
+#define TCPS_RTO_INIT	1000000		/* usec, RFC 6298 2.1 */
+#define TCPS_RTO_MIN	200000		/* usec */
+#define TCPS_RTO_MAX	60000000	/* usec */
+#define TCPS_MAXRXT	8		/* timeouts in a row before giving up */
+#define TCPS_DUPACKS	3		/* duplicate acks to fast retransmit */
+#define TCPS_OPTLEN	12		/* nop, nop, timestamp, see packet() */
+#define TCPS_RCVWIN	0xffff		/* we take any data, ack and drop it */
+#define TCPS_MAXSACK	16		/* ranges of the scoreboard */
+
+/* 
+ * A bulk transfer on a connection opened by tcp_open, in cb. The
+ * payload is made up from the sequence number, so nothing is kept
+ * for the retransmission but the offsets: the bytes from una to max
+ * are in flight, the holes are sent again from una, or those between
+ * the ranges the peer SACKed. The offsets are 64 bits, the sequence 
+ * numbers are iss plus the offset.
+ */
+struct tcpstream {
+	sesscb *cb;
+	int ipv;			/* 4 or IPV6_VERSION */
+	u_int64_t bytes;		/* to send */
+	u_int iss;			/* sequence number of offset 0 */
+	u_int64_t una;			/* oldest byte not acked */
+	u_int64_t nxt;			/* next byte to send */
+	u_int64_t max;			/* highest byte sent + 1 */
+	u_int64_t recover;		/* NewReno, RFC 6582 */
+	int inrecovery;			/* 1 fast recovery, 2 after timeout */
+	int dupacks;
+	u_int64_t rxt_nxt;		/* next hole to fill */
+	int nsacked;			/* scoreboard, in order, above una */
+	struct {
+		u_int64_t start;
+		u_int64_t end;
+	} sacked[TCPS_MAXSACK];
+	u_int wnd;			/* peer window, scaled */
+	const struct tcpcc *cc;		/* of cb->cc */
+	u_int cwnd;			/* bytes */
+	u_int ssthresh;
+	u_int bytes_acked;		/* NewReno, RFC 3465 */
+	u_int64_t epoch;		/* CUBIC, usec, of the avoidance */
+	double w_max;			/* segments */
+	double w_est;
+	double k;			/* seconds */
+	u_int rcv_nxt;			/* peer data, acked and dropped */
+	int ackpending;
+	int mss;			/* payload of a segment */
+	int srtt;			/* usec, RFC 6298 */
+	int rttvar;
+	int rto;
+	int rxtshift;			/* timeouts in a row */
+	int rtt_on;			/* a segment is being timed */
+	u_int64_t rtt_off;
+	u_int64_t rtt_start;
+	u_int64_t rxt_at;		/* timer, usec, 0 if not running */
+	u_int64_t start;		/* usec */
+	u_int64_t end;
+	u_short winsize;		/* of cb, restored at the end */
+	int rst;
+	int dead;			/* too many timeouts */
+	u_long segs;			/* segments sent */
+	u_long rexmits;			/* of which retransmitted */
+	u_long fastrexmits;		/* by three duplicate acks */
+	u_long timeouts;		/* by the timer */
+	u_long acks;			/* acks which moved una */
+};
+
+int tcp_stream(pcs *pc, int ipv, struct tcpstream *ts);
+int tcp_streams(pcs *pc, struct tcpstream *ts, int n, 
+    int (*tick)(struct tcpstream *ts, int n, void *arg), void *arg);
+void tcp_stream_report(struct tcpstream *ts, int port, const char *host);
+
+#endif
+
+/* end of file */
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "globle.h"
+#include "queue.h"
+#include "stats.h"
+#include "trace.h"
+
+volatile int trace_enabled = 0;
+
+/* written by the writer thread of the VPC only */
+static struct {
+	struct trchist h[TRC_STAGES + 1];
+} __attribute__((aligned(CACHELINE_SIZE))) trhist[MAX_NUM_PTHS];
+
+static const char *stages[TRC_STAGES + 1] = {
+	"read", "up", "bgoq", "output", "arp", "oq", "write", "total"};
+
+u_int64_t trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return (u_int64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* 
+ * called by pth_writer after VWrite, charge the time between two 
+ * stamps to the later stage
+ */
+void trace_account(int id, struct packet *m)
+{
+	int i, first = TRC_NONE, prev = TRC_NONE;
+
+	if (id < 0 || id >= MAX_NUM_PTHS || m->stamp[TRC_WRITE] == 0)
+		return;
+
+	for (i = 0; i < TRC_STAGES; i++) {
+		if (m->stamp[i] == 0)
+			continue;
+		if (prev == TRC_NONE)
+			first = i;
+		else if (m->stamp[i] >= m->stamp[prev])
+			trace_histadd(&trhist[id].h[i], m->stamp[i] - m->stamp[prev]);
+		prev = i;
+	}
+	if (first != TRC_NONE && first != TRC_WRITE)
+		trace_histadd(&trhist[id].h[TRC_TOTAL], 
+		    m->stamp[TRC_WRITE] - m->stamp[first]);
+}
+
+struct trchist *trace_hist(int id)
+{
+	return trhist[id].h;
+}
+
+/* the writer keeps counting, a sample may be lost */
+void trace_reset(int id)
+{
+	memset(&trhist[id], 0, sizeof(trhist[id]));
+}
+
+const char *trace_stage(int stage)
+{
+	if (stage < 0 || stage > TRC_TOTAL)
+		return "?";
+	return stages[stage];
+}
+
+void trace_histadd(struct trchist *h, u_int64_t ns)
+{
+	u_int64_t us = ns / 1000;
+	int b = 0;
+
+	while (us && b < TRC_BUCKETS - 1) {
+		us >>= 1;
+		b++;
+	}
+	h->bucket[b]++;
+	h->count++;
+	h->sum += ns;
+	if (ns > h->max)
+		h->max = ns;
+}
+
+/* the upper bound of the bucket holding the pct percentile */
+u_long trace_histpct(struct trchist *h, int pct)
+{
+	u_long n = 0, want;
+	int b;
+
+	want = (h->count * pct + 99) / 100;
+	for (b = 0; b < TRC_BUCKETS - 1; b++) {
+		n += h->bucket[b];
+		if (n >= want)
+			break;
+	}
+	return 1UL << b;
+}
+
+/* end of file */
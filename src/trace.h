@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2007-2015, Paul Meng (mirnshi@gmail.com)
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in the 
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+ * THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <sys/types.h>
+
+/* 
+ * The stages of the packet path, stamped in the order a packet sees
+ * them. A packet does not pass all of them, e.g. an ARP reply goes
+ * from TRC_READ to TRC_OQ directly, the gap is charged to the next
+ * stage stamped.
+ */
+#define TRC_NONE	(-1)
+#define TRC_READ	0	/* read from the device, pth_reader */
+#define TRC_UP		1	/* handled by upv4/upv6 */
+#define TRC_BGOQ	2	/* put into the background output queue */
+#define TRC_OUTPUT	3	/* taken by pth_output */
+#define TRC_ARP		4	/* ether address resolved */
+#define TRC_OQ		5	/* put into the output queue */
+#define TRC_WRITE	6	/* written by VWrite, pth_writer */
+#define TRC_STAGES	7
+#define TRC_TOTAL	TRC_STAGES	/* the first stamp to TRC_WRITE */
+
+/* log2 buckets in microseconds, [0] is < 1us, the last is > 1s */
+#define TRC_BUCKETS	22
+
+struct trchist {
+	u_long count;
+	u_int64_t sum;			/* nanoseconds */
+	u_int64_t max;
+	u_long bucket[TRC_BUCKETS];
+};
+
+extern volatile int trace_enabled;
+
+u_int64_t trace_now(void);
+
+#define TRACE_STAMP(m, s) do { \
+	if (trace_enabled) \
+		(m)->stamp[(s)] = trace_now(); \
+} while (0)
+
+/* a reply built by upv4/upv6 starts when its request was read */
+#define TRACE_REPLY(m, m0) do { \
+	if (trace_enabled) { \
+		(m)->stamp[TRC_READ] = (m0)->stamp[TRC_READ]; \
+		(m)->stamp[TRC_UP] = trace_now(); \
+	} \
+} while (0)
+
+struct packet;
+
+void trace_account(int id, struct packet *m);
+struct trchist *trace_hist(int id);
+void trace_reset(int id);
+const char *trace_stage(int stage);
+void trace_histadd(struct trchist *h, u_int64_t ns);
+u_long trace_histpct(struct trchist *h, int pct);
+
+#endif
+
+/* end of file */
@@ -164,6 +164,30 @@ int arg2int(const char* arg, int min, int max, int defval)
 	return r;
 }
 
+/* bytes, with an optional k, m or g suffix, 0 if invalid */
+u_int64_t arg2size(const char *arg)
+{
+	double r;
+	char unit = 0;
+
+	if (arg == NULL || sscanf(arg, "%lf%c", &r, &unit) < 1 || r < 0)
+		return 0;
+	
+	switch (unit | 0x20) {
+		case 'g':
+			r *= 1024;
+		case 'm':
+			r *= 1024;
+		case 'k':
+			r *= 1024;
+		case 0x20:
+			break;
+		default:
+			return 0;
+	}
+	return (u_int64_t)r;
+}
+
 /* Highlight {Hword}
  * Underline {Uword}
  * Color     {Nword}, N from 1 to 9
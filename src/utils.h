@@ -27,6 +27,7 @@
 #ifndef _UTILS_H_
 #define _UTILS_H_
 
+#include <sys/types.h>
 #include <sys/time.h>
 #include <stdarg.h>
 
@@ -42,6 +43,7 @@ void esc_prn(const char *fmt, ...);
 void esc_fprn(FILE *f, const char *fmt, ...);
 
 int arg2int(const char* arg, int min, int max, int defalt);
+u_int64_t arg2size(const char *arg);
 
 #endif
 
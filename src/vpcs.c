@@ -49,9 +49,15 @@
 #include "daemon.h"
 #include "help.h"
 #include "dump.h"
+#include "filter.h"
 #include "relay.h"
+#include "perf.h"
+#include "httpd.h"
+#include "httpc.h"
+#include "conngen.h"
 #include "dhcp.h"
 #include "frag6.h"
+#include "metrics.h"
 
 const char *ver = "0.8.2";
 /* track the binary */
@@ -89,10 +95,27 @@ char *tapname = "tap0";  /* TAP device name (only when 1 VPC is created) */
 
 int macaddr = 0; /* the last byte of ether address */
 
+extern int memtopo;
+extern int unixtype;
+extern char *pktif;
+extern int tapvnet;
+extern int tapqueues;
+
+/* the tap queue served by a pth_mqreader/pth_mqwriter pair */
+struct tapq {
+	int id;
+	int q;
+};
+static struct tapq tapq[MAX_NUM_PTHS][TAP_MAXQ];
+
 
 static void *pth_reader(void *devid);
 static void *pth_output(void *devid);
 static void *pth_writer(void *devid);
+static void *pth_mqreader(void *arg);
+static void *pth_mqwriter(void *arg);
+static void rx_frame(pcs *pc, u_char *buf, int len);
+static void tx_frame(pcs *pc, int q, struct packet *m);
 static void *pth_timer_tick(void *);
 static void *pth_bgjob(void *);
 void parse_cmd(char *cmdstr);
@@ -121,6 +144,7 @@ static cmdStub cmd_entry[] = {
 	{"?",		NULL,	run_help,	help_help},
 	{"arp",		"show",	run_show,	help_show},
 	{"clear",	NULL,	run_clear,	help_clear},
+	{"conngen",	NULL,	run_conngen,	help_conngen},
 	{"dhcp",	"ip",	run_ipconfig,	help_ip},
 	{"disconnect",  NULL,   run_disconnect, NULL},
 	{"echo",	NULL,	run_echo,	NULL},
@@ -130,6 +154,7 @@ static cmdStub cmd_entry[] = {
 	{"ip",		NULL,	run_ipconfig,	help_ip},
 	{"load",	NULL,	run_load,	help_load},
 	{"neighbor",	NULL,	run_nb6,	NULL},
+	{"perf",	NULL,	run_perf,	help_perf},
 	{"ping",	NULL,	run_ping,	help_ping},
 	{"quit",	NULL,	run_quit,	NULL},
 	{"tracer",	NULL,	run_tracert,	help_trace},
@@ -141,7 +166,8 @@ static cmdStub cmd_entry[] = {
 	{"version",	NULL,	run_ver,	NULL},
 	{"sleep",	NULL,	run_sleep,	help_sleep},
 	{"zzz",		NULL,	run_sleep,	help_sleep},
-	{"webserver", NULL, run_webserver, NULL},
+	{"webload",	NULL,	run_webload,	help_webload},
+	{"webserver",	NULL,	run_webserver,	help_webserver},
 	{NULL, NULL}
 };
 
@@ -156,14 +182,19 @@ int main(int argc, char **argv)
 	int c;
 	pthread_t timer_pid, relay_pid, bgjob_pid;
 	int daemon_bg = 1;
+	int metrics_lport = 0;
 	char *cmd;
 
 	memset(&echoctl, 0, sizeof(struct echoctl));
 	rhost = inet_addr("127.0.0.1");
 	
 	devtype = DEV_UDP;		
-	while ((c = getopt(argc, argv, "?c:efhm:p:r:Rs:t:uvFi:d:")) != -1) {
+	while ((c = getopt(argc, argv, "?A:c:efhl:m:M:Op:q:r:Rs:t:uU:vFi:d:")) != -1) {
 		switch (c) {
+			case 'A':
+				devtype = DEV_PACKET;
+				pktif = strdup(optarg);
+				break;
 			case 'c':
 				rport_flag = 1;
 				rport = arg2int(optarg, 1024, 65000, 30000);
@@ -174,12 +205,32 @@ int main(int argc, char **argv)
 			case 'f':
 				daemon_bg = 0;
 				break;
+			case 'l':
+				devtype = DEV_MEM;
+				if (!strcmp(optarg, "switch"))
+					memtopo = MEM_SWITCH;
+				else if (!strcmp(optarg, "pair"))
+					memtopo = MEM_PAIR;
+				else {
+					usage();
+					exit(0);
+				}
+				break;
 			case 'm':
 				macaddr = arg2int(optarg, 0, 240, 0);
 				break;
 			case 'p':
 				daemon_port = arg2int(optarg, 1024, 65000, 5000);
 				break;
+			case 'O':
+				tapvnet = 1;
+				break;
+			case 'q':
+				tapqueues = arg2int(optarg, 1, TAP_MAXQ, 1);
+				break;
+			case 'M':
+				metrics_lport = arg2int(optarg, 1024, 65000, 9100);
+				break;
 			case 'r':
 				startupfile = strdup(optarg);
 				break;
@@ -196,6 +247,17 @@ int main(int argc, char **argv)
 			case 'u':
 				devtype = DEV_UDP;
 				break;
+			case 'U':
+				devtype = DEV_UNIX;
+				if (!strcmp(optarg, "seqpacket"))
+					unixtype = UNIX_SEQPACKET;
+				else if (!strcmp(optarg, "dgram"))
+					unixtype = UNIX_DGRAM;
+				else {
+					usage();
+					exit(0);
+				}
+				break;
 			case 'v':
 				run_ver(argc, argv);
 				exit(0);
@@ -221,6 +283,8 @@ int main(int argc, char **argv)
 				break;
 		}
 	}
+	if (devtype != DEV_TAP)
+		tapqueues = 1;
 	if (optind != argc) {
 		if (optind + 1 == argc)
 			startupfile = strdup(argv[optind]);
@@ -265,6 +329,9 @@ int main(int argc, char **argv)
 	delay_ms(100);
 	pthread_create(&relay_pid, NULL, pth_relay, (void *)0);
 	pthread_create(&bgjob_pid, NULL, pth_bgjob, (void *)0);
+	if (metrics_lport && start_metrics(metrics_lport) != 0)
+		printf("Open metrics port %d error [%s]\n", metrics_lport, 
+		    strerror(errno));
 	pcid = 0;
 
 	delay_ms(50);
@@ -427,9 +494,9 @@ void *pth_reader(void *devid)
 {
 	int id;
 	pcs *pc = NULL;
-	struct packet *m = NULL;
 	u_char buf[PKT_MAXSIZE];
-	int rc;
+	pthread_t tid;
+	int rc, q;
 
 	id = *(int *)devid;
 	pc  = &vpc[id];
@@ -438,6 +505,8 @@ void *pth_reader(void *devid)
 	pc->rhost = rhost;
 	pc->lport = lport + id;
 	pc->rport = rport + id;
+	snprintf(pc->lsock, sizeof(pc->lsock), UNIX_SOCKPATH, pc->lport);
+	snprintf(pc->rsock, sizeof(pc->rsock), UNIX_SOCKPATH, pc->rport);
 	
 	pc->ip4.mac[0] = 0x00;
 	pc->ip4.mac[1] = 0x50;
@@ -459,6 +528,12 @@ void *pth_reader(void *devid)
 				printf("Create TAP device %s error [%s]\n", tapname, strerror(errno));
 		else if (devtype == DEV_UDP)
 			printf("Open port %d error [%s]\n", vpc[id].lport, strerror(errno));
+		else if (devtype == DEV_MEM)
+			printf("Create memory device %d error\n", id + 1);
+		else if (devtype == DEV_UNIX)
+			printf("Open socket %s error [%s]\n", pc->lsock, strerror(errno));
+		else if (devtype == DEV_PACKET)
+			printf("Attach to %s error [%s]\n", pktif, strerror(errno));
 		return NULL;
 	}
 		
@@ -467,10 +542,12 @@ void *pth_reader(void *devid)
 	pc->iq.type = 0 + id * 100;
 	init_queue(&pc->oq);
 	pc->oq.type = 1 + id * 100;
+	pc->oq.stage = TRC_OQ;
 	init_queue(&pc->bgiq);
 	pc->bgiq.type = 2 + id * 100;
 	init_queue(&pc->bgoq);
 	pc->bgoq.type = 3 + id * 100;
+	pc->bgoq.stage = TRC_BGOQ;
 	
 	
 	if (pthread_create(&(pc->wpid), NULL, pth_writer, devid) != 0) {
@@ -483,41 +560,109 @@ void *pth_reader(void *devid)
 		exit(-1);
 	}
 	
+	pthread_mutex_init(&(pc->rxlock), NULL);
+	for (q = 1; q < tapqueues; q++) {
+		init_queue(&pc->txq[q]);
+		pc->txq[q].type = 4 + q + id * 100;
+		tapq[id][q].id = id;
+		tapq[id][q].q = q;
+		if (pthread_create(&tid, NULL, pth_mqreader, &tapq[id][q]) != 0 ||
+		    pthread_create(&tid, NULL, pth_mqwriter, &tapq[id][q]) != 0) {
+			printf("PC%d error\n", id + 1);
+			exit(-1);
+		}
+	}
+	
 	while (1) {
 		rc = VRead(pc, buf, PKT_MAXSIZE);
-		if (rc > 0) {
-			m = new_pkt(PKT_MAXSIZE);
-			if (m == NULL) {
-				printf("Out of memory.\n");
-				exit(-1);
-			}
-			memcpy(m->data, buf, rc);
-			m->len = rc;
-			gettimeofday(&(m->ts), (void*)0);
+		if (rc <= 0)
+			continue;
+		if (tapqueues > 1) {
+			pthread_mutex_lock(&pc->rxlock);
+			rx_frame(pc, buf, rc);
+			pthread_mutex_unlock(&pc->rxlock);
+		} else
+			rx_frame(pc, buf, rc);
+	}
 
-			if (!memcmp(m->data, pc->ip4.mac, ETH_ALEN) ||
-			    pc->dmpflag & DMP_ALL) {
-				if (pc->dmpflag & DMP_FILE)
-					dmp_packet2file(m, pc->dmpfile);					
-				dmp_packet(m, pc->dmpflag);
-			}
-	
-			rc = upv4(pc, &m);
-			if (rc == PKT_UP) {
-				if (dhcp_enq(pc, m))
-					continue;
-				if (pc->mscb.sock != 0) {
-					enq(&pc->iq, m);
-				} else
-					del_pkt(m);
-			} else if (rc == PKT_DROP)
-				del_pkt(m);
+	return NULL;
+}
+
+/* 
+ * the frames of all the tap queues go through the same arp cache, 
+ * fragment queues and tcp sessions, so only the reads run in parallel
+ */
+void *pth_mqreader(void *arg)
+{
+	struct tapq *tq = arg;
+	pcs *pc = &vpc[tq->id];
+	u_char buf[PKT_MAXSIZE];
+	int rc;
+
+	while (1) {
+		/* the tap is set aside while the shared memory link is up */
+		if (pc->shm != NULL) {
+			delay_ms(100);
+			continue;
+		}
+		rc = tap_read(pc, tq->q, buf, PKT_MAXSIZE);
+		if (rc > 0) {
+			pthread_mutex_lock(&pc->rxlock);
+			rx_frame(pc, buf, rc);
+			pthread_mutex_unlock(&pc->rxlock);
 		}
 	}
-
 	return NULL;
 }
 
+static void
+rx_frame(pcs *pc, u_char *buf, int len)
+{
+	struct packet *m = NULL;
+	struct timespec ts;
+	int rc;
+
+	STATS_INC(pc, rx.frames);
+	STATS_ADD(pc, rx.bytes, len);
+	if (pc->dmpflag & DMP_PCAPNG)
+		clock_gettime(CLOCK_REALTIME, &ts);
+	m = new_pkt(PKT_MAXSIZE);
+	if (m == NULL) {
+		printf("Out of memory.\n");
+		exit(-1);
+	}
+	TRACE_STAMP(m, TRC_READ);
+	memcpy(m->data, buf, len);
+	m->len = len;
+	gettimeofday(&(m->ts), (void*)0);
+
+	if (pc->dmpflag && 
+	    (!memcmp(m->data, pc->ip4.mac, ETH_ALEN) ||
+	    pc->dmpflag & DMP_ALL) &&
+	    filter_match(&pc->dmpfilter, DMP_DIR_IN, m->data, m->len)) {
+		if (pc->dmpflag & DMP_FILE)
+			dmp_packet2file(m, &pc->dmpfile);					
+		if (pc->dmpflag & DMP_PCAPNG)
+			dmp_packet2pcapng(pc->id, DMP_DIR_IN, 
+			    m->data, m->len, &ts);
+		dmp_defer(pc->id, DMP_DIR_IN, m, pc->dmpflag);
+	}
+
+	rc = upv4(pc, &m);
+	if (rc == PKT_UP) {
+		if (dhcp_enq(pc, m))
+			return;
+		if (pc->mscb.sock != 0) {
+			STATS_INC(pc, rx.up);
+			enq(&pc->iq, m);
+		} else {
+			STATS_INC(pc, rx.drop_noapp);
+			del_pkt(m);
+		}
+	} else if (rc == PKT_DROP)
+		del_pkt(m);
+}
+
 void *pth_output(void *devid)
 {
 	int id;
@@ -534,6 +679,7 @@ void *pth_output(void *devid)
 		m = waitdeq(&pc->bgoq);
 		
 		while (m) {
+			TRACE_STAMP(m, TRC_OUTPUT);
 			send4(pc, m);
 			m = deq(&pc->bgoq);
 		}
@@ -545,6 +691,8 @@ void *pth_writer(void *devid)
 {
 	int id;
 	pcs *pc = NULL;
+	struct timespec ts;
+	int q;
 	
 	id = *(int *)devid;
 	pc  = &vpc[id];
@@ -557,20 +705,84 @@ void *pth_writer(void *devid)
 		m = waitdeq(&pc->oq);
 
 		while (m) {
-			if (pc->dmpflag & DMP_FILE)
-				dmp_packet2file(m, pc->dmpfile);
-
-			dmp_packet(m, pc->dmpflag);
-			if (VWrite(pc, m->data, m->len) != m->len)
-				printf("Send packet error\n");
-			del_pkt(m);
+			if (pc->dmpflag && filter_match(&pc->dmpfilter, 
+			    DMP_DIR_OUT, m->data, m->len)) {
+				if (pc->dmpflag & DMP_FILE)
+					dmp_packet2file(m, &pc->dmpfile);
+				if (pc->dmpflag & DMP_PCAPNG) {
+					clock_gettime(CLOCK_REALTIME, &ts);
+					dmp_packet2pcapng(pc->id, DMP_DIR_OUT, 
+					    m->data, m->len, &ts);
+				}
+				dmp_defer(pc->id, DMP_DIR_OUT, m, pc->dmpflag);
+			}
+			/* a flow always leaves by the same queue */
+			q = 0;
+			if (tapqueues > 1 && pc->shm == NULL)
+				q = tap_txq(m->data, m->len, tapqueues);
+			if (q != 0)
+				enq(&pc->txq[q], m);
+			else
+				tx_frame(pc, 0, m);
 			
 			m = deq(&pc->oq);
 		}
+		VFlush(pc);
+	}
+	return NULL;
+}
+
+void *pth_mqwriter(void *arg)
+{
+	struct tapq *tq = arg;
+	pcs *pc = &vpc[tq->id];
+	struct packet *m;
+
+	while (1) {
+		m = waitdeq(&pc->txq[tq->q]);
+		while (m) {
+			tx_frame(pc, tq->q, m);
+			m = deq(&pc->txq[tq->q]);
+		}
 	}
 	return NULL;
 }
 
+/* 
+ * the queue writers share the tx counters, the trace histograms 
+ * keep one writer and sample the frames of the queue 0
+ */
+static void
+tx_frame(pcs *pc, int q, struct packet *m)
+{
+	int n;
+
+	if (q == 0)
+		n = VWrite(pc, m->data, m->len);
+	else
+		n = tap_write(pc, q, m->data, m->len);
+	if (n != m->len) {
+		if (tapqueues > 1)
+			STATS_ATOMIC_INC(pc, tx.errors);
+		else
+			STATS_INC(pc, tx.errors);
+		printf("Send packet error\n");
+	} else {
+		if (tapqueues > 1) {
+			STATS_ATOMIC_INC(pc, tx.frames);
+			STATS_ATOMIC_ADD(pc, tx.bytes, m->len);
+		} else {
+			STATS_INC(pc, tx.frames);
+			STATS_ADD(pc, tx.bytes, m->len);
+		}
+		if (trace_enabled && q == 0) {
+			m->stamp[TRC_WRITE] = trace_now();
+			trace_account(pc->id, m);
+		}
+	}
+	del_pkt(m);
+}
+
 void *pth_timer_tick(void *dummy)
 {
 	while (1) {
@@ -655,10 +867,32 @@ void startup(void)
 void 
 sig_clean(int sig)
 {
-	int i;
+	int i, q;
 	
-	for (i = 0; i < num_pths; i++)
-		close(vpc[i].fd);
+	shm_clean();
+
+	/* the handles of the memory device are not descriptors */
+	if (devtype != DEV_MEM) {
+		for (i = 0; i < num_pths; i++)
+			close(vpc[i].fd);
+	}
+	for (i = 0; i < num_pths; i++) {
+		for (q = 1; q < tapqueues; q++) {
+			if (vpc[i].tapfd[q] > 0)
+				close(vpc[i].tapfd[q]);
+		}
+	}
+	if (devtype == DEV_UNIX) {
+		for (i = 0; i < num_pths; i++) {
+			if (vpc[i].rfd > 0)
+				close(vpc[i].rfd);
+			if (vpc[i].wfd > 0)
+				close(vpc[i].wfd);
+			/* not ours if it was in use by somebody else */
+			if (vpc[i].fd > 0)
+				unlink(vpc[i].lsock);
+		}
+	}
 
 	if (rls != NULL && histfile != NULL) 
 		savehistory(histfile, rls);	
@@ -717,16 +951,29 @@ void usage()
 		"  {H-i} {Unum}         number of vpc instances to start (default is 9)\r\n"
 		"  {H-p} {Uport}        run as a daemon listening on the tcp {Uport}\r\n"
 		"  {H-m} {Unum}         start byte of ether address, default from 0\r\n"
+		"  {H-M} {Uport}        serve Prometheus metrics on the tcp {Uport}\r\n"
 		"  [{H-r}] {UFILENAME}  load and execute script file {HFILENAME}\r\n"
 		"\r\n"
 		"  {H-e}             tap mode, using /dev/tapx by default (linux only)\r\n"
 		"  [{H-u}]           udp mode, default\r\n"
+		"  {H-l} {Utopology}    memory mode, the vpcs are wired inside the process,\r\n"
+		"                    {Htopology} is {Hpair} (vpc1-vpc2, vpc3-vpc4...) or {Hswitch}\r\n"
+		"  {H-U} {Utype}        unix mode, {Htype} is {Hdgram} or {Hseqpacket}\r\n"
+		"  {H-A} {Uifname}      packet mode, attach to the host interface {Uifname}\r\n"
+		"                    with mapped rings (linux only)\r\n"
 		"\r\nudp mode options:\r\n"
 		"  {H-s} {Uport}        local udp base {Uport}, default from 20000\r\n"
 		"  {H-c} {Uport}        remote udp base {Uport} (dynamips udp port), default from 30000\r\n"
 		"  {H-t} {Uip}          remote host {UIP}, default 127.0.0.1\r\n"
+		"\r\nunix mode options:\r\n"
+		"  {H-s} {Uport}        bind /tmp/vpcs-{Uport}.sock, default from 20000\r\n"
+		"  {H-c} {Uport}        send to /tmp/vpcs-{Uport}.sock, default from 30000\r\n"
 		"\r\ntap mode options:\r\n"
 		"  {H-d} {Udevice}      {Udevice} name, works only when -i is set to 1\r\n"
+		"  {H-O}             offload, accept TCP super-frames and partial checksums\r\n"
+		"                    from the host\r\n"
+		"  {H-q} {Unum}         open {Unum} queues per tap, each with its own reader\r\n"
+		"                    and writer (linux only, default 1, at most 8)\r\n"
 		"\r\nhypervisor mode option:\r\n"
 		"  {H-H} {Uport}        run as the hypervisor listening on the tcp {Uport}\r\n"
 		"\r\n"
@@ -30,9 +30,15 @@
 #include "queue.h"
 #include "globle.h"
 #include "ip.h"
+#include "stats.h"
 
 #define MAX_LEN  (128)
 
+struct dmpfile; /* defined in dump.h */
+struct dmpfilter; /* defined in filter.h */
+struct shmdev; /* defined in shm.h */
+struct tcplistener; /* defined in tcpsock.h */
+
 typedef struct {
 	u_char mac[6];
 	u_int ip;
@@ -95,6 +101,7 @@ typedef struct {
 
 #define MAX_NAMES_LEN	(12)
 #define MAX_SESSIONS	1000
+#define MAX_LISTENERS	4
 #define POOL_SIZE	32
 #define POOL_TIMEOUT	120
 
@@ -105,18 +112,28 @@ typedef struct {
 	pthread_t rpid;			/* reader pthread id */
 	pthread_t wpid;			/* writer pthread id */	
 	int dmpflag;			/* dump flag */
-	FILE *dmpfile;			/* dump file pointer */
+	struct dmpfile *dmpfile;	/* dump file */
+	struct dmpfilter *dmpfilter;	/* capture filter */
 	int bgjobflag;			/* backgroun job flag */
 	int fd;				/* device handle */
-	int rfd;			/* client handle if in the udp mode		 */	
+	int rfd;			/* accepted peer if in the seqpacket mode */
+	int wfd;			/* connected to rsock, seqpacket mode */
+	volatile int wreset;		/* rsock changed, the writer reconnects */
+	int tapfd[TAP_MAXQ];		/* tap queues, tapfd[0] is fd */
 	int lport;			/* local udp port */
 	int rport;			/* remote udp port */
 	u_int rhost;			/* remote host */
+	char lsock[UNIX_PATH_LEN];	/* local socket, unix mode */
+	char rsock[UNIX_PATH_LEN];	/* remote socket, unix mode */
+	struct shmdev * volatile shm;	/* shared memory link, see shm.h */
+	volatile int shmusers;		/* threads inside shm_read/write */
 	struct pq bgiq;			/* background input queue */
 	struct pq bgoq;			/* background output queue */
 	struct pq iq;			/* queue */
 	struct pq oq;			/* queue */
+	struct pq txq[TAP_MAXQ];	/* frames steered to the tap queues */
 	pthread_mutex_t locker;		/* mutex */
+	pthread_mutex_t rxlock;		/* serialize the tap queue readers */
 	sesscb mscb;			/* opened by app */
 	sesscb sesscb[MAX_SESSIONS];	/* tcp session pool */
 	tcpcb6 tcpcb6[MAX_SESSIONS];	/* tcp6 session pool */
@@ -128,7 +145,8 @@ typedef struct {
 	hipv6 ip6;
 	hipv6 link6;
 	int mtu;
-	volatile int tcp_listen_port;
+	struct tcplistener *listener[MAX_LISTENERS];	/* see tcpsock.h */
+	struct pcstats stats;		/* counters, see stats.h */
 } pcs;
 
 struct echoctl {
@@ -0,0 +1,256 @@
+#!/bin/bash
+#-----------------------------------------------------------------
+# Back-to-back throughput and latency benchmark.
+#
+#   vpcs A (10.0.0.1)  udp BASE <---> BASE+1  vpcs B (10.0.0.2)
+#
+# Two vpcs daemons are wired back to back over UDP on the loopback,
+# the same way test/b2b wires two VPCs inside one process. A pings
+# B with ICMP, UDP and TCP at each interval given with -i, and one
+# CSV line per run is written to stdout (or the -o file):
+#
+#   proto,size,interval_ms,sent,received,loss_pct,duration_s,pps,
+#   mbps,rtt_min_ms,rtt_p50_ms,rtt_p90_ms,rtt_p99_ms,rtt_max_ms,
+#   cpu_us_per_pkt
+#
+# pps and mbps count the frames and bytes received by both sides,
+# cpu_us_per_pkt is the cpu of both processes divided by the frames
+# they sent. Both come from the -M metrics endpoint. The ping
+# command is stop-and-wait, so the offered rate is set by the
+# interval between probes; for TCP the interval is the -w wait time
+# and is never less than 10ms since it is also the connect timeout.
+#-----------------------------------------------------------------
+
+VPCS=${VPCS:-`dirname $0`/../build/vpcs}
+BASE=20100
+COUNT=100
+SIZE=56
+INTERVALS="100 10 1"
+PROTOS="icmp udp tcp"
+OUT=
+VERBOSE=
+
+usage()
+{
+	cat <<EOF
+usage: $0 [options]
+  -b vpcs      vpcs binary, default $VPCS
+  -p port      base port, default $BASE. Ports base to base+1 are
+               the udp link, base+2 to base+5 the consoles and the
+               metrics endpoints
+  -c count     probes per run, default $COUNT
+  -l size      payload size, default $SIZE
+  -i 'list'    intervals in ms, default '$INTERVALS'
+  -P 'list'    protocols, default '$PROTOS'
+  -o file      write the report to file
+  -v           copy the ping output to stderr
+EOF
+	exit 1
+}
+
+while getopts "b:p:c:l:i:P:o:vh" opt; do
+	case $opt in
+	b) VPCS=$OPTARG ;;
+	p) BASE=$OPTARG ;;
+	c) COUNT=$OPTARG ;;
+	l) SIZE=$OPTARG ;;
+	i) INTERVALS=$OPTARG ;;
+	P) PROTOS=$OPTARG ;;
+	o) OUT=$OPTARG ;;
+	v) VERBOSE=1 ;;
+	*) usage ;;
+	esac
+done
+
+if [ ! -x "$VPCS" ]; then
+	echo "$VPCS: not found, build vpcs first or use -b" >&2
+	exit 1
+fi
+
+CONA=$((BASE + 2))
+CONB=$((BASE + 3))
+META=$((BASE + 4))
+METB=$((BASE + 5))
+PIDS=
+SEQ=0
+
+cleanup()
+{
+	exec 3>&- 4>&- 2>/dev/null
+	[ -n "$PIDS" ] && kill $PIDS 2>/dev/null
+	wait 2>/dev/null
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+# start one vpcs daemon in the foreground of a background job, the
+# mac offset keeps the two sides apart, udp ping tells its replies
+# by the mac address in the payload
+start()
+{
+	"$VPCS" -F -R -i 1 -p $1 -s $2 -c $3 -M $4 -m $5 >/dev/null 2>&1 &
+	PIDS="$PIDS $!"
+}
+
+# connect fd $1 to the console on port $2 and wait for the prompt,
+# anything typed before vpcs sets up its terminal is flushed, so
+# keep poking it with empty lines until the prompt shows up
+attach()
+{
+	local i chunk
+
+	for i in `seq 50`; do
+		eval "exec $1<>/dev/tcp/127.0.0.1/$2" 2>/dev/null && break
+		sleep 0.1
+	done
+	for i in `seq 20`; do
+		printf "\n" >&$1
+		while IFS= read -r -t 0.5 -d '>' chunk <&$1; do
+			case "$chunk" in
+			*VPCS) return 0 ;;
+			esac
+		done
+	done
+	echo "can not connect to the console on port $2" >&2
+	exit 1
+}
+
+# run a command on console fd $1, print its output
+run()
+{
+	local fd=$1 mark line
+
+	shift
+	SEQ=$((SEQ + 1))
+	mark="__bench_${SEQ}_${RANDOM}__"
+	printf "%s\necho %s\n" "$*" "$mark" >&$fd
+	while IFS= read -r -t 120 line <&$fd; do
+		line=${line//$'\r'/}
+		case "$line" in
+		*echo\ $mark*) ;;
+		*$mark*) return 0 ;;
+		*) echo "$line" ;;
+		esac
+	done
+	echo "console timeout: $*" >&2
+	exit 1
+}
+
+# sum the samples of metric $2 read from the endpoint on port $1
+metric()
+{
+	local resp
+
+	exec 5<>/dev/tcp/127.0.0.1/$1 || return 1
+	printf "GET /metrics HTTP/1.0\r\n\r\n" >&5
+	resp=`cat <&5`
+	exec 5>&-
+	echo "$resp" | awk -v m="$2" '
+	    $1 == m || index($1, m "{") == 1 { s += $2 }
+	    END { printf "%.6f\n", s }'
+}
+
+# snapshot: rx frames, rx bytes, tx frames, cpu seconds of both sides
+snapshot()
+{
+	local p
+
+	for p in $META $METB; do
+		metric $p vpcs_rx_frames_total
+		metric $p vpcs_rx_bytes_total
+		metric $p vpcs_tx_frames_total
+		metric $p process_cpu_seconds_total
+	done | awk '{ v[NR % 4] += $1 } END {
+	    printf "%s %s %s %s\n", v[1], v[2], v[3], v[0] }'
+}
+
+now()
+{
+	date +%s.%N
+}
+
+bench()
+{
+	local proto=$1 ival=$2 opt wait out t0 t1 s0 s1
+
+	case $proto in
+	icmp) opt="-1 -i $ival" ;;
+	udp) opt="-2 -i $ival" ;;
+	tcp)
+		wait=$ival
+		[ $wait -lt 10 ] && wait=10
+		opt="-3 -w $wait"
+		;;
+	esac
+
+	s0=`snapshot`
+	t0=`now`
+	out=`run 3 ping 10.0.0.2 $opt -c $COUNT -l $SIZE`
+	[ -n "$VERBOSE" ] && echo "$out" >&2
+	t1=`now`
+	s1=`snapshot`
+
+	echo "$out" | awk -v proto=$proto -v size=$SIZE -v ival=$ival \
+	    -v count=$COUNT -v t0=$t0 -v t1=$t1 \
+	    -v s0="$s0" -v s1="$s1" '
+	function pct(p, k) {
+		if (n == 0)
+			return 0
+		k = int(p * n / 100 + 0.999999)
+		if (k < 1)
+			k = 1
+		return rtt[k]
+	}
+	# icmp/udp: "... icmp_seq=1 ttl=64 time=0.123 ms"
+	# tcp: the connect time stands for the round trip
+	/(icmp|udp)_seq=.* time=/ || /Connect .* time=/ {
+		sub(/.*time=/, "")
+		rtt[++n] = $1 + 0
+	}
+	END {
+		# insertion sort, n is small
+		for (i = 2; i <= n; i++) {
+			v = rtt[i]
+			for (j = i - 1; j > 0 && rtt[j] > v; j--)
+				rtt[j + 1] = rtt[j]
+			rtt[j + 1] = v
+		}
+		split(s0, a)
+		split(s1, b)
+		dur = t1 - t0
+		frames = b[1] - a[1]
+		bytes = b[2] - a[2]
+		txf = b[3] - a[3]
+		cpu = b[4] - a[4]
+		printf "%s,%d,%d,%d,%d,%.1f,%.3f,%.0f,%.3f,", proto, size,
+		    ival, count, n, (count - n) * 100.0 / count, dur,
+		    frames / dur, bytes * 8 / dur / 1000000
+		printf "%.3f,%.3f,%.3f,%.3f,%.3f,%.2f\n", pct(0), pct(50),
+		    pct(90), pct(99), pct(100),
+		    txf ? cpu * 1000000 / txf : 0
+	}'
+}
+
+start $CONA $BASE $((BASE + 1)) $META 0
+start $CONB $((BASE + 1)) $BASE $METB 1
+attach 3 $CONA
+attach 4 $CONB
+
+run 3 ip 10.0.0.1 24 >/dev/null
+run 4 ip 10.0.0.2 24 >/dev/null
+
+# warm the arp caches
+run 3 ping 10.0.0.2 -c 1 >/dev/null
+
+[ -n "$OUT" ] && exec >"$OUT"
+
+echo "proto,size,interval_ms,sent,received,loss_pct,duration_s,pps,\
+mbps,rtt_min_ms,rtt_p50_ms,rtt_p90_ms,rtt_p99_ms,rtt_max_ms,\
+cpu_us_per_pkt"
+for proto in $PROTOS; do
+	for ival in $INTERVALS; do
+		bench $proto $ival
+	done
+done
+
+# end of file